@@ -38,6 +38,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "fcm_mgr.h"
 #include "log.h"
 #include "neigh_table.h"
+#include "nf_utils.h"
 
 // Intervals and timeouts in seconds
 #define FCM_TIMER_INTERVAL   5
@@ -228,4 +229,7 @@ void fcm_conntrack_event_cb(void *data)
             plugin->process_ct_event(plugin, data);
         }
     }
+
+    /* The plugins do not keep references to the event list */
+    nf_free_ct_flow_list(data);
 }
@@ -162,6 +162,7 @@ fcm_tag_update_cb(om_tag_t *tag,
                   struct ds_tree *updated)
 {
     data_report_tags_update_cb(tag, removed, added, updated);
+    fsm_policy_tag_update(tag, removed, added, updated);
 
     return true;
 }
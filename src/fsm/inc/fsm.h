@@ -131,6 +131,15 @@ struct fsm_parser_ops
     /* packet parsing handler. Provided by the plugin */
     void (*handler)(struct fsm_session *, struct net_header_parser *);
 
+    /*
+     * batched packet parsing handler. Optionally provided by the plugin.
+     * Receives the vector of packets parsed during a tap poll cycle,
+     * in arrival order. The packets are only valid for the duration
+     * of the call. Taps fall back to the packet handler when not set.
+     */
+    void (*batch_handler)(struct fsm_session *, struct net_header_parser *,
+                          size_t);
+
     /*
      * service plugin request. Provided to the plugin.
      * Used for backward compatibility:
@@ -185,6 +194,18 @@ struct fsm_dpi_plugin_client_pkt_info
 struct fsm_dpi_plugin_ops
 {
     void (*handler)(struct fsm_session *, struct net_header_parser *);
+
+    /*
+     * batched packet handler. Optional.
+     * Receives consecutive packets of a single flow, in arrival order.
+     * The plugin stops once it has set its verdict for the flow,
+     * and returns the number of packets it handled.
+     * A flow is only dispatched in bursts when all its plugins provide
+     * a batch handler. The flow counters then already account for the
+     * whole burst when the handler is called.
+     */
+    size_t (*batch_handler)(struct fsm_session *,
+                            struct net_header_parser **, size_t);
     bool (*register_client)(struct fsm_session *,
                             struct fsm_session *,
                             char *);
@@ -260,6 +281,35 @@ struct fsm_pcaps
 };
 
 
+/* Maximum number of packets handed at once to a batch handler */
+#define FSM_TPACKET_BATCH_MAX 64
+
+/**
+ * @brief session AF_PACKET TPACKET_V3 ring container
+ */
+struct fsm_tpacket
+{
+    int fd;                          /* AF_PACKET socket */
+    ev_io fsm_evio;                  /* socket io watcher */
+    uint8_t *ring;                   /* mmap'ed block ring */
+    size_t ring_len;                 /* mmap'ed length */
+    unsigned int block_size;         /* size of a ring block */
+    unsigned int block_nr;           /* number of ring blocks */
+    unsigned int frame_size;         /* ring frame size hint */
+    unsigned int block_tmo;          /* block retire timeout in ms */
+    unsigned int block_idx;          /* next block to walk */
+    struct net_header_parser parser; /* per-packet parser template */
+    uint64_t pkts_received;          /* cumulative kernel packet count */
+    uint64_t pkts_dropped;           /* cumulative kernel drop count */
+    uint64_t freeze_cnt;             /* cumulative queue freeze count */
+    uint64_t blocks_walked;          /* retired blocks processed */
+    unsigned int max_blocks_in_use;  /* ring fill high water mark */
+    struct net_header_parser *batch; /* packets pending batch dispatch */
+    size_t batch_cnt;                /* number of pending packets */
+    int started;
+};
+
+
 /**
  * @brief supported fsm services.
  *
@@ -414,6 +464,7 @@ struct fsm_session
     struct fsm_session_ops ops;      /* session function pointers */
     union fsm_plugin_ops *p_ops;     /* plugin function pointers */
     struct fsm_pcaps *pcaps;         /* pcaps container */
+    struct fsm_tpacket *tpacket;     /* TPACKET_V3 ring container */
     ds_tree_t *mqtt_headers;         /* mqtt headers from AWLAN_Node */
     char *name;                      /* convenient session name pointer */
     char *topic;                     /* convenient mqtt topic pointer */
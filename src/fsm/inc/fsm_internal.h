@@ -48,6 +48,7 @@ enum
     FSM_TAP_NFQ = 0x02,
     FSM_TAP_RAW = 0x04,
     FSM_TAP_SOCKET = 0x08,
+    FSM_TAP_TPACKET = 0x10,
 };
 
 enum recv_msg_type {
@@ -141,6 +142,50 @@ bool
 fsm_raw_tap_update(struct fsm_session *session);
 
 
+/**
+ * @brief update AF_PACKET TPACKET_V3 ring settings for the given session
+ *
+ * @param session the fsm session involved
+ * @return true if the ring settings were successful, false otherwise
+ */
+bool
+fsm_tpacket_tap_update(struct fsm_session *session);
+
+
+/**
+ * @brief releases the AF_PACKET TPACKET_V3 ring of the session
+ *
+ * @param session the fsm session involved
+ */
+void
+fsm_tpacket_close(struct fsm_session *session);
+
+
+/**
+ * @brief collects the AF_PACKET TPACKET_V3 ring statistics
+ *
+ * The kernel counters are cleared on read, the ring keeps running totals.
+ * @param session the fsm session involved
+ * @param stats the pcap-compatible counters to fill
+ * @return true if the counters were retrieved, false otherwise
+ */
+bool
+fsm_tpacket_stats(struct fsm_session *session, struct pcap_stat *stats);
+
+
+/**
+ * @brief hands the frames of a retired TPACKET_V3 block to the session
+ *
+ * The frames are delivered to the session's batch handler when provided,
+ * at most FSM_TPACKET_BATCH_MAX at a time, before the call returns.
+ * @param session the fsm session involved
+ * @param pbd the block descriptor
+ */
+void
+fsm_tpacket_walk_block(struct fsm_session *session,
+                       struct tpacket_block_desc *pbd);
+
+
 /**
  * @brief Initializes the tap context for the given session
  *
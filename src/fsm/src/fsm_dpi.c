@@ -323,7 +323,7 @@ fsm_dpi_add_plugin_to_tree(struct fsm_session *session,
             continue;
         }
 
-        dpi_flow_info = CALLOC(1, sizeof(*dpi_flow_info));
+        dpi_flow_info = net_md_alloc_flow_ctx(acc->aggr);
         if (dpi_flow_info == NULL)
         {
             flow = ds_tree_next(tree, flow);
@@ -383,7 +383,7 @@ fsm_dpi_del_plugin_from_acc(struct fsm_session *session,
     }
 
     ds_tree_remove(acc->dpi_plugins, dpi_flow_info);
-    FREE(dpi_flow_info);
+    net_md_free_flow_ctx(dpi_flow_info);
 }
 
 
@@ -1246,6 +1246,35 @@ fsm_dispatcher_init_tap_intfs(struct fsm_session *dispatcher)
 }
 
 
+/**
+ * @brief retrieves the flow memory cap of the dispatcher
+ *
+ * The cap is set through the flow_mem_cap_kb other_config option.
+ * When reached, the oldest idle flows are evicted to make room for new ones.
+ * @param session the dispatcher session
+ * @return the cap in bytes, 0 when not set
+ */
+static size_t
+fsm_dpi_get_flow_mem_cap(struct fsm_session *session)
+{
+    char *cap_str;
+    long value;
+
+    cap_str = fsm_get_other_config_val(session, "flow_mem_cap_kb");
+    if (cap_str == NULL) return 0;
+
+    errno = 0;
+    value = strtol(cap_str, NULL, 10);
+    if ((errno != 0) || (value <= 0))
+    {
+        LOGW("%s: invalid flow memory cap %s", __func__, cap_str);
+        return 0;
+    }
+
+    return (size_t)value * 1024;
+}
+
+
 /**
  * @brief initializes the dpi resources of a dispatcher session
  *
@@ -1299,6 +1328,9 @@ fsm_init_dpi_dispatcher(struct fsm_session *session)
     aggr_set.send_report = net_md_send_report;
     aggr_set.on_acc_create = fsm_dpi_on_acc_creation;
     aggr_set.on_acc_destroy = fsm_dpi_on_acc_destruction;
+    aggr_set.flow_ctx_size = MAX(sizeof(ds_tree_t),
+                                 sizeof(struct fsm_dpi_flow_info));
+    aggr_set.mem_cap = fsm_dpi_get_flow_mem_cap(session);
     aggr = net_md_allocate_aggregator(&aggr_set);
     if (aggr == NULL) return false;
 
@@ -1963,6 +1995,64 @@ flush_accel_flows(struct net_md_stats_accumulator *acc)
 }
 
 
+/**
+ * @brief applies the dpi plugins verdict to the flow of the given packet
+ *
+ * @param session the dispatcher session
+ * @param net_parser the last packet presented to the dpi plugins
+ * @param drop true if a plugin requested the flow to be dropped
+ * @param pass true if all plugins requested the flow to pass through
+ */
+static void
+fsm_dispatch_set_verdict(struct fsm_session *session,
+                         struct net_header_parser *net_parser,
+                         bool drop, bool pass)
+{
+    struct net_md_stats_accumulator *acc;
+    struct dpi_mark_policy mark_policy;
+    int state = FSM_DPI_CLEAR;
+    int mark;
+    int err;
+
+    acc = net_parser->acc;
+
+    if (drop) state = FSM_DPI_DROP;
+    if (pass) state = FSM_DPI_PASSTHRU;
+
+    acc->dpi_done = state;
+
+    if (acc->dpi_always) acc->dpi_done = FSM_DPI_CLEAR;
+
+    if (pass || drop)
+    {
+        mark = fsm_dpi_get_mark(net_parser->acc->flow_marker, acc->dpi_done);
+
+        /* Set the flow_marker to be used for FCM */
+        acc->flow_marker = mark;
+        fsm_dpi_set_flow_marker(acc);
+        memset(&mark_policy, 0, sizeof(mark_policy));
+        mark_policy.flow_mark = mark;
+        err = session->set_dpi_mark(net_parser, &mark_policy);
+        if (err != 0)
+        {
+            LOGD("%s: Setting ct_mark failed (2)", __func__);
+        }
+        else
+        {
+            if ((mark > 2) && (acc->mark_done != mark))
+            {
+                flush_accel_flows(acc);
+                acc->mark_done = mark;
+            }
+        }
+    }
+    else
+    {
+        acc->mark_done = FSM_DPI_INSPECT;
+    }
+}
+
+
 /**
  * @brief dispatches a received packet to the dpi plugin handlers
  *
@@ -1982,7 +2072,6 @@ fsm_dispatch_pkt(struct fsm_session *session,
     struct fsm_dpi_flow_info *info;
     struct fsm_session *dpi_plugin;
     struct fsm_dpi_plugin *plugin;
-    int state = FSM_DPI_CLEAR;
     ds_tree_t *tree;
     bool process;
     bool drop;
@@ -2094,39 +2183,178 @@ fsm_dispatch_pkt(struct fsm_session *session,
         fsm_forward_pkt(session, net_parser);
     }
 
-    if (drop) state = FSM_DPI_DROP;
-    if (pass) state = FSM_DPI_PASSTHRU;
+    fsm_dispatch_set_verdict(session, net_parser, drop, pass);
+}
 
-    acc->dpi_done = state;
 
-    if (acc->dpi_always) acc->dpi_done = FSM_DPI_CLEAR;
+/**
+ * @brief checks if a flow is to be dispatched in bursts
+ *
+ * A flow is dispatched in bursts when all the dpi plugins presented its
+ * packets provide a batch handler. Plugins relying on the per-packet
+ * handler thus never see flow counters accounting for packets they were
+ * not presented yet.
+ * @param acc the flow accumulator
+ * @return true if the flow's packets can be deferred, false otherwise
+ */
+static bool
+fsm_dpi_flow_is_batchable(struct net_md_stats_accumulator *acc)
+{
+    struct fsm_dpi_plugin_ops *dpi_plugin_ops;
+    struct fsm_dpi_flow_info *info;
+    struct fsm_session *dpi_plugin;
+    ds_tree_t *tree;
+    bool batchable;
 
-    if (pass || drop)
+    if (acc->dpi_done != 0) return false;
+
+    tree = acc->dpi_plugins;
+    if (tree == NULL) return false;
+
+    batchable = false;
+    ds_tree_foreach(tree, info)
     {
-        mark = fsm_dpi_get_mark(net_parser->acc->flow_marker, acc->dpi_done);
+        dpi_plugin = info->session;
+        if (dpi_plugin->p_ops == NULL) continue;
 
-        /* Set the flow_marker to be used for FCM */
-        acc->flow_marker = mark;
-        fsm_dpi_set_flow_marker(acc);
-        memset(&mark_policy, 0, sizeof(mark_policy));
-        mark_policy.flow_mark = mark;
-        err = session->set_dpi_mark(net_parser, &mark_policy);
-        if (err != 0)
+        dpi_plugin_ops = &dpi_plugin->p_ops->dpi_plugin_ops;
+        if (dpi_plugin_ops->handler == NULL) continue;
+        if (dpi_plugin_ops->batch_handler == NULL) return false;
+
+        batchable = true;
+    }
+
+    return batchable;
+}
+
+
+/**
+ * @brief dispatches a burst of packets of a flow under inspection
+ *
+ * Each dpi plugin inspecting the flow is presented the burst in one go
+ * through its batch handler. The burst ends at the packet where the last
+ * plugin set its verdict: the remaining packets are then handled as
+ * packets of an inspected flow.
+ * @param session the dispatcher session
+ * @param pkts the packets of the flow, in arrival order
+ * @param n the number of packets
+ * @return the number of packets consumed by the burst
+ */
+static size_t
+fsm_dispatch_pkt_burst(struct fsm_session *session,
+                       struct net_header_parser **pkts, size_t n)
+{
+    union fsm_dpi_context *plugin_dpi_context;
+    struct fsm_dpi_plugin_ops *dpi_plugin_ops;
+    struct net_md_stats_accumulator *acc;
+    struct fsm_dpi_flow_info *info;
+    struct fsm_session *dpi_plugin;
+    struct fsm_dpi_plugin *plugin;
+    size_t consumed;
+    size_t handled;
+    ds_tree_t *tree;
+    bool process;
+    bool drop;
+    bool pass;
+    size_t i;
+
+    acc = pkts[0]->acc;
+    tree = acc->dpi_plugins;
+
+    consumed = 0;
+    drop = false;
+    pass = true;
+
+    info = ds_tree_head(tree);
+    while (info != NULL && !drop)
+    {
+        dpi_plugin = info->session;
+        plugin_dpi_context = dpi_plugin->dpi;
+        plugin = &plugin_dpi_context->plugin;
+
+        /* All the packets of the burst share the same end points */
+        process = fsm_dpi_should_process(pkts[0],
+                                         plugin->targets,
+                                         plugin->excluded_targets);
+        if (!process)
         {
-            LOGD("%s: Setting ct_mark failed (2)", __func__);
+            info = ds_tree_next(tree, info);
+            continue;
         }
-        else
+
+        if (info->decision == FSM_DPI_CLEAR)
         {
-            if ((mark > 2) && (acc->mark_done != mark))
+            info->decision = FSM_DPI_INSPECT;
+        }
+
+        if ((info->decision == FSM_DPI_INSPECT || acc->dpi_always) &&
+            (dpi_plugin->p_ops != NULL))
+        {
+            dpi_plugin_ops = &dpi_plugin->p_ops->dpi_plugin_ops;
+            if (dpi_plugin_ops->batch_handler != NULL)
             {
-                flush_accel_flows(acc);
-                acc->mark_done = mark;
+                fsm_fn_trace(dpi_plugin_ops->batch_handler, FSM_FN_ENTER);
+                handled = dpi_plugin_ops->batch_handler(dpi_plugin, pkts, n);
+                fsm_fn_trace(dpi_plugin_ops->batch_handler, FSM_FN_EXIT);
+                consumed = MAX(consumed, handled);
             }
         }
+
+        drop = (info->decision == FSM_DPI_DROP);
+        pass &= (info->decision == FSM_DPI_PASSTHRU);
+
+        info = ds_tree_next(tree, info);
     }
-    else
+
+    /* No plugin handled the burst: it is processed as a whole */
+    if (consumed == 0) consumed = n;
+    consumed = MIN(consumed, n);
+
+    for (i = 0; i < consumed; i++)
     {
-        acc->mark_done = FSM_DPI_INSPECT;
+        if (!pkts[i]->payload_updated) continue;
+
+        FSM_TRACK_DNS(pkts[i], session->name);
+        fsm_forward_pkt(session, pkts[i]);
+    }
+
+    fsm_dispatch_set_verdict(session, pkts[consumed - 1], drop, pass);
+
+    return consumed;
+}
+
+
+/**
+ * @brief dispatches consecutive packets of a flow to the dpi plugins
+ *
+ * Flows only inspected by plugins providing a batch handler are
+ * dispatched in bursts. Other flows are dispatched packet by packet.
+ * @param session the dispatcher session
+ * @param pkts the packets of the flow, in arrival order
+ * @param n the number of packets
+ */
+static void
+fsm_dispatch_flow_pkts(struct fsm_session *session,
+                       struct net_header_parser **pkts, size_t n)
+{
+    struct net_md_stats_accumulator *acc;
+    bool burst;
+    size_t i;
+
+    acc = pkts[0]->acc;
+
+    i = 0;
+    while (i < n)
+    {
+        burst = fsm_dpi_flow_is_batchable(acc);
+        if (!burst || (i == n - 1))
+        {
+            fsm_dispatch_pkt(session, pkts[i]);
+            i++;
+            continue;
+        }
+
+        i += fsm_dispatch_pkt_burst(session, &pkts[i], n - i);
     }
 }
 
@@ -2153,17 +2381,18 @@ fsm_dpi_filter_packet(struct net_header_parser *net_parser)
 
 
 /**
- * @brief the dispatcher plugin's packet handler
+ * @brief binds a received packet to its flow
  *
- * Retrieves the flow accumulator.
+ * Retrieves the flow accumulator, updates its counters.
  * If the flow is new, bind it to the dpi plugins
- * Dispatch the packet to the dpi plugins
  * @param session the dispatcher session
  * @param net_parser the parsed packet
+ * @return true if the packet is to be presented to the dpi plugins,
+ *         false otherwise
  */
-static void
-fsm_dpi_handler(struct fsm_session *session,
-                struct net_header_parser *net_parser)
+static bool
+fsm_dpi_prepare_pkt(struct fsm_session *session,
+                    struct net_header_parser *net_parser)
 {
     struct net_md_stats_accumulator *acc;
     struct fsm_dpi_dispatcher *dispatch;
@@ -2173,22 +2402,6 @@ fsm_dpi_handler(struct fsm_session *session,
     bool process;
 
     dpi_context = session->dpi;
-    if (dpi_context == NULL) return;
-
-    if (kconfig_enabled(CONFIG_FSM_MAP_LEGACY_PLUGINS))
-    {
-        struct fsm_parser_ops *parser_ops;
-        struct fsm_session *mapped;
-
-        mapped = fsm_map_plugin_find_session(net_parser);
-        if (mapped == NULL) return;
-
-        parser_ops = &mapped->p_ops->parser_ops;
-        parser_ops->handler(mapped, net_parser);
-
-        return;
-    }
-
     dispatch = &dpi_context->dispatch;
     process = fsm_dpi_should_process(net_parser,
                                      dispatch->included_devices,
@@ -2199,11 +2412,11 @@ fsm_dpi_handler(struct fsm_session *session,
         LOGT("%s: not processing the following flow: ", __func__);
         net_header_logt(net_parser);
 
-        return;
+        return false;
     }
 
     acc = fsm_net_parser_to_acc(net_parser, dispatch->aggr);
-    if (acc == NULL) return;
+    if (acc == NULL) return false;
 
     counters.packets_count = acc->counters.packets_count + 1;
     counters.bytes_count = acc->counters.bytes_count + net_parser->packet_len;
@@ -2215,12 +2428,162 @@ fsm_dpi_handler(struct fsm_session *session,
     net_parser->acc = acc;
 
     process = fsm_dpi_filter_packet(net_parser);
-    if (!process) return;
+    if (!process) return false;
 
     net_header_logt(net_parser);
+
+    return true;
+}
+
+
+/**
+ * @brief presents a packet to the legacy plugin mapped to its port
+ *
+ * @param net_parser the parsed packet
+ */
+static void
+fsm_dpi_legacy_handler(struct net_header_parser *net_parser)
+{
+    struct fsm_parser_ops *parser_ops;
+    struct fsm_session *mapped;
+
+    mapped = fsm_map_plugin_find_session(net_parser);
+    if (mapped == NULL) return;
+
+    parser_ops = &mapped->p_ops->parser_ops;
+    parser_ops->handler(mapped, net_parser);
+}
+
+
+/**
+ * @brief the dispatcher plugin's packet handler
+ *
+ * Retrieves the flow accumulator.
+ * If the flow is new, bind it to the dpi plugins
+ * Dispatch the packet to the dpi plugins
+ * @param session the dispatcher session
+ * @param net_parser the parsed packet
+ */
+static void
+fsm_dpi_handler(struct fsm_session *session,
+                struct net_header_parser *net_parser)
+{
+    bool process;
+
+    if (session->dpi == NULL) return;
+
+    if (kconfig_enabled(CONFIG_FSM_MAP_LEGACY_PLUGINS))
+    {
+        fsm_dpi_legacy_handler(net_parser);
+        return;
+    }
+
+    process = fsm_dpi_prepare_pkt(session, net_parser);
+    if (!process) return;
+
     fsm_dispatch_pkt(session, net_parser);
 }
 
+
+/**
+ * @brief presents bound packets to the dpi plugins, flow by flow
+ *
+ * The packets are grouped by flow with an insertion sort, which is stable:
+ * the packets of a flow keep their arrival order.
+ * @param session the dispatcher session
+ * @param pkts the packets, in arrival order. The array gets sorted by flow.
+ * @param n the number of packets
+ */
+static void
+fsm_dpi_dispatch_batch(struct fsm_session *session,
+                       struct net_header_parser **pkts,
+                       size_t n)
+{
+    struct net_header_parser *pkt;
+    size_t i;
+    size_t j;
+
+    for (i = 1; i < n; i++)
+    {
+        pkt = pkts[i];
+        j = i;
+        while ((j > 0) && ((uintptr_t)pkts[j - 1]->acc > (uintptr_t)pkt->acc))
+        {
+            pkts[j] = pkts[j - 1];
+            j--;
+        }
+        pkts[j] = pkt;
+    }
+
+    i = 0;
+    while (i < n)
+    {
+        j = i + 1;
+        while ((j < n) && (pkts[j]->acc == pkts[i]->acc)) j++;
+
+        fsm_dispatch_flow_pkts(session, &pkts[i], j - i);
+        i = j;
+    }
+}
+
+
+#define FSM_DPI_BATCH_MAX 64
+/**
+ * @brief the dispatcher plugin's batched packet handler
+ *
+ * Each packet is bound to its flow and dispatched right away, so the flow
+ * counters seen by the plugins account for the packets up to the current
+ * one. Only the packets of flows whose plugins all provide a batch handler
+ * are deferred, then presented to the plugins flow by flow. Their flows
+ * were just updated, so the flow memory cap cannot evict them meanwhile.
+ * @param session the dispatcher session
+ * @param parsers the parsed packets, in arrival order
+ * @param count the number of packets
+ */
+static void
+fsm_dpi_batch_handler(struct fsm_session *session,
+                      struct net_header_parser *parsers,
+                      size_t count)
+{
+    struct net_header_parser *pkts[FSM_DPI_BATCH_MAX];
+    struct net_header_parser *pkt;
+    bool process;
+    size_t nb;
+    size_t i;
+
+    if (session->dpi == NULL) return;
+
+    if (kconfig_enabled(CONFIG_FSM_MAP_LEGACY_PLUGINS))
+    {
+        for (i = 0; i < count; i++) fsm_dpi_legacy_handler(&parsers[i]);
+        return;
+    }
+
+    nb = 0;
+    for (i = 0; i < count; i++)
+    {
+        pkt = &parsers[i];
+
+        process = fsm_dpi_prepare_pkt(session, pkt);
+        if (!process) continue;
+
+        if (!fsm_dpi_flow_is_batchable(pkt->acc))
+        {
+            fsm_dispatch_pkt(session, pkt);
+            continue;
+        }
+
+        pkts[nb++] = pkt;
+        if (nb < FSM_DPI_BATCH_MAX) continue;
+
+        fsm_dpi_dispatch_batch(session, pkts, nb);
+        nb = 0;
+    }
+
+    fsm_dpi_dispatch_batch(session, pkts, nb);
+}
+
+
 /**
  * @brief releases the dpi context of a flow accumulator
  *
@@ -2244,9 +2607,10 @@ fsm_dpi_free_flow_context(struct net_md_stats_accumulator *acc)
         remove = dpi_flow_info;
         dpi_flow_info = ds_tree_next(dpi_sessions, dpi_flow_info);
         ds_tree_remove(dpi_sessions, remove);
-        FREE(remove);
+        net_md_free_flow_ctx(remove);
     }
-    FREE(dpi_sessions);
+    net_md_free_flow_ctx(dpi_sessions);
+    acc->dpi_plugins = NULL;
 }
 
 
@@ -2271,7 +2635,7 @@ fsm_dpi_alloc_flow_context(struct fsm_session *session,
     if (acc->dpi_plugins != NULL) return;
 
     acc->free_plugins = fsm_dpi_free_flow_context;
-    acc->dpi_plugins = CALLOC(1, sizeof(ds_tree_t));
+    acc->dpi_plugins = net_md_alloc_flow_ctx(acc->aggr);
     if (acc->dpi_plugins == NULL) return;
 
     ds_tree_init(acc->dpi_plugins, fsm_dpi_session_cmp,
@@ -2283,7 +2647,7 @@ fsm_dpi_alloc_flow_context(struct fsm_session *session,
     dpi_plugin = ds_tree_head(dpi_sessions);
     while (dpi_plugin != NULL)
     {
-        dpi_flow_info = CALLOC(1, sizeof(*dpi_flow_info));
+        dpi_flow_info = net_md_alloc_flow_ctx(acc->aggr);
         if (dpi_flow_info == NULL)
         {
             dpi_plugin = ds_tree_next(dpi_sessions, dpi_plugin);
@@ -2308,6 +2672,17 @@ fsm_pcap_stats(struct fsm_session *session)
     if (!fsm_plugin_has_intf(session)) return;
     if (session->conf == NULL) return;
 
+    if (session->tpacket != NULL)
+    {
+        memset(&stats, 0, sizeof(stats));
+        if (fsm_tpacket_stats(session, &stats))
+        {
+            dpi_stats_store_pcap_stats(&stats, session->conf->if_name);
+            LOGI("%s: %s: tpacket received: %u, dropped: %u",
+                 __func__, session->conf->if_name, stats.ps_recv, stats.ps_drop);
+        }
+    }
+
     pcaps = session->pcaps;
     if (pcaps == NULL) return;
 
@@ -2417,6 +2792,7 @@ fsm_dpi_periodic(struct fsm_session *session)
         LOGI("%s: %s: total flows: %zu held flows: %zu, reported flows: %zu",
              __func__, session->name, aggr->total_flows, aggr->held_flows,
              window->num_stats);
+        net_md_log_mem_stats(aggr);
 
         LOGI("%s: unix_ipc: io successes: %" PRIu64
              ", io failures: %" PRIu64, __func__,
@@ -2471,6 +2847,7 @@ fsm_dispatch_set_ops(struct fsm_session *session)
     /* Set the plugin specific ops */
     dispatch_ops = &session->p_ops->parser_ops;
     dispatch_ops->handler = fsm_dpi_handler;
+    dispatch_ops->batch_handler = fsm_dpi_batch_handler;
 
     session_ops = &session->ops;
     session_ops->periodic = fsm_dpi_periodic;
@@ -58,6 +58,10 @@ static const struct fsm_tap_type
     {
         .tap_str_type = "fsm_tap_socket",
         .tap_type = FSM_TAP_SOCKET,
+    },
+    {
+        .tap_str_type = "fsm_tap_tpacket",
+        .tap_type = FSM_TAP_TPACKET,
     }
 };
 
@@ -181,6 +185,8 @@ fsm_update_open_taps(uint32_t taps_to_open, struct fsm_session *session)
 
     if (taps_to_open & FSM_TAP_SOCKET) rc |= fsm_socket_tap_update(session);
 
+    if (taps_to_open & FSM_TAP_TPACKET) rc |= fsm_tpacket_tap_update(session);
+
     return rc;
 }
 
@@ -212,6 +218,12 @@ fsm_update_close_taps(uint32_t taps_to_close, struct fsm_session *session)
     {
         fsm_socket_tap_close(session);
     }
+
+    if (taps_to_close & FSM_TAP_TPACKET)
+    {
+        /* Free the AF_PACKET ring resources */
+        if (session->tpacket != NULL) fsm_tpacket_close(session);
+    }
 }
 
 
@@ -140,6 +140,14 @@ int main(int argc, char ** argv)
         return -1;
     }
 
+    if (CONFIG_FSM_REPORT_QUEUE_LEN > 0)
+    {
+        if (!qm_conn_async_start(CONFIG_FSM_REPORT_QUEUE_LEN))
+        {
+            LOGI("Reports will be sent synchronously");
+        }
+    }
+
     if (neigh_table_init())
     {
         LOGE("Initializing Neighbour Table failed " );
@@ -163,6 +171,8 @@ int main(int argc, char ** argv)
 
     ev_run(loop, 0);
 
+    qm_conn_async_stop();
+
     target_close(TARGET_INIT_MGR_FSM, loop);
 
     neigh_table_cleanup();
@@ -144,6 +144,10 @@ fsm_tag_update_cb(om_tag_t *tag,
 {
     network_zone_tag_update_cb(tag, removed, added, updated);
     fsm_process_tag_update(tag, removed, added, updated);
+
+    /* Policy mac sets and verdicts may depend on the tag's values */
+    fsm_policy_tag_update(tag, removed, added, updated);
+    fsm_policy_verdict_invalidate();
     return true;
 }
 
@@ -887,6 +891,8 @@ fsm_init_plugin(struct fsm_session *session)
  *
  * If connecting to QM fails with the specific connect error,
  * do not attempt to reconnnect for a while.
+ * When the asynchronous sender runs, the report is queued to it and
+ * true means the report was queued.
  */
 static bool
 fsm_send_to_qm(qm_compress_t compress, char *topic, void *data, int data_size)
@@ -912,6 +918,12 @@ fsm_send_to_qm(qm_compress_t compress, char *topic, void *data, int data_size)
         mgr->qm_backoff = 0;
     }
 
+    /* The sender thread drops reports during its own back off */
+    if (qm_conn_async_running())
+    {
+        return qm_conn_send_async(compress, topic, data, data_size);
+    }
+
     ret = qm_conn_send_direct(compress, topic, data, data_size, &res);
     if (ret) return true;
 
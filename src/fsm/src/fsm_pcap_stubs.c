@@ -46,3 +46,32 @@ fsm_pcap_close(struct fsm_session *session)
 {
     return;
 }
+
+
+bool
+fsm_tpacket_tap_update(struct fsm_session *session)
+{
+    return true;
+}
+
+
+void
+fsm_tpacket_close(struct fsm_session *session)
+{
+    return;
+}
+
+
+bool
+fsm_tpacket_stats(struct fsm_session *session, struct pcap_stat *stats)
+{
+    return false;
+}
+
+
+void
+fsm_tpacket_walk_block(struct fsm_session *session,
+                       struct tpacket_block_desc *pbd)
+{
+    return;
+}
@@ -0,0 +1,662 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <pcap.h>
+
+#include "os.h"
+#include "util.h"
+#include "log.h"
+#include "fsm.h"
+#include "fsm_internal.h"
+#include "memutil.h"
+#include "os_ev_trace.h"
+
+/* Default ring geometry: 64 blocks of 64KB, blocks retired after 8ms */
+#define FSM_TPACKET_BLOCK_SIZE (1 << 16)
+#define FSM_TPACKET_BLOCK_NR 64
+#define FSM_TPACKET_FRAME_SIZE 2048
+#define FSM_TPACKET_BLOCK_TMO 8
+
+#define FSM_TPACKET_VLAN_TAG_LEN 4
+
+#if defined(CONFIG_FSM_PCAP_SNAPLEN) && (CONFIG_FSM_PCAP_SNAPLEN > 0)
+static int g_tpacket_snaplen = CONFIG_FSM_PCAP_SNAPLEN;
+#else
+static int g_tpacket_snaplen = 2048;
+#endif
+
+
+/**
+ * @brief reads an unsigned integer option from the session's other_config
+ *
+ * @param session the session
+ * @param key the other_config key
+ * @param def the value returned when the key is absent or invalid
+ * @return the option value
+ */
+static unsigned int
+fsm_tpacket_get_option(struct fsm_session *session, char *key,
+                       unsigned int def)
+{
+    char *value_str;
+    long value;
+
+    value_str = fsm_get_other_config_val(session, key);
+    if (value_str == NULL) return def;
+
+    errno = 0;
+    value = strtol(value_str, NULL, 10);
+    if ((errno != 0) || (value <= 0))
+    {
+        LOGD("%s: error reading %s value %s", __func__, key, value_str);
+        return def;
+    }
+
+    return (unsigned int)value;
+}
+
+
+/**
+ * @brief parse a session's ring options from ovsdb.
+ *
+ * The block size must be a multiple of the page size and of the frame size.
+ * @param session the session
+ */
+static void
+fsm_tpacket_get_options(struct fsm_session *session)
+{
+    struct fsm_tpacket *tpacket;
+    unsigned int page_size;
+
+    tpacket = session->tpacket;
+
+    tpacket->block_size = fsm_tpacket_get_option(session, "tpacket_bsize",
+                                                 FSM_TPACKET_BLOCK_SIZE);
+    tpacket->block_nr = fsm_tpacket_get_option(session, "tpacket_bnum",
+                                               FSM_TPACKET_BLOCK_NR);
+    tpacket->frame_size = fsm_tpacket_get_option(session, "tpacket_fsize",
+                                                 FSM_TPACKET_FRAME_SIZE);
+    tpacket->block_tmo = fsm_tpacket_get_option(session, "tpacket_tmo",
+                                                FSM_TPACKET_BLOCK_TMO);
+
+    page_size = (unsigned int)sysconf(_SC_PAGESIZE);
+    if ((tpacket->block_size % page_size) != 0)
+    {
+        LOGW("%s: %s: block size %u is not page aligned, using %u",
+             __func__, session->name, tpacket->block_size,
+             FSM_TPACKET_BLOCK_SIZE);
+        tpacket->block_size = FSM_TPACKET_BLOCK_SIZE;
+    }
+
+    if ((tpacket->block_size % tpacket->frame_size) != 0)
+    {
+        LOGW("%s: %s: frame size %u does not divide block size %u, using %u",
+             __func__, session->name, tpacket->frame_size,
+             tpacket->block_size, FSM_TPACKET_FRAME_SIZE);
+        tpacket->frame_size = FSM_TPACKET_FRAME_SIZE;
+    }
+
+    LOGI("%s: %s: ring: %u blocks of %u bytes, frame size %u, timeout %u ms",
+         __func__, session->name, tpacket->block_nr, tpacket->block_size,
+         tpacket->frame_size, tpacket->block_tmo);
+}
+
+
+/**
+ * @brief compiles and attaches the session's capture filter to the socket
+ *
+ * libpcap compiles the filter into classic BPF, which the kernel accepts
+ * as is through SO_ATTACH_FILTER.
+ * @param session the session
+ * @return true if the filter was attached, false otherwise
+ */
+static bool
+fsm_tpacket_set_filter(struct fsm_session *session)
+{
+    struct fsm_tpacket *tpacket;
+    struct bpf_program bpf;
+    struct sock_fprog prog;
+    char *pkt_filter;
+    pcap_t *pcap;
+    int rc;
+
+    tpacket = session->tpacket;
+    pkt_filter = session->conf->pkt_capt_filter;
+    if (pkt_filter == NULL) return true;
+    if (strlen(pkt_filter) == 0) return true;
+
+    pcap = pcap_open_dead(DLT_EN10MB, g_tpacket_snaplen);
+    if (pcap == NULL) return false;
+
+    MEMZERO(bpf);
+    rc = pcap_compile(pcap, &bpf, pkt_filter, 1, PCAP_NETMASK_UNKNOWN);
+    if (rc != 0)
+    {
+        LOGE("%s: Error compiling capture filter: '%s'. PCAP error:\n>>> %s",
+             __func__, pkt_filter, pcap_geterr(pcap));
+        pcap_close(pcap);
+        return false;
+    }
+
+    prog.len = bpf.bf_len;
+    prog.filter = (struct sock_filter *)bpf.bf_insns;
+    rc = setsockopt(tpacket->fd, SOL_SOCKET, SO_ATTACH_FILTER,
+                    &prog, sizeof(prog));
+    if (rc != 0)
+    {
+        LOGE("%s: Error setting the capture filter: %s", __func__,
+             strerror(errno));
+    }
+
+    pcap_freecode(&bpf);
+    pcap_close(pcap);
+
+    return (rc == 0);
+}
+
+
+/**
+ * @brief hands the pending packets to the session's batch handler
+ *
+ * @param session the session
+ */
+static void
+fsm_tpacket_flush_batch(struct fsm_session *session)
+{
+    struct fsm_parser_ops *parser_ops;
+    struct fsm_tpacket *tpacket;
+
+    tpacket = session->tpacket;
+    if (tpacket->batch_cnt == 0) return;
+
+    parser_ops = &session->p_ops->parser_ops;
+    parser_ops->batch_handler(session, tpacket->batch, tpacket->batch_cnt);
+    tpacket->batch_cnt = 0;
+}
+
+
+/**
+ * @brief hands a frame of a retired block to the session's handler
+ *
+ * The frame is parsed in place. The kernel strips the 802.1Q header into
+ * the frame metadata: when present it is restored in the headroom reserved
+ * through PACKET_RESERVE, so the parser sees the frame as pcap would.
+ * When the session provides a batch handler, the parsed packet is queued
+ * and handed over with the other packets of the block.
+ * @param session the session
+ * @param hdr the frame header
+ */
+static void
+fsm_tpacket_process_frame(struct fsm_session *session,
+                          struct tpacket3_hdr *hdr)
+{
+    struct net_header_parser *net_parser;
+    struct net_header_parser one_parser;
+    struct fsm_parser_ops *parser_ops;
+    struct fsm_tpacket *tpacket;
+    uint8_t *bytes;
+    size_t caplen;
+    size_t len;
+
+    caplen = hdr->tp_snaplen;
+    if (caplen == 0) return;
+
+    tpacket = session->tpacket;
+    bytes = (uint8_t *)hdr + hdr->tp_mac;
+
+    /*
+     * Same test as libpcap's VLAN_VALID(): a zero TCI with
+     * TP_STATUS_VLAN_VALID set is a priority tagged (VLAN ID 0) frame
+     * and its tag must be restored too.
+     */
+    if ((hdr->hv1.tp_vlan_tci != 0) || (hdr->tp_status & TP_STATUS_VLAN_VALID))
+    {
+        uint16_t *tag;
+
+        memmove(bytes - FSM_TPACKET_VLAN_TAG_LEN, bytes, 2 * ETH_ALEN);
+        bytes -= FSM_TPACKET_VLAN_TAG_LEN;
+        tag = (uint16_t *)(bytes + 2 * ETH_ALEN);
+        if (hdr->tp_status & TP_STATUS_VLAN_TPID_VALID)
+        {
+            tag[0] = htons(hdr->hv1.tp_vlan_tpid);
+        }
+        else
+        {
+            tag[0] = htons(ETH_P_8021Q);
+        }
+        tag[1] = htons(hdr->hv1.tp_vlan_tci);
+        caplen += FSM_TPACKET_VLAN_TAG_LEN;
+    }
+
+    parser_ops = &session->p_ops->parser_ops;
+    if (parser_ops->batch_handler != NULL)
+    {
+        net_parser = &tpacket->batch[tpacket->batch_cnt];
+    }
+    else
+    {
+        net_parser = &one_parser;
+    }
+
+    /* Start from the template holding the per ring settings */
+    *net_parser = tpacket->parser;
+    net_parser->packet_len = caplen;
+    net_parser->caplen = caplen;
+    net_parser->data = bytes;
+    len = net_header_parse(net_parser);
+    if (len == 0) return;
+
+    if (parser_ops->batch_handler == NULL)
+    {
+        parser_ops->handler(session, net_parser);
+        return;
+    }
+
+    tpacket->batch_cnt++;
+    if (tpacket->batch_cnt == FSM_TPACKET_BATCH_MAX) fsm_tpacket_flush_batch(session);
+}
+
+
+/**
+ * @brief walks the frames of a retired block
+ *
+ * @param session the session
+ * @param pbd the block descriptor
+ */
+void
+fsm_tpacket_walk_block(struct fsm_session *session,
+                       struct tpacket_block_desc *pbd)
+{
+    struct tpacket3_hdr *hdr;
+    uint32_t num_pkts;
+    uint32_t i;
+
+    num_pkts = pbd->hdr.bh1.num_pkts;
+    hdr = (struct tpacket3_hdr *)((uint8_t *)pbd +
+                                  pbd->hdr.bh1.offset_to_first_pkt);
+    for (i = 0; i < num_pkts; i++)
+    {
+        fsm_tpacket_process_frame(session, hdr);
+        hdr = (struct tpacket3_hdr *)((uint8_t *)hdr + hdr->tp_next_offset);
+    }
+
+    /* The frames are only valid until the block is handed back */
+    fsm_tpacket_flush_batch(session);
+}
+
+
+/**
+ * @brief returns the ring block at the given index
+ */
+static inline struct tpacket_block_desc *
+fsm_tpacket_block(struct fsm_tpacket *tpacket, unsigned int idx)
+{
+    return (struct tpacket_block_desc *)(tpacket->ring +
+                                         (idx * tpacket->block_size));
+}
+
+
+/**
+ * @brief updates the ring fill high water mark
+ *
+ * @param tpacket the ring container
+ */
+static void
+fsm_tpacket_update_fill(struct fsm_tpacket *tpacket)
+{
+    struct tpacket_block_desc *pbd;
+    unsigned int in_use;
+    unsigned int idx;
+    unsigned int i;
+
+    in_use = 0;
+    idx = tpacket->block_idx;
+    for (i = 0; i < tpacket->block_nr; i++)
+    {
+        pbd = fsm_tpacket_block(tpacket, idx);
+        if ((pbd->hdr.bh1.block_status & TP_STATUS_USER) == 0) break;
+
+        in_use++;
+        idx = (idx + 1) % tpacket->block_nr;
+    }
+
+    if (in_use > tpacket->max_blocks_in_use) tpacket->max_blocks_in_use = in_use;
+}
+
+
+static void
+fsm_tpacket_recv_fn(EV_P_ ev_io *ev, int revents)
+{
+    (void)loop;
+    (void)revents;
+
+    struct tpacket_block_desc *pbd;
+    struct fsm_tpacket *tpacket;
+    struct fsm_session *session;
+    unsigned int walked;
+
+    session = ev->data;
+    tpacket = session->tpacket;
+
+    fsm_tpacket_update_fill(tpacket);
+
+    /* Walk all the retired blocks, and hand them back to the kernel */
+    walked = 0;
+    pbd = fsm_tpacket_block(tpacket, tpacket->block_idx);
+    while ((pbd->hdr.bh1.block_status & TP_STATUS_USER) &&
+           (walked < tpacket->block_nr))
+    {
+        fsm_tpacket_walk_block(session, pbd);
+        __sync_synchronize();
+        pbd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+
+        walked++;
+        tpacket->block_idx = (tpacket->block_idx + 1) % tpacket->block_nr;
+        pbd = fsm_tpacket_block(tpacket, tpacket->block_idx);
+    }
+    tpacket->blocks_walked += walked;
+}
+
+
+/**
+ * @brief checks that the interface carries ethernet frames
+ *
+ * @param fd a socket to issue the ioctl on
+ * @param iface the interface name
+ * @return true if the interface is an ethernet interface, false otherwise
+ */
+static bool
+fsm_tpacket_is_ether(int fd, char *iface)
+{
+    struct ifreq ifr;
+    int rc;
+
+    MEMZERO(ifr);
+    STRSCPY(ifr.ifr_name, iface);
+    rc = ioctl(fd, SIOCGIFHWADDR, &ifr);
+    if (rc != 0)
+    {
+        LOGE("%s: %s: SIOCGIFHWADDR failed: %s", __func__,
+             iface, strerror(errno));
+        return false;
+    }
+
+    return (ifr.ifr_hwaddr.sa_family == ARPHRD_ETHER);
+}
+
+
+static bool
+fsm_tpacket_open(struct fsm_session *session)
+{
+    struct fsm_mgr *mgr = fsm_get_mgr();
+    struct fsm_tpacket *tpacket;
+    struct tpacket_req3 req;
+    struct sockaddr_ll sll;
+    unsigned int ifindex;
+    char *iface;
+    int version;
+    int reserve;
+    int rc;
+
+    tpacket = session->tpacket;
+    iface = session->conf->if_name;
+    if (iface == NULL) return true;
+
+    ifindex = if_nametoindex(iface);
+    if (ifindex == 0)
+    {
+        LOGE("%s: %s: unknown interface", __func__, iface);
+        return false;
+    }
+
+    tpacket->fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+    if (tpacket->fd < 0)
+    {
+        LOGE("%s: %s: socket creation failed: %s", __func__,
+             iface, strerror(errno));
+        return false;
+    }
+
+    if (!fsm_tpacket_is_ether(tpacket->fd, iface))
+    {
+        LOGE("%s: %s: unsupported data link layer", __func__, iface);
+        goto error;
+    }
+
+    version = TPACKET_V3;
+    rc = setsockopt(tpacket->fd, SOL_PACKET, PACKET_VERSION,
+                    &version, sizeof(version));
+    if (rc != 0)
+    {
+        LOGE("%s: %s: TPACKET_V3 not supported: %s", __func__,
+             iface, strerror(errno));
+        goto error;
+    }
+
+    /* Headroom to restore the vlan tag stripped by the kernel */
+    reserve = FSM_TPACKET_VLAN_TAG_LEN;
+    rc = setsockopt(tpacket->fd, SOL_PACKET, PACKET_RESERVE,
+                    &reserve, sizeof(reserve));
+    if (rc != 0)
+    {
+        LOGE("%s: %s: Error setting the ring headroom: %s", __func__,
+             iface, strerror(errno));
+        goto error;
+    }
+
+    if (!fsm_tpacket_set_filter(session)) goto error;
+
+    MEMZERO(req);
+    req.tp_block_size = tpacket->block_size;
+    req.tp_block_nr = tpacket->block_nr;
+    req.tp_frame_size = tpacket->frame_size;
+    req.tp_frame_nr = (tpacket->block_size * tpacket->block_nr) /
+                      tpacket->frame_size;
+    req.tp_retire_blk_tov = tpacket->block_tmo;
+    req.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+    rc = setsockopt(tpacket->fd, SOL_PACKET, PACKET_RX_RING,
+                    &req, sizeof(req));
+    if (rc != 0)
+    {
+        LOGE("%s: %s: Error setting the rx ring: %s", __func__,
+             iface, strerror(errno));
+        goto error;
+    }
+
+    tpacket->ring_len = (size_t)tpacket->block_size * tpacket->block_nr;
+    tpacket->ring = mmap(NULL, tpacket->ring_len, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_LOCKED, tpacket->fd, 0);
+    if (tpacket->ring == MAP_FAILED)
+    {
+        LOGE("%s: %s: Error mapping the rx ring: %s", __func__,
+             iface, strerror(errno));
+        tpacket->ring = NULL;
+        goto error;
+    }
+
+    MEMZERO(sll);
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_ALL);
+    sll.sll_ifindex = ifindex;
+    rc = bind(tpacket->fd, (struct sockaddr *)&sll, sizeof(sll));
+    if (rc != 0)
+    {
+        LOGE("%s: %s: bind failed: %s", __func__, iface, strerror(errno));
+        goto error;
+    }
+
+    /* Set the per-packet parser settings once */
+    MEMZERO(tpacket->parser);
+    tpacket->parser.pcap_datalink = DLT_EN10MB;
+    tpacket->parser.payload_updated = false;
+    tpacket->parser.tap_intf = iface;
+    tpacket->block_idx = 0;
+
+    /* Register FD for libev events */
+    OS_EV_TRACE_MAP(fsm_tpacket_recv_fn);
+    ev_io_init(&tpacket->fsm_evio, fsm_tpacket_recv_fn, tpacket->fd, EV_READ);
+    tpacket->fsm_evio.data = (void *)session;
+    ev_io_start(mgr->loop, &tpacket->fsm_evio);
+    tpacket->started = 1;
+
+    LOGI("%s: %s: TPACKET_V3 ring of %zu bytes started", __func__,
+         iface, tpacket->ring_len);
+
+    return true;
+
+error:
+    LOGE("Interface %s registered for snooping returning error.", iface);
+    if (tpacket->ring != NULL) munmap(tpacket->ring, tpacket->ring_len);
+    tpacket->ring = NULL;
+    close(tpacket->fd);
+    tpacket->fd = -1;
+
+    return false;
+}
+
+
+void
+fsm_tpacket_close(struct fsm_session *session)
+{
+    struct fsm_mgr *mgr = fsm_get_mgr();
+    struct fsm_tpacket *tpacket;
+
+    tpacket = session->tpacket;
+    if (tpacket == NULL) return;
+
+    if (ev_is_active(&tpacket->fsm_evio))
+    {
+        ev_io_stop(mgr->loop, &tpacket->fsm_evio);
+    }
+
+    if (tpacket->ring != NULL) munmap(tpacket->ring, tpacket->ring_len);
+    if (tpacket->fd >= 0) close(tpacket->fd);
+
+    FREE(tpacket->batch);
+    FREE(tpacket);
+    session->tpacket = NULL;
+}
+
+
+bool
+fsm_tpacket_stats(struct fsm_session *session, struct pcap_stat *stats)
+{
+    struct tpacket_stats_v3 tp_stats;
+    struct fsm_tpacket *tpacket;
+    socklen_t len;
+    int rc;
+
+    tpacket = session->tpacket;
+    if (tpacket == NULL) return false;
+    if (tpacket->fd < 0) return false;
+
+    MEMZERO(tp_stats);
+    len = sizeof(tp_stats);
+    rc = getsockopt(tpacket->fd, SOL_PACKET, PACKET_STATISTICS,
+                    &tp_stats, &len);
+    if (rc != 0)
+    {
+        LOGT("%s: PACKET_STATISTICS failed: %s", __func__, strerror(errno));
+        return false;
+    }
+
+    /* tp_packets accounts for both the received and the dropped packets */
+    tpacket->pkts_received += tp_stats.tp_packets;
+    tpacket->pkts_dropped += tp_stats.tp_drops;
+    tpacket->freeze_cnt += tp_stats.tp_freeze_q_cnt;
+
+    stats->ps_recv = (u_int)tpacket->pkts_received;
+    stats->ps_drop = (u_int)tpacket->pkts_dropped;
+    stats->ps_ifdrop = 0;
+
+    LOGI("%s: %s: ring blocks: %u, max in use: %u, walked: %" PRIu64
+         ", queue freezes: %" PRIu64, __func__, session->conf->if_name,
+         tpacket->block_nr, tpacket->max_blocks_in_use,
+         tpacket->blocks_walked, tpacket->freeze_cnt);
+
+    /* Restart the high water mark for the next reporting interval */
+    tpacket->max_blocks_in_use = 0;
+
+    return true;
+}
+
+
+bool
+fsm_tpacket_tap_update(struct fsm_session *session)
+{
+    struct fsm_tpacket *tpacket;
+    bool ret;
+
+    if ((session->tap_type & FSM_TAP_TPACKET) == 0) return false;
+
+    if (session->tpacket != NULL) fsm_tpacket_close(session);
+
+    tpacket = CALLOC(1, sizeof(*tpacket));
+    if (tpacket == NULL) return false;
+
+    tpacket->fd = -1;
+    session->tpacket = tpacket;
+
+    tpacket->batch = CALLOC(FSM_TPACKET_BATCH_MAX, sizeof(*tpacket->batch));
+    if (tpacket->batch == NULL) goto err_free_tpacket;
+
+    fsm_tpacket_get_options(session);
+    ret = fsm_tpacket_open(session);
+    if (!ret)
+    {
+        LOGE("tpacket open failed for handler %s",
+             session->name);
+        goto err_free_batch;
+    }
+
+    return true;
+
+err_free_batch:
+    FREE(tpacket->batch);
+
+err_free_tpacket:
+    FREE(tpacket);
+    session->tpacket = NULL;
+
+    return false;
+}
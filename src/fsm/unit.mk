@@ -44,6 +44,7 @@ UNIT_SRC += src/fsm_nfqueues.c
 UNIT_SRC += src/fsm_raw.c
 UNIT_SRC += $(if $(CONFIG_FSM_DPI_SOCKET), src/fsm_dispatch_listener.c)
 UNIT_SRC += $(if $(CONFIG_FSM_TAP_INTF), src/fsm_pcap.c, src/fsm_pcap_stubs.c)
+UNIT_SRC += $(if $(CONFIG_FSM_TAP_INTF), src/fsm_tpacket.c)
 
 UNIT_CFLAGS := -I$(UNIT_PATH)/inc
 UNIT_CFLAGS += -Isrc/lib/oms/inc
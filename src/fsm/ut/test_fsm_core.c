@@ -1658,6 +1658,282 @@ test_dpi_dispatch_delete(void)
 }
 
 
+#define TEST_BATCH_PKTS 3
+static uint64_t g_handler_counts[TEST_BATCH_PKTS];
+static size_t g_handler_calls;
+static size_t g_batch_handler_calls;
+static size_t g_batch_handler_pkts;
+static uint64_t g_batch_handler_count;
+static bool g_batch_handler_ordered;
+
+
+static void
+test_batch_dpi_handler(struct fsm_session *session,
+                       struct net_header_parser *net_parser)
+{
+    if (g_handler_calls < TEST_BATCH_PKTS)
+    {
+        g_handler_counts[g_handler_calls] = net_parser->acc->counters.packets_count;
+    }
+    g_handler_calls++;
+}
+
+
+static size_t
+test_batch_dpi_batch_handler(struct fsm_session *session,
+                             struct net_header_parser **pkts, size_t n)
+{
+    size_t i;
+
+    g_batch_handler_calls++;
+    g_batch_handler_pkts += n;
+    g_batch_handler_count = pkts[0]->acc->counters.packets_count;
+
+    /* The packets of the flow are presented in arrival order */
+    for (i = 1; i < n; i++) g_batch_handler_ordered &= (pkts[i] == pkts[i - 1] + 1);
+
+    return n;
+}
+
+
+/**
+ * @brief presents a batch of packets of a single flow to the dispatcher
+ *
+ * @param plugin_ops the dpi plugin operations to test
+ */
+static void
+test_dpi_batch_dispatch(struct fsm_dpi_plugin_ops *plugin_ops)
+{
+    struct net_header_parser parsers[TEST_BATCH_PKTS];
+    struct schema_Flow_Service_Manager_Config *conf;
+    struct fsm_parser_ops *dispatch_ops;
+    struct fsm_session *dispatcher;
+    struct fsm_session *plugin;
+    ds_tree_t *sessions;
+    size_t len;
+    size_t i;
+
+    g_handler_calls = 0;
+    g_batch_handler_calls = 0;
+    g_batch_handler_pkts = 0;
+    g_batch_handler_count = 0;
+    g_batch_handler_ordered = true;
+    memset(g_handler_counts, 0, sizeof(g_handler_counts));
+
+    /* Add a dpi plugin session */
+    conf = &g_confs[7];
+    fsm_add_session(conf);
+    sessions = fsm_get_sessions();
+    plugin = ds_tree_find(sessions, conf->handler);
+    TEST_ASSERT_NOT_NULL(plugin);
+    plugin->p_ops->dpi_plugin_ops = *plugin_ops;
+
+    /* Add a dpi dispatcher session */
+    conf = &g_confs[6];
+    fsm_add_session(conf);
+    dispatcher = ds_tree_find(sessions, conf->handler);
+    TEST_ASSERT_NOT_NULL(dispatcher);
+
+    /* Prepare packets of the same flow */
+    memset(parsers, 0, sizeof(parsers));
+    for (i = 0; i < TEST_BATCH_PKTS; i++)
+    {
+        UT_CREATE_PCAP_PAYLOAD(pkt372, &parsers[i]);
+        len = net_header_parse(&parsers[i]);
+        TEST_ASSERT_TRUE(len != 0);
+    }
+
+    /* Call the dispatcher's batch handler */
+    dispatch_ops = &dispatcher->p_ops->parser_ops;
+    TEST_ASSERT_NOT_NULL(dispatch_ops->batch_handler);
+    dispatch_ops->batch_handler(dispatcher, parsers, TEST_BATCH_PKTS);
+
+    /* All the packets were bound to the same flow */
+    TEST_ASSERT_NOT_NULL(parsers[0].acc);
+    for (i = 1; i < TEST_BATCH_PKTS; i++)
+    {
+        TEST_ASSERT_TRUE(parsers[i].acc == parsers[0].acc);
+    }
+    TEST_ASSERT_EQUAL_UINT64(TEST_BATCH_PKTS, parsers[0].acc->counters.packets_count);
+
+    /* Remove the dpi dispatch session */
+    conf = &g_confs[6];
+    fsm_delete_session(conf);
+
+    /* Remove the dpi plugin session */
+    conf = &g_confs[7];
+    fsm_delete_session(conf);
+}
+
+
+/**
+ * @brief validate the batched dispatch to a per packet dpi plugin
+ *
+ * Each packet is dispatched right after being bound to its flow:
+ * the plugin sees the flow counters up to the current packet.
+ */
+void
+test_dpi_batch_dispatch_per_pkt(void)
+{
+    struct fsm_dpi_plugin_ops plugin_ops =
+    {
+        .handler = test_batch_dpi_handler,
+        .dpi_free_resources = dummy_dpi_plugin_free_resources,
+    };
+    size_t i;
+
+    test_dpi_batch_dispatch(&plugin_ops);
+
+    TEST_ASSERT_EQUAL_UINT(TEST_BATCH_PKTS, g_handler_calls);
+    for (i = 0; i < TEST_BATCH_PKTS; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT64(i + 1, g_handler_counts[i]);
+    }
+}
+
+
+/**
+ * @brief validate the batched dispatch to a batch capable dpi plugin
+ *
+ * The packets of the flow are presented as one burst.
+ * The flow counters account for the whole burst.
+ */
+void
+test_dpi_batch_dispatch_burst(void)
+{
+    struct fsm_dpi_plugin_ops plugin_ops =
+    {
+        .handler = test_batch_dpi_handler,
+        .batch_handler = test_batch_dpi_batch_handler,
+        .dpi_free_resources = dummy_dpi_plugin_free_resources,
+    };
+
+    test_dpi_batch_dispatch(&plugin_ops);
+
+    TEST_ASSERT_EQUAL_UINT(0, g_handler_calls);
+    TEST_ASSERT_EQUAL_UINT(1, g_batch_handler_calls);
+    TEST_ASSERT_EQUAL_UINT(TEST_BATCH_PKTS, g_batch_handler_pkts);
+    TEST_ASSERT_EQUAL_UINT64(TEST_BATCH_PKTS, g_batch_handler_count);
+    TEST_ASSERT_TRUE(g_batch_handler_ordered);
+}
+
+
+static size_t g_tpacket_batch_calls;
+static size_t g_tpacket_batch_pkts;
+static size_t g_tpacket_batch_max;
+static bool g_tpacket_batch_parsed;
+
+
+static void
+test_tpacket_batch_handler(struct fsm_session *session,
+                           struct net_header_parser *parsers, size_t count)
+{
+    size_t i;
+
+    g_tpacket_batch_calls++;
+    g_tpacket_batch_pkts += count;
+    if (count > g_tpacket_batch_max) g_tpacket_batch_max = count;
+    for (i = 0; i < count; i++)
+    {
+        g_tpacket_batch_parsed &= (parsers[i].caplen == sizeof(pkt372));
+        g_tpacket_batch_parsed &= (parsers[i].parsed != 0);
+        g_tpacket_batch_parsed &= (parsers[i].ip_version == 4);
+    }
+}
+
+
+/**
+ * @brief walks a fake TPACKET_V3 block holding copies of a packet
+ *
+ * @param num_pkts the number of frames of the block
+ */
+static void
+test_tpacket_walk_block(uint32_t num_pkts)
+{
+    struct tpacket_block_desc *pbd;
+    union fsm_plugin_ops p_ops;
+    struct fsm_session session;
+    struct fsm_tpacket tpacket;
+    struct tpacket3_hdr *hdr;
+    size_t frame_size;
+    size_t mac_off;
+    size_t first;
+    uint8_t *block;
+    uint32_t i;
+
+    g_tpacket_batch_calls = 0;
+    g_tpacket_batch_pkts = 0;
+    g_tpacket_batch_max = 0;
+    g_tpacket_batch_parsed = true;
+
+    /* Lay out the frames as the kernel does */
+    first = TPACKET_ALIGN(sizeof(*pbd));
+    mac_off = TPACKET_ALIGN(sizeof(*hdr)) + 4;
+    frame_size = TPACKET_ALIGN(mac_off + sizeof(pkt372));
+    block = CALLOC(1, first + (num_pkts * frame_size));
+    TEST_ASSERT_NOT_NULL(block);
+
+    pbd = (struct tpacket_block_desc *)block;
+    pbd->hdr.bh1.num_pkts = num_pkts;
+    pbd->hdr.bh1.offset_to_first_pkt = first;
+    for (i = 0; i < num_pkts; i++)
+    {
+        hdr = (struct tpacket3_hdr *)(block + first + (i * frame_size));
+        hdr->tp_next_offset = frame_size;
+        hdr->tp_mac = mac_off;
+        hdr->tp_snaplen = sizeof(pkt372);
+        hdr->tp_len = sizeof(pkt372);
+        memcpy((uint8_t *)hdr + mac_off, pkt372, sizeof(pkt372));
+    }
+
+    memset(&p_ops, 0, sizeof(p_ops));
+    p_ops.parser_ops.batch_handler = test_tpacket_batch_handler;
+
+    memset(&tpacket, 0, sizeof(tpacket));
+    tpacket.parser.pcap_datalink = DLT_EN10MB;
+    tpacket.batch = CALLOC(FSM_TPACKET_BATCH_MAX, sizeof(*tpacket.batch));
+    TEST_ASSERT_NOT_NULL(tpacket.batch);
+
+    memset(&session, 0, sizeof(session));
+    session.p_ops = &p_ops;
+    session.tpacket = &tpacket;
+
+    fsm_tpacket_walk_block(&session, pbd);
+
+    /* All the frames were handed over before the block is released */
+    TEST_ASSERT_EQUAL_UINT(0, tpacket.batch_cnt);
+    TEST_ASSERT_EQUAL_UINT(num_pkts, g_tpacket_batch_pkts);
+    TEST_ASSERT_TRUE(g_tpacket_batch_max <= FSM_TPACKET_BATCH_MAX);
+    TEST_ASSERT_TRUE(g_tpacket_batch_parsed);
+
+    FREE(tpacket.batch);
+    FREE(block);
+}
+
+
+/**
+ * @brief validate the delivery of a TPACKET_V3 block to a batch handler
+ */
+void
+test_tpacket_batch_delivery(void)
+{
+    if (!kconfig_enabled(CONFIG_FSM_TAP_INTF))
+    {
+        TEST_IGNORE_MESSAGE("The tap interfaces are disabled");
+    }
+
+    /* A block fitting in one batch is delivered at once */
+    test_tpacket_walk_block(TEST_BATCH_PKTS);
+    TEST_ASSERT_EQUAL_UINT(1, g_tpacket_batch_calls);
+    TEST_ASSERT_EQUAL_UINT(TEST_BATCH_PKTS, g_tpacket_batch_max);
+
+    /* Larger blocks are delivered in full batches, then the remainder */
+    test_tpacket_walk_block(FSM_TPACKET_BATCH_MAX + TEST_BATCH_PKTS);
+    TEST_ASSERT_EQUAL_UINT(2, g_tpacket_batch_calls);
+    TEST_ASSERT_EQUAL_UINT(FSM_TPACKET_BATCH_MAX, g_tpacket_batch_max);
+}
+
+
 /**
  * @brief validate the timing out of a flow
  *
@@ -3849,6 +4125,12 @@ test_fsm_tap_type_from_str(void)
     retval = fsm_tap_type_from_str("fsm_tap_pcap,fsm_tap_nfqueues");
     TEST_ASSERT_EQUAL((FSM_TAP_PCAP | FSM_TAP_NFQ), retval);
 
+    retval = fsm_tap_type_from_str("fsm_tap_tpacket");
+    TEST_ASSERT_EQUAL(FSM_TAP_TPACKET, retval);
+
+    retval = fsm_tap_type_from_str("fsm_tap_tpacket,fsm_tap_nfqueues");
+    TEST_ASSERT_EQUAL((FSM_TAP_TPACKET | FSM_TAP_NFQ), retval);
+
     retval = fsm_tap_type_from_str("broken");
     TEST_ASSERT_EQUAL(FSM_TAP_PCAP, retval);
 
@@ -5573,6 +5855,9 @@ main(int argc, char *argv[])
     RUN_TEST(test_dpi_dispatcher_no_ip_pkt);
     RUN_TEST(test_fsm_tap_type_from_str);
     RUN_TEST(test_dpi_dispatch_delete);
+    RUN_TEST(test_dpi_batch_dispatch_per_pkt);
+    RUN_TEST(test_dpi_batch_dispatch_burst);
+    RUN_TEST(test_tpacket_batch_delivery);
     RUN_TEST(test_parser_webcat_session);
     RUN_TEST(test_webcat_parser_session);
     RUN_TEST(test_dispatcher_device_process);
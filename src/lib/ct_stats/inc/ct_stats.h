@@ -35,6 +35,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "network_metadata_report.h"
 #include "nf_utils.h"
 #include "fsm_policy.h"
+#include "ct_stats_flow_index.h"
 
 #define MAX_CT_STATS        (256)
 #define MAX_IPV4_IPV6_LEN    (46)
@@ -67,6 +68,15 @@ typedef struct flow_stats_
     struct fcm_filter_client *r_client;
     size_t n_device2apps;
     ds_tree_t device2apps;
+
+    /* event driven collection */
+    bool ct_events;          /* maintain ct_index from ctnetlink events */
+    ds_tree_t ct_index;      /* struct ct_stats_flow, keyed by tuple + zone */
+    size_t ct_index_count;
+    ds_dlist_t ct_dirty;     /* flows changed since the last sampling */
+    uint32_t resync_cycles;  /* full dump every resync_cycles collections */
+    uint32_t cycles;
+    uint32_t overruns;       /* last seen event socket overrun count */
 } flow_stats_t;
 
 
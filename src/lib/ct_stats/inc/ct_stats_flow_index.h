@@ -0,0 +1,76 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CT_STATS_FLOW_INDEX_H_INCLUDED
+#define CT_STATS_FLOW_INDEX_H_INCLUDED
+
+#include <stdbool.h>
+
+#include "ds_dlist.h"
+#include "ds_tree.h"
+#include "nf_utils.h"
+
+/* Default number of collection cycles between two full conntrack dumps */
+#define CT_STATS_RESYNC_CYCLES (6)
+
+struct flow_stats_;
+
+/**
+ * @brief persistent conntrack entry, maintained from ctnetlink events
+ *
+ * The embedded ctflow_info_t comes first so that the dirty list can be
+ * walked by ct_flow_add_sample() like any other list of parsed flows.
+ */
+struct ct_stats_flow
+{
+    ctflow_info_t info;      /* info.ct_node links the dirty list */
+    bool dirty;              /* changed since the last sampling */
+    bool seen;               /* present in the ongoing resync dump */
+    ds_tree_node_t ct_index_node;
+};
+
+void
+ct_stats_flow_index_init(struct flow_stats_ *ct_stats);
+
+void
+ct_stats_flow_index_update(struct flow_stats_ *ct_stats, ds_dlist_t *ct_list);
+
+void
+ct_stats_flow_index_resync_flow(struct flow_stats_ *ct_stats, ct_flow_t *flow);
+
+void
+ct_stats_flow_index_resync_done(struct flow_stats_ *ct_stats, bool complete);
+
+void
+ct_stats_flow_index_resync(struct flow_stats_ *ct_stats, ds_dlist_t *ct_list);
+
+void
+ct_stats_flow_index_flush(struct flow_stats_ *ct_stats);
+
+void
+ct_stats_flow_index_free(struct flow_stats_ *ct_stats);
+
+#endif /* CT_STATS_FLOW_INDEX_H_INCLUDED */
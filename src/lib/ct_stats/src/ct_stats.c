@@ -365,118 +365,133 @@ apply_filter(flow_stats_t *ct_stats, fcm_filter_l2_info_t *mac_filter,
 }
 
 /**
- * @brief adds collected conntrack info to the plugin aggregator
+ * @brief adds a conntrack flow to the plugin aggregator
  *
  * @param ct_stats the aggregator container
+ * @param flow the flow to add
+ * @return -1 on aggregator error, 1 if the flow was sampled, 0 otherwise
  */
-void
-ct_flow_add_sample(flow_stats_t *ct_stats)
+static int
+ct_flow_add_one_sample(flow_stats_t *ct_stats, ct_flow_t *flow)
 {
     struct net_md_aggregator *aggr;
     struct flow_counters pkts_ct;
     struct net_md_flow_key key;
+    bool                     smac_lookup;
+    bool                     dmac_lookup;
+    bool                     skip_flow;
+    fcm_filter_l2_info_t     mac_filter;
+    struct sockaddr_storage *ssrc;
+    struct sockaddr_storage *sdst;
+    os_macaddr_t             smac;
+    os_macaddr_t             dmac;
+    int                      af;
+    bool ret;
+
+    aggr = ct_stats->aggr;
+
+    memset(&smac, 0, sizeof(os_macaddr_t));
+    memset(&dmac, 0, sizeof(os_macaddr_t));
+
+    af = flow->layer3_info.src_ip.ss_family;
+
+    ssrc = &flow->layer3_info.src_ip;
+    sdst = &flow->layer3_info.dst_ip;
+
+    // Lookup source ip.
+    smac_lookup = neigh_table_lookup(ssrc, &smac);
+    dmac_lookup = neigh_table_lookup(sdst, &dmac);
+
+    ct_stats->node_count++;
+    /* add only if smac or dmac is present */
+    if (!(smac_lookup ^ dmac_lookup)) return 0;
+
+    snprintf(mac_filter.src_mac, sizeof(mac_filter.src_mac),
+             "%02x:%02x:%02x:%02x:%02x:%02x",
+             smac.addr[0], smac.addr[1],
+             smac.addr[2], smac.addr[3],
+             smac.addr[4], smac.addr[5]);
+    snprintf(mac_filter.dst_mac, sizeof(mac_filter.src_mac),
+             "%02x:%02x:%02x:%02x:%02x:%02x",
+             dmac.addr[0], dmac.addr[1],
+             dmac.addr[2], dmac.addr[3],
+             dmac.addr[4], dmac.addr[5]);
+
+
+    skip_flow = nf_ct_filter_ip(af, &flow->layer3_info.dst_ip);
+    if (skip_flow) return 0;
+
+    skip_flow = nf_ct_filter_ip(af, &flow->layer3_info.src_ip);
+    if (skip_flow) return 0;
+
+    if (!apply_filter(ct_stats, &mac_filter, flow)) return 0;
+
+    memset(&key, 0, sizeof(struct net_md_flow_key));
+    memset(&pkts_ct, 0, sizeof(struct flow_counters));
+    if (smac_lookup) key.smac = &smac;
+    if (dmac_lookup) key.dmac = &dmac;
+
+    key.ip_version = (af == AF_INET ? 4 : 6);
+    if (af == AF_INET)
+    {
+        struct sockaddr_in *ssrc;
+        struct sockaddr_in *sdst;
+
+        ssrc = (struct sockaddr_in *)&flow->layer3_info.src_ip;
+        sdst = (struct sockaddr_in *)&flow->layer3_info.dst_ip;
+        key.src_ip = (uint8_t *)&ssrc->sin_addr.s_addr;
+        key.dst_ip = (uint8_t *)&sdst->sin_addr.s_addr;
+    }
+    else if (af == AF_INET6)
+    {
+        struct sockaddr_in6 *ssrc;
+        struct sockaddr_in6 *sdst;
+
+        ssrc = (struct sockaddr_in6 *)&flow->layer3_info.src_ip;
+        sdst = (struct sockaddr_in6 *)&flow->layer3_info.dst_ip;
+        key.src_ip = ssrc->sin6_addr.s6_addr;
+        key.dst_ip = sdst->sin6_addr.s6_addr;
+    }
+    key.ipprotocol = flow->layer3_info.proto_type;
+    key.sport = flow->layer3_info.src_port;
+    key.dport = flow->layer3_info.dst_port;
+    key.flowmarker = flow->ct_mark;
+    pkts_ct.packets_count = flow->pkt_info.pkt_cnt;
+    pkts_ct.bytes_count = flow->pkt_info.bytes;
+    if (flow->start) key.fstart = true;
+    if (flow->end) key.fend = true;
+
+    ret = net_md_add_sample(aggr, &key, &pkts_ct);
+    if (!ret)
+    {
+        LOGW("%s: some error with net_md_add_sample", __func__);
+        return -1;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief adds collected conntrack info to the plugin aggregator
+ *
+ * @param ct_stats the aggregator container
+ */
+void
+ct_flow_add_sample(flow_stats_t *ct_stats)
+{
     ctflow_info_t *flow_info;
     ds_dlist_t *ctflow_list;
     int sample_count;
-    ct_flow_t *flow;
-    bool ret;
+    int rc;
 
-    aggr = ct_stats->aggr;
     sample_count = 0;
 
     ctflow_list = (ct_stats->ctflow_event_list != NULL) ? ct_stats->ctflow_event_list : &ct_stats->ctflow_list;
     ds_dlist_foreach(ctflow_list, flow_info)
     {
-        bool                     smac_lookup;
-        bool                     dmac_lookup;
-        bool                     skip_flow;
-        fcm_filter_l2_info_t     mac_filter;
-        struct sockaddr_storage *ssrc;
-        struct sockaddr_storage *sdst;
-        os_macaddr_t             smac;
-        os_macaddr_t             dmac;
-        int                      af;
-
-        memset(&smac, 0, sizeof(os_macaddr_t));
-        memset(&dmac, 0, sizeof(os_macaddr_t));
-
-        flow = &flow_info->flow;
-        af = flow->layer3_info.src_ip.ss_family;
-
-        ssrc = &flow->layer3_info.src_ip;
-        sdst = &flow->layer3_info.dst_ip;
-
-        // Lookup source ip.
-        smac_lookup = neigh_table_lookup(ssrc, &smac);
-        dmac_lookup = neigh_table_lookup(sdst, &dmac);
-
-        ct_stats->node_count++;
-        /* add only if smac or dmac is present */
-        if (!(smac_lookup ^ dmac_lookup)) continue;
-
-        snprintf(mac_filter.src_mac, sizeof(mac_filter.src_mac),
-                 "%02x:%02x:%02x:%02x:%02x:%02x",
-                 smac.addr[0], smac.addr[1],
-                 smac.addr[2], smac.addr[3],
-                 smac.addr[4], smac.addr[5]);
-        snprintf(mac_filter.dst_mac, sizeof(mac_filter.src_mac),
-                 "%02x:%02x:%02x:%02x:%02x:%02x",
-                 dmac.addr[0], dmac.addr[1],
-                 dmac.addr[2], dmac.addr[3],
-                 dmac.addr[4], dmac.addr[5]);
-
-
-        skip_flow = nf_ct_filter_ip(af, &flow->layer3_info.dst_ip);
-        if (skip_flow) continue;
-
-        skip_flow = nf_ct_filter_ip(af, &flow->layer3_info.src_ip);
-        if (skip_flow) continue;
-
-        if (apply_filter(ct_stats, &mac_filter, flow))
-        {
-            memset(&key, 0, sizeof(struct net_md_flow_key));
-            memset(&pkts_ct, 0, sizeof(struct flow_counters));
-            if (smac_lookup) key.smac = &smac;
-            if (dmac_lookup) key.dmac = &dmac;
-
-            key.ip_version = (af == AF_INET ? 4 : 6);
-            if (af == AF_INET)
-            {
-                struct sockaddr_in *ssrc;
-                struct sockaddr_in *sdst;
-
-                ssrc = (struct sockaddr_in *)&flow->layer3_info.src_ip;
-                sdst = (struct sockaddr_in *)&flow->layer3_info.dst_ip;
-                key.src_ip = (uint8_t *)&ssrc->sin_addr.s_addr;
-                key.dst_ip = (uint8_t *)&sdst->sin_addr.s_addr;
-            }
-            else if (af == AF_INET6)
-            {
-                struct sockaddr_in6 *ssrc;
-                struct sockaddr_in6 *sdst;
-
-                ssrc = (struct sockaddr_in6 *)&flow->layer3_info.src_ip;
-                sdst = (struct sockaddr_in6 *)&flow->layer3_info.dst_ip;
-                key.src_ip = ssrc->sin6_addr.s6_addr;
-                key.dst_ip = sdst->sin6_addr.s6_addr;
-            }
-            key.ipprotocol = flow->layer3_info.proto_type;
-            key.sport = flow->layer3_info.src_port;
-            key.dport = flow->layer3_info.dst_port;
-            key.flowmarker = flow->ct_mark;
-            pkts_ct.packets_count = flow->pkt_info.pkt_cnt;
-            pkts_ct.bytes_count = flow->pkt_info.bytes;
-            if (flow->start) key.fstart = true;
-            if (flow->end) key.fend = true;
-            sample_count++;
-
-            ret = net_md_add_sample(aggr, &key, &pkts_ct);
-            if (!ret)
-            {
-                LOGW("%s: some error with net_md_add_sample", __func__);
-                break;
-            }
-        }
+        rc = ct_flow_add_one_sample(ct_stats, &flow_info->flow);
+        if (rc < 0) break;
+        sample_count += rc;
     }
 
     if (LOG_SEVERITY_ENABLED(LOG_SEVERITY_TRACE))
@@ -487,6 +502,57 @@ ct_flow_add_sample(flow_stats_t *ct_stats)
     free_ct_flow_list(ct_stats);
 }
 
+/**
+ * @brief sink of a streamed conntrack dump, sampling each flow
+ *
+ * @param flow the flow decoded from the dump
+ * @param ctx the ct_stats instance
+ * @return false to stop the dump on aggregator error
+ */
+static bool
+ct_stats_sample_sink(ct_flow_t *flow, void *ctx)
+{
+    flow_stats_t *ct_stats = ctx;
+
+    return (ct_flow_add_one_sample(ct_stats, flow) >= 0);
+}
+
+/**
+ * @brief samples the conntrack table straight out of the dump replies
+ *
+ * Flows are added to the aggregator as they are decoded, without
+ * building the intermediate list of ct_get_stats().
+ *
+ * @param ct_stats the aggregator container
+ * @return 0 on success, -1 otherwise
+ */
+static int
+ct_stats_stream_samples(flow_stats_t *ct_stats)
+{
+    bool rc;
+
+    rc = nf_ct_stream_flow_entries(AF_INET, ct_stats->ct_zone,
+                                   ct_stats_sample_sink, ct_stats);
+    if (!rc)
+    {
+        LOGE("%s: IPV4 conntrack flow collection error", __func__);
+        return -1;
+    }
+
+    rc = nf_ct_stream_flow_entries(AF_INET6, ct_stats->ct_zone,
+                                   ct_stats_sample_sink, ct_stats);
+    if (!rc)
+    {
+        LOGE("%s: IPv6 conntrack flow collection error", __func__);
+        return -1;
+    }
+
+    LOGT("%s: sampled %d flows", __func__, ct_stats->node_count);
+    ct_stats->node_count = 0;
+
+    return 0;
+}
+
 void
 ct_stats_update_flow(struct net_md_stats_accumulator *acc, int action)
 {
@@ -915,11 +981,106 @@ ct_stats_process_ct_event(fcm_collect_plugin_t *collector, void *data)
     ct_stats = collector->plugin_ctx;
     if (ct_stats != mgr->active) return;
 
+    /* In event mode, flows are sampled at the next collection */
+    if (ct_stats->ct_events)
+    {
+        ct_stats_flow_index_update(ct_stats, (ds_dlist_t *)data);
+        return;
+    }
+
     ct_stats->ctflow_event_list = (ds_dlist_t *)data;
     ct_flow_add_sample(ct_stats);
     ct_stats->ctflow_event_list = NULL;
 }
 
+
+/**
+ * @brief sink of a streamed resync dump, reconciling the flow index
+ */
+static bool
+ct_stats_resync_sink(ct_flow_t *flow, void *ctx)
+{
+    flow_stats_t *ct_stats = ctx;
+
+    ct_stats_flow_index_resync_flow(ct_stats, flow);
+    return true;
+}
+
+
+/**
+ * @brief reconciles the flow index with a streamed conntrack dump
+ *
+ * Indexed flows are only closed when both dumps completed, a failed dump
+ * would otherwise close all the flows it did not reach.
+ *
+ * @param ct_stats the collector instance
+ * @return 0 on success, -1 otherwise
+ */
+static int
+ct_stats_stream_resync(flow_stats_t *ct_stats)
+{
+    bool rc;
+
+    rc = nf_ct_stream_flow_entries(AF_INET, ct_stats->ct_zone,
+                                   ct_stats_resync_sink, ct_stats);
+    if (rc)
+    {
+        rc = nf_ct_stream_flow_entries(AF_INET6, ct_stats->ct_zone,
+                                       ct_stats_resync_sink, ct_stats);
+    }
+    if (!rc) LOGE("%s: conntrack flow collection error", __func__);
+
+    ct_stats_flow_index_resync_done(ct_stats, rc);
+
+    return (rc ? 0 : -1);
+}
+
+
+/**
+ * @brief samples the flows changed since the last collection
+ *
+ * The flow index is kept up to date by conntrack events. A full dump
+ * reconciles it on the first collection, after the kernel dropped events
+ * and every resync_cycles collections, refreshing the counters of long
+ * lived flows which did not generate any event.
+ *
+ * @param ct_stats the collector instance
+ */
+static void
+ct_stats_collect_events(flow_stats_t *ct_stats)
+{
+    uint32_t overruns;
+    bool resync;
+    int rc;
+
+    overruns = nf_ct_get_event_overruns();
+    resync = (ct_stats->cycles == 0);
+    resync |= (overruns != ct_stats->overruns);
+    if (ct_stats->resync_cycles != 0)
+    {
+        resync |= ((ct_stats->cycles % ct_stats->resync_cycles) == 0);
+    }
+    ct_stats->cycles++;
+
+    if (resync)
+    {
+        if (overruns != ct_stats->overruns)
+        {
+            LOGN("%s: conntrack events lost, resynchronizing", __func__);
+        }
+        ct_stats->overruns = overruns;
+
+        rc = ct_stats_stream_resync(ct_stats);
+        if (rc == -1) ct_stats->cycles = 0;
+    }
+
+    ct_stats->ctflow_event_list = &ct_stats->ct_dirty;
+    ct_flow_add_sample(ct_stats);
+    ct_stats->ctflow_event_list = NULL;
+
+    ct_stats_flow_index_flush(ct_stats);
+}
+
 /**
  * @brief triggers conntrack records collection
  *
@@ -930,7 +1091,6 @@ ct_stats_collect_cb(fcm_collect_plugin_t *collector)
 {
     flow_stats_t *ct_stats;
     flow_stats_mgr_t *mgr;
-    int rc;
 
     if (collector == NULL) return;
 
@@ -938,14 +1098,10 @@ ct_stats_collect_cb(fcm_collect_plugin_t *collector)
     ct_stats = collector->plugin_ctx;
     if (ct_stats != mgr->active) return;
 
-    rc = ct_get_stats();
-    if (rc == -1) return;
-
-    ct_stats = collector->plugin_ctx;
     ct_stats->collect_filter = collector->filters.collect;
 
-    ct_flow_add_sample(ct_stats);
-
+    if (ct_stats->ct_events) ct_stats_collect_events(ct_stats);
+    else ct_stats_stream_samples(ct_stats);
 }
 
 
@@ -1034,6 +1190,8 @@ ct_stats_plugin_init(fcm_collect_plugin_t *collector)
     flow_stats_t *ct_stats;
     flow_stats_mgr_t *mgr;
     char *str_max_flows;
+    char *ct_events;
+    char *ct_resync;
     char *ct_zone;
     char *active;
     char *name;
@@ -1089,6 +1247,16 @@ ct_stats_plugin_init(fcm_collect_plugin_t *collector)
     else ct_stats->ct_zone = 0;
     LOGD("%s: configured zone: %d", __func__, ct_stats->ct_zone);
 
+    /* Track conntrack events instead of dumping the table every cycle */
+    ct_events = collector->get_other_config(collector, "ct_events");
+    ct_stats->ct_events = (ct_events != NULL && !strcmp(ct_events, "true"));
+    ct_resync = collector->get_other_config(collector, "ct_resync_cycles");
+    if (ct_resync) ct_stats->resync_cycles = strtoul(ct_resync, NULL, 10);
+    else ct_stats->resync_cycles = CT_STATS_RESYNC_CYCLES;
+    ct_stats_flow_index_init(ct_stats);
+    LOGD("%s: conntrack events: %s, resync cycles: %u", __func__,
+         ct_stats->ct_events ? "enabled" : "disabled", ct_stats->resync_cycles);
+
     rc = ct_stats_alloc_aggr(ct_stats);
     if (rc != 0) return -1;
 
@@ -1117,6 +1285,14 @@ ct_stats_plugin_init(fcm_collect_plugin_t *collector)
     rc = ct_stats_activate_window(collector);
     if (rc != 0) goto err;
 
+    /* New and destroy events are only reported to maintain the flow index */
+    if (ct_stats->ct_events && nf_ct_set_flow_events(true) != 0)
+    {
+        LOGW("%s: conntrack events unavailable, dumping the table instead",
+             __func__);
+        ct_stats->ct_events = false;
+    }
+
     ct_stats->initialized = true;
 
     /* Check if the session has a name */
@@ -1183,6 +1359,9 @@ ct_stats_plugin_exit(fcm_collect_plugin_t *collector)
     net_md_free_aggregator(aggr);
     FREE(aggr);
 
+    if (ct_stats->ct_events) nf_ct_set_flow_events(false);
+    ct_stats_flow_index_free(ct_stats);
+
     /* delete the session */
     ds_tree_remove(&mgr->ct_stats_sessions, ct_stats);
     FREE(ct_stats);
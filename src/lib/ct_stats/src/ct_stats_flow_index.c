@@ -0,0 +1,284 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "log.h"
+#include "memutil.h"
+#include "ds_dlist.h"
+#include "ds_tree.h"
+#include "nf_utils.h"
+#include "ct_stats.h"
+#include "ct_stats_flow_index.h"
+
+
+/**
+ * @brief compares two conntrack entries by tuple and zone
+ *
+ * @param a the first ct_flow_t
+ * @param b the second ct_flow_t
+ */
+static int
+ct_stats_flow_cmp(const void *a, const void *b)
+{
+    const ct_flow_t *fa = a;
+    const ct_flow_t *fb = b;
+    int cmp;
+
+    cmp = (int)fa->ct_zone - (int)fb->ct_zone;
+    if (cmp != 0) return cmp;
+
+    return memcmp(&fa->layer3_info, &fb->layer3_info,
+                  sizeof(fa->layer3_info));
+}
+
+
+/**
+ * @brief queues an indexed flow for the next sampling
+ *
+ * @param ct_stats the flow index container
+ * @param entry the flow to queue
+ */
+static void
+ct_stats_flow_mark_dirty(flow_stats_t *ct_stats, struct ct_stats_flow *entry)
+{
+    if (entry->dirty) return;
+
+    entry->dirty = true;
+    ds_dlist_insert_tail(&ct_stats->ct_dirty, entry);
+}
+
+
+/**
+ * @brief returns the indexed flow matching the given flow, adding it if new
+ *
+ * @param ct_stats the flow index container
+ * @param flow the flow to look up
+ * @param new set to true if the flow was not indexed yet
+ * @return the indexed flow, NULL on allocation failure
+ */
+static struct ct_stats_flow *
+ct_stats_flow_get(flow_stats_t *ct_stats, ct_flow_t *flow, bool *new)
+{
+    struct ct_stats_flow *entry;
+
+    *new = false;
+    entry = ds_tree_find(&ct_stats->ct_index, flow);
+    if (entry != NULL) return entry;
+
+    entry = CALLOC(1, sizeof(*entry));
+    if (entry == NULL) return NULL;
+
+    entry->info.flow = *flow;
+    ds_tree_insert(&ct_stats->ct_index, entry, &entry->info.flow);
+    ct_stats->ct_index_count++;
+    *new = true;
+
+    return entry;
+}
+
+
+/**
+ * @brief initializes the persistent conntrack flow index
+ *
+ * @param ct_stats the flow index container
+ */
+void
+ct_stats_flow_index_init(flow_stats_t *ct_stats)
+{
+    ds_tree_init(&ct_stats->ct_index, ct_stats_flow_cmp,
+                 struct ct_stats_flow, ct_index_node);
+    ds_dlist_init(&ct_stats->ct_dirty, struct ct_stats_flow, info.ct_node);
+    ct_stats->ct_index_count = 0;
+    ct_stats->cycles = 0;
+    ct_stats->overruns = 0;
+}
+
+
+/**
+ * @brief applies a batch of conntrack events to the flow index
+ *
+ * Every flow referenced by an event is marked dirty. Update events only
+ * carry counters when conntrack accounting is enabled, so counters are
+ * kept from the previous state when the event reports none.
+ *
+ * @param ct_stats the flow index container
+ * @param ct_list the list of ctflow_info_t parsed from the events
+ */
+void
+ct_stats_flow_index_update(flow_stats_t *ct_stats, ds_dlist_t *ct_list)
+{
+    struct ct_stats_flow *entry;
+    ctflow_info_t *flow_info;
+    ct_flow_t *flow;
+    bool new;
+
+    ds_dlist_foreach(ct_list, flow_info)
+    {
+        flow = &flow_info->flow;
+
+        entry = ct_stats_flow_get(ct_stats, flow, &new);
+        if (entry == NULL) continue;
+
+        if (!new)
+        {
+            if (flow->pkt_info.pkt_cnt != 0) entry->info.flow.pkt_info = flow->pkt_info;
+            entry->info.flow.ct_mark = flow->ct_mark;
+            entry->info.flow.start = flow->start;
+            entry->info.flow.end |= flow->end;
+        }
+
+        ct_stats_flow_mark_dirty(ct_stats, entry);
+    }
+}
+
+
+/**
+ * @brief reconciles an indexed flow with its entry in a full dump
+ *
+ * The flow is marked dirty if its counters or mark moved since the last
+ * sample. ct_stats_flow_index_resync_done() completes the resync.
+ *
+ * @param ct_stats the flow index container
+ * @param flow the flow from the dump
+ */
+void
+ct_stats_flow_index_resync_flow(flow_stats_t *ct_stats, ct_flow_t *flow)
+{
+    struct ct_stats_flow *entry;
+    bool changed;
+    bool new;
+
+    entry = ct_stats_flow_get(ct_stats, flow, &new);
+    if (entry == NULL) return;
+
+    entry->seen = true;
+    changed = new;
+    changed |= (entry->info.flow.pkt_info.pkt_cnt != flow->pkt_info.pkt_cnt);
+    changed |= (entry->info.flow.pkt_info.bytes != flow->pkt_info.bytes);
+    changed |= (entry->info.flow.ct_mark != flow->ct_mark);
+    if (!changed) return;
+
+    entry->info.flow = *flow;
+    ct_stats_flow_mark_dirty(ct_stats, entry);
+}
+
+
+/**
+ * @brief completes a resync
+ *
+ * When the dump completed, flows missing from it lost their destroy event
+ * and are closed.
+ *
+ * @param ct_stats the flow index container
+ * @param complete true if the whole table was dumped
+ */
+void
+ct_stats_flow_index_resync_done(flow_stats_t *ct_stats, bool complete)
+{
+    struct ct_stats_flow *entry;
+
+    ds_tree_foreach(&ct_stats->ct_index, entry)
+    {
+        if (complete && !entry->seen)
+        {
+            entry->info.flow.end = true;
+            ct_stats_flow_mark_dirty(ct_stats, entry);
+        }
+        entry->seen = false;
+    }
+
+    LOGD("%s: %zu indexed flows", __func__, ct_stats->ct_index_count);
+}
+
+
+/**
+ * @brief reconciles the flow index with a full conntrack dump
+ *
+ * @param ct_stats the flow index container
+ * @param ct_list the list of ctflow_info_t from the dump
+ */
+void
+ct_stats_flow_index_resync(flow_stats_t *ct_stats, ds_dlist_t *ct_list)
+{
+    ctflow_info_t *flow_info;
+
+    ds_dlist_foreach(ct_list, flow_info)
+    {
+        ct_stats_flow_index_resync_flow(ct_stats, &flow_info->flow);
+    }
+
+    ct_stats_flow_index_resync_done(ct_stats, true);
+}
+
+
+/**
+ * @brief clears the dirty list once sampled, dropping terminated flows
+ *
+ * @param ct_stats the flow index container
+ */
+void
+ct_stats_flow_index_flush(flow_stats_t *ct_stats)
+{
+    struct ct_stats_flow *entry;
+
+    while (!ds_dlist_is_empty(&ct_stats->ct_dirty))
+    {
+        entry = ds_dlist_remove_head(&ct_stats->ct_dirty);
+        entry->dirty = false;
+        if (!entry->info.flow.end) continue;
+
+        ds_tree_remove(&ct_stats->ct_index, entry);
+        ct_stats->ct_index_count--;
+        FREE(entry);
+    }
+}
+
+
+/**
+ * @brief releases the flow index
+ *
+ * @param ct_stats the flow index container
+ */
+void
+ct_stats_flow_index_free(flow_stats_t *ct_stats)
+{
+    struct ct_stats_flow *entry;
+    struct ct_stats_flow *next;
+
+    ds_dlist_init(&ct_stats->ct_dirty, struct ct_stats_flow, info.ct_node);
+
+    entry = ds_tree_head(&ct_stats->ct_index);
+    while (entry != NULL)
+    {
+        next = ds_tree_next(&ct_stats->ct_index, entry);
+        ds_tree_remove(&ct_stats->ct_index, entry);
+        FREE(entry);
+        entry = next;
+    }
+    ct_stats->ct_index_count = 0;
+}
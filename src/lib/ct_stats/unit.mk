@@ -40,6 +40,7 @@ endif
 
 UNIT_SRC := src/ct_stats.c
 UNIT_SRC += src/ct_stats_remark.c
+UNIT_SRC += src/ct_stats_flow_index.c
 
 UNIT_CFLAGS := -I$(UNIT_PATH)/inc
 UNIT_CFLAGS += -Isrc/fcm/inc
@@ -418,6 +418,81 @@ test_process_v6_zones(void)
 
 
 
+/**
+ * @brief feeds the ipv4 dump as conntrack events to the flow index
+ */
+void
+test_process_v4_events(void)
+{
+    fcm_collect_plugin_t *collector;
+    struct ct_stats_flow *entry;
+    flow_stats_t *ct_stats;
+    struct mnl_buf *p_mnl;
+    ds_dlist_t ct_list;
+    size_t n_indexed;
+    size_t n_dirty;
+    uint32_t portid;
+    uint32_t seq;
+    bool loop;
+    int idx;
+    int ret;
+
+    ct_stats = ct_stats_get_active_instance();
+    TEST_ASSERT_NOT_NULL(ct_stats);
+
+    collector = ct_stats->collector;
+    TEST_ASSERT_NOT_NULL(collector);
+
+    ct_stats->ct_events = true;
+    ds_dlist_init(&ct_list, ctflow_info_t, ct_node);
+
+    loop = true;
+    idx = 0;
+    while (loop)
+    {
+        p_mnl = &g_mnl_buf_ipv4[idx];
+        portid = g_portid;
+        if (p_mnl->portid != 0) portid = p_mnl->portid;
+        seq = g_seq;
+        if (p_mnl->seq != 0) seq = p_mnl->seq;
+        ret = mnl_cb_run(p_mnl->data, p_mnl->len, seq, portid,
+                         nf_process_ct_cb, &ct_list);
+        if (ret <= MNL_CB_STOP) loop = false;
+        idx++;
+    }
+    TEST_ASSERT_FALSE(ds_dlist_is_empty(&ct_list));
+
+    /* Every event lands in the index and is queued for sampling */
+    ct_stats_process_ct_event(collector, &ct_list);
+    n_indexed = ct_stats->ct_index_count;
+    TEST_ASSERT_TRUE(n_indexed > 0);
+
+    n_dirty = 0;
+    ds_dlist_foreach(&ct_stats->ct_dirty, entry) n_dirty++;
+    TEST_ASSERT_EQUAL_UINT(n_indexed, n_dirty);
+
+    /* Replaying the same events does not duplicate flows */
+    ct_stats_process_ct_event(collector, &ct_list);
+    TEST_ASSERT_EQUAL_UINT(n_indexed, ct_stats->ct_index_count);
+    nf_free_ct_flow_list(&ct_list);
+
+    ct_stats->ctflow_event_list = &ct_stats->ct_dirty;
+    ct_flow_add_sample(ct_stats);
+    ct_stats->ctflow_event_list = NULL;
+    ct_stats_flow_index_flush(ct_stats);
+    TEST_ASSERT_TRUE(ds_dlist_is_empty(&ct_stats->ct_dirty));
+
+    /* A resync against an empty table closes all remaining flows */
+    ct_stats_flow_index_resync(ct_stats, &ct_list);
+    ct_stats_flow_index_flush(ct_stats);
+    TEST_ASSERT_EQUAL_UINT(0, ct_stats->ct_index_count);
+    TEST_ASSERT_NULL(ds_tree_head(&ct_stats->ct_index));
+
+    ct_stats->ct_events = false;
+    collector->send_report(collector);
+}
+
+
 void
 test_ct_stat_v4(void)
 {
@@ -442,6 +517,37 @@ test_ct_stat_v4(void)
 }
 
 
+static bool
+test_count_sink(ct_flow_t *flow, void *ctx)
+{
+    size_t *count = ctx;
+
+    TEST_ASSERT_NOT_NULL(flow);
+    (*count)++;
+
+    return true;
+}
+
+
+void
+test_ct_stat_stream_v4(void)
+{
+    flow_stats_t *ct_stats;
+    size_t count;
+    bool ret;
+
+    ct_stats = ct_stats_get_active_instance();
+    TEST_ASSERT_NOT_NULL(ct_stats);
+
+    /* Both directions of each record reach the sink */
+    count = 0;
+    ret = nf_ct_stream_flow_entries(AF_INET, ct_stats->ct_zone,
+                                    test_count_sink, &count);
+    TEST_ASSERT_TRUE(ret);
+    TEST_ASSERT_EQUAL_UINT(0, count % 2);
+}
+
+
 void
 test_ct_stat_v6(void)
 {
@@ -583,8 +689,10 @@ main(int argc, char *argv[])
     RUN_TEST(test_process_v6);
     RUN_TEST(test_process_v4_zones);
     RUN_TEST(test_process_v6_zones);
+    RUN_TEST(test_process_v4_events);
 #if !defined(__x86_64__)
     RUN_TEST(test_ct_stat_v4);
+    RUN_TEST(test_ct_stat_stream_v4);
     RUN_TEST(test_ct_stat_v6);
 #endif
     RUN_TEST(test_ct_stats_collect_filter_cb);
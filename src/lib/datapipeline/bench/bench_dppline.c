@@ -0,0 +1,237 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* dppline report packing benchmark
+ *
+ * Queues client reports and drains the queue twice per round: once with
+ * the current pack path (dpp_get_report2() with DPP_FAST_PACK,
+ * dpp_get_report() otherwise) and once with dpp_get_report_arena().
+ * Reports heap allocations and time spent per drained queue:
+ *
+ *     bench_dppline [-n rounds] [-r reports] [-c clients]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "memutil.h"
+#include "util.h"
+#include "dppline.h"
+
+#define BENCH_BUF_SIZE      STATS_MQTT_BUF_SZ
+#define BENCH_RATES         4
+
+/* glibc entry points, used to count the allocations of the pack paths */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static bool g_count;
+static unsigned long g_allocs;
+
+void *malloc(size_t size)
+{
+    if (g_count) g_allocs++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    if (g_count) g_allocs++;
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    if (g_count) g_allocs++;
+    return __libc_realloc(ptr, size);
+}
+
+static uint8_t g_buf[BENCH_BUF_SIZE];
+
+static void bench_put_clients(int reports, int clients)
+{
+    dpp_client_report_data_t report;
+    dpp_client_stats_rx_t *rx;
+    dpp_client_stats_tx_t *tx;
+    dpp_client_record_t *rec;
+    int r, c, i;
+
+    for (r = 0; r < reports; r++)
+    {
+        memset(&report, 0, sizeof(report));
+        ds_dlist_init(&report.list, dpp_client_record_t, node);
+        report.radio_type = RADIO_TYPE_5G;
+        report.channel = 36;
+        report.timestamp_ms = 1000 * r;
+        STRSCPY(report.uplink_type, "eth");
+
+        for (c = 0; c < clients; c++)
+        {
+            rec = dpp_client_record_alloc();
+            rec->info.type = RADIO_TYPE_5G;
+            rec->info.mac[0] = 0x02;
+            rec->info.mac[4] = c >> 8;
+            rec->info.mac[5] = c;
+            STRSCPY(rec->info.ifname, "home-ap-50");
+            STRSCPY(rec->info.essid, "bench");
+            rec->stats.bytes_tx = 1000 * c;
+            rec->stats.bytes_rx = 2000 * c;
+            rec->stats.rssi = -40 - (c % 30);
+            rec->is_connected = 1;
+            rec->connected = 1;
+            rec->duration_ms = 10000;
+
+            for (i = 0; i < BENCH_RATES; i++)
+            {
+                rx = dpp_client_stats_rx_record_alloc();
+                rx->mcs = i;
+                rx->nss = 2;
+                rx->bytes = 100 * i;
+                ds_dlist_insert_tail(&rec->stats_rx, rx);
+
+                tx = dpp_client_stats_tx_record_alloc();
+                tx->mcs = i;
+                tx->nss = 2;
+                tx->bytes = 200 * i;
+                ds_dlist_insert_tail(&rec->stats_tx, tx);
+            }
+            ds_dlist_insert_tail(&report.list, rec);
+        }
+
+        dpp_put_client(&report);
+
+        while ((rec = ds_dlist_remove_head(&report.list)) != NULL)
+        {
+            while ((rx = ds_dlist_remove_head(&rec->stats_rx)) != NULL) FREE(rx);
+            while ((tx = ds_dlist_remove_head(&rec->stats_tx)) != NULL) FREE(tx);
+            dpp_client_record_free(rec);
+        }
+    }
+}
+
+static double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool bench_get_current(uint32_t *len)
+{
+#ifdef DPP_FAST_PACK
+    uint8_t *buf = g_buf;
+    bool ret;
+
+    ret = dpp_get_report2(&buf, sizeof(g_buf), len);
+    if (buf != g_buf) FREE(buf);
+    return ret;
+#else
+    return dpp_get_report(g_buf, sizeof(g_buf), len);
+#endif
+}
+
+static bool bench_get_arena(uint32_t *len)
+{
+    return dpp_get_report_arena(g_buf, sizeof(g_buf), len);
+}
+
+/* Drain the queue, returns the number of reports produced */
+static int bench_drain(bool (*get)(uint32_t *len), unsigned long *allocs,
+                       double *elapsed, uint64_t *bytes)
+{
+    uint32_t len;
+    double start;
+    int reports;
+
+    reports = 0;
+    g_allocs = 0;
+    g_count = true;
+    start = bench_now();
+    while (dpp_get_queue_elements() > 0)
+    {
+        if (!get(&len)) break;
+        *bytes += len;
+        reports++;
+    }
+    *elapsed += bench_now() - start;
+    g_count = false;
+    *allocs += g_allocs;
+
+    return reports;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long allocs[2] = { 0, 0 };
+    double elapsed[2] = { 0, 0 };
+    uint64_t bytes[2] = { 0, 0 };
+    int reports[2] = { 0, 0 };
+    int nreports = 10;
+    int nclients = 128;
+    int rounds = 20;
+    int opt;
+    int i;
+
+    while ((opt = getopt(argc, argv, "n:r:c:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n': rounds = atoi(optarg); break;
+            case 'r': nreports = atoi(optarg); break;
+            case 'c': nclients = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-n rounds] [-r reports] [-c clients]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    log_open("BENCH_DPPLINE", LOG_OPEN_STDOUT_QUIET);
+    dpp_init();
+
+    for (i = 0; i < rounds; i++)
+    {
+        bench_put_clients(nreports, nclients);
+        reports[0] += bench_drain(bench_get_current, &allocs[0], &elapsed[0], &bytes[0]);
+
+        bench_put_clients(nreports, nclients);
+        reports[1] += bench_drain(bench_get_arena, &allocs[1], &elapsed[1], &bytes[1]);
+    }
+
+    printf("%d rounds of %d client reports x %d clients\n", rounds, nreports, nclients);
+    printf("%-8s %10s %12s %12s %12s\n", "path", "reports", "bytes", "allocs/rnd", "usec/rnd");
+    printf("%-8s %10d %12llu %12lu %12.1f\n", "current", reports[0],
+           (unsigned long long)bytes[0], allocs[0] / rounds, elapsed[0] * 1e6 / rounds);
+    printf("%-8s %10d %12llu %12lu %12.1f\n", "arena", reports[1],
+           (unsigned long long)bytes[1], allocs[1] / rounds, elapsed[1] * 1e6 / rounds);
+
+    return 0;
+}
@@ -124,6 +124,14 @@ bool dpp_get_report(uint8_t * buff, size_t sz, uint32_t * packed_sz);
 bool dpp_get_report2(uint8_t **pbuff, size_t suggest_sz, uint32_t *packed_sz);
 #endif
 
+/*
+ * Get the protobuf packed buffer, building the report in an arena
+ *
+ * Same contract as dpp_get_report(): packs as many queued stats as fit in
+ * sz, call again until the queue is empty to get the remaining reports.
+ */
+bool dpp_get_report_arena(uint8_t *buff, size_t sz, uint32_t *packed_sz);
+
 void dpp_mac_to_str(uint8_t *mac, char *str);
 char* dpp_mac_str_tmp(uint8_t *mac);
 
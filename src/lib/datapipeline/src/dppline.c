@@ -891,6 +891,165 @@ Sts__ReportType dppline_to_proto_report_type(report_type_t report_type)
     return 0;
 }
 
+/*
+ * Report tree allocator
+ *
+ * The Sts__Report tree built by dppline_add_stat_*() is normally allocated
+ * with the system allocator and released with sts__report__free_unpacked().
+ * While dpp_get_report_arena() runs, the tree is carved out of a bump arena
+ * instead and released at once by resetting the arena. The first arena
+ * block is kept across reports so that steady state reporting does not
+ * allocate at all.
+ */
+#define DPP_ARENA_BLOCK_SIZE    (64 * 1024)
+#define DPP_ARENA_ALIGN         (16)
+#define DPP_ARENA_HDR_SIZE      DPP_ARENA_ALIGN
+#define DPP_ARENA_ROUND(_sz)    (((_sz) + DPP_ARENA_ALIGN - 1) & ~((size_t)DPP_ARENA_ALIGN - 1))
+
+typedef struct dppline_arena_block
+{
+    struct dppline_arena_block     *next;
+    size_t                          size;
+    size_t                          used;
+    uint8_t                        *data;
+} dppline_arena_block_t;
+
+typedef struct
+{
+    dppline_arena_block_t          *head;  /* current block, older ones chained */
+    uint8_t                        *last;  /* last allocation, may grow in place */
+} dppline_arena_t;
+
+static dppline_arena_t g_dpp_arena;
+static bool g_dpp_arena_active = false;
+
+static dppline_arena_block_t *dppline_arena_block_new(size_t size)
+{
+    dppline_arena_block_t *b;
+
+    b = MALLOC(sizeof(*b) + DPP_ARENA_ALIGN + size);
+    b->next = NULL;
+    b->size = size;
+    b->used = 0;
+    b->data = (uint8_t *)DPP_ARENA_ROUND((uintptr_t)(b + 1));
+
+    return b;
+}
+
+static void *dppline_arena_alloc(size_t sz)
+{
+    dppline_arena_t *a = &g_dpp_arena;
+    dppline_arena_block_t *b;
+    size_t need;
+    uint8_t *p;
+
+    need = DPP_ARENA_HDR_SIZE + DPP_ARENA_ROUND(sz);
+
+    b = a->head;
+    if (b == NULL || b->used + need > b->size)
+    {
+        b = dppline_arena_block_new(need > DPP_ARENA_BLOCK_SIZE ? need : DPP_ARENA_BLOCK_SIZE);
+        b->next = a->head;
+        a->head = b;
+    }
+
+    p = b->data + b->used;
+    b->used += need;
+    *(size_t *)p = sz;
+    p += DPP_ARENA_HDR_SIZE;
+    a->last = p;
+
+    return p;
+}
+
+static void *dppline_arena_realloc(void *ptr, size_t sz)
+{
+    dppline_arena_t *a = &g_dpp_arena;
+    dppline_arena_block_t *b = a->head;
+    size_t old_sz;
+    size_t grow;
+    void *p;
+
+    if (ptr == NULL) return dppline_arena_alloc(sz);
+
+    old_sz = *(size_t *)((uint8_t *)ptr - DPP_ARENA_HDR_SIZE);
+    if (sz <= old_sz) return ptr;
+
+    /* extend the last allocation in place when the block has room */
+    grow = DPP_ARENA_ROUND(sz) - DPP_ARENA_ROUND(old_sz);
+    if (ptr == a->last && b->used + grow <= b->size)
+    {
+        b->used += grow;
+        *(size_t *)((uint8_t *)ptr - DPP_ARENA_HDR_SIZE) = sz;
+        return ptr;
+    }
+
+    p = dppline_arena_alloc(sz);
+    memcpy(p, ptr, old_sz);
+
+    return p;
+}
+
+/* Release everything but the first block */
+static void dppline_arena_reset()
+{
+    dppline_arena_t *a = &g_dpp_arena;
+    dppline_arena_block_t *b;
+
+    while (a->head != NULL && a->head->next != NULL)
+    {
+        b = a->head;
+        a->head = b->next;
+        FREE(b);
+    }
+    if (a->head != NULL) a->head->used = 0;
+    a->last = NULL;
+}
+
+static void *dppline_mem_alloc(size_t sz)
+{
+    if (g_dpp_arena_active) return dppline_arena_alloc(sz);
+    return MALLOC(sz);
+}
+
+static void *dppline_mem_calloc(size_t n, size_t sz)
+{
+    void *p;
+
+    if (!g_dpp_arena_active) return CALLOC(n, sz);
+    p = dppline_arena_alloc(n * sz);
+    memset(p, 0, n * sz);
+    return p;
+}
+
+static void *dppline_mem_realloc(void *ptr, size_t sz)
+{
+    if (g_dpp_arena_active) return dppline_arena_realloc(ptr, sz);
+    return REALLOC(ptr, sz);
+}
+
+static void *dppline_mem_memndup(const void *src, size_t sz)
+{
+    void *p;
+
+    if (!g_dpp_arena_active) return MEMNDUP(src, sz);
+    p = dppline_arena_alloc(sz);
+    memcpy(p, src, sz);
+    return p;
+}
+
+static char *dppline_mem_strdup(const char *str)
+{
+    if (!g_dpp_arena_active) return strdup(str);
+    return dppline_mem_memndup(str, strlen(str) + 1);
+}
+
+#define DPP_MALLOC(sz)          dppline_mem_alloc(sz)
+#define DPP_CALLOC(n, sz)       dppline_mem_calloc(n, sz)
+#define DPP_REALLOC(ptr, sz)    dppline_mem_realloc(ptr, sz)
+#define DPP_MEMNDUP(src, sz)    dppline_mem_memndup(src, sz)
+#define DPP_STRDUP(str)         dppline_mem_strdup(str)
+
 static void dppline_add_stat_survey(Sts__Report *r, dppline_stats_t *s)
 {
     Sts__Survey *sr = NULL;
@@ -901,11 +1060,11 @@ static void dppline_add_stat_survey(Sts__Report *r, dppline_stats_t *s)
     r->n_survey++;
 
     // allocate or extend the size of surveys
-    r->survey = REALLOC(r->survey,
+    r->survey = DPP_REALLOC(r->survey,
             r->n_survey * sizeof(Sts__Survey*));
 
     // allocate new buffer Sts__Survey
-    sr = MALLOC(sizeof(Sts__Survey));
+    sr = DPP_MALLOC(sizeof(Sts__Survey));
     r->survey[r->n_survey - 1] = sr;
 
     sts__survey__init(sr);
@@ -916,13 +1075,13 @@ static void dppline_add_stat_survey(Sts__Report *r, dppline_stats_t *s)
     sr->timestamp_ms = survey->timestamp_ms;
     sr->has_timestamp_ms = true;
     if (REPORT_TYPE_AVERAGE == survey->report_type) {
-        sr->survey_avg = MALLOC(survey->qty * sizeof(*sr->survey_avg));
+        sr->survey_avg = DPP_MALLOC(survey->qty * sizeof(*sr->survey_avg));
         sr->n_survey_avg = survey->qty;
         for (i = 0; i < survey->qty; i++)
         {
             dpp_survey_record_avg_t *rec = &survey->avg[i];
             Sts__Survey__SurveyAvg *dr; // dest rec
-            dr = sr->survey_avg[i] = MALLOC(sizeof(**sr->survey_avg));
+            dr = sr->survey_avg[i] = DPP_MALLOC(sizeof(**sr->survey_avg));
             sts__survey__survey_avg__init(dr);
 
             dr->channel = rec->info.chan;
@@ -931,7 +1090,7 @@ static void dppline_add_stat_survey(Sts__Report *r, dppline_stats_t *s)
             Sts__AvgTypeSigned   *davgs;
 #define CP_AVG(_name, _name1) do { \
         if (rec->_name1.avg) { \
-            davg = dr->_name = MALLOC(sizeof(*dr->_name)); \
+            davg = dr->_name = DPP_MALLOC(sizeof(*dr->_name)); \
             sts__avg_type__init(davg); \
             davg->avg = rec->_name1.avg; \
             if(rec->_name1.min) { \
@@ -951,7 +1110,7 @@ static void dppline_add_stat_survey(Sts__Report *r, dppline_stats_t *s)
 
 #define CP_AVG_SIGNED(_name, _name1) do { \
         if (rec->_name1.avg) { \
-            davgs = dr->_name = MALLOC(sizeof(*dr->_name)); \
+            davgs = dr->_name = DPP_MALLOC(sizeof(*dr->_name)); \
             sts__avg_type_signed__init(davgs); \
             davgs->avg = rec->_name1.avg; \
             if(rec->_name1.min) { \
@@ -988,13 +1147,13 @@ static void dppline_add_stat_survey(Sts__Report *r, dppline_stats_t *s)
            s->u.survey.numrec * (sizeof(Sts__AvgType)*5)); */
     } else {
         /* RAW only due to legacy (revisit once PERCENTILE AND HISTOGRAM)*/
-        sr->survey_list = MALLOC(survey->qty * sizeof(*sr->survey_list));
+        sr->survey_list = DPP_MALLOC(survey->qty * sizeof(*sr->survey_list));
         sr->n_survey_list = survey->qty;
         for (i = 0; i < survey->qty; i++)
         {
             dpp_survey_record_t *rec = &survey->list[i];
             Sts__Survey__SurveySample *dr; // dest rec
-            dr = sr->survey_list[i] = MALLOC(sizeof(**sr->survey_list));
+            dr = sr->survey_list[i] = DPP_MALLOC(sizeof(**sr->survey_list));
             sts__survey__survey_sample__init(dr);
 
             dr->channel = rec->info.chan;
@@ -1059,12 +1218,12 @@ static void dppline_add_stat_neighbor(Sts__Report *r, dppline_stats_t *s)
     r->n_neighbors++;
 
     // allocate or extend the size of neighbors
-    r->neighbors = REALLOC(r->neighbors,
+    r->neighbors = DPP_REALLOC(r->neighbors,
             r->n_neighbors * sizeof(Sts__Neighbor*));
     size += sizeof(Sts__Neighbor*);
 
     // allocate new buffer Sts__Neighbor
-    sr = MALLOC(sizeof(Sts__Neighbor));
+    sr = DPP_MALLOC(sizeof(Sts__Neighbor));
     size += sizeof(Sts__Neighbor);
     r->neighbors[r->n_neighbors - 1] = sr;
 
@@ -1075,20 +1234,20 @@ static void dppline_add_stat_neighbor(Sts__Report *r, dppline_stats_t *s)
     sr->has_report_type = true;
     sr->timestamp_ms = neighbor->timestamp_ms;
     sr->has_timestamp_ms = true;
-    sr->bss_list = MALLOC(neighbor->qty * sizeof(*sr->bss_list));
+    sr->bss_list = DPP_MALLOC(neighbor->qty * sizeof(*sr->bss_list));
     size += neighbor->qty * sizeof(*sr->bss_list);
     sr->n_bss_list = neighbor->qty;
     for (i = 0; i < neighbor->qty; i++)
     {
         dpp_neighbor_record_t *rec = &neighbor->list[i];
         Sts__Neighbor__NeighborBss *dr; // dest rec
-        dr = sr->bss_list[i] = MALLOC(sizeof(**sr->bss_list));
+        dr = sr->bss_list[i] = DPP_MALLOC(sizeof(**sr->bss_list));
         size += sizeof(**sr->bss_list);
         sts__neighbor__neighbor_bss__init(dr);
 
-        dr->bssid = strdup(rec->bssid);
+        dr->bssid = DPP_STRDUP(rec->bssid);
         size += strlen(rec->bssid) + 1;
-        dr->ssid = strdup(rec->ssid);
+        dr->ssid = DPP_STRDUP(rec->ssid);
         size += strlen(rec->ssid) + 1;
         if (rec->sig) {
             dr->rssi = rec->sig;
@@ -1113,7 +1272,7 @@ static void dppline_add_stat_neighbor(Sts__Report *r, dppline_stats_t *s)
         }
 
         if (rec->beacon_ies_len) {
-            dr->beacon_ies.data = MEMNDUP(rec->beacon_ies, rec->beacon_ies_len);
+            dr->beacon_ies.data = DPP_MEMNDUP(rec->beacon_ies, rec->beacon_ies_len);
             dr->beacon_ies.len = rec->beacon_ies_len;
             dr->has_beacon_ies = true;
         }
@@ -1183,11 +1342,11 @@ static void dppline_add_stat_client(Sts__Report *r, dppline_stats_t *s)
     r->n_clients++;
 
     // allocate or extend the size of clients
-    r->clients = REALLOC(r->clients,
+    r->clients = DPP_REALLOC(r->clients,
             r->n_clients * sizeof(Sts__ClientReport*));
 
     // allocate new buffer
-    sr = MALLOC(sizeof(Sts__ClientReport));
+    sr = DPP_MALLOC(sizeof(Sts__ClientReport));
     size += sizeof(Sts__ClientReport);
     r->clients[r->n_clients - 1] = sr;
 
@@ -1200,33 +1359,33 @@ static void dppline_add_stat_client(Sts__Report *r, dppline_stats_t *s)
         sr->has_uplink_changed = true;
         sr->uplink_changed = client->uplink_changed;
     }
-    sr->uplink_type = strdup(client->uplink_type);
+    sr->uplink_type = DPP_STRDUP(client->uplink_type);
 
-    sr->client_list = MALLOC(client->qty * sizeof(*sr->client_list));
+    sr->client_list = DPP_MALLOC(client->qty * sizeof(*sr->client_list));
     size += client->qty * sizeof(*sr->client_list);
     sr->n_client_list = client->qty;
     for (i = 0; i < client->qty; i++)
     {
         dpp_client_record_t *rec = &client->list[i].rec;
         int network_id_len;
-        dr = sr->client_list[i] = MALLOC(sizeof(**sr->client_list));
+        dr = sr->client_list[i] = DPP_MALLOC(sizeof(**sr->client_list));
         size += sizeof(**sr->client_list);
         sts__client__init(dr);
 
-        dr->mac_address = MALLOC(MACADDR_STR_LEN);
+        dr->mac_address = DPP_MALLOC(MACADDR_STR_LEN);
         dpp_mac_to_str(rec->info.mac, dr->mac_address);
         size += MACADDR_STR_LEN;
 
-        dr->mld_address = MALLOC(MACADDR_STR_LEN);
+        dr->mld_address = DPP_MALLOC(MACADDR_STR_LEN);
         dpp_mac_to_str(rec->info.mld_addr, dr->mld_address);
         size += MACADDR_STR_LEN;
 
-        dr->ssid = strdup(rec->info.essid);
+        dr->ssid = DPP_STRDUP(rec->info.essid);
         size += strlen(rec->info.essid) + 1;
 
         network_id_len = strlen(rec->info.networkid);
         if (network_id_len) {
-            dr->network_id = strdup(rec->info.networkid);
+            dr->network_id = DPP_STRDUP(rec->info.networkid);
             size += network_id_len + 1;
         }
 
@@ -1256,7 +1415,7 @@ static void dppline_add_stat_client(Sts__Report *r, dppline_stats_t *s)
         dr->has_disconnect_count = true;
         dr->has_duration_ms = true;
 
-        dr->stats = MALLOC(sizeof(*dr->stats));
+        dr->stats = DPP_MALLOC(sizeof(*dr->stats));
         size += sizeof(*dr->stats);
         sts__client__stats__init(dr->stats);
 
@@ -1313,7 +1472,7 @@ static void dppline_add_stat_client(Sts__Report *r, dppline_stats_t *s)
             dr->stats->has_tx_rate_perceived = true;
         }
 
-        dr->rx_stats = MALLOC(client->list[i].rx_qty * sizeof(*dr->rx_stats));
+        dr->rx_stats = DPP_MALLOC(client->list[i].rx_qty * sizeof(*dr->rx_stats));
         size += client->list[i].rx_qty * sizeof(*dr->rx_stats);
         dr->n_rx_stats = client->list[i].rx_qty;
         for (j = 0; j < client->list[i].rx_qty; j++)
@@ -1321,7 +1480,7 @@ static void dppline_add_stat_client(Sts__Report *r, dppline_stats_t *s)
             Sts__Client__RxStats   *drx;
             dpp_client_stats_rx_t  *srx = &client->list[i].rx[j];
 
-            drx = dr->rx_stats[j] = MALLOC(sizeof(**dr->rx_stats));
+            drx = dr->rx_stats[j] = DPP_MALLOC(sizeof(**dr->rx_stats));
             sts__client__rx_stats__init(drx);
 
             drx->mcs        = srx->mcs;
@@ -1358,7 +1517,7 @@ static void dppline_add_stat_client(Sts__Report *r, dppline_stats_t *s)
             }
         }
 
-        dr->tx_stats = MALLOC(client->list[i].tx_qty * sizeof(*dr->tx_stats));
+        dr->tx_stats = DPP_MALLOC(client->list[i].tx_qty * sizeof(*dr->tx_stats));
         size += client->list[i].tx_qty * sizeof(*dr->tx_stats);
         dr->n_tx_stats = client->list[i].tx_qty;
         for (j = 0; j < client->list[i].tx_qty; j++)
@@ -1366,7 +1525,7 @@ static void dppline_add_stat_client(Sts__Report *r, dppline_stats_t *s)
             Sts__Client__TxStats *dtx;
             dpp_client_stats_tx_t *stx = &client->list[i].tx[j];
 
-            dtx = dr->tx_stats[j] = MALLOC(sizeof(**dr->tx_stats));
+            dtx = dr->tx_stats[j] = DPP_MALLOC(sizeof(**dr->tx_stats));
             sts__client__tx_stats__init(dtx);
 
             dtx->mcs     = stx->mcs;
@@ -1399,27 +1558,27 @@ static void dppline_add_stat_client(Sts__Report *r, dppline_stats_t *s)
             }
         }
 
-        dr->tid_stats = MALLOC(client->list[i].tid_qty * sizeof(*dr->tid_stats));
+        dr->tid_stats = DPP_MALLOC(client->list[i].tid_qty * sizeof(*dr->tid_stats));
         size += client->list[i].tid_qty * sizeof(*dr->tid_stats);
         dr->n_tid_stats = client->list[i].tid_qty;
         for (j = 0; j < client->list[i].tid_qty; j++)
         {
             Sts__Client__TidStats *dtid;
             dpp_client_tid_record_list_t *stid = &client->list[i].tid[j];
-            dtid = dr->tid_stats[j] = MALLOC(sizeof(**dr->tid_stats));
+            dtid = dr->tid_stats[j] = DPP_MALLOC(sizeof(**dr->tid_stats));
             sts__client__tid_stats__init(dtid);
 
             dtid->offset_ms =
                 sr->timestamp_ms - stid->timestamp_ms;
             dtid->has_offset_ms = true;
 
-            dtid->sojourn = MALLOC(CLIENT_MAX_TID_RECORDS * sizeof(*dtid->sojourn));
+            dtid->sojourn = DPP_MALLOC(CLIENT_MAX_TID_RECORDS * sizeof(*dtid->sojourn));
             for (n = 0, j1 = 0; j1 < CLIENT_MAX_TID_RECORDS; j1++)
             {
                 Sts__Client__TidStats__Sojourn *drr;
                 dpp_client_stats_tid_t *srr = &stid->entry[n];
                 if (!(srr->num_msdus)) continue;
-                drr = dtid->sojourn[n] = MALLOC(sizeof(**dtid->sojourn));
+                drr = dtid->sojourn[n] = DPP_MALLOC(sizeof(**dtid->sojourn));
                 sts__client__tid_stats__sojourn__init(drr);
                 drr->ac = dppline_to_proto_wmm_ac_type(srr->ac);
                 drr->tid = srr->tid;
@@ -1439,7 +1598,7 @@ static void dppline_add_stat_client(Sts__Report *r, dppline_stats_t *s)
                 n++;
             }
             dtid->n_sojourn = n;
-            dtid->sojourn = REALLOC(dtid->sojourn, n * sizeof(*dtid->sojourn));
+            dtid->sojourn = DPP_REALLOC(dtid->sojourn, n * sizeof(*dtid->sojourn));
             size += n * sizeof(*dtid->sojourn);
         }
     }
@@ -1458,11 +1617,11 @@ static void dppline_add_stat_device(Sts__Report *r, dppline_stats_t *s)
     r->n_device++;
 
     // allocate or extend the size of devices
-    r->device = REALLOC(r->device,
+    r->device = DPP_REALLOC(r->device,
             r->n_device * sizeof(Sts__Device*));
 
     // allocate new buffer Sts__Device
-    sr = MALLOC(sizeof(Sts__Device));
+    sr = DPP_MALLOC(sizeof(Sts__Device));
     r->device[r->n_device - 1] = sr;
 
     sts__device__init(sr);
@@ -1470,7 +1629,7 @@ static void dppline_add_stat_device(Sts__Report *r, dppline_stats_t *s)
     sr->has_timestamp_ms = true;
 
     if (device->record.populated) {
-        sr->load = MALLOC(sizeof(*sr->load));
+        sr->load = DPP_MALLOC(sizeof(*sr->load));
         sts__device__load_avg__init(sr->load);
         sr->load->one = device->record.load[DPP_DEVICE_LOAD_AVG_ONE];
         sr->load->has_one = true;
@@ -1482,7 +1641,7 @@ static void dppline_add_stat_device(Sts__Report *r, dppline_stats_t *s)
         sr->uptime = device->record.uptime;
         sr->has_uptime = true;
 
-        sr->mem_util = MALLOC(sizeof(*sr->mem_util));
+        sr->mem_util = DPP_MALLOC(sizeof(*sr->mem_util));
         sts__device__mem_util__init(sr->mem_util);
         sr->mem_util->mem_total = device->record.mem_util.mem_total;
         sr->mem_util->mem_used = device->record.mem_util.mem_used;
@@ -1491,11 +1650,11 @@ static void dppline_add_stat_device(Sts__Report *r, dppline_stats_t *s)
         sr->mem_util->swap_used = device->record.mem_util.swap_used;
         sr->mem_util->has_swap_used = true;
 
-        sr->fs_util = MALLOC(DPP_DEVICE_FS_TYPE_QTY * sizeof(*sr->fs_util));
+        sr->fs_util = DPP_MALLOC(DPP_DEVICE_FS_TYPE_QTY * sizeof(*sr->fs_util));
         sr->n_fs_util = DPP_DEVICE_FS_TYPE_QTY;
         for (i = 0; i < sr->n_fs_util; i++)
         {
-            sr->fs_util[i] = MALLOC(sizeof(**sr->fs_util));
+            sr->fs_util[i] = DPP_MALLOC(sizeof(**sr->fs_util));
             sts__device__fs_util__init(sr->fs_util[i]);
 
             sr->fs_util[i]->fs_total = device->record.fs_util[i].fs_total;
@@ -1503,7 +1662,7 @@ static void dppline_add_stat_device(Sts__Report *r, dppline_stats_t *s)
             sr->fs_util[i]->fs_type = (Sts__FsType)device->record.fs_util[i].fs_type;
         }
 
-        sr->cpuutil = MALLOC(sizeof(*sr->cpuutil));
+        sr->cpuutil = DPP_MALLOC(sizeof(*sr->cpuutil));
         sts__device__cpu_util__init(sr->cpuutil);
         sr->cpuutil->cpu_util = device->record.cpu_util.cpu_util;
         sr->cpuutil->has_cpu_util = true;
@@ -1512,13 +1671,13 @@ static void dppline_add_stat_device(Sts__Report *r, dppline_stats_t *s)
         sr->n_ps_cpu_util = device->record.n_top_cpu;
         if (sr->n_ps_cpu_util > 0)
         {
-            sr->ps_cpu_util = MALLOC(sr->n_ps_cpu_util * sizeof(*sr->ps_cpu_util));
+            sr->ps_cpu_util = DPP_MALLOC(sr->n_ps_cpu_util * sizeof(*sr->ps_cpu_util));
             for (i = 0; i < sr->n_ps_cpu_util; i++)
             {
-                sr->ps_cpu_util[i] = MALLOC(sizeof(**sr->ps_cpu_util));
+                sr->ps_cpu_util[i] = DPP_MALLOC(sizeof(**sr->ps_cpu_util));
                 sts__device__per_process_util__init(sr->ps_cpu_util[i]);
                 sr->ps_cpu_util[i]->pid = device->record.top_cpu[i].pid;
-                sr->ps_cpu_util[i]->cmd = strdup(device->record.top_cpu[i].cmd);
+                sr->ps_cpu_util[i]->cmd = DPP_STRDUP(device->record.top_cpu[i].cmd);
                 sr->ps_cpu_util[i]->util = device->record.top_cpu[i].util;
             }
         }
@@ -1527,17 +1686,17 @@ static void dppline_add_stat_device(Sts__Report *r, dppline_stats_t *s)
         sr->n_ps_mem_util = device->record.n_top_mem;
         if (sr->n_ps_mem_util > 0)
         {
-            sr->ps_mem_util = MALLOC(sr->n_ps_mem_util * sizeof(*sr->ps_mem_util));
+            sr->ps_mem_util = DPP_MALLOC(sr->n_ps_mem_util * sizeof(*sr->ps_mem_util));
             for (i = 0; i < sr->n_ps_mem_util; i++)
             {
-                sr->ps_mem_util[i] = MALLOC(sizeof(**sr->ps_mem_util));
+                sr->ps_mem_util[i] = DPP_MALLOC(sizeof(**sr->ps_mem_util));
                 sts__device__per_process_util__init(sr->ps_mem_util[i]);
                 sr->ps_mem_util[i]->pid = device->record.top_mem[i].pid;
-                sr->ps_mem_util[i]->cmd = strdup(device->record.top_mem[i].cmd);
+                sr->ps_mem_util[i]->cmd = DPP_STRDUP(device->record.top_mem[i].cmd);
                 sr->ps_mem_util[i]->util = device->record.top_mem[i].util;
             }
         }
-        sr->powerinfo = MALLOC(sizeof(*sr->powerinfo));
+        sr->powerinfo = DPP_MALLOC(sizeof(*sr->powerinfo));
         sts__device__power_info__init(sr->powerinfo);
         if (device->record.power_info.ps_type)
         {
@@ -1565,12 +1724,12 @@ static void dppline_add_stat_device(Sts__Report *r, dppline_stats_t *s)
 
     if (device->qty > 0)
     {
-        sr->radio_temp = MALLOC(device->qty * sizeof(*sr->radio_temp));
+        sr->radio_temp = DPP_MALLOC(device->qty * sizeof(*sr->radio_temp));
     }
     sr->n_radio_temp = device->qty;
     for (i = 0; i < device->qty; i++)
     {
-        sr->radio_temp[i] = MALLOC(sizeof(**sr->radio_temp));
+        sr->radio_temp[i] = DPP_MALLOC(sizeof(**sr->radio_temp));
         sts__device__radio_temp__init(sr->radio_temp[i]);
 
         sr->radio_temp[i]->band = dppline_to_proto_radio(device->list[i].type);
@@ -1581,13 +1740,13 @@ static void dppline_add_stat_device(Sts__Report *r, dppline_stats_t *s)
 
     if (device->thermal_qty > 0)
     {
-        sr->thermal_stats = MALLOC(device->thermal_qty * sizeof(*sr->thermal_stats));
+        sr->thermal_stats = DPP_MALLOC(device->thermal_qty * sizeof(*sr->thermal_stats));
     }
     sr->n_thermal_stats = device->thermal_qty;
     for (i = 0; i < device->thermal_qty; i++)
     {
         Sts__Device__Thermal *dts;
-        dts = sr->thermal_stats[i] = MALLOC(sizeof(**sr->thermal_stats));
+        dts = sr->thermal_stats[i] = DPP_MALLOC(sizeof(**sr->thermal_stats));
         sts__device__thermal__init(sr->thermal_stats[i]);
 
         if(device->thermal_list[i].fan_rpm >= 0)
@@ -1614,7 +1773,7 @@ static void dppline_add_stat_device(Sts__Report *r, dppline_stats_t *s)
             sr->thermal_stats[i]->has_target_rpm = true;
         }
 
-        sr->thermal_stats[i]->led_state = MALLOC(DPP_DEVICE_LED_COUNT * sizeof(*dts->led_state));
+        sr->thermal_stats[i]->led_state = DPP_MALLOC(DPP_DEVICE_LED_COUNT * sizeof(*dts->led_state));
         sr->thermal_stats[i]->n_led_state = 0;
 
         for (j = 0; j < DPP_DEVICE_LED_COUNT; j++)
@@ -1623,7 +1782,7 @@ static void dppline_add_stat_device(Sts__Report *r, dppline_stats_t *s)
             {
                 Sts__Device__Thermal__LedState *led_state;
 
-                led_state = sr->thermal_stats[i]->led_state[j] = MALLOC(sizeof(**sr->thermal_stats[i]->led_state));
+                led_state = sr->thermal_stats[i]->led_state[j] = DPP_MALLOC(sizeof(**sr->thermal_stats[i]->led_state));
                 sts__device__thermal__led_state__init(led_state);
                 led_state->position = device->thermal_list[i].led_states[j].position;
                 led_state->has_position = true;
@@ -1637,7 +1796,7 @@ static void dppline_add_stat_device(Sts__Report *r, dppline_stats_t *s)
         sr->thermal_stats[i]->timestamp_ms = device->thermal_list[i].timestamp_ms;
         sr->thermal_stats[i]->has_timestamp_ms = true;
 
-        sr->thermal_stats[i]->txchainmask = MALLOC(DPP_DEVICE_TX_CHAINMASK_MAX * sizeof(*dts->txchainmask));
+        sr->thermal_stats[i]->txchainmask = DPP_MALLOC(DPP_DEVICE_TX_CHAINMASK_MAX * sizeof(*dts->txchainmask));
         sr->thermal_stats[i]->n_txchainmask = 0;
 
         for(j = 0; j < DPP_DEVICE_TX_CHAINMASK_MAX; j++)
@@ -1645,7 +1804,7 @@ static void dppline_add_stat_device(Sts__Report *r, dppline_stats_t *s)
             Sts__Device__Thermal__RadioTxChainMask  *txchainmask;
             if (device->thermal_list[i].radio_txchainmasks[j].type != RADIO_TYPE_NONE)
             {
-                txchainmask = sr->thermal_stats[i]->txchainmask[j] = MALLOC(sizeof(**sr->thermal_stats[i]->txchainmask));
+                txchainmask = sr->thermal_stats[i]->txchainmask[j] = DPP_MALLOC(sizeof(**sr->thermal_stats[i]->txchainmask));
                 sts__device__thermal__radio_tx_chain_mask__init(txchainmask);
                 txchainmask->band =  dppline_to_proto_radio(device->thermal_list[i].radio_txchainmasks[j].type);
                 txchainmask->has_band = true;
@@ -1668,25 +1827,25 @@ static void dppline_add_stat_capacity(Sts__Report *r, dppline_stats_t *s)
     r->n_capacity++;
 
     // allocate or extend the size of capacities
-    r->capacity = REALLOC(r->capacity,
+    r->capacity = DPP_REALLOC(r->capacity,
             r->n_capacity * sizeof(Sts__Capacity*));
 
     // allocate new buffer Sts__Capacity
-    sr = MALLOC(sizeof(Sts__Capacity));
+    sr = DPP_MALLOC(sizeof(Sts__Capacity));
     r->capacity[r->n_capacity - 1] = sr;
 
     sts__capacity__init(sr);
     sr->band = dppline_to_proto_radio(capacity->radio_type);
     sr->timestamp_ms = capacity->timestamp_ms;
     sr->has_timestamp_ms = true;
-    sr->queue_list = MALLOC(capacity->qty * sizeof(*sr->queue_list));
+    sr->queue_list = DPP_MALLOC(capacity->qty * sizeof(*sr->queue_list));
     sr->n_queue_list = capacity->qty;
     for (i = 0; i < capacity->qty; i++)
     {
         dpp_capacity_record_t *rec = &capacity->list[i];
 
         Sts__Capacity__QueueSample *dr; // dest rec
-        dr = sr->queue_list[i] = MALLOC(sizeof(**sr->queue_list));
+        dr = sr->queue_list[i] = DPP_MALLOC(sizeof(**sr->queue_list));
         sts__capacity__queue_sample__init(dr);
 
         dr->bytes_tx = rec->bytes_tx;
@@ -1758,12 +1917,12 @@ static void dppline_add_stat_bs_client(Sts__Report * r, dppline_stats_t * s)
     r->n_bs_report++;
 
     // allocate or extend the size of bs_report array
-    r->bs_report = REALLOC(r->bs_report,
+    r->bs_report = DPP_REALLOC(r->bs_report,
             r->n_bs_report * sizeof(Sts__BSReport*));
     assert(r->bs_report);
 
     // allocate new buffer Sts__BSReport
-    sr = MALLOC(sizeof(Sts__BSReport));
+    sr = DPP_MALLOC(sizeof(Sts__BSReport));
 
     // append report
     r->bs_report[r->n_bs_report - 1] = sr;
@@ -1773,7 +1932,7 @@ static void dppline_add_stat_bs_client(Sts__Report * r, dppline_stats_t * s)
     sr->timestamp_ms = bs_client->timestamp_ms;
 
     // Append clients, so client array needs to be resided
-    sr->clients = REALLOC(sr->clients,
+    sr->clients = DPP_REALLOC(sr->clients,
             (sr->n_clients + bs_client->qty) * sizeof(*sr->clients));
     assert(sr->clients);
 
@@ -1793,14 +1952,14 @@ static void dppline_add_stat_bs_client(Sts__Report * r, dppline_stats_t * s)
         dpp_bs_client_record_t *c_rec = &bs_client->list[client];
 
         // Allocate memory for the BS Client
-        cr = sr->clients[sr->n_clients] = MALLOC(sizeof(**sr->clients));
+        cr = sr->clients[sr->n_clients] = DPP_MALLOC(sizeof(**sr->clients));
         sr->n_clients++;
         sts__bsclient__init(cr);
 
-        cr->mac_address = MALLOC(MACADDR_STR_LEN);
+        cr->mac_address = DPP_MALLOC(MACADDR_STR_LEN);
         dpp_mac_to_str(c_rec->mac, cr->mac_address);
 
-        cr->mld_address = MALLOC(MACADDR_STR_LEN);
+        cr->mld_address = DPP_MALLOC(MACADDR_STR_LEN);
         dpp_mac_to_str(c_rec->mld_address, cr->mld_address);
 
         // alloc band list
@@ -1818,7 +1977,7 @@ static void dppline_add_stat_bs_client(Sts__Report * r, dppline_stats_t * s)
             cr->n_bs_band_report++;
         }
 
-        cr->bs_band_report = CALLOC(cr->n_bs_band_report, sizeof(*cr->bs_band_report));
+        cr->bs_band_report = DPP_CALLOC(cr->n_bs_band_report, sizeof(*cr->bs_band_report));
 
         // For each band per client
         for (band = 0, band_report = 0; band < c_rec->num_band_records; band++)
@@ -1830,7 +1989,7 @@ static void dppline_add_stat_bs_client(Sts__Report * r, dppline_stats_t * s)
             }
 
             // Allocate memory for the band report
-            br = cr->bs_band_report[band_report] = MALLOC(sizeof(Sts__BSClient__BSBandReport));
+            br = cr->bs_band_report[band_report] = DPP_MALLOC(sizeof(Sts__BSClient__BSBandReport));
             band_report++;
             sts__bsclient__bsband_report__init(br);
 
@@ -1867,10 +2026,10 @@ static void dppline_add_stat_bs_client(Sts__Report * r, dppline_stats_t * s)
             br->probe_bcast_cnt = b_rec->probe_bcast_cnt;
             br->has_probe_bcast_cnt = true;
 
-            br->ifname = strdup(b_rec->ifname);
+            br->ifname = DPP_STRDUP(b_rec->ifname);
 
             // alloc event list
-            br->event_list = CALLOC(b_rec->num_event_records, sizeof(*br->event_list));
+            br->event_list = DPP_CALLOC(b_rec->num_event_records, sizeof(*br->event_list));
             br->n_event_list = b_rec->num_event_records;
 
             // copy each event
@@ -1879,7 +2038,7 @@ static void dppline_add_stat_bs_client(Sts__Report * r, dppline_stats_t * s)
                 dpp_bs_client_event_record_t *e_rec = &b_rec->event_record[event];
 
                 // alloc event
-                er = br->event_list[event] = MALLOC(sizeof(Sts__BSClient__BSEvent));
+                er = br->event_list[event] = DPP_MALLOC(sizeof(Sts__BSClient__BSEvent));
                 sts__bsclient__bsevent__init(er);
 
                 er->type = (Sts__BSEventType)e_rec->type;
@@ -1973,7 +2132,7 @@ static void dppline_add_stat_bs_client(Sts__Report * r, dppline_stats_t * s)
                 er->has_rrm_caps_ftm_range_rpt = true;
 
                 if (e_rec->assoc_ies_len) {
-                    er->assoc_ies.data = MALLOC(e_rec->assoc_ies_len);
+                    er->assoc_ies.data = DPP_MALLOC(e_rec->assoc_ies_len);
                     if (er->assoc_ies.data) {
                         memcpy(er->assoc_ies.data, e_rec->assoc_ies, e_rec->assoc_ies_len);
                         er->assoc_ies.len = e_rec->assoc_ies_len;
@@ -2019,11 +2178,11 @@ static void dppline_add_stat_rssi(Sts__Report *r, dppline_stats_t *s)
     r->n_rssi_report++;
 
     // allocate or extend the size of rssi_report
-    r->rssi_report = REALLOC(r->rssi_report,
+    r->rssi_report = DPP_REALLOC(r->rssi_report,
             r->n_rssi_report * sizeof(Sts__RssiReport*));
 
     // allocate new buffer
-    sr = MALLOC(sizeof(Sts__RssiReport));
+    sr = DPP_MALLOC(sizeof(Sts__RssiReport));
     r->rssi_report[r->n_rssi_report - 1] = sr;
 
     sts__rssi_report__init(sr);
@@ -2031,15 +2190,15 @@ static void dppline_add_stat_rssi(Sts__Report *r, dppline_stats_t *s)
     sr->report_type = dppline_to_proto_report_type(rssi->report_type);
     sr->timestamp_ms = rssi->timestamp_ms;
     sr->has_timestamp_ms = true;
-    sr->peer_list = MALLOC(rssi->qty * sizeof(*sr->peer_list));
+    sr->peer_list = DPP_MALLOC(rssi->qty * sizeof(*sr->peer_list));
     sr->n_peer_list = rssi->qty;
     for (i = 0; i < rssi->qty; i++)
     {
         dpp_rssi_record_t *rec = &rssi->list[i].rec;
-        dr = sr->peer_list[i] = MALLOC(sizeof(**sr->peer_list));
+        dr = sr->peer_list[i] = DPP_MALLOC(sizeof(**sr->peer_list));
         sts__rssi_peer__init(dr);
 
-        dr->mac_address = MALLOC(MACADDR_STR_LEN);
+        dr->mac_address = DPP_MALLOC(MACADDR_STR_LEN);
         dpp_mac_to_str(rec->mac, dr->mac_address);
 
         if (rec->source) {
@@ -2048,14 +2207,14 @@ static void dppline_add_stat_rssi(Sts__Report *r, dppline_stats_t *s)
         }
 
         if (REPORT_TYPE_RAW == rssi->report_type) {
-            dr->rssi_list = MALLOC(rssi->list[i].raw_qty * sizeof(*dr->rssi_list));
+            dr->rssi_list = DPP_MALLOC(rssi->list[i].raw_qty * sizeof(*dr->rssi_list));
             dr->n_rssi_list = rssi->list[i].raw_qty;
             for (j = 0; j < rssi->list[i].raw_qty; j++)
             {
                 Sts__RssiPeer__RssiSample   *draw;
                 dpp_rssi_raw_t  *sraw = &rssi->list[i].raw[j];
 
-                draw = dr->rssi_list[j] = MALLOC(sizeof(**dr->rssi_list));
+                draw = dr->rssi_list[j] = DPP_MALLOC(sizeof(**dr->rssi_list));
                 sts__rssi_peer__rssi_sample__init(draw);
 
                 draw->rssi = sraw->rssi;
@@ -2069,7 +2228,7 @@ static void dppline_add_stat_rssi(Sts__Report *r, dppline_stats_t *s)
             Sts__AvgType   *davg;
             dpp_avg_t      *savg = &rssi->list[i].rec.rssi.avg;
 
-            davg = dr->rssi_avg = MALLOC(sizeof(*dr->rssi_avg));
+            davg = dr->rssi_avg = DPP_MALLOC(sizeof(*dr->rssi_avg));
             sts__avg_type__init(davg);
 
             if (savg->avg) {
@@ -2112,15 +2271,15 @@ static void dppline_add_stat_client_auth_fails(Sts__Report *r, dppline_stats_t *
     r->n_client_auth_fails_report++;
 
     // allocate or extend the size of client_auth_fails_report
-    r->client_auth_fails_report = REALLOC(r->client_auth_fails_report, r->n_client_auth_fails_report * sizeof(Sts__ClientAuthFailsReport*));
+    r->client_auth_fails_report = DPP_REALLOC(r->client_auth_fails_report, r->n_client_auth_fails_report * sizeof(Sts__ClientAuthFailsReport*));
 
     // allocate new buffer
-    sr = MALLOC(sizeof(Sts__ClientAuthFailsReport));
+    sr = DPP_MALLOC(sizeof(Sts__ClientAuthFailsReport));
     r->client_auth_fails_report[r->n_client_auth_fails_report - 1] = sr;
 
     sts__client_auth_fails_report__init(sr);
     sr->band = dppline_to_proto_radio(client_auth_fails->radio_type);
-    sr->bss_list = MALLOC(client_auth_fails->qty * sizeof(*sr->bss_list));
+    sr->bss_list = DPP_MALLOC(client_auth_fails->qty * sizeof(*sr->bss_list));
     sr->n_bss_list = client_auth_fails->qty;
     for (i = 0; i < client_auth_fails->qty; i++)
     {
@@ -2128,12 +2287,12 @@ static void dppline_add_stat_client_auth_fails(Sts__Report *r, dppline_stats_t *
         Sts__ClientAuthFailsReport__BSS *br;
 
         bss = &client_auth_fails->list[i];
-        br = sr->bss_list[i] = MALLOC(sizeof(Sts__ClientAuthFailsReport__BSS));
+        br = sr->bss_list[i] = DPP_MALLOC(sizeof(Sts__ClientAuthFailsReport__BSS));
 
         sts__client_auth_fails_report__bss__init(br);
-        br->ifname = strdup(bss->if_name);
+        br->ifname = DPP_STRDUP(bss->if_name);
 
-        br->client_list = MALLOC(bss->qty * sizeof(*br->client_list));
+        br->client_list = DPP_MALLOC(bss->qty * sizeof(*br->client_list));
         br->n_client_list = bss->qty;
 
         for (j = 0; j < bss->qty; j++)
@@ -2142,10 +2301,10 @@ static void dppline_add_stat_client_auth_fails(Sts__Report *r, dppline_stats_t *
             Sts__ClientAuthFailsReport__BSS__Client *cr;
 
             client = &bss->list[j];
-            cr = br->client_list[j] = MALLOC(sizeof(Sts__ClientAuthFailsReport__BSS__Client));
+            cr = br->client_list[j] = DPP_MALLOC(sizeof(Sts__ClientAuthFailsReport__BSS__Client));
 
             sts__client_auth_fails_report__bss__client__init(cr);
-            cr->mac_address = strdup(client->mac);
+            cr->mac_address = DPP_STRDUP(client->mac);
             cr->auth_fails = client->auth_fails;
             cr->invalid_psk = client->invalid_psk;
         }
@@ -2160,14 +2319,14 @@ static void dppline_add_stat_radius(Sts__Report *r, dppline_stats_t *s)
 
     /* Allocate or extend the size of the radius_report and increment counter. */
     r->n_radius_report++;
-    r->radius_report = REALLOC(r->radius_report,
+    r->radius_report = DPP_REALLOC(r->radius_report,
             r->n_radius_report * sizeof(Sts__RadiusReport*));
 
     /* Allocate new buffer for RadiusReport protobuf object */
-    sr = MALLOC(sizeof(Sts__RadiusReport));
+    sr = DPP_MALLOC(sizeof(Sts__RadiusReport));
 
     sts__radius_report__init(sr);
-    sr->radius_list = MALLOC(dpp_radius->qty * sizeof(*sr->radius_list));
+    sr->radius_list = DPP_MALLOC(dpp_radius->qty * sizeof(*sr->radius_list));
     sr->timestamp_ms = dpp_radius->timestamp_ms;
     sr->has_timestamp_ms = true;
     sr->n_radius_list = dpp_radius->qty;
@@ -2180,12 +2339,12 @@ static void dppline_add_stat_radius(Sts__Report *r, dppline_stats_t *s)
         Sts__RadiusReport__RadiusRecord *rr;
 
         record = dpp_radius->list[list_index];
-        rr = sr->radius_list[list_index] = MALLOC(sizeof(*rr));
+        rr = sr->radius_list[list_index] = DPP_MALLOC(sizeof(*rr));
         sts__radius_report__radius_record__init(rr);
 
-        rr->vif_name      = strdup(record->vif_name);
-        rr->vif_role      = strdup(record->vif_role);
-        rr->serveraddress = strdup(record->radiusAuthServerAddress);
+        rr->vif_name      = DPP_STRDUP(record->vif_name);
+        rr->vif_role      = DPP_STRDUP(record->vif_role);
+        rr->serveraddress = DPP_STRDUP(record->radiusAuthServerAddress);
 
         rr->serverindex                    = record->radiusAuthServerIndex;
         rr->clientserverportnumber         = record->radiusAuthClientServerPortNumber;
@@ -2596,6 +2755,146 @@ bool dpp_get_report2(uint8_t **pbuff, size_t suggest_sz, uint32_t *packed_sz)
 }
 #endif
 
+/*
+ * Top level repeated field of the report a stats type is appended to
+ */
+static size_t *dppline_report_field(Sts__Report *r, int type, ProtobufCMessage ***elems)
+{
+#define DPP_REPORT_FIELD(_field) \
+    do { *elems = (ProtobufCMessage **)r->_field; return &r->n_##_field; } while (0)
+
+    switch (type)
+    {
+        case DPP_T_SURVEY:              DPP_REPORT_FIELD(survey);
+        case DPP_T_CAPACITY:            DPP_REPORT_FIELD(capacity);
+        case DPP_T_NEIGHBOR:            DPP_REPORT_FIELD(neighbors);
+        case DPP_T_CLIENT:              DPP_REPORT_FIELD(clients);
+        case DPP_T_DEVICE:              DPP_REPORT_FIELD(device);
+        case DPP_T_BS_CLIENT:           DPP_REPORT_FIELD(bs_report);
+        case DPP_T_RSSI:                DPP_REPORT_FIELD(rssi_report);
+        case DPP_T_CLIENT_AUTH_FAILS:   DPP_REPORT_FIELD(client_auth_fails_report);
+        case DPP_T_RADIUS_STATS:        DPP_REPORT_FIELD(radius_report);
+        default:
+            break;
+    }
+#undef DPP_REPORT_FIELD
+
+    *elems = NULL;
+    return NULL;
+}
+
+static size_t dppline_varint_size(size_t v)
+{
+    size_t n = 1;
+
+    while (v >= 0x80)
+    {
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+
+/*
+ * Create the protobuf buff in an arena and pack it to the given buffer
+ *
+ * Stats are added until the next one would not fit in sz, the remaining
+ * ones stay queued for the next report. The packed size is tracked per
+ * added record instead of re-computing it for the whole report. A single
+ * stats record larger than sz can never be sent and is dropped.
+ */
+bool dpp_get_report_arena(uint8_t *buff, size_t sz, uint32_t *packed_sz)
+{
+    ProtobufCMessage **elems;
+    ds_dlist_iter_t iter;
+    Sts__Report report;
+    dppline_stats_t *s;
+    size_t packed_size;
+    size_t rec_size;
+    size_t n_before;
+    size_t *n;
+    size_t i;
+    bool ret = false;
+
+    /* prevent sending empty reports */
+    if (dpp_get_queue_elements() == 0)
+    {
+        LOG(DEBUG, "get_report: queue depth is zero");
+        return false;
+    }
+
+    /* stop any further actions in case improper buffer submitted */
+    if (NULL == buff || sz == 0)
+    {
+        LOG(DEBUG, "get_report: invalid buffer or size");
+        return false;
+    }
+
+    /* the report itself is never freed, it can live on the stack */
+    sts__report__init(&report);
+    report.nodeid = getNodeid();
+    packed_size = sts__report__get_packed_size(&report);
+
+    g_dpp_arena_active = true;
+
+    for (s = ds_dlist_ifirst(&iter, &g_dppline_list); s != NULL; s = ds_dlist_inext(&iter))
+    {
+        n = dppline_report_field(&report, s->type, &elems);
+        n_before = (n != NULL) ? *n : 0;
+
+        dppline_add_stat(&report, s);
+
+        /* each new element costs a one byte tag, its length and itself */
+        rec_size = 0;
+        if (n != NULL)
+        {
+            dppline_report_field(&report, s->type, &elems);
+            for (i = n_before; i < *n; i++)
+            {
+                size_t len = protobuf_c_message_get_packed_size(elems[i]);
+                rec_size += 1 + dppline_varint_size(len) + len;
+            }
+        }
+
+        if (packed_size + rec_size > sz)
+        {
+            /* the record stays in the arena but is no longer referenced */
+            if (n != NULL) *n = n_before;
+
+            if (ret)
+            {
+                /* keep the remaining stats for the next report */
+                break;
+            }
+
+            LOG(ERR, "Dropping stats type %d, packed size %zu exceeds %zu",
+                s->type, packed_size + rec_size, sz);
+        }
+        else
+        {
+            packed_size += rec_size;
+            ret = true;
+        }
+
+        /* remove item from the list and free memory */
+        s = ds_dlist_iremove(&iter);
+        queue_size -= s->size;
+        queue_depth--;
+        dppline_free_stat(s);
+    }
+
+    g_dpp_arena_active = false;
+
+    *packed_sz = 0;
+    if (ret) *packed_sz = sts__report__pack(&report, buff);
+
+    FREE(report.nodeid);
+    dppline_arena_reset();
+    dppline_log_queue();
+
+    return ret;
+}
+
 
 /*
  * Count the number of stats in queue
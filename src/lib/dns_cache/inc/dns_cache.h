@@ -34,6 +34,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <sys/socket.h>
 
 #include "ds_tree.h"
+#include "ds_dlist.h"
 #include "os.h"
 #include "os_types.h"
 
@@ -44,13 +45,30 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define SERVICE_PROVIDER_MAX_ELEMS 3
 #define DNS_CACHE_SOURCE_MAX 2
 
+/* Default cap on the number of cached ip2action entries */
+#define DNS_CACHE_DEFAULT_MAX_ENTRIES 8192
+
+/* Initial number of ip2action hash buckets, must be a power of 2 */
+#define DNS_CACHE_HASH_MIN_BUCKETS 256
+
+/* Number of one second slots in the ip2action ttl wheel */
+#define DNS_CACHE_TTL_WHEEL_SLOTS 512
+
+struct ip2action;
+
 struct dns_cache_mgr
 {
     bool        initialized;
     uint8_t     refcount;
     uint32_t    cache_hit_count[SERVICE_PROVIDER_MAX_ELEMS];
     bool        disable_dns_cache[DNS_CACHE_SOURCE_MAX];
-    ds_tree_t   ip2a_tree;
+    struct ip2action **ip2a_buckets;   /* chained hash keyed on mac/ip/dir */
+    size_t      nbuckets;
+    ds_dlist_t  ttl_wheel[DNS_CACHE_TTL_WHEEL_SLOTS];
+    time_t      wheel_ts;              /* last second swept by the wheel */
+    ds_dlist_t  lru_list;              /* most recently used first */
+    int         max_entries;
+    uint64_t    lru_evictions;
     int         entries;
 };
 
@@ -120,7 +138,12 @@ struct ip2action
 #define cache_bc cache_info.bc_info
 #define cache_wb cache_info.wb_info
 #define cache_gk cache_info.gk_info
-    ds_tree_node_t              ip2a_tnode;
+    uint32_t                    hash;
+    struct ip2action            *hash_next;
+    time_t                      expiry_ts;
+    size_t                      ttl_slot;
+    ds_dlist_node_t             ttl_node;
+    ds_dlist_node_t             lru_node;
 };
 
 struct ip2action_req
@@ -233,6 +256,17 @@ dns_cache_del_entry(struct ip2action_req *to_del);
 bool
 dns_cache_ttl_cleanup();
 
+/**
+ * @brief set the maximum number of cached entries.
+ *
+ * Once the limit is reached, adding a new entry evicts the least
+ * recently used one.
+ *
+ * @param max_entries the new limit. 0 restores the default.
+ */
+void
+dns_cache_set_max_entries(int max_entries);
+
 /**
  * @brief print cache'd entres.
  *
@@ -25,6 +25,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <stdint.h>
+#include <inttypes.h>
 #include <time.h>
 #include <netinet/in.h>
 #include <sys/types.h>
@@ -48,6 +49,7 @@ mgr =
 {
     .initialized = false,
     .refcount = 0,
+    .max_entries = DNS_CACHE_DEFAULT_MAX_ENTRIES,
 };
 
 struct dns_cache_mgr *
@@ -98,6 +100,135 @@ dns_cache_ip2action_cmp(const void *_a, const void *_b)
     return 0;
 }
 
+/**
+ * @brief computes the hash of an ip2action key
+ *
+ * FNV-1a over the same fields dns_cache_ip2action_cmp() compares.
+ */
+static uint32_t
+dns_cache_ip2action_hash(struct ip2action *i2a)
+{
+    uint32_t hash;
+    uint8_t *p;
+    size_t len;
+    size_t i;
+
+    hash = 2166136261U;
+
+    p = i2a->device_mac->addr;
+    for (i = 0; i < sizeof(os_macaddr_t); i++)
+    {
+        hash ^= p[i];
+        hash *= 16777619U;
+    }
+
+    len = (i2a->af_family == AF_INET) ? 4 : 16;
+    p = i2a->ip_tbl;
+    for (i = 0; i < len; i++)
+    {
+        hash ^= p[i];
+        hash *= 16777619U;
+    }
+
+    hash ^= (uint8_t)i2a->af_family;
+    hash *= 16777619U;
+    hash ^= i2a->direction;
+    hash *= 16777619U;
+
+    return hash;
+}
+
+static bool
+dns_cache_hash_resize(struct dns_cache_mgr *mgr, size_t nbuckets)
+{
+    struct ip2action **buckets;
+    struct ip2action *i2a;
+    struct ip2action *next;
+    size_t idx;
+    size_t i;
+
+    buckets = CALLOC(nbuckets, sizeof(*buckets));
+    if (buckets == NULL) return false;
+
+    for (i = 0; i < mgr->nbuckets; i++)
+    {
+        i2a = mgr->ip2a_buckets[i];
+        while (i2a != NULL)
+        {
+            next = i2a->hash_next;
+            idx = i2a->hash & (nbuckets - 1);
+            i2a->hash_next = buckets[idx];
+            buckets[idx] = i2a;
+            i2a = next;
+        }
+    }
+
+    FREE(mgr->ip2a_buckets);
+    mgr->ip2a_buckets = buckets;
+    mgr->nbuckets = nbuckets;
+
+    return true;
+}
+
+static bool
+dns_cache_hash_insert(struct dns_cache_mgr *mgr, struct ip2action *i2a)
+{
+    size_t idx;
+    bool rc;
+
+    /* Keep the load factor at or below 1 */
+    if ((size_t)mgr->entries >= mgr->nbuckets)
+    {
+        rc = dns_cache_hash_resize(mgr, MAX(mgr->nbuckets * 2,
+                                            (size_t)DNS_CACHE_HASH_MIN_BUCKETS));
+        /* A full table still works, only an absent one does not */
+        if (!rc && (mgr->nbuckets == 0)) return false;
+    }
+
+    idx = i2a->hash & (mgr->nbuckets - 1);
+    i2a->hash_next = mgr->ip2a_buckets[idx];
+    mgr->ip2a_buckets[idx] = i2a;
+
+    return true;
+}
+
+static void
+dns_cache_hash_remove(struct dns_cache_mgr *mgr, struct ip2action *i2a)
+{
+    struct ip2action **pprev;
+    size_t idx;
+
+    idx = i2a->hash & (mgr->nbuckets - 1);
+    for (pprev = &mgr->ip2a_buckets[idx]; *pprev != NULL;
+         pprev = &(*pprev)->hash_next)
+    {
+        if (*pprev != i2a) continue;
+
+        *pprev = i2a->hash_next;
+        i2a->hash_next = NULL;
+        return;
+    }
+}
+
+/**
+ * @brief (re)schedules an entry in the ttl wheel
+ *
+ * The entry lands in the slot of its expiry second. Entries already past
+ * due are parked in the next slot the wheel will sweep.
+ */
+static void
+dns_cache_wheel_schedule(struct dns_cache_mgr *mgr, struct ip2action *i2a)
+{
+    time_t slot_ts;
+    size_t slot;
+
+    i2a->expiry_ts = i2a->original_ts + i2a->cache_ttl;
+    slot_ts = MAX(i2a->expiry_ts, mgr->wheel_ts + 1);
+    slot = (size_t)slot_ts % DNS_CACHE_TTL_WHEEL_SLOTS;
+    ds_dlist_insert_tail(&mgr->ttl_wheel[slot], i2a);
+    i2a->ttl_slot = slot;
+}
+
 uint8_t
 dns_cache_get_service_provider(char *service_provider)
 {
@@ -161,6 +292,8 @@ disable_dns_cache(struct dns_cache_settings *cache_init)
 void
 dns_cache_init_mgr(struct dns_cache_mgr *mgr)
 {
+    size_t i;
+
     if (!mgr) return;
 
     if (mgr->initialized)
@@ -169,8 +302,16 @@ dns_cache_init_mgr(struct dns_cache_mgr *mgr)
         return;
     }
 
-    ds_tree_init(&mgr->ip2a_tree, dns_cache_ip2action_cmp,
-                 struct ip2action, ip2a_tnode);
+    mgr->ip2a_buckets = NULL;
+    mgr->nbuckets = 0;
+    for (i = 0; i < DNS_CACHE_TTL_WHEEL_SLOTS; i++)
+    {
+        ds_dlist_init(&mgr->ttl_wheel[i], struct ip2action, ttl_node);
+    }
+    mgr->wheel_ts = time(NULL) - 1;
+    ds_dlist_init(&mgr->lru_list, struct ip2action, lru_node);
+    if (mgr->max_entries <= 0) mgr->max_entries = DNS_CACHE_DEFAULT_MAX_ENTRIES;
+    mgr->lru_evictions = 0;
 
     mgr->initialized = true;
     mgr->refcount++;
@@ -240,26 +381,37 @@ dns_cache_free_ip2action(struct ip2action *i2a)
    return;
 }
 
+/**
+ * @brief removes an entry from the hash, the ttl wheel and the lru list
+ *        and frees it.
+ */
+static void
+dns_cache_unlink_ip2action(struct dns_cache_mgr *mgr, struct ip2action *i2a)
+{
+    dns_cache_hash_remove(mgr, i2a);
+    ds_dlist_remove(&mgr->ttl_wheel[i2a->ttl_slot], i2a);
+    ds_dlist_remove(&mgr->lru_list, i2a);
+    dns_cache_free_ip2action(i2a);
+    FREE(i2a);
+    mgr->entries--;
+}
+
 void
 dns_cache_cleanup(void)
 {
     struct dns_cache_mgr *mgr = dns_cache_get_mgr();
     struct ip2action *i2a_entry, *i2a_next;
-    ds_tree_t *tree;
 
     if (!mgr->initialized) return;
 
-    tree = &mgr->ip2a_tree;
-    i2a_entry = ds_tree_head(tree);
-    while (i2a_entry != NULL)
+    ds_dlist_foreach_safe(&mgr->lru_list, i2a_entry, i2a_next)
     {
-        i2a_next = ds_tree_next(tree, i2a_entry);
-        ds_tree_remove(tree, i2a_entry);
-        dns_cache_free_ip2action(i2a_entry);
-        FREE(i2a_entry);
-        mgr->entries--;
-        i2a_entry = i2a_next;
+        dns_cache_unlink_ip2action(mgr, i2a_entry);
     }
+
+    FREE(mgr->ip2a_buckets);
+    mgr->ip2a_buckets = NULL;
+    mgr->nbuckets = 0;
     return;
 }
 
@@ -335,20 +487,34 @@ dns_cache_lookup_ip2action(struct ip2action_req *req)
     struct dns_cache_mgr *mgr = dns_cache_get_mgr();
     struct ip2action     i2a_lkp;
     struct ip2action     *i2a;
+    uint32_t             hash;
 
     if (!req) return NULL;
 
     if (!req->ip_addr || !req->device_mac) return NULL;
 
+    if (mgr->nbuckets == 0) return NULL;
+
     memset(&i2a_lkp, 0, sizeof(struct ip2action));
 
     i2a_lkp.ip_addr = req->ip_addr;
     dns_cache_set_ip(&i2a_lkp);
+    if (i2a_lkp.ip_tbl == NULL) return NULL;
     i2a_lkp.device_mac = req->device_mac;
     i2a_lkp.direction = req->direction;
 
-    i2a = ds_tree_find(&mgr->ip2a_tree, &i2a_lkp);
-    if (i2a != NULL) return i2a;
+    hash = dns_cache_ip2action_hash(&i2a_lkp);
+    i2a = mgr->ip2a_buckets[hash & (mgr->nbuckets - 1)];
+    for (; i2a != NULL; i2a = i2a->hash_next)
+    {
+        if (i2a->hash != hash) continue;
+        if (dns_cache_ip2action_cmp(i2a, &i2a_lkp) != 0) continue;
+
+        /* Refresh the entry's lru position */
+        ds_dlist_remove(&mgr->lru_list, i2a);
+        ds_dlist_insert_head(&mgr->lru_list, i2a);
+        return i2a;
+    }
 
     return NULL;
 }
@@ -628,6 +794,7 @@ dns_cache_add_entry(struct ip2action_req *to_add)
 {
     struct dns_cache_mgr *mgr = dns_cache_get_mgr();
     struct ip2action     *i2a;
+    bool                 rc;
 
     if (!mgr->initialized || !to_add) return false;
 
@@ -636,6 +803,10 @@ dns_cache_add_entry(struct ip2action_req *to_add)
     {
         dns_cache_update_ip2action(i2a, to_add);
 
+        /* The ttl may have changed, move the entry to its new wheel slot */
+        ds_dlist_remove(&mgr->ttl_wheel[i2a->ttl_slot], i2a);
+        dns_cache_wheel_schedule(mgr, i2a);
+
         LOGD("%s: ip2action_cache updated entry in cache:", __func__);
         return true;
     }
@@ -644,10 +815,29 @@ dns_cache_add_entry(struct ip2action_req *to_add)
     i2a = dns_cache_alloc_ip2action(to_add);
     if (i2a == NULL) return false;
 
+    /* Make room by evicting the least recently used entry */
+    if (mgr->entries >= mgr->max_entries)
+    {
+        LOGD("%s: ip2action_cache full (%d entries), evicting lru entry",
+             __func__, mgr->entries);
+        dns_cache_unlink_ip2action(mgr, ds_dlist_tail(&mgr->lru_list));
+        mgr->lru_evictions++;
+    }
+
     LOGD("%s: ip2action_cache adding to cache:", __func__);
 
+    i2a->hash = dns_cache_ip2action_hash(i2a);
+    rc = dns_cache_hash_insert(mgr, i2a);
+    if (!rc)
+    {
+        LOGE("%s: Couldn't allocate the ip2action hash table.", __func__);
+        dns_cache_free_ip2action(i2a);
+        FREE(i2a);
+        return false;
+    }
+    dns_cache_wheel_schedule(mgr, i2a);
+    ds_dlist_insert_head(&mgr->lru_list, i2a);
     mgr->entries++;
-    ds_tree_insert(&mgr->ip2a_tree, i2a, i2a);
 
     return true;
 }
@@ -673,11 +863,7 @@ dns_cache_del_entry(struct ip2action_req *to_del)
     LOGD("%s: ip2action_cache removing entry:", __func__);
 
     /* free ip2action entry  */
-    dns_cache_free_ip2action(i2a);
-    ds_tree_remove(&mgr->ip2a_tree, i2a);
-    FREE(i2a);
-
-    mgr->entries--;
+    dns_cache_unlink_ip2action(mgr, i2a);
     return true;
 }
 
@@ -692,31 +878,41 @@ dns_cache_ttl_cleanup(void)
 {
     struct dns_cache_mgr *mgr = dns_cache_get_mgr();
     struct ip2action     *i2a, *next;
-    ds_tree_t            *tree;
+    ds_dlist_t           *slot;
+    time_t               nslots;
     time_t               now;
+    time_t               ts;
 
     if (!mgr->initialized) return false;
 
     LOGD("%s: ip2action_cache removing ttl expired entries", __func__);
     now = time(NULL);
 
-    tree = &mgr->ip2a_tree;
+    /*
+     * Sweep the slots elapsed since the last run. Sweep the whole wheel
+     * if more than a revolution elapsed or if the clock went backwards.
+     */
+    nslots = now - mgr->wheel_ts;
+    if ((nslots <= 0) || (nslots > DNS_CACHE_TTL_WHEEL_SLOTS))
+    {
+        nslots = DNS_CACHE_TTL_WHEEL_SLOTS;
+    }
 
-    i2a = ds_tree_head(tree);
-    while (i2a != NULL)
+    for (ts = now - nslots + 1; ts <= now; ts++)
     {
-        if ((now - i2a->original_ts) < i2a->cache_ttl)
+        slot = &mgr->ttl_wheel[(size_t)ts % DNS_CACHE_TTL_WHEEL_SLOTS];
+        ds_dlist_foreach_safe(slot, i2a, next)
         {
-            i2a = ds_tree_next(tree, i2a);
-            continue;
+            /* Entries a wheel revolution or more away stay put */
+            if (i2a->expiry_ts > now) continue;
+
+            dns_cache_unlink_ip2action(mgr, i2a);
         }
-        next = ds_tree_next(tree, i2a);
-        ds_tree_remove(tree, i2a);
-        dns_cache_free_ip2action(i2a);
-        FREE(i2a);
-        mgr->entries--;
-        i2a = next;
     }
+
+    /* Entries scheduled later during this second land in the current slot */
+    mgr->wheel_ts = now - 1;
+
     return true;
 }
 
@@ -736,6 +932,31 @@ dns_cache_get_size(void)
     return mgr->entries;
 }
 
+/**
+ * @brief set the maximum number of cached entries.
+ *
+ * @param max_entries the new limit. 0 restores the default.
+ */
+void
+dns_cache_set_max_entries(int max_entries)
+{
+    struct dns_cache_mgr *mgr = dns_cache_get_mgr();
+    struct ip2action *i2a;
+
+    if (max_entries <= 0) max_entries = DNS_CACHE_DEFAULT_MAX_ENTRIES;
+    mgr->max_entries = max_entries;
+
+    if (!mgr->initialized) return;
+
+    /* Trim the cache down to the new limit */
+    while (mgr->entries > mgr->max_entries)
+    {
+        i2a = ds_dlist_tail(&mgr->lru_list);
+        dns_cache_unlink_ip2action(mgr, i2a);
+        mgr->lru_evictions++;
+    }
+}
+
 /**
  * @brief print cache size.
  *
@@ -854,15 +1075,12 @@ dns_cache_print(void)
 {
     struct dns_cache_mgr *mgr = dns_cache_get_mgr();
     struct ip2action *i2a;
-    ds_tree_t *tree;
 
     if (!mgr->initialized) return;
 
-    tree = &mgr->ip2a_tree;
-
     LOGT("%s: ====START====", __func__);
 
-    ds_tree_foreach(tree, i2a)
+    ds_dlist_foreach(&mgr->lru_list, i2a)
     {
         dns_cache_print_entry(i2a);
     }
@@ -925,6 +1143,8 @@ dns_cache_print_details(void)
 
     dns_cache_print_size();
     dns_cache_print_hit_count();
+    LOGT("%s: ip2action_cache max entries: %d, lru evictions: %" PRIu64,
+         __func__, mgr->max_entries, mgr->lru_evictions);
 }
 
 /**
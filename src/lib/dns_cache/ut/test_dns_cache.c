@@ -1653,6 +1653,103 @@ void test_dns_cache_direction(void)
     LOGI("\n******************** %s: completed ****************\n", __func__);
 }
 
+void test_dns_cache_max_entries(void)
+{
+    struct ip2action_req  key;
+    struct sockaddr_storage ip;
+    os_macaddr_t mac;
+    uint32_t v4udstip;
+    bool rc_lookup;
+    bool rc_add;
+    int nelem;
+    int i;
+
+    LOGI("\n******************** %s: starting ****************\n", __func__);
+
+    dns_cache_set_max_entries(2);
+
+    entry1->service_id = 0;
+    entry1->cache_bc.reputation = 3;
+    entry1->nelems = 1;
+    entry2->service_id = 0;
+    entry2->cache_bc.reputation = 3;
+    entry2->nelems = 1;
+    entry5->service_id = 0;
+    entry5->cache_bc.reputation = 3;
+    entry5->nelems = 1;
+
+    rc_add = dns_cache_add_entry(entry1);
+    TEST_ASSERT_TRUE(rc_add);
+    rc_add = dns_cache_add_entry(entry2);
+    TEST_ASSERT_TRUE(rc_add);
+
+    /* Touch entry1 so entry2 becomes the least recently used */
+    memset(&key, 0, sizeof(struct ip2action_req));
+    v4udstip = htonl(0x04030201);
+    sockaddr_storage_populate(AF_INET, &v4udstip, &ip);
+    key.ip_addr = &ip;
+    memcpy(&mac, entry1->device_mac, sizeof(mac));
+    key.device_mac = &mac;
+    rc_lookup = dns_cache_ip2action_lookup(&key);
+    TEST_ASSERT_TRUE(rc_lookup);
+
+    /* Adding a third entry evicts entry2 */
+    rc_add = dns_cache_add_entry(entry5);
+    TEST_ASSERT_TRUE(rc_add);
+    nelem = dns_cache_get_size();
+    TEST_ASSERT_EQUAL_INT(2, nelem);
+
+    memset(&key, 0, sizeof(struct ip2action_req));
+    v4udstip = htonl(0x04030202);
+    sockaddr_storage_populate(AF_INET, &v4udstip, &ip);
+    key.ip_addr = &ip;
+    memcpy(&mac, entry2->device_mac, sizeof(mac));
+    key.device_mac = &mac;
+    rc_lookup = dns_cache_ip2action_lookup(&key);
+    TEST_ASSERT_FALSE(rc_lookup);
+
+    memset(&key, 0, sizeof(struct ip2action_req));
+    v4udstip = htonl(0x04030201);
+    sockaddr_storage_populate(AF_INET, &v4udstip, &ip);
+    key.ip_addr = &ip;
+    memcpy(&mac, entry1->device_mac, sizeof(mac));
+    key.device_mac = &mac;
+    rc_lookup = dns_cache_ip2action_lookup(&key);
+    TEST_ASSERT_TRUE(rc_lookup);
+
+    /* Lowering the limit trims the cache */
+    dns_cache_set_max_entries(1);
+    nelem = dns_cache_get_size();
+    TEST_ASSERT_EQUAL_INT(1, nelem);
+    rc_lookup = dns_cache_ip2action_lookup(&key);
+    TEST_ASSERT_TRUE(rc_lookup);
+
+    /* Restore the default and grow past the initial hash size */
+    dns_cache_set_max_entries(0);
+    dns_cache_cleanup();
+    for (i = 0; i < 1000; i++)
+    {
+        v4udstip = htonl(0x0a000000 + i);
+        sockaddr_storage_populate(AF_INET, &v4udstip, entry2->ip_addr);
+        rc_add = dns_cache_add_entry(entry2);
+        TEST_ASSERT_TRUE(rc_add);
+    }
+    nelem = dns_cache_get_size();
+    TEST_ASSERT_EQUAL_INT(1000, nelem);
+
+    memset(&key, 0, sizeof(struct ip2action_req));
+    v4udstip = htonl(0x0a000000 + 500);
+    sockaddr_storage_populate(AF_INET, &v4udstip, &ip);
+    key.ip_addr = &ip;
+    memcpy(&mac, entry2->device_mac, sizeof(mac));
+    key.device_mac = &mac;
+    rc_lookup = dns_cache_ip2action_lookup(&key);
+    TEST_ASSERT_TRUE(rc_lookup);
+
+    dns_cache_cleanup();
+    LOGI("\n******************** %s: completed ****************\n", __func__);
+}
+
 void test_events(void)
 {
     /* Test overall test duration */
@@ -1681,6 +1778,7 @@ int main(int argc, char *argv[])
     RUN_TEST(test_dns_cache_entries);
     RUN_TEST(test_dns_cache_action_by_name);
     RUN_TEST(test_dns_cache_direction);
+    RUN_TEST(test_dns_cache_max_entries);
     RUN_TEST(test_dns_cache_disable);
 
     return ut_fini();
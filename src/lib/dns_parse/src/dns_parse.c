@@ -97,6 +97,7 @@ dns_parse_update(struct fsm_session *session)
     char *dbg_str = session->ops.get_config(session, "debug");
     char *cache_ip_str = session->ops.get_config(session, "cache_ip");
     char *mqtt_blocker_topic = session->ops.get_config(session, "blk_mqtt");
+    char *cache_max_entries;
     char *hs_report_interval;
     char *hs_report_topic;
     long interval;
@@ -114,6 +115,13 @@ dns_parse_update(struct fsm_session *session)
                                               "wc_health_stats_topic");
     dns_session->health_stats_report_topic = hs_report_topic;
 
+    cache_max_entries = session->ops.get_config(session,
+                                                "dns_cache_max_entries");
+    if (cache_max_entries != NULL)
+    {
+        dns_cache_set_max_entries((int)strtoul(cache_max_entries, NULL, 10));
+    }
+
     if (dbg_str != NULL)
     {
         LOGT("%s: session %p: debug key value: %s",
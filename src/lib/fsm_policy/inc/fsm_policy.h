@@ -34,6 +34,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "ds_list.h"
 #include "ovsdb_utils.h"
 #include "os_types.h"
+#include "policy_tags.h"
 #include "schema.h"
 
 enum {
@@ -317,6 +318,77 @@ struct fsm_policy_req
 
 #define FSM_MAX_POLICIES 60
 
+#define FSM_FQDN_MAX_LEN 256
+
+/**
+ * @brief character trie node of a compiled fqdn set
+ */
+struct fsm_fqdn_char
+{
+    char c;
+    bool terminal;                  /* an entry ends here */
+    struct fsm_fqdn_char *child;    /* first child */
+    struct fsm_fqdn_char *sibling;  /* next child of the parent */
+};
+
+/**
+ * @brief label trie node of a compiled wildcard fqdn set
+ */
+struct fsm_fqdn_label
+{
+    char *label;                    /* label or fnmatch() pattern */
+    bool glob;                      /* label is a pattern */
+    bool terminal;                  /* a pattern ends here */
+    ds_tree_t literals;             /* children by label */
+    struct fsm_fqdn_label *globs;   /* pattern children */
+    struct fsm_fqdn_label *next;    /* next pattern child of the parent */
+    ds_tree_node_t node;
+};
+
+/**
+ * @brief compiled fqdn set of a policy
+ *
+ * Built when the policy is provisioned, see fsm_fqdn_matcher_compile().
+ */
+struct fsm_fqdn_matcher
+{
+    int op;                         /* FSM_FQDN_OP_* lookup type */
+    struct fsm_fqdn_char *chars;    /* exact, sfl and sfr lookups */
+    struct fsm_fqdn_label *labels;  /* wildcard lookups */
+};
+
+/**
+ * @brief binary index of a policy's mac set
+ */
+struct fsm_mac_set
+{
+    uint64_t *slots;                /* open addressing hash set of macs */
+    size_t nslots;
+    size_t count;
+    char **tags;                    /* tag entries of the set, expanded in slots */
+    size_t ntags;
+};
+
+/**
+ * @brief radix tree node of a policy's ip set
+ */
+struct fsm_ip_node
+{
+    uint8_t addr[16];               /* prefix, masked */
+    int plen;                       /* prefix length in bits */
+    bool terminal;                  /* the prefix is in the set */
+    struct fsm_ip_node *child[2];
+};
+
+/**
+ * @brief binary index of a policy's ip set
+ */
+struct fsm_ip_set
+{
+    struct fsm_ip_node *ipv4;
+    struct fsm_ip_node *ipv6;
+};
+
 /**
  * @brief representation of a policy rule.
  *
@@ -336,10 +408,12 @@ struct fsm_policy_rules
     bool mac_rule_present;
     int mac_op;
     struct str_set *macs;
+    struct fsm_mac_set *mac_set;
 
     bool fqdn_rule_present;
     int fqdn_op;
     struct str_set *fqdns;
+    struct fsm_fqdn_matcher *fqdn_matcher;
 
     bool cat_rule_present;
     int cat_op;
@@ -352,6 +426,7 @@ struct fsm_policy_rules
     bool ip_rule_present;
     int ip_op;
     struct str_set *ipaddrs;
+    struct fsm_ip_set *ip_set;
 
     bool app_rule_present;
     int app_op;
@@ -429,11 +504,46 @@ struct fsm_policy_client
     ds_tree_node_t client_node;
 };
 
+#define FSM_POLICY_VERDICT_CACHE_SIZE 512
+
+/**
+ * @brief cached outcome of a policy table walk
+ *
+ * Keyed by (device, fqdn or ip, policy table).
+ */
+struct fsm_policy_verdict
+{
+    uint64_t generation;            /* cache generation at store time */
+    uint32_t hash;
+    struct policy_table *table;
+    os_macaddr_t device_id;
+    char *name;                     /* fqdn or ip, NULL if the entry is empty */
+    struct fsm_policy *match;       /* last matching policy, NULL if none */
+    struct fsm_policy *rule;        /* last matching policy setting the rule name */
+    bool report;                    /* a matching policy requires reporting */
+    bool dns_lookup;                /* the walk went through the dns cache */
+};
+
+struct fsm_policy_verdict_stats
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t invalidations;
+};
+
+struct fsm_policy_verdict_cache
+{
+    uint64_t generation;
+    struct fsm_policy_verdict entries[FSM_POLICY_VERDICT_CACHE_SIZE];
+    struct fsm_policy_verdict_stats stats;
+};
+
 struct fsm_policy_session
 {
     bool initialized;
     ds_tree_t policy_tables;
     ds_tree_t clients;
+    struct fsm_policy_verdict_cache verdicts;
 };
 
 struct fsm_request_args
@@ -476,6 +586,26 @@ int fsm_policy_get_req_type(struct fsm_policy_req *req);
 void fsm_walk_clients_tree(const char *caller);
 void fsm_policy_flush_cache(struct fsm_policy *policy);
 bool fsm_policy_wildmatch(char *pattern, char *domain);
+int fsm_fqdn_lookup_op(int fqdn_op);
+struct fsm_fqdn_matcher *fsm_fqdn_matcher_compile(int op, struct str_set *fqdns);
+void fsm_fqdn_matcher_free(struct fsm_fqdn_matcher *matcher);
+bool fsm_fqdn_matcher_match(struct fsm_fqdn_matcher *matcher, const char *fqdn);
+struct fsm_mac_set *fsm_mac_set_compile(struct str_set *macs);
+void fsm_mac_set_free(struct fsm_mac_set *set);
+bool fsm_mac_set_lookup(struct fsm_mac_set *set, os_macaddr_t *mac);
+void fsm_policy_tag_update(om_tag_t *tag, ds_tree_t *removed,
+                           ds_tree_t *added, ds_tree_t *updated);
+struct fsm_ip_set *fsm_ip_set_compile(struct str_set *ips);
+void fsm_ip_set_free(struct fsm_ip_set *set);
+bool fsm_ip_set_lookup(struct fsm_ip_set *set, int af, const void *addr);
+void fsm_policy_verdict_invalidate(void);
+struct fsm_policy_verdict *fsm_policy_verdict_lookup(struct fsm_policy_req *req,
+                                                     struct policy_table *table);
+void fsm_policy_verdict_store(struct fsm_policy_req *req,
+                              struct policy_table *table,
+                              struct fsm_policy_verdict *walk);
+void fsm_policy_verdict_flush(void);
+void fsm_policy_get_verdict_stats(struct fsm_policy_verdict_stats *stats);
 struct fsm_policy_req *
 fsm_policy_initialize_request(struct fsm_request_args *request_args);
 void fsm_policy_free_request(struct fsm_policy_req *policy_request);
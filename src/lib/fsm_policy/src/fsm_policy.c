@@ -39,6 +39,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <fnmatch.h>
 #include <sys/socket.h>
 #include <netdb.h>
+#include <arpa/inet.h>
 
 #include "os.h"
 #include "util.h"
@@ -262,6 +263,9 @@ bool fsm_device_in_set(struct fsm_policy_req *req, struct fsm_policy *p)
 
     if (macs_set == NULL) return false;
 
+    /* Rules provisioned through ovsdb carry a binary index */
+    if (p->rules.mac_set != NULL) return fsm_mac_set_lookup(p->rules.mac_set, mac);
+
     return find_mac_in_set(mac, macs_set);
 }
 
@@ -378,59 +382,20 @@ fsm_policy_wildmatch(char *pattern, char *domain)
 }
 
 
-/**
- * fsm_fqdn_in_set: looks up a fqdn in a policy's fqdns values set.
- * @req: the policy request
- * @p: policy
- * @op: lookup
- *
- * Checks if the request's fqdn is either an exact match, start from right
- * or start form left superset of an entry in the policy's fqdn set entry.
- */
-static bool fsm_fqdn_in_set(struct fsm_policy_req *req, struct fsm_policy *p,
-                            int op)
-{
-    struct str_set *fqdns_set;
-    size_t nelems, i;
-    int rc;
-
-    fqdns_set = p->rules.fqdns;
-    if (fqdns_set == NULL) return false;
-    nelems = fqdns_set->nelems;
-    for (i = 0; i < nelems; i++)
-    {
-        char *fqdn_req = req->url;
-        char *entry_set = fqdns_set->array[i];
-        int entry_set_len = strlen(entry_set);
-        int fqdn_req_len = strlen(fqdn_req);
-
-        if (entry_set_len > fqdn_req_len) continue;
-
-        if (op == FSM_FQDN_OP_WILD) return fsm_policy_wildmatch(entry_set, fqdn_req);
-
-        if (op == FSM_FQDN_OP_SFR) fqdn_req += (fqdn_req_len - entry_set_len);
-
-        rc = strncmp(fqdn_req, entry_set, entry_set_len);
-        if (rc == 0) return true;
-    }
-    return false;
-}
-
 /**
  * fsm_fqdn_check: check if a fqdn matches the policy's fqdn rule
  * @req: the request being processed
  * @policy: the policy being checked against
  *
+ * The policy's fqdn set is compiled at provisioning time,
+ * see fsm_fqdn_matcher_compile().
  */
 static bool fsm_fqdn_check(struct fsm_policy_req *req,
                            struct fsm_policy *policy)
 {
     struct fsm_policy_rules *rules;
     bool rc = false;
-    bool in_policy, sfr, sfl, wild;
-    int op;
-
-    op = FSM_FQDN_OP_XM;
+    bool in_policy;
 
     rules = &policy->rules;
     if (!rules->fqdn_rule_present) return true;
@@ -441,22 +406,7 @@ static bool fsm_fqdn_check(struct fsm_policy_req *req,
     in_policy |= (rules->fqdn_op == FQDN_OP_SFL_IN);
     in_policy |= (rules->fqdn_op == FQDN_OP_WILD_IN);
 
-
-    sfr = (rules->fqdn_op == FQDN_OP_SFR_IN);
-    sfr |= (rules->fqdn_op == FQDN_OP_SFR_OUT);
-    if (sfr) op = FSM_FQDN_OP_SFR;
-
-    sfl = (rules->fqdn_op == FQDN_OP_SFL_IN);
-    sfl |= (rules->fqdn_op == FQDN_OP_SFL_OUT);
-    if (sfl) op = FSM_FQDN_OP_SFL;
-
-
-    wild = (rules->fqdn_op == FQDN_OP_WILD_IN);
-    wild |= (rules->fqdn_op == FQDN_OP_WILD_OUT);
-    if (wild) op = FSM_FQDN_OP_WILD;
-
-
-    rc = fsm_fqdn_in_set(req, policy, op);
+    rc = fsm_fqdn_matcher_match(rules->fqdn_matcher, req->url);
 
     /* If fqdn in set and policy applies to fqdns out of set, no match */
     if ((rc) && (!in_policy)) return false;
@@ -532,25 +482,21 @@ fsm_fqdncats_in_set(struct fsm_policy_req *req,
 
 
 /**
- * @brief looks up a fqdn in a policy's fqdns values set.
+ * @brief looks up an ip in a policy's ip values set.
  * @param req the policy request
  * @param p the policy
  * @param op the lookup operation
  *
- * Checks if the request's ip is either an exact match, start from right
- * or start form left superset of an entry in the policy's fqdn set entry.
+ * Checks if the request's ip is covered by an address or a cidr prefix
+ * of the policy's ip set.
  */
 static bool fsm_ip_in_set(struct fsm_policy_req *req, struct fsm_policy *p,
                           int op)
 {
+    uint8_t addr[sizeof(struct in6_addr)];
     struct net_md_stats_accumulator *acc;
     struct net_md_flow_key *key;
-    struct str_set *ips_set;
-    size_t ip_str_len;
-    size_t nelems;
     int af_family;
-    size_t len;
-    size_t i;
     int rc;
 
     acc = req->acc;
@@ -560,23 +506,12 @@ static bool fsm_ip_in_set(struct fsm_policy_req *req, struct fsm_policy *p,
     if (key->ip_version == 6) af_family = AF_INET6;
     if (af_family == 0) return false;
 
-    ips_set = p->rules.ipaddrs;
-    if (ips_set == NULL) return false;
-
-    ip_str_len = strlen(req->url);
-    nelems = ips_set->nelems;
-    for (i = 0; i < nelems; i++)
-    {
-        char *entry_set;
+    if (p->rules.ip_set == NULL) return false;
 
-        entry_set = ips_set->array[i];
-        len = strlen(entry_set);
-        if (len != ip_str_len) continue;
-        rc = strncmp(req->url, entry_set, len);
-        if (!rc) return true;
+    rc = inet_pton(af_family, req->url, addr);
+    if (rc != 1) return false;
 
-    }
-    return false;
+    return fsm_ip_set_lookup(p->rules.ip_set, af_family, addr);
 }
 
 
@@ -1348,45 +1283,26 @@ fsm_gk_check_required(struct fsm_policy *policy,
 }
 
 /**
- * fsm_apply_policies: check a request against stored policies
- * @req: policy checking (mac, fqdn, categories) request
+ * @brief walks a policy table looking for the matching policies
  *
- * Walks through the policies table looking for a match,
- * combines the action and report to apply
+ * @param req the request being processed
+ * @param table the policy table
+ * @param policy_reply the reply being built
+ * @param walk the outcome of the walk
+ * @return true if the outcome only depends on the device, the request's
+ *         name and the table, and can be cached.
  */
-int fsm_apply_policies(struct fsm_policy_req *req,
-                       struct fsm_policy_reply *policy_reply)
+static bool
+fsm_walk_policies(struct fsm_policy_req *req, struct policy_table *table,
+                  struct fsm_policy_reply *policy_reply,
+                  struct fsm_policy_verdict *walk)
 {
-    struct fsm_policy *last_match_policy;
-    struct policy_table *table;
-    int action = FSM_NO_MATCH;
+    bool cacheable;
     struct fsm_policy *p;
-    int req_type;
-    bool report;
-    bool gk_req;
-
+    bool rc;
     int i;
-    bool rc, matched = false;
-
-    table = policy_reply->policy_table;
-    if (table == NULL)
-    {
-        policy_reply->action = FSM_NO_MATCH;
-        policy_reply->log = FSM_REPORT_NONE;
-        return policy_reply->action;
-    }
-
-    req_type = fsm_policy_get_req_type(req);
-    LOGT("%s(): request type %d, policy_request == %p, policy_reply == %p, fqdn == %p",
-         __func__,
-         req_type,
-         req,
-         policy_reply,
-         req->fqdn_req);
-
-    last_match_policy = NULL;
-    req->report = false;
 
+    cacheable = true;
     for (i = 0; i < FSM_MAX_POLICIES; i++)
     {
         p = table->lookup_array[i];
@@ -1404,10 +1320,16 @@ int fsm_apply_policies(struct fsm_policy_req *req,
         rc = fsm_ip_check(req, p);
         if (!rc) continue;
 
+        /* Categorization and risk results are not part of the cache key */
+        walk->dns_lookup = true;
+        if (p->rules.cat_rule_present) cacheable = false;
+
         /* fqdn rule passed. Check categories */
         rc = fsm_cat_check(req, p, policy_reply);
         if (!rc) continue;
 
+        if (p->rules.risk_rule_present) cacheable = false;
+
         /* categories rules passed. Check risk level */
         rc = fsm_risk_level_check(req, p, policy_reply);
         if (!rc) continue;
@@ -1418,8 +1340,7 @@ int fsm_apply_policies(struct fsm_policy_req *req,
          * No action implicitely means going to the next entry.
          * Though record we had a match
          */
-        matched = true;
-        last_match_policy = p;
+        walk->match = p;
 
         /* Explicit check for reporting is required for
          * gatekeeper policy, since gatekeeper reports
@@ -1428,17 +1349,96 @@ int fsm_apply_policies(struct fsm_policy_req *req,
         if (p->action != FSM_GATEKEEPER_REQ)
         {
             /* check if reporting is required */
-            report = (p->report_type == FSM_REPORT_ALL);
-            req->report |= report;
-            req->rule_name = p->rule_name;
-            req->policy_index = p->idx;
-            req->action = (p->action == FSM_ACTION_NONE ? FSM_OBSERVED : p->action);
-
-            LOGT("%s(): report flag %d, rule name %s ", __func__, req->report, req->rule_name);
+            walk->report |= (p->report_type == FSM_REPORT_ALL);
+            walk->rule = p;
         }
         if (p->action != FSM_ACTION_NONE) break;
     }
 
+    return cacheable;
+}
+
+
+/**
+ * @brief sets the request's rule and report from a walk's outcome
+ *
+ * @param req the request being processed
+ * @param verdict the walk's outcome
+ */
+static void
+fsm_apply_verdict(struct fsm_policy_req *req, struct fsm_policy_verdict *verdict)
+{
+    struct fsm_policy *p;
+
+    req->report = verdict->report;
+
+    p = verdict->rule;
+    if (p == NULL) return;
+
+    req->rule_name = p->rule_name;
+    req->policy_index = p->idx;
+    req->action = (p->action == FSM_ACTION_NONE ? FSM_OBSERVED : p->action);
+
+    LOGT("%s(): report flag %d, rule name %s ", __func__, req->report, req->rule_name);
+}
+
+
+/**
+ * fsm_apply_policies: check a request against stored policies
+ * @req: policy checking (mac, fqdn, categories) request
+ *
+ * Walks through the policies table looking for a match,
+ * combines the action and report to apply
+ */
+int fsm_apply_policies(struct fsm_policy_req *req,
+                       struct fsm_policy_reply *policy_reply)
+{
+    struct fsm_policy_verdict *verdict;
+    struct fsm_policy *last_match_policy;
+    struct fsm_policy_verdict walk;
+    struct policy_table *table;
+    int action = FSM_NO_MATCH;
+    struct fsm_policy *p;
+    bool matched = false;
+    bool cacheable;
+    int req_type;
+    bool gk_req;
+
+    table = policy_reply->policy_table;
+    if (table == NULL)
+    {
+        policy_reply->action = FSM_NO_MATCH;
+        policy_reply->log = FSM_REPORT_NONE;
+        return policy_reply->action;
+    }
+
+    req_type = fsm_policy_get_req_type(req);
+    LOGT("%s(): request type %d, policy_request == %p, policy_reply == %p, fqdn == %p",
+         __func__,
+         req_type,
+         req,
+         policy_reply,
+         req->fqdn_req);
+
+    /* Replay a previous walk for the same device, name and table */
+    verdict = fsm_policy_verdict_lookup(req, table);
+    if (verdict == NULL)
+    {
+        memset(&walk, 0, sizeof(walk));
+        cacheable = fsm_walk_policies(req, table, policy_reply, &walk);
+        if (cacheable) fsm_policy_verdict_store(req, table, &walk);
+        verdict = &walk;
+    }
+    else
+    {
+        LOGT("%s(): replaying cached verdict", __func__);
+        if (verdict->dns_lookup) fsm_dns_cache_lookup(req, policy_reply);
+    }
+
+    fsm_apply_verdict(req, verdict);
+    matched = (verdict->match != NULL);
+    last_match_policy = verdict->match;
+
     if (matched)
     {
         p = last_match_policy;
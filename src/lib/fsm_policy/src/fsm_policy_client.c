@@ -24,6 +24,7 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <inttypes.h>
 #include <stddef.h>
 
 #include "ds_tree.h"
@@ -93,6 +94,9 @@ fsm_walk_clients_tree(const char *caller)
     tree = &mgr->clients;
 
     LOGD("%s: Walking client tree", caller);
+    LOGD("%s: verdict cache: %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64 " invalidations",
+         caller, mgr->verdicts.stats.hits, mgr->verdicts.stats.misses,
+         mgr->verdicts.stats.invalidations);
     client = ds_tree_head(tree);
     while (client != NULL)
     {
@@ -285,3 +289,18 @@ fsm_policy_flush_cache(struct fsm_policy *policy)
         client = ds_tree_next(tree, client);
     }
 }
+
+
+/**
+ * @brief returns the policy verdict cache counters
+ *
+ * @param stats the counters to fill
+ */
+void
+fsm_policy_get_verdict_stats(struct fsm_policy_verdict_stats *stats)
+{
+    struct fsm_policy_session *mgr;
+
+    mgr = fsm_policy_get_mgr();
+    *stats = mgr->verdicts.stats;
+}
@@ -0,0 +1,398 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <fnmatch.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "ds_tree.h"
+#include "fsm_policy.h"
+#include "log.h"
+#include "memutil.h"
+
+/*
+ * Compiled fqdn matchers.
+ *
+ * A policy's fqdn set is compiled once when the policy is provisioned:
+ * - exact and start from left entries go in a character trie walked from
+ *   the first character of the requested fqdn,
+ * - start from right entries go in a character trie of the reversed
+ *   entries, walked from the last character of the requested fqdn,
+ * - wildcard entries go in a trie of labels, rightmost label first.
+ *   Literal labels are indexed by name, labels holding a pattern are
+ *   checked with fnmatch().
+ * Looking up a fqdn is a single walk and does not allocate memory.
+ */
+
+/* Same limit as fsm_policy_wildmatch() */
+#define FSM_FQDN_WILD_MAX_LABELS 9
+
+
+/**
+ * @brief map a policy fqdn operation to a lookup type
+ *
+ * @param fqdn_op the FQDN_OP_* policy operation
+ * @return the FSM_FQDN_OP_* lookup type
+ */
+int
+fsm_fqdn_lookup_op(int fqdn_op)
+{
+    switch (fqdn_op)
+    {
+        case FQDN_OP_SFR_IN:
+        case FQDN_OP_SFR_OUT:
+            return FSM_FQDN_OP_SFR;
+
+        case FQDN_OP_SFL_IN:
+        case FQDN_OP_SFL_OUT:
+            return FSM_FQDN_OP_SFL;
+
+        case FQDN_OP_WILD_IN:
+        case FQDN_OP_WILD_OUT:
+            return FSM_FQDN_OP_WILD;
+
+        default:
+            return FSM_FQDN_OP_XM;
+    }
+}
+
+
+static void
+fsm_fqdn_chars_add(struct fsm_fqdn_char *root, const char *entry, bool reverse)
+{
+    struct fsm_fqdn_char *node;
+    struct fsm_fqdn_char *child;
+    size_t len;
+    size_t i;
+    char c;
+
+    len = strlen(entry);
+    node = root;
+    for (i = 0; i < len; i++)
+    {
+        c = reverse ? entry[len - 1 - i] : entry[i];
+        for (child = node->child; child != NULL; child = child->sibling)
+        {
+            if (child->c == c) break;
+        }
+
+        if (child == NULL)
+        {
+            child = CALLOC(1, sizeof(*child));
+            child->c = c;
+            child->sibling = node->child;
+            node->child = child;
+        }
+        node = child;
+    }
+    node->terminal = true;
+}
+
+
+static void
+fsm_fqdn_chars_free(struct fsm_fqdn_char *node)
+{
+    struct fsm_fqdn_char *child;
+    struct fsm_fqdn_char *next;
+
+    if (node == NULL) return;
+
+    for (child = node->child; child != NULL; child = next)
+    {
+        next = child->sibling;
+        fsm_fqdn_chars_free(child);
+    }
+    FREE(node);
+}
+
+
+/**
+ * @brief checks if an entry of the character trie is a prefix of the fqdn
+ *
+ * The fqdn is walked backwards for reversed tries.
+ */
+static bool
+fsm_fqdn_chars_match(struct fsm_fqdn_char *root, const char *fqdn, bool reverse)
+{
+    struct fsm_fqdn_char *node;
+    size_t len;
+    size_t i;
+    char c;
+
+    len = strlen(fqdn);
+    node = root;
+    for (i = 0; ; i++)
+    {
+        if (node->terminal) return true;
+        if (i == len) return false;
+
+        c = reverse ? fqdn[len - 1 - i] : fqdn[i];
+        for (node = node->child; node != NULL; node = node->sibling)
+        {
+            if (node->c == c) break;
+        }
+        if (node == NULL) return false;
+    }
+}
+
+
+static struct fsm_fqdn_label *
+fsm_fqdn_label_new(const char *label)
+{
+    struct fsm_fqdn_label *node;
+
+    node = CALLOC(1, sizeof(*node));
+    node->label = STRDUP(label);
+    node->glob = (strpbrk(label, "*?[\\") != NULL);
+    ds_tree_init(&node->literals, ds_str_cmp, struct fsm_fqdn_label, node);
+
+    return node;
+}
+
+
+static void
+fsm_fqdn_label_free(struct fsm_fqdn_label *node)
+{
+    struct fsm_fqdn_label *child;
+    struct fsm_fqdn_label *next;
+
+    if (node == NULL) return;
+
+    while ((child = ds_tree_head(&node->literals)) != NULL)
+    {
+        ds_tree_remove(&node->literals, child);
+        fsm_fqdn_label_free(child);
+    }
+
+    for (child = node->globs; child != NULL; child = next)
+    {
+        next = child->next;
+        fsm_fqdn_label_free(child);
+    }
+
+    FREE(node->label);
+    FREE(node);
+}
+
+
+/**
+ * @brief splits a fqdn in place in its labels
+ *
+ * Empty labels are skipped, as strtok_r() does.
+ *
+ * @return the number of labels, -1 if there are too many
+ */
+static int
+fsm_fqdn_split_labels(char *fqdn, char **labels)
+{
+    int n;
+
+    n = 0;
+    while (*fqdn != '\0')
+    {
+        if (*fqdn == '.')
+        {
+            *fqdn++ = '\0';
+            continue;
+        }
+
+        if (n == FSM_FQDN_WILD_MAX_LABELS) return -1;
+        labels[n++] = fqdn;
+
+        fqdn = strchrnul(fqdn, '.');
+    }
+
+    return n;
+}
+
+
+static void
+fsm_fqdn_labels_add(struct fsm_fqdn_label *root, const char *entry)
+{
+    char *labels[FSM_FQDN_WILD_MAX_LABELS];
+    struct fsm_fqdn_label *child;
+    struct fsm_fqdn_label *node;
+    char *pattern;
+    int n;
+
+    pattern = STRDUP(entry);
+    n = fsm_fqdn_split_labels(pattern, labels);
+    if (n == -1)
+    {
+        LOGD("%s(): Pattern is too long %s", __func__, entry);
+        goto out;
+    }
+
+    node = root;
+    while (n-- > 0)
+    {
+        if (strpbrk(labels[n], "*?[\\") != NULL)
+        {
+            for (child = node->globs; child != NULL; child = child->next)
+            {
+                if (strcmp(child->label, labels[n]) == 0) break;
+            }
+            if (child == NULL)
+            {
+                child = fsm_fqdn_label_new(labels[n]);
+                child->next = node->globs;
+                node->globs = child;
+            }
+        }
+        else
+        {
+            child = ds_tree_find(&node->literals, labels[n]);
+            if (child == NULL)
+            {
+                child = fsm_fqdn_label_new(labels[n]);
+                ds_tree_insert(&node->literals, child, child->label);
+            }
+        }
+        node = child;
+    }
+    node->terminal = true;
+
+out:
+    FREE(pattern);
+}
+
+
+static bool
+fsm_fqdn_labels_walk(struct fsm_fqdn_label *node, char **labels, int n)
+{
+    struct fsm_fqdn_label *child;
+    char *label;
+
+    if (n == 0) return node->terminal;
+
+    label = labels[n - 1];
+    child = ds_tree_find(&node->literals, label);
+    if (child != NULL && fsm_fqdn_labels_walk(child, labels, n - 1)) return true;
+
+    for (child = node->globs; child != NULL; child = child->next)
+    {
+        if (fnmatch(child->label, label, 0)) continue;
+        if (fsm_fqdn_labels_walk(child, labels, n - 1)) return true;
+    }
+
+    return false;
+}
+
+
+static bool
+fsm_fqdn_labels_match(struct fsm_fqdn_label *root, const char *fqdn)
+{
+    char *labels[FSM_FQDN_WILD_MAX_LABELS];
+    char name[FSM_FQDN_MAX_LEN];
+    size_t len;
+    int n;
+
+    len = strlen(fqdn);
+    if (len >= sizeof(name)) return false;
+
+    memcpy(name, fqdn, len + 1);
+    n = fsm_fqdn_split_labels(name, labels);
+    if (n == -1) return false;
+
+    return fsm_fqdn_labels_walk(root, labels, n);
+}
+
+
+/**
+ * @brief compiles a policy's fqdn set
+ *
+ * @param op the FSM_FQDN_OP_* lookup type
+ * @param fqdns the provisioned fqdn set
+ * @return the compiled matcher, NULL if the set is empty
+ */
+struct fsm_fqdn_matcher *
+fsm_fqdn_matcher_compile(int op, struct str_set *fqdns)
+{
+    struct fsm_fqdn_matcher *matcher;
+    bool reverse;
+    size_t i;
+
+    if (fqdns == NULL) return NULL;
+
+    matcher = CALLOC(1, sizeof(*matcher));
+    matcher->op = op;
+
+    if (op == FSM_FQDN_OP_WILD)
+    {
+        matcher->labels = fsm_fqdn_label_new("");
+        for (i = 0; i < fqdns->nelems; i++)
+        {
+            fsm_fqdn_labels_add(matcher->labels, fqdns->array[i]);
+        }
+        return matcher;
+    }
+
+    reverse = (op == FSM_FQDN_OP_SFR);
+    matcher->chars = CALLOC(1, sizeof(*matcher->chars));
+    for (i = 0; i < fqdns->nelems; i++)
+    {
+        fsm_fqdn_chars_add(matcher->chars, fqdns->array[i], reverse);
+    }
+
+    return matcher;
+}
+
+
+/**
+ * @brief frees a compiled fqdn matcher
+ *
+ * @param matcher the matcher to free
+ */
+void
+fsm_fqdn_matcher_free(struct fsm_fqdn_matcher *matcher)
+{
+    if (matcher == NULL) return;
+
+    fsm_fqdn_chars_free(matcher->chars);
+    fsm_fqdn_label_free(matcher->labels);
+    FREE(matcher);
+}
+
+
+/**
+ * @brief looks up a fqdn in a compiled fqdn set
+ *
+ * @param matcher the compiled set
+ * @param fqdn the fqdn to look up
+ * @return true if an entry of the set matches the fqdn
+ */
+bool
+fsm_fqdn_matcher_match(struct fsm_fqdn_matcher *matcher, const char *fqdn)
+{
+    if (matcher == NULL) return false;
+    if (fqdn == NULL) return false;
+
+    if (matcher->labels != NULL) return fsm_fqdn_labels_match(matcher->labels, fqdn);
+
+    return fsm_fqdn_chars_match(matcher->chars, fqdn,
+                                (matcher->op == FSM_FQDN_OP_SFR));
+}
@@ -219,11 +219,15 @@ fsm_free_rules(struct fsm_policy_rules *rules)
     rules->mac_rule_present = false;
     rules->mac_op = -1;
     free_str_set(rules->macs);
+    fsm_mac_set_free(rules->mac_set);
+    rules->mac_set = NULL;
 
     /* Reset fqdn check */
     rules->fqdn_rule_present = false;
     rules->fqdn_op = -1;
     free_str_set(rules->fqdns);
+    fsm_fqdn_matcher_free(rules->fqdn_matcher);
+    rules->fqdn_matcher = NULL;
 
     /* Reset web categorization check */
     rules->cat_rule_present = false;
@@ -239,6 +243,8 @@ fsm_free_rules(struct fsm_policy_rules *rules)
     rules->ip_rule_present = false;
     rules->ip_op = -1;
     free_str_set(rules->ipaddrs);
+    fsm_ip_set_free(rules->ip_set);
+    rules->ip_set = NULL;
 
     /* Reset app check */
     rules->app_rule_present = false;
@@ -278,7 +284,10 @@ bool fsm_set_mac_rules(struct fsm_policy_rules *rules,
                                  spolicy->macs_len,
                                  spolicy->macs);
     check = fsm_check_conversion(rules->macs, spolicy->macs_len);
-    return check;
+    if (!check) return false;
+
+    rules->mac_set = fsm_mac_set_compile(rules->macs);
+    return true;
 }
 
 
@@ -322,7 +331,11 @@ bool fsm_set_fqdn_rules(struct fsm_policy_rules *rules,
                                   spolicy->fqdns_len,
                                   spolicy->fqdns);
     check = fsm_check_conversion(rules->fqdns, spolicy->fqdns_len);
-    return check;
+    if (!check) return false;
+
+    rules->fqdn_matcher = fsm_fqdn_matcher_compile(fsm_fqdn_lookup_op(rules->fqdn_op),
+                                                   rules->fqdns);
+    return true;
 }
 
 
@@ -429,7 +442,10 @@ fsm_set_ip_rules(struct fsm_policy_rules *rules,
                                     spolicy->ipaddrs_len,
                                     spolicy->ipaddrs);
     check = fsm_check_conversion(rules->ipaddrs, spolicy->ipaddrs_len);
-    return check;
+    if (!check) return false;
+
+    rules->ip_set = fsm_ip_set_compile(rules->ipaddrs);
+    return true;
 }
 
 
@@ -875,6 +891,7 @@ void fsm_add_policy(struct schema_FSM_Policy *spolicy)
     }
 
     fsm_prepare_policy(fpolicy);
+    fsm_policy_verdict_invalidate();
 }
 
 
@@ -900,6 +917,8 @@ void fsm_free_policy(struct fsm_policy *fpolicy)
     idx = fpolicy->idx;
     table->lookup_array[idx] = NULL;
     FREE(fpolicy);
+
+    fsm_policy_verdict_invalidate();
 }
 
 
@@ -1001,6 +1020,7 @@ void fsm_init_manager(void)
                  struct policy_table, table_node);
 
     fsm_policy_client_init();
+    fsm_policy_verdict_flush();
     mgr->initialized = true;
 }
 
@@ -0,0 +1,680 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <arpa/inet.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "fsm_policy.h"
+#include "log.h"
+#include "memutil.h"
+#include "os_types.h"
+#include "policy_tags.h"
+#include "util.h"
+
+/*
+ * Binary indexes of a policy's mac and ip sets, built when the policy
+ * is provisioned:
+ * - mac addresses are kept in an open addressing hash set of 48 bits
+ *   values. Tag entries are expanded into the hash set, and the sets
+ *   referring to a tag are rebuilt when the tag changes.
+ * - ip addresses and cidr prefixes are kept in a path compressed radix
+ *   tree per address family.
+ */
+
+#define FSM_MAC_SET_MIN_SLOTS 16
+
+/* marks a used slot, so that 00:00:00:00:00:00 can be stored */
+#define FSM_MAC_SET_USED (1ULL << 48)
+
+/* length of the string representation of a mac address */
+#define FSM_MAC_STR_LEN 17
+
+/**
+ * @brief a tag change not yet applied to the tag's values
+ *
+ * The tags manager notifies an update before applying it to the tag.
+ */
+struct fsm_mac_set_tag_diff
+{
+    om_tag_t *tag;
+    ds_tree_t *removed;
+    ds_tree_t *added;
+    ds_tree_t *updated;
+};
+
+
+static uint64_t
+fsm_mac_to_u64(const uint8_t *addr)
+{
+    uint64_t key;
+    int i;
+
+    key = 0;
+    for (i = 0; i < 6; i++) key = (key << 8) | addr[i];
+
+    return key;
+}
+
+
+static size_t
+fsm_mac_set_hash(uint64_t key)
+{
+    key ^= key >> 29;
+    key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 32;
+
+    return (size_t)key;
+}
+
+
+static void
+fsm_mac_set_insert_slot(uint64_t *slots, size_t nslots, uint64_t key)
+{
+    size_t mask;
+    size_t i;
+
+    mask = nslots - 1;
+    for (i = fsm_mac_set_hash(key) & mask; slots[i] != 0; i = (i + 1) & mask)
+    {
+        if (slots[i] == key) return;
+    }
+    slots[i] = key;
+}
+
+
+static bool
+fsm_mac_set_find(struct fsm_mac_set *set, uint64_t key)
+{
+    size_t mask;
+    size_t i;
+
+    mask = set->nslots - 1;
+    for (i = fsm_mac_set_hash(key) & mask; set->slots[i] != 0; i = (i + 1) & mask)
+    {
+        if (set->slots[i] == key) return true;
+    }
+
+    return false;
+}
+
+
+/**
+ * @brief doubles the number of slots of a mac index
+ *
+ * Tag expansions do not know their size upfront.
+ */
+static void
+fsm_mac_set_grow(struct fsm_mac_set *set)
+{
+    uint64_t *slots;
+    size_t nslots;
+    size_t i;
+
+    nslots = set->nslots << 1;
+    slots = CALLOC(nslots, sizeof(*slots));
+    for (i = 0; i < set->nslots; i++)
+    {
+        if (set->slots[i] != 0) fsm_mac_set_insert_slot(slots, nslots, set->slots[i]);
+    }
+
+    FREE(set->slots);
+    set->slots = slots;
+    set->nslots = nslots;
+}
+
+
+static void
+fsm_mac_set_insert(struct fsm_mac_set *set, uint64_t key)
+{
+    key |= FSM_MAC_SET_USED;
+    if (fsm_mac_set_find(set, key)) return;
+
+    if (2 * (set->count + 1) > set->nslots) fsm_mac_set_grow(set);
+    fsm_mac_set_insert_slot(set->slots, set->nslots, key);
+    set->count++;
+}
+
+
+/**
+ * @brief parses a lower case mac address at the start of a set entry
+ *
+ * Set entries used to be compared to the lower case representation of
+ * the device mac, upper case entries never matched.
+ */
+static bool
+fsm_mac_set_parse(const char *s, uint64_t *key)
+{
+    uint8_t addr[6];
+    int hi, lo;
+    int i;
+
+    for (i = 0; i < 6; i++)
+    {
+        if (i > 0 && *s++ != ':') return false;
+
+        hi = (*s >= '0' && *s <= '9') ? *s - '0' : (*s >= 'a' && *s <= 'f') ? *s - 'a' + 10 : -1;
+        s++;
+        lo = (*s >= '0' && *s <= '9') ? *s - '0' : (*s >= 'a' && *s <= 'f') ? *s - 'a' + 10 : -1;
+        s++;
+        if (hi < 0 || lo < 0) return false;
+
+        addr[i] = (uint8_t)((hi << 4) | lo);
+    }
+
+    *key = fsm_mac_to_u64(addr);
+    return true;
+}
+
+
+/**
+ * @brief adds a tag value to a mac index
+ *
+ * om_tag_in() matched tag values exactly, and only those carrying the
+ * flags requested by the tag entry, if any.
+ */
+static void
+fsm_mac_set_add_tag_value(struct fsm_mac_set *set, char *value,
+                          int flags, int match_flags)
+{
+    uint64_t key;
+
+    if (match_flags && !(flags & match_flags)) return;
+    if (strlen(value) != FSM_MAC_STR_LEN) return;
+    if (!fsm_mac_set_parse(value, &key)) return;
+
+    fsm_mac_set_insert(set, key);
+}
+
+
+/**
+ * @brief expands a tag entry of a mac set into the mac index
+ *
+ * @param set the mac index
+ * @param entry the tag entry of the set
+ * @param diff a pending change of a tag, NULL if none
+ */
+static void
+fsm_mac_set_add_tag(struct fsm_mac_set *set, char *entry,
+                    struct fsm_mac_set_tag_diff *diff)
+{
+    om_tag_list_entry_t *tle;
+    om_tag_list_entry_t *e;
+    bool pending;
+    int match_flags;
+    om_tag_t *tag;
+    int flags;
+
+    match_flags = om_get_type_of_tag(entry);
+    if (match_flags == OM_TLE_FLAG_NONE) match_flags = 0;
+
+    /* A tag being removed is already out of the tags tree */
+    tag = om_tag_find(entry);
+    if (tag == NULL) return;
+
+    pending = (diff != NULL && diff->tag == tag);
+    ds_tree_foreach(&tag->values, tle)
+    {
+        flags = tle->flags;
+        if (pending && diff->removed != NULL)
+        {
+            e = om_tag_list_entry_find_by_value(diff->removed, tle->value);
+            if (e != NULL) continue;
+        }
+        if (pending && diff->updated != NULL)
+        {
+            e = om_tag_list_entry_find_by_value(diff->updated, tle->value);
+            if (e != NULL) flags = e->flags;
+        }
+        fsm_mac_set_add_tag_value(set, tle->value, flags, match_flags);
+    }
+
+    if (!pending || diff->added == NULL) return;
+
+    ds_tree_foreach(diff->added, tle)
+    {
+        fsm_mac_set_add_tag_value(set, tle->value, tle->flags, match_flags);
+    }
+}
+
+
+static struct fsm_mac_set *
+fsm_mac_set_build(struct str_set *macs, struct fsm_mac_set_tag_diff *diff)
+{
+    struct fsm_mac_set *set;
+    uint64_t key;
+    size_t nslots;
+    char *entry;
+    size_t i;
+
+    if (macs == NULL) return NULL;
+
+    set = CALLOC(1, sizeof(*set));
+
+    nslots = FSM_MAC_SET_MIN_SLOTS;
+    while (nslots < 2 * macs->nelems) nslots <<= 1;
+    set->nslots = nslots;
+    set->slots = CALLOC(nslots, sizeof(*set->slots));
+    set->tags = CALLOC(macs->nelems, sizeof(*set->tags));
+
+    for (i = 0; i < macs->nelems; i++)
+    {
+        entry = macs->array[i];
+
+        if (om_tag_get_type(entry) != NOT_A_OPENSYNC_TAG)
+        {
+            set->tags[set->ntags++] = entry;
+            fsm_mac_set_add_tag(set, entry, diff);
+            continue;
+        }
+
+        if (fsm_mac_set_parse(entry, &key)) fsm_mac_set_insert(set, key);
+    }
+
+    return set;
+}
+
+
+/**
+ * @brief builds the binary index of a policy's mac set
+ *
+ * Tag and tag group entries are expanded with the current tag values.
+ *
+ * @param macs the provisioned mac set
+ * @return the mac index, NULL if the set is empty
+ */
+struct fsm_mac_set *
+fsm_mac_set_compile(struct str_set *macs)
+{
+    return fsm_mac_set_build(macs, NULL);
+}
+
+
+/**
+ * @brief frees a mac index
+ *
+ * @param set the index to free
+ */
+void
+fsm_mac_set_free(struct fsm_mac_set *set)
+{
+    if (set == NULL) return;
+
+    FREE(set->slots);
+    FREE(set->tags);
+    FREE(set);
+}
+
+
+/**
+ * @brief looks up a mac address in a policy's mac index
+ *
+ * @param set the mac index
+ * @param mac the mac address to look up
+ * @return true if the mac or one of the tags of the set matches
+ */
+bool
+fsm_mac_set_lookup(struct fsm_mac_set *set, os_macaddr_t *mac)
+{
+    uint64_t key;
+
+    if (set == NULL) return false;
+
+    key = fsm_mac_to_u64(mac->addr) | FSM_MAC_SET_USED;
+    return fsm_mac_set_find(set, key);
+}
+
+
+/**
+ * @brief checks if a tag entry of a mac set names the given tag
+ *
+ * Compares names, as a tag being removed can no longer be looked up.
+ */
+static bool
+fsm_mac_set_tag_match(char *entry, om_tag_t *tag)
+{
+    size_t len;
+    char *name;
+    int type;
+
+    type = om_tag_get_type(entry);
+    if ((type == OPENSYNC_GROUP_TAG) != tag->group) return false;
+
+    name = entry + 2;
+    if (*name == TEMPLATE_DEVICE_CHAR) name++;
+    else if (*name == TEMPLATE_CLOUD_CHAR) name++;
+    else if (*name == TEMPLATE_LOCAL_CHAR) name++;
+
+    /* Skip the end marker */
+    len = strlen(name) - 1;
+    if (strlen(tag->name) != len) return false;
+
+    return (strncmp(name, tag->name, len) == 0);
+}
+
+
+static bool
+fsm_mac_set_has_tag(struct fsm_mac_set *set, om_tag_t *tag)
+{
+    size_t i;
+
+    for (i = 0; i < set->ntags; i++)
+    {
+        if (fsm_mac_set_tag_match(set->tags[i], tag)) return true;
+    }
+
+    return false;
+}
+
+
+/**
+ * @brief rebuilds the mac indexes referring to a changed tag
+ *
+ * To be called from the tags manager's update callback, which runs
+ * before the change is applied to the tag's values.
+ *
+ * @param tag the changed tag
+ * @param removed the values removed from the tag
+ * @param added the values added to the tag
+ * @param updated the values whose flags changed
+ */
+void
+fsm_policy_tag_update(om_tag_t *tag, ds_tree_t *removed,
+                      ds_tree_t *added, ds_tree_t *updated)
+{
+    struct fsm_mac_set_tag_diff diff;
+    struct fsm_policy_session *mgr;
+    struct fsm_policy_rules *rules;
+    struct policy_table *table;
+    struct fsm_mac_set *set;
+    struct fsm_policy *p;
+
+    if (tag == NULL) return;
+
+    diff.tag = tag;
+    diff.removed = removed;
+    diff.added = added;
+    diff.updated = updated;
+
+    mgr = fsm_policy_get_mgr();
+    ds_tree_foreach(&mgr->policy_tables, table)
+    {
+        ds_tree_foreach(&table->policies, p)
+        {
+            rules = &p->rules;
+            if (rules->mac_set == NULL) continue;
+            if (!fsm_mac_set_has_tag(rules->mac_set, tag)) continue;
+
+            set = fsm_mac_set_build(rules->macs, &diff);
+            fsm_mac_set_free(rules->mac_set);
+            rules->mac_set = set;
+            LOGD("%s(): rebuilt policy %s mac set on tag %s change, %zu macs",
+                 __func__, p->rule_name, tag->name, set->count);
+        }
+    }
+}
+
+
+static int
+fsm_ip_bit(const uint8_t *addr, int bit)
+{
+    return (addr[bit >> 3] >> (7 - (bit & 7))) & 1;
+}
+
+
+/**
+ * @brief returns the length of the common prefix of two addresses
+ *
+ * @param a first address
+ * @param b second address
+ * @param max_len number of bits to compare
+ */
+static int
+fsm_ip_common_len(const uint8_t *a, const uint8_t *b, int max_len)
+{
+    uint8_t diff;
+    int len;
+    int i;
+
+    len = 0;
+    for (i = 0; len < max_len; i++)
+    {
+        diff = a[i] ^ b[i];
+        if (diff == 0)
+        {
+            len += 8;
+            continue;
+        }
+        while (!(diff & 0x80))
+        {
+            diff <<= 1;
+            len++;
+        }
+        break;
+    }
+
+    return (len < max_len ? len : max_len);
+}
+
+
+static struct fsm_ip_node *
+fsm_ip_node_new(const uint8_t *addr, int plen, bool terminal)
+{
+    struct fsm_ip_node *node;
+    int i;
+
+    node = CALLOC(1, sizeof(*node));
+    memcpy(node->addr, addr, (plen + 7) / 8);
+    if (plen & 7) node->addr[plen / 8] &= (uint8_t)(0xff << (8 - (plen & 7)));
+    for (i = (plen + 7) / 8; i < (int)sizeof(node->addr); i++) node->addr[i] = 0;
+    node->plen = plen;
+    node->terminal = terminal;
+
+    return node;
+}
+
+
+static void
+fsm_ip_tree_insert(struct fsm_ip_node **root, const uint8_t *addr, int plen)
+{
+    struct fsm_ip_node **pnode;
+    struct fsm_ip_node *node;
+    struct fsm_ip_node *glue;
+    struct fsm_ip_node *leaf;
+    int common;
+
+    pnode = root;
+    while ((node = *pnode) != NULL)
+    {
+        common = fsm_ip_common_len(node->addr, addr,
+                                   (node->plen < plen ? node->plen : plen));
+        if (common < node->plen)
+        {
+            /* The new prefix and the node diverge, or the new prefix covers the node */
+            if (common == plen)
+            {
+                leaf = fsm_ip_node_new(addr, plen, true);
+                leaf->child[fsm_ip_bit(node->addr, plen)] = node;
+                *pnode = leaf;
+                return;
+            }
+
+            glue = fsm_ip_node_new(addr, common, false);
+            leaf = fsm_ip_node_new(addr, plen, true);
+            glue->child[fsm_ip_bit(addr, common)] = leaf;
+            glue->child[fsm_ip_bit(node->addr, common)] = node;
+            *pnode = glue;
+            return;
+        }
+
+        /* The node covers the new prefix */
+        if (node->plen == plen)
+        {
+            node->terminal = true;
+            return;
+        }
+        pnode = &node->child[fsm_ip_bit(addr, node->plen)];
+    }
+
+    *pnode = fsm_ip_node_new(addr, plen, true);
+}
+
+
+static void
+fsm_ip_tree_free(struct fsm_ip_node *node)
+{
+    if (node == NULL) return;
+
+    fsm_ip_tree_free(node->child[0]);
+    fsm_ip_tree_free(node->child[1]);
+    FREE(node);
+}
+
+
+static bool
+fsm_ip_tree_lookup(struct fsm_ip_node *node, const uint8_t *addr, int alen)
+{
+    while (node != NULL)
+    {
+        if (fsm_ip_common_len(node->addr, addr, node->plen) < node->plen) return false;
+        if (node->terminal) return true;
+        if (node->plen == alen) return false;
+
+        node = node->child[fsm_ip_bit(addr, node->plen)];
+    }
+
+    return false;
+}
+
+
+/**
+ * @brief parses an address or a cidr prefix
+ *
+ * @param entry the ip set entry
+ * @param addr the parsed address
+ * @param plen the prefix length
+ * @return the address family, 0 if the entry is not valid
+ */
+static int
+fsm_ip_set_parse(const char *entry, uint8_t *addr, int *plen)
+{
+    char buf[INET6_ADDRSTRLEN + 8];
+    char *slash;
+    char *end;
+    long len;
+    int max;
+    int af;
+
+    STRSCPY(buf, entry);
+    slash = strchr(buf, '/');
+    if (slash != NULL) *slash++ = '\0';
+
+    af = (strchr(buf, ':') != NULL) ? AF_INET6 : AF_INET;
+    if (inet_pton(af, buf, addr) != 1) return 0;
+
+    max = (af == AF_INET ? 32 : 128);
+    *plen = max;
+    if (slash == NULL) return af;
+
+    len = strtol(slash, &end, 10);
+    if (*slash == '\0' || *end != '\0') return 0;
+    if (len < 0 || len > max) return 0;
+    *plen = (int)len;
+
+    return af;
+}
+
+
+/**
+ * @brief builds the radix trees of a policy's ip set
+ *
+ * Entries are addresses or cidr prefixes.
+ *
+ * @param ips the provisioned ip set
+ * @return the ip index, NULL if the set is empty
+ */
+struct fsm_ip_set *
+fsm_ip_set_compile(struct str_set *ips)
+{
+    uint8_t addr[sizeof(struct in6_addr)];
+    struct fsm_ip_set *set;
+    size_t i;
+    int plen;
+    int af;
+
+    if (ips == NULL) return NULL;
+
+    set = CALLOC(1, sizeof(*set));
+    for (i = 0; i < ips->nelems; i++)
+    {
+        af = fsm_ip_set_parse(ips->array[i], addr, &plen);
+        if (af == AF_INET) fsm_ip_tree_insert(&set->ipv4, addr, plen);
+        else if (af == AF_INET6) fsm_ip_tree_insert(&set->ipv6, addr, plen);
+        else LOGD("%s(): ignoring invalid ip entry %s", __func__, ips->array[i]);
+    }
+
+    return set;
+}
+
+
+/**
+ * @brief frees an ip index
+ *
+ * @param set the index to free
+ */
+void
+fsm_ip_set_free(struct fsm_ip_set *set)
+{
+    if (set == NULL) return;
+
+    fsm_ip_tree_free(set->ipv4);
+    fsm_ip_tree_free(set->ipv6);
+    FREE(set);
+}
+
+
+/**
+ * @brief looks up an address in a policy's ip index
+ *
+ * @param set the ip index
+ * @param af the address family
+ * @param addr the address, in network order
+ * @return true if a prefix of the set covers the address
+ */
+bool
+fsm_ip_set_lookup(struct fsm_ip_set *set, int af, const void *addr)
+{
+    if (set == NULL) return false;
+
+    if (af == AF_INET) return fsm_ip_tree_lookup(set->ipv4, addr, 32);
+    if (af == AF_INET6) return fsm_ip_tree_lookup(set->ipv6, addr, 128);
+
+    return false;
+}
@@ -0,0 +1,201 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "fsm_policy.h"
+#include "log.h"
+#include "memutil.h"
+#include "os_types.h"
+
+/*
+ * Policy verdict cache.
+ *
+ * Memoizes the outcome of a walk through a policy table for a
+ * (device, fqdn or ip, table) tuple: the last matching policy, the policy
+ * which set the request's rule and the report flag. The actions, redirects
+ * and reports are then derived from the cached policies as for a walk.
+ *
+ * The cache is a direct mapped array. Entries are tagged with the cache
+ * generation, which is bumped on any policy or tag change, invalidating
+ * every entry at once. Walks depending on categorization or risk level
+ * lookups are not cached.
+ */
+
+
+static uint32_t
+fsm_policy_verdict_hash(os_macaddr_t *device_id, const char *name,
+                        struct policy_table *table)
+{
+    uintptr_t t;
+    uint32_t h;
+    size_t i;
+
+    /* FNV-1a */
+    h = 2166136261u;
+    for (i = 0; i < sizeof(device_id->addr); i++)
+    {
+        h ^= device_id->addr[i];
+        h *= 16777619u;
+    }
+
+    for (; *name != '\0'; name++)
+    {
+        h ^= (uint8_t)*name;
+        h *= 16777619u;
+    }
+
+    t = (uintptr_t)table;
+    for (i = 0; i < sizeof(t); i++)
+    {
+        h ^= (uint8_t)(t >> (8 * i));
+        h *= 16777619u;
+    }
+
+    return h;
+}
+
+
+static struct fsm_policy_verdict_cache *
+fsm_policy_verdict_get_cache(void)
+{
+    struct fsm_policy_session *mgr;
+
+    mgr = fsm_policy_get_mgr();
+    return &mgr->verdicts;
+}
+
+
+/**
+ * @brief invalidates all cached verdicts
+ *
+ * To be called when a policy or a tag changes.
+ */
+void
+fsm_policy_verdict_invalidate(void)
+{
+    struct fsm_policy_verdict_cache *cache;
+
+    cache = fsm_policy_verdict_get_cache();
+    cache->generation++;
+    cache->stats.invalidations++;
+}
+
+
+/**
+ * @brief looks up a cached verdict
+ *
+ * @param req the policy request
+ * @param table the policy table the request is checked against
+ * @return the cached verdict, NULL if none
+ */
+struct fsm_policy_verdict *
+fsm_policy_verdict_lookup(struct fsm_policy_req *req,
+                          struct policy_table *table)
+{
+    struct fsm_policy_verdict_cache *cache;
+    struct fsm_policy_verdict *verdict;
+    uint32_t hash;
+
+    if (req->device_id == NULL) return NULL;
+    if (req->url == NULL) return NULL;
+
+    cache = fsm_policy_verdict_get_cache();
+    hash = fsm_policy_verdict_hash(req->device_id, req->url, table);
+    verdict = &cache->entries[hash % FSM_POLICY_VERDICT_CACHE_SIZE];
+
+    if (verdict->name == NULL) goto miss;
+    if (verdict->generation != cache->generation) goto miss;
+    if (verdict->hash != hash) goto miss;
+    if (verdict->table != table) goto miss;
+    if (memcmp(&verdict->device_id, req->device_id, sizeof(verdict->device_id))) goto miss;
+    if (strcmp(verdict->name, req->url)) goto miss;
+
+    cache->stats.hits++;
+    return verdict;
+
+miss:
+    cache->stats.misses++;
+    return NULL;
+}
+
+
+/**
+ * @brief stores the verdict of a policy table walk
+ *
+ * @param req the policy request
+ * @param table the policy table the request was checked against
+ * @param walk the outcome of the walk
+ */
+void
+fsm_policy_verdict_store(struct fsm_policy_req *req,
+                         struct policy_table *table,
+                         struct fsm_policy_verdict *walk)
+{
+    struct fsm_policy_verdict_cache *cache;
+    struct fsm_policy_verdict *verdict;
+    uint32_t hash;
+
+    if (req->device_id == NULL) return;
+    if (req->url == NULL) return;
+
+    cache = fsm_policy_verdict_get_cache();
+    hash = fsm_policy_verdict_hash(req->device_id, req->url, table);
+    verdict = &cache->entries[hash % FSM_POLICY_VERDICT_CACHE_SIZE];
+
+    FREE(verdict->name);
+    verdict->name = STRDUP(req->url);
+    verdict->hash = hash;
+    verdict->generation = cache->generation;
+    verdict->table = table;
+    memcpy(&verdict->device_id, req->device_id, sizeof(verdict->device_id));
+    verdict->match = walk->match;
+    verdict->rule = walk->rule;
+    verdict->report = walk->report;
+    verdict->dns_lookup = walk->dns_lookup;
+}
+
+
+/**
+ * @brief frees the cached verdicts
+ */
+void
+fsm_policy_verdict_flush(void)
+{
+    struct fsm_policy_verdict_cache *cache;
+    size_t i;
+
+    cache = fsm_policy_verdict_get_cache();
+    for (i = 0; i < FSM_POLICY_VERDICT_CACHE_SIZE; i++)
+    {
+        FREE(cache->entries[i].name);
+        cache->entries[i].name = NULL;
+    }
+    fsm_policy_verdict_invalidate();
+}
@@ -34,6 +34,9 @@ UNIT_TYPE := LIB
 UNIT_SRC := src/fsm_policy.c
 UNIT_SRC += src/fsm_policy_ovsdb.c
 UNIT_SRC += src/fsm_policy_client.c
+UNIT_SRC += src/fsm_policy_fqdn.c
+UNIT_SRC += src/fsm_policy_sets.c
+UNIT_SRC += src/fsm_policy_verdict.c
 
 UNIT_CFLAGS := -I$(UNIT_PATH)/inc
 UNIT_CFLAGS += -Isrc/fsm/inc
@@ -800,6 +800,89 @@ void test_apply_wildcard_policy_match_in(void)
 }
 
 
+void test_policy_verdict_cache(void)
+{
+    struct fsm_policy_verdict_stats before;
+    struct fsm_policy_verdict_stats after;
+    struct fsm_policy_reply *policy_reply;
+    struct fsm_session session = { 0 };
+    struct schema_FSM_Policy *spolicy;
+    struct fqdn_pending_req fqdn_req;
+    struct fsm_url_request req_info;
+    struct fsm_policy_session *mgr;
+    struct policy_table *table;
+    struct fsm_policy_req req;
+    os_macaddr_t dev_mac;
+    int action;
+    int i;
+
+    memset(&fqdn_req, 0, sizeof(fqdn_req));
+    memset(&req_info, 0, sizeof(req_info));
+    memset(&req, 0, sizeof(req));
+    memset(&dev_mac, 0, sizeof(dev_mac));
+
+    /* Insert wildcard policy */
+    spolicy = &spolicies[6];
+    fsm_add_policy(spolicy);
+
+    mgr = fsm_policy_get_mgr();
+    table = ds_tree_find(&mgr->policy_tables, spolicy->policy);
+    TEST_ASSERT_NOT_NULL(table);
+
+    req.device_id = &dev_mac;
+    STRSCPY(req_info.url, "www.books.google.com");
+    req.url = "www.books.google.com";
+    fqdn_req.req_info = &req_info;
+    fqdn_req.numq = 1;
+    req.fqdn_req = &fqdn_req;
+    req.session = &session;
+
+    /* The first walk is a miss, the second one replays it */
+    fsm_policy_get_verdict_stats(&before);
+    for (i = 0; i < 2; i++)
+    {
+        policy_reply = fsm_policy_initialize_reply(&session);
+        TEST_ASSERT_NOT_NULL(policy_reply);
+        policy_reply->policy_table = table;
+        policy_reply->categories_check = test_cat_check;
+        action = fsm_apply_policies(&req, policy_reply);
+        TEST_ASSERT_EQUAL_INT(FSM_UPDATE_TAG, action);
+        TEST_ASSERT_EQUAL_STRING("my_v4_tag", policy_reply->updatev4_tag);
+        TEST_ASSERT_EQUAL_STRING(spolicy->name, req.rule_name);
+        fsm_policy_free_reply(policy_reply);
+    }
+    fsm_policy_get_verdict_stats(&after);
+    TEST_ASSERT_EQUAL_UINT64(before.misses + 1, after.misses);
+    TEST_ASSERT_EQUAL_UINT64(before.hits + 1, after.hits);
+
+    /* Another device is a different verdict */
+    dev_mac.addr[5] = 0x42;
+    policy_reply = fsm_policy_initialize_reply(&session);
+    TEST_ASSERT_NOT_NULL(policy_reply);
+    policy_reply->policy_table = table;
+    action = fsm_apply_policies(&req, policy_reply);
+    TEST_ASSERT_EQUAL_INT(FSM_NO_MATCH, action);
+    fsm_policy_free_reply(policy_reply);
+    fsm_policy_get_verdict_stats(&after);
+    TEST_ASSERT_EQUAL_UINT64(before.misses + 2, after.misses);
+
+    /* A policy change invalidates the cached verdicts */
+    fsm_update_policy(spolicy);
+    fsm_policy_get_verdict_stats(&before);
+    TEST_ASSERT_TRUE(before.invalidations > after.invalidations);
+
+    policy_reply = fsm_policy_initialize_reply(&session);
+    TEST_ASSERT_NOT_NULL(policy_reply);
+    policy_reply->policy_table = table;
+    action = fsm_apply_policies(&req, policy_reply);
+    TEST_ASSERT_EQUAL_INT(FSM_NO_MATCH, action);
+    fsm_policy_free_reply(policy_reply);
+    fsm_policy_get_verdict_stats(&after);
+    TEST_ASSERT_EQUAL_UINT64(before.misses + 1, after.misses);
+    TEST_ASSERT_EQUAL_UINT64(before.hits, after.hits);
+}
+
+
 void test_apply_wildcard_policy_no_match(void)
 {
     struct schema_FSM_Policy *spolicy;
@@ -1697,6 +1780,256 @@ test_fsm_policy_wildmatch(void)
     TEST_ASSERT_FALSE(rc);
 }
 
+void
+test_fsm_fqdn_matcher(void)
+{
+    char *entries[] =
+    {
+        "google.com",
+        "www.bo*.google.com",
+        "*.facebook.com",
+        "ads.*.net",
+    };
+    struct fsm_fqdn_matcher *matcher;
+    struct str_set fqdns;
+    bool rc;
+
+    fqdns.array = entries;
+    fqdns.nelems = ARRAY_SIZE(entries);
+
+    /* start from right */
+    matcher = fsm_fqdn_matcher_compile(FSM_FQDN_OP_SFR, &fqdns);
+    TEST_ASSERT_NOT_NULL(matcher);
+    rc = fsm_fqdn_matcher_match(matcher, "www.google.com");
+    TEST_ASSERT_TRUE(rc);
+    rc = fsm_fqdn_matcher_match(matcher, "google.com");
+    TEST_ASSERT_TRUE(rc);
+    rc = fsm_fqdn_matcher_match(matcher, "google.co");
+    TEST_ASSERT_FALSE(rc);
+    rc = fsm_fqdn_matcher_match(matcher, "oogle.com");
+    TEST_ASSERT_FALSE(rc);
+    fsm_fqdn_matcher_free(matcher);
+
+    /* start from left */
+    matcher = fsm_fqdn_matcher_compile(FSM_FQDN_OP_SFL, &fqdns);
+    TEST_ASSERT_NOT_NULL(matcher);
+    rc = fsm_fqdn_matcher_match(matcher, "google.com.au");
+    TEST_ASSERT_TRUE(rc);
+    rc = fsm_fqdn_matcher_match(matcher, "www.google.com");
+    TEST_ASSERT_FALSE(rc);
+    fsm_fqdn_matcher_free(matcher);
+
+    /* wildcards, every entry of the set is checked */
+    matcher = fsm_fqdn_matcher_compile(FSM_FQDN_OP_WILD, &fqdns);
+    TEST_ASSERT_NOT_NULL(matcher);
+    rc = fsm_fqdn_matcher_match(matcher, "google.com");
+    TEST_ASSERT_TRUE(rc);
+    rc = fsm_fqdn_matcher_match(matcher, "www.books.google.com");
+    TEST_ASSERT_TRUE(rc);
+    rc = fsm_fqdn_matcher_match(matcher, "www.maps.google.com");
+    TEST_ASSERT_FALSE(rc);
+    rc = fsm_fqdn_matcher_match(matcher, "m.facebook.com");
+    TEST_ASSERT_TRUE(rc);
+    rc = fsm_fqdn_matcher_match(matcher, "facebook.com");
+    TEST_ASSERT_FALSE(rc);
+    rc = fsm_fqdn_matcher_match(matcher, "ads.example.net");
+    TEST_ASSERT_TRUE(rc);
+    rc = fsm_fqdn_matcher_match(matcher, "1.2.3.4.5.6.7.8.9.google.com");
+    TEST_ASSERT_FALSE(rc);
+    fsm_fqdn_matcher_free(matcher);
+
+    matcher = fsm_fqdn_matcher_compile(FSM_FQDN_OP_XM, NULL);
+    TEST_ASSERT_NULL(matcher);
+    rc = fsm_fqdn_matcher_match(matcher, "google.com");
+    TEST_ASSERT_FALSE(rc);
+}
+
+void
+test_fsm_policy_binary_sets(void)
+{
+    char *macs[] =
+    {
+        "00:00:00:00:00:00",
+        "aa:bb:cc:dd:ee:ff",
+        "AA:BB:CC:00:11:22",
+        "not a mac",
+    };
+    char *ips[] =
+    {
+        "10.1.2.3",
+        "192.168.0.0/16",
+        "192.168.40.0/24",
+        "2001:db8::/32",
+        "fe80::1",
+        "1.2.3.4/33",
+    };
+    uint8_t addr[sizeof(struct in6_addr)];
+    struct fsm_mac_set *mac_set;
+    struct fsm_ip_set *ip_set;
+    struct str_set set;
+    os_macaddr_t mac;
+    bool rc;
+
+    set.array = macs;
+    set.nelems = ARRAY_SIZE(macs);
+    mac_set = fsm_mac_set_compile(&set);
+    TEST_ASSERT_NOT_NULL(mac_set);
+    TEST_ASSERT_EQUAL_UINT(2, mac_set->count);
+
+    memset(&mac, 0, sizeof(mac));
+    rc = fsm_mac_set_lookup(mac_set, &mac);
+    TEST_ASSERT_TRUE(rc);
+
+    mac = (os_macaddr_t) { .addr = { 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff } };
+    rc = fsm_mac_set_lookup(mac_set, &mac);
+    TEST_ASSERT_TRUE(rc);
+
+    /* Upper case entries never matched the device mac */
+    mac = (os_macaddr_t) { .addr = { 0xaa, 0xbb, 0xcc, 0x00, 0x11, 0x22 } };
+    rc = fsm_mac_set_lookup(mac_set, &mac);
+    TEST_ASSERT_FALSE(rc);
+    fsm_mac_set_free(mac_set);
+
+    set.array = ips;
+    set.nelems = ARRAY_SIZE(ips);
+    ip_set = fsm_ip_set_compile(&set);
+    TEST_ASSERT_NOT_NULL(ip_set);
+
+    inet_pton(AF_INET, "10.1.2.3", addr);
+    rc = fsm_ip_set_lookup(ip_set, AF_INET, addr);
+    TEST_ASSERT_TRUE(rc);
+
+    inet_pton(AF_INET, "10.1.2.4", addr);
+    rc = fsm_ip_set_lookup(ip_set, AF_INET, addr);
+    TEST_ASSERT_FALSE(rc);
+
+    inet_pton(AF_INET, "192.168.40.12", addr);
+    rc = fsm_ip_set_lookup(ip_set, AF_INET, addr);
+    TEST_ASSERT_TRUE(rc);
+
+    inet_pton(AF_INET, "192.168.1.1", addr);
+    rc = fsm_ip_set_lookup(ip_set, AF_INET, addr);
+    TEST_ASSERT_TRUE(rc);
+
+    inet_pton(AF_INET, "192.169.1.1", addr);
+    rc = fsm_ip_set_lookup(ip_set, AF_INET, addr);
+    TEST_ASSERT_FALSE(rc);
+
+    inet_pton(AF_INET, "1.2.3.4", addr);
+    rc = fsm_ip_set_lookup(ip_set, AF_INET, addr);
+    TEST_ASSERT_FALSE(rc);
+
+    inet_pton(AF_INET6, "2001:db8:1::42", addr);
+    rc = fsm_ip_set_lookup(ip_set, AF_INET6, addr);
+    TEST_ASSERT_TRUE(rc);
+
+    inet_pton(AF_INET6, "fe80::1", addr);
+    rc = fsm_ip_set_lookup(ip_set, AF_INET6, addr);
+    TEST_ASSERT_TRUE(rc);
+
+    inet_pton(AF_INET6, "fe80::2", addr);
+    rc = fsm_ip_set_lookup(ip_set, AF_INET6, addr);
+    TEST_ASSERT_FALSE(rc);
+    fsm_ip_set_free(ip_set);
+}
+
+
+static bool
+test_policy_tag_update_cb(om_tag_t *tag, ds_tree_t *removed,
+                          ds_tree_t *added, ds_tree_t *updated)
+{
+    fsm_policy_tag_update(tag, removed, added, updated);
+    return true;
+}
+
+void
+test_fsm_policy_tag_sets(void)
+{
+    struct schema_Openflow_Tag tag_1;
+    struct schema_Openflow_Tag tag_3;
+    struct schema_FSM_Policy *spolicy;
+    struct fsm_mac_set *mac_set;
+    struct fsm_policy *fpolicy;
+    struct tag_mgr tag_mgr;
+    os_macaddr_t mac;
+    bool rc;
+
+    MEMZERO(tag_mgr);
+    tag_mgr.service_tag_update = test_policy_tag_update_cb;
+    om_tag_init(&tag_mgr);
+
+    /* Macs: ${@tag_1}, $[group_tag] ("#tag_1" and "tag_3") and a plain mac */
+    spolicy = &spolicies[5];
+    fsm_add_policy(spolicy);
+    fpolicy = fsm_policy_lookup(spolicy);
+    TEST_ASSERT_NOT_NULL(fpolicy);
+    mac_set = fpolicy->rules.mac_set;
+    TEST_ASSERT_NOT_NULL(mac_set);
+
+    /* 2 device values of tag_1, 3 cloud values of tag_1, 5 values of tag_3 */
+    TEST_ASSERT_EQUAL_UINT(11, mac_set->count);
+
+    mac = (os_macaddr_t) { .addr = { 0x12, 0x12, 0x12, 0x12, 0x12, 0x12 } };
+    rc = fsm_mac_set_lookup(mac_set, &mac);
+    TEST_ASSERT_TRUE(rc);
+
+    mac = (os_macaddr_t) { .addr = { 0x35, 0x35, 0x35, 0x35, 0x35, 0x35 } };
+    rc = fsm_mac_set_lookup(mac_set, &mac);
+    TEST_ASSERT_TRUE(rc);
+
+    mac = (os_macaddr_t) { .addr = { 0x23, 0x23, 0x23, 0x23, 0x23, 0x23 } };
+    rc = fsm_mac_set_lookup(mac_set, &mac);
+    TEST_ASSERT_FALSE(rc);
+
+    /* Replace a device value of tag_1 */
+    tag_1 = g_tags[0];
+    STRSCPY(tag_1.device_value[1], "16:16:16:16:16:16");
+    rc = om_tag_update_from_schema(&tag_1);
+    TEST_ASSERT_TRUE(rc);
+    mac_set = fpolicy->rules.mac_set;
+
+    mac = (os_macaddr_t) { .addr = { 0x16, 0x16, 0x16, 0x16, 0x16, 0x16 } };
+    rc = fsm_mac_set_lookup(mac_set, &mac);
+    TEST_ASSERT_TRUE(rc);
+
+    mac = (os_macaddr_t) { .addr = { 0x12, 0x12, 0x12, 0x12, 0x12, 0x12 } };
+    rc = fsm_mac_set_lookup(mac_set, &mac);
+    TEST_ASSERT_FALSE(rc);
+
+    /* Add a value to tag_3, reaching the policy through the tag group */
+    tag_3 = g_tags[2];
+    STRSCPY(tag_3.device_value[2], "36:36:36:36:36:36");
+    tag_3.device_value_len = 3;
+    rc = om_tag_update_from_schema(&tag_3);
+    TEST_ASSERT_TRUE(rc);
+    mac_set = fpolicy->rules.mac_set;
+
+    mac = (os_macaddr_t) { .addr = { 0x36, 0x36, 0x36, 0x36, 0x36, 0x36 } };
+    rc = fsm_mac_set_lookup(mac_set, &mac);
+    TEST_ASSERT_TRUE(rc);
+    TEST_ASSERT_EQUAL_UINT(12, mac_set->count);
+
+    /* Removing the tag group drops its values */
+    rc = om_tag_group_remove_from_schema(&g_tag_group);
+    TEST_ASSERT_TRUE(rc);
+    mac_set = fpolicy->rules.mac_set;
+
+    rc = fsm_mac_set_lookup(mac_set, &mac);
+    TEST_ASSERT_FALSE(rc);
+    TEST_ASSERT_EQUAL_UINT(3, mac_set->count);
+
+    rc = om_tag_group_add_from_schema(&g_tag_group);
+    TEST_ASSERT_TRUE(rc);
+    rc = om_tag_update_from_schema(&g_tags[0]);
+    TEST_ASSERT_TRUE(rc);
+    rc = om_tag_update_from_schema(&g_tags[2]);
+    TEST_ASSERT_TRUE(rc);
+    TEST_ASSERT_EQUAL_UINT(11, fpolicy->rules.mac_set->count);
+
+    MEMZERO(tag_mgr);
+    om_tag_init(&tag_mgr);
+}
+
 void
 test_set_log_action(void)
 {
@@ -1794,9 +2127,13 @@ int main(int argc, char *argv[])
     RUN_TEST(test_apply_mac_policies);
     RUN_TEST(test_apply_wildcard_policy_match_in);
     RUN_TEST(test_apply_wildcard_policy_no_match);
+    RUN_TEST(test_policy_verdict_cache);
     RUN_TEST(test_ip_threat_blacklist);
     RUN_TEST(test_fsm_policy_flush);
     RUN_TEST(test_fsm_policy_wildmatch);
+    RUN_TEST(test_fsm_fqdn_matcher);
+    RUN_TEST(test_fsm_policy_binary_sets);
+    RUN_TEST(test_fsm_policy_tag_sets);
     RUN_TEST(test_ipthreat_multiple_provider_check);
     RUN_TEST(test_set_log_action);
     RUN_TEST(test_ipthreat_multiple_provider_block);
@@ -38,6 +38,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "fsm.h"
 #include "fsm_policy.h"
 #include "ds_tree.h"
+#include "ds_dlist.h"
 #include "util.h"
 #include "os.h"
 #include "network_metadata_report.h"
@@ -71,7 +72,7 @@ struct counter_s
 /* supported attribute types */
 struct attr_generic_s
 {
-    char             *name;
+    char             *name;       /* interned, see gkc_intern_get() */
     struct counter_s  hit_count;  /* number of times lookup is performed */
 };
 
@@ -84,7 +85,7 @@ struct attr_ip_addr_s
 
 struct attr_hostname_s
 {
-    char             *name;
+    char             *name;       /* interned, see gkc_intern_get() */
     struct counter_s  count_fqdn;
     struct counter_s  count_host;
     struct counter_s  count_sni;
@@ -109,6 +110,77 @@ enum gkc_flow_direction
     GKC_FLOW_DIRECTION_INTERNAL_IGNORE,
 };
 
+/* TTL timing wheel geometry: a one second resolution level covering
+ * GKC_TTL_WHEEL_L0_SLOTS seconds, a coarse level covering
+ * GKC_TTL_WHEEL_L0_SLOTS * GKC_TTL_WHEEL_L1_SLOTS seconds and an overflow
+ * list for anything further out.
+ */
+#define GKC_TTL_WHEEL_L0_SLOTS 256
+#define GKC_TTL_WHEEL_L1_SLOTS 64
+
+/* Default max number of entries expired by a single gkc_ttl_cleanup() call */
+#define GKC_TTL_CLEANUP_BUDGET 4096
+
+/* Initial number of buckets of the attribute names intern table */
+#define GKC_INTERN_MIN_BUCKETS 256
+
+/**
+ * @brief a refcounted attribute name shared by all the cache entries
+ *        (of any device) carrying the same name
+ */
+struct gkc_intern_str
+{
+    struct gkc_intern_str *next; /* bucket chain */
+    uint64_t hash;
+    uint32_t refcnt;             /* number of cache entries using the name */
+    size_t len;
+    char str[];
+};
+
+/**
+ * @brief hash table of the interned attribute names
+ */
+struct gkc_intern_table
+{
+    struct gkc_intern_str **buckets;
+    size_t nbuckets;
+    size_t count;                /* unique names */
+    uint64_t refs;               /* cache entries referencing a name */
+    size_t bytes;                /* bytes used by the unique names */
+};
+
+struct per_device_cache;
+
+/**
+ * @brief TTL timing wheel linkage embedded in attribute and flow entries
+ */
+struct gkc_ttl_node
+{
+    time_t expiry_ts;                     /* original_ts + cache_ttl */
+    ds_dlist_t *slot;                     /* wheel slot, NULL if not scheduled */
+    struct per_device_cache *pdevice;     /* device owning the entry */
+    ds_tree_t *tree;                      /* tree the entry is inserted in */
+    enum gk_cache_request_type attr_type; /* tree type, flow or attribute */
+    ds_dlist_node_t node;
+};
+
+/**
+ * @brief hierarchical timing wheel tracking the entries expiry
+ */
+struct gkc_ttl_wheel
+{
+    ds_dlist_t l0[GKC_TTL_WHEEL_L0_SLOTS];  /* one second slots */
+    ds_dlist_t l1[GKC_TTL_WHEEL_L1_SLOTS];  /* GKC_TTL_WHEEL_L0_SLOTS seconds slots */
+    ds_dlist_t overflow;
+    time_t wheel_ts;                        /* last second fully swept */
+    size_t budget;                          /* max expiries per cleanup */
+    uint64_t scheduled;                     /* entries currently in the wheel */
+    uint64_t expired;                       /* total expired entries */
+    uint64_t last_expired;                  /* expired by the last cleanup */
+    uint64_t cascaded;                      /* entries moved down a level */
+    uint64_t budget_exhausted;              /* cleanups which hit the budget */
+};
+
 /**
  * @brief structure to store parameters
  * required for checking and deleting
@@ -158,6 +230,7 @@ struct attr_cache
     ds_tree_node_t          attr_tnode;
     uint32_t                flow_marker;
     char                    *network_id;
+    struct gkc_ttl_node     ttl;              /* TTL wheel linkage */
 };
 
 /**
@@ -183,6 +256,7 @@ struct ip_flow_cache
     struct counter_s hit_count; /* number of times lookup is performed */
     bool is_private_ip;
     char *network_id;
+    struct gkc_ttl_node ttl;    /* TTL wheel linkage */
     ds_tree_node_t ipflow_tnode;
 };
 
@@ -229,6 +303,8 @@ struct gk_cache_mgr
     bool initialized;
     uint64_t total_entry_count;
     ds_tree_t per_device_tree; /* per_device_cache */
+    struct gkc_ttl_wheel ttl_wheel;
+    struct gkc_intern_table names;
 };
 
 /**
@@ -464,11 +540,20 @@ gkc_del_attr_from_dev(struct per_device_cache *pdevice,
 /**
  * @brief remove old cache entres.
  *
- * @param ttl the cache entry time to live
+ * Only the entries due to expire are visited, at most the configured
+ * budget per call. Entries left over are expired by the next calls.
  */
 void
 gkc_ttl_cleanup(void);
 
+/**
+ * @brief set the max number of entries expired by one gkc_ttl_cleanup() call
+ *
+ * @param budget the max number of expiries, 0 restores the default
+ */
+void
+gkc_ttl_set_budget(size_t budget);
+
 /******************************************************************************
  * IP flow related operations
  *******************************************************************************/
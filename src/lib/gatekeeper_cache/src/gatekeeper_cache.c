@@ -32,6 +32,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include "gatekeeper_cache.h"
+#include "gatekeeper_cache_internals.h"
 #include "log.h"
 #include "os_types.h"
 #include "memutil.h"
@@ -301,6 +302,12 @@ gk_cache_init_mgr(struct gk_cache_mgr *mgr)
     /* initialize per device tree */
     ds_tree_init(&mgr->per_device_tree, gkc_mac_addr_cmp, struct per_device_cache, perdevice_tnode);
 
+    /* initialize the TTL timing wheel */
+    gkc_ttl_wheel_init(&mgr->ttl_wheel);
+
+    /* initialize the attribute names intern table */
+    gkc_intern_init(&mgr->names);
+
     mgr->initialized = true;
 }
 
@@ -366,7 +373,7 @@ gkc_new_attr_entry(struct gk_attr_cache_interface *entry)
         case GK_CACHE_REQ_TYPE_FQDN:
             attr->host_name = CALLOC(1, sizeof(*attr->host_name));
             if (attr->host_name == NULL) goto cleanup_new_attr;
-            attr->host_name->name = STRDUP(entry->attr_name);
+            attr->host_name->name = gkc_intern_get(entry->attr_name);
             attr->host_name->count_fqdn.total = 1;
             gk_add_new_redirect_entry(entry, new_attr_cache);
             break;
@@ -374,7 +381,7 @@ gkc_new_attr_entry(struct gk_attr_cache_interface *entry)
         case GK_CACHE_REQ_TYPE_HOST:
             attr->host_name = CALLOC(1, sizeof(*attr->host_name));
             if (attr->host_name == NULL) goto cleanup_new_attr;
-            attr->host_name->name = STRDUP(entry->attr_name);
+            attr->host_name->name = gkc_intern_get(entry->attr_name);
             attr->host_name->count_host.total = 1;
             gk_add_new_redirect_entry(entry, new_attr_cache);
             break;
@@ -382,7 +389,7 @@ gkc_new_attr_entry(struct gk_attr_cache_interface *entry)
         case GK_CACHE_REQ_TYPE_SNI:
             attr->host_name = CALLOC(1, sizeof(*attr->host_name));
             if (attr->host_name == NULL) goto cleanup_new_attr;
-            attr->host_name->name = STRDUP(entry->attr_name);
+            attr->host_name->name = gkc_intern_get(entry->attr_name);
             attr->host_name->count_sni.total = 1;
             gk_add_new_redirect_entry(entry, new_attr_cache);
             break;
@@ -390,7 +397,7 @@ gkc_new_attr_entry(struct gk_attr_cache_interface *entry)
         case GK_CACHE_REQ_TYPE_URL:
             attr->url = CALLOC(1, sizeof(*attr->url));
             if (attr->url == NULL) goto cleanup_new_attr;
-            attr->url->name = STRDUP(entry->attr_name);
+            attr->url->name = gkc_intern_get(entry->attr_name);
             attr->url->hit_count.total = 1;
             break;
 
@@ -417,7 +424,7 @@ gkc_new_attr_entry(struct gk_attr_cache_interface *entry)
         case GK_CACHE_REQ_TYPE_APP:
             attr->app_name = CALLOC(1, sizeof(*attr->app_name));
             if (attr->app_name == NULL) goto cleanup_new_attr;
-            attr->app_name->name = STRDUP(entry->attr_name);
+            attr->app_name->name = gkc_intern_get(entry->attr_name);
             attr->app_name->hit_count.total = 1;
             break;
 
@@ -466,6 +473,7 @@ cleanup_new_attr:
  * @brief effectively add the attribute to the per device 'host_name' tree.
  *        We have ensured that the manager is initialized.
  *
+ * @params: pdevice: device owning the tree
  * @params: cache: tree structure for the attribute type
  * @params: entry: interface structure with input values
  *
@@ -473,7 +481,8 @@ cleanup_new_attr:
  *         false otherwise (we updated the cache)
  */
 static bool
-gkc_insert_host_name(ds_tree_t *cache, struct gk_attr_cache_interface *entry)
+gkc_insert_host_name(struct per_device_cache *pdevice, ds_tree_t *cache,
+                     struct gk_attr_cache_interface *entry)
 {
     struct attr_cache *cached_attr_entry;
     struct attr_cache *new_attr_cache;
@@ -536,6 +545,9 @@ gkc_insert_host_name(ds_tree_t *cache, struct gk_attr_cache_interface *entry)
     if (new_attr_cache == NULL) return false;
 
     ds_tree_insert(cache, new_attr_cache, &new_attr_cache->key);
+    gkc_ttl_schedule(&new_attr_cache->ttl,
+                     new_attr_cache->original_ts + new_attr_cache->cache_ttl,
+                     pdevice, cache, GK_CACHE_INTERNAL_TYPE_HOSTNAME);
 
     return true;
 }
@@ -543,6 +555,7 @@ gkc_insert_host_name(ds_tree_t *cache, struct gk_attr_cache_interface *entry)
 /**
  * @brief effectively add the attribute to a per device 'cache' tree.
  *
+ * @params: pdevice: device owning the tree
  * @params: cache: tree structure for the attribute type
  * @params: entry: interface structure with input values
  *
@@ -550,7 +563,8 @@ gkc_insert_host_name(ds_tree_t *cache, struct gk_attr_cache_interface *entry)
  *         false otherwise (we updated the cache)
  */
 static bool
-gkc_insert_generic(ds_tree_t *cache, struct gk_attr_cache_interface *entry)
+gkc_insert_generic(struct per_device_cache *pdevice, ds_tree_t *cache,
+                   struct gk_attr_cache_interface *entry)
 {
     struct attr_cache *new_attr_cache;
     bool was_inserted;
@@ -570,6 +584,9 @@ gkc_insert_generic(ds_tree_t *cache, struct gk_attr_cache_interface *entry)
     if (new_attr_cache == NULL) return false;
 
     ds_tree_insert(cache, new_attr_cache, &new_attr_cache->key);
+    gkc_ttl_schedule(&new_attr_cache->ttl,
+                     new_attr_cache->original_ts + new_attr_cache->cache_ttl,
+                     pdevice, cache, entry->attribute_type);
 
     return true;
 }
@@ -592,23 +609,23 @@ gkc_add_attr_tree(struct per_device_cache *pdevice_cache, struct gk_attr_cache_i
         case GK_CACHE_REQ_TYPE_FQDN:
         case GK_CACHE_REQ_TYPE_HOST:
         case GK_CACHE_REQ_TYPE_SNI:
-            was_inserted = gkc_insert_host_name(&pdevice_cache->hostname_tree, entry);
+            was_inserted = gkc_insert_host_name(pdevice_cache, &pdevice_cache->hostname_tree, entry);
             break;
 
         case GK_CACHE_REQ_TYPE_URL:
-            was_inserted = gkc_insert_generic(&pdevice_cache->url_tree, entry);
+            was_inserted = gkc_insert_generic(pdevice_cache, &pdevice_cache->url_tree, entry);
             break;
 
         case GK_CACHE_REQ_TYPE_IPV4:
-            was_inserted = gkc_insert_generic(&pdevice_cache->ipv4_tree, entry);
+            was_inserted = gkc_insert_generic(pdevice_cache, &pdevice_cache->ipv4_tree, entry);
             break;
 
         case GK_CACHE_REQ_TYPE_IPV6:
-            was_inserted = gkc_insert_generic(&pdevice_cache->ipv6_tree, entry);
+            was_inserted = gkc_insert_generic(pdevice_cache, &pdevice_cache->ipv6_tree, entry);
             break;
 
         case GK_CACHE_REQ_TYPE_APP:
-            was_inserted = gkc_insert_generic(&pdevice_cache->app_tree, entry);
+            was_inserted = gkc_insert_generic(pdevice_cache, &pdevice_cache->app_tree, entry);
             break;
 
         default:
@@ -861,6 +878,7 @@ gkc_cleanup_mgr(void)
 
     if (!mgr->initialized) return;
     gk_cache_cleanup();
+    gkc_intern_fini(&mgr->names);
     mgr->initialized = false;
     mgr->total_entry_count = 0;
 }
@@ -930,6 +948,60 @@ gkc_update_entry_action(struct gk_attr_cache_interface *req, struct attr_cache *
     return true;
 }
 
+/**
+ * @brief check if the attribute type is identified by its name
+ *
+ * @params: attr_type: attribute type
+ * @return: true for hostnames, URLs and application names
+ */
+static bool
+gkc_is_named_attr(enum gk_cache_request_type attr_type)
+{
+    switch (attr_type)
+    {
+        case GK_CACHE_REQ_TYPE_FQDN:
+        case GK_CACHE_REQ_TYPE_HOST:
+        case GK_CACHE_REQ_TYPE_SNI:
+        case GK_CACHE_REQ_TYPE_URL:
+        case GK_CACHE_REQ_TYPE_APP:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief get the interned name of a cache entry
+ *
+ * @params: attr_entry: cache entry
+ * @params: attr_type: attribute type of the entry
+ * @return: the entry name, NULL if the type has no name
+ */
+static char *
+gkc_get_attr_name(struct attr_cache *attr_entry, enum gk_cache_request_type attr_type)
+{
+    union attribute_type *attr;
+
+    attr = &attr_entry->attr;
+    switch (attr_type)
+    {
+        case GK_CACHE_REQ_TYPE_FQDN:
+        case GK_CACHE_REQ_TYPE_HOST:
+        case GK_CACHE_REQ_TYPE_SNI:
+            return attr->host_name->name;
+
+        case GK_CACHE_REQ_TYPE_URL:
+            return attr->url->name;
+
+        case GK_CACHE_REQ_TYPE_APP:
+            return attr->app_name->name;
+
+        default:
+            return NULL;
+    }
+}
+
 /**
  * @brief check if the attribute is present in the attribute
  *        tree
@@ -943,6 +1015,7 @@ gkc_lookup_attr_tree(ds_tree_t *tree, struct gk_attr_cache_interface *req, bool
 {
     struct attr_cache *attr_entry;
     union attribute_type *attr;
+    char *name = NULL;
     int hit_count;
     uint64_t key;
     bool rc;
@@ -950,6 +1023,13 @@ gkc_lookup_attr_tree(ds_tree_t *tree, struct gk_attr_cache_interface *req, bool
 
     if (!req->attr_name && !req->ip_addr) return false;
 
+    if (gkc_is_named_attr(req->attribute_type))
+    {
+        /* A name not interned is not cached for any device */
+        name = gkc_intern_find(req->attr_name);
+        if (name == NULL) return false;
+    }
+
     if (req->cache_key == 0)
         req->cache_key = get_attr_key(req);
     key = req->cache_key;
@@ -957,6 +1037,13 @@ gkc_lookup_attr_tree(ds_tree_t *tree, struct gk_attr_cache_interface *req, bool
     attr_entry = ds_tree_find(tree, &key);
     if (attr_entry == NULL) return false;
     attr = &attr_entry->attr;
+
+    /* Names are interned: guard against key collisions by pointer */
+    if (name != NULL && gkc_get_attr_name(attr_entry, req->attribute_type) != name)
+    {
+        LOGD("%s(): key collision on %s", __func__, req->attr_name);
+        return false;
+    }
     rc = attr_entry->is_private_ip;
 
     hit_count = req->hit_counter;
@@ -1348,13 +1435,16 @@ void
 gkc_ttl_cleanup(void)
 {
     struct gk_cache_mgr *mgr;
-    ds_tree_t *tree;
+    size_t expired;
 
     mgr = gk_cache_get_mgr();
     if (!mgr->initialized) return;
 
-    tree = &mgr->per_device_tree;
-    gk_cache_check_ttl_device_tree(tree);
+    /* Only visit the entries due to expire */
+    expired = gkc_ttl_wheel_expire(time(NULL));
+
+    LOGT("%s(): expired %zu entries, %lu entries left in cache",
+         __func__, expired, gk_get_cache_count());
 }
 
 /**
@@ -1618,6 +1708,8 @@ gkc_print_cache_parts(enum gk_cache_request_type cache_type)
     tree = &mgr->per_device_tree;
 
     LOGT("%s: gatekeeper_cache dump", __func__);
+    gkc_ttl_print_stats();
+    gkc_intern_print_stats();
     LOGT("=====START=====");
 
     ds_tree_foreach(tree, entry)
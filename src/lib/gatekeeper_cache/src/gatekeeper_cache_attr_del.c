@@ -26,6 +26,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "gatekeeper_cache.h"
 #include "gatekeeper_cache_cmp.h"
+#include "gatekeeper_cache_internals.h"
 #include "log.h"
 #include "memutil.h"
 #include "sockaddr_storage.h"
@@ -40,6 +41,9 @@ gkc_free_attr_entry(struct attr_cache *attr_entry, enum gk_cache_request_type at
 {
     union attribute_type *attr;
 
+    /* the entry is going away, drop it from the TTL wheel */
+    gkc_ttl_unschedule(&attr_entry->ttl);
+
     attr = &attr_entry->attr;
     switch (attr_type)
     {
@@ -53,12 +57,12 @@ gkc_free_attr_entry(struct attr_cache *attr_entry, enum gk_cache_request_type at
         /* fallthru */
     case GK_CACHE_REQ_TYPE_HOST:
     case GK_CACHE_REQ_TYPE_SNI:
-        FREE(attr->host_name->name);
+        gkc_intern_put(attr->host_name->name);
         FREE(attr->host_name);
         break;
 
     case GK_CACHE_REQ_TYPE_URL:
-        FREE(attr->url->name);
+        gkc_intern_put(attr->url->name);
         FREE(attr->url);
         break;
 
@@ -71,7 +75,7 @@ gkc_free_attr_entry(struct attr_cache *attr_entry, enum gk_cache_request_type at
         break;
 
     case GK_CACHE_REQ_TYPE_APP:
-        FREE(attr->app_name->name);
+        gkc_intern_put(attr->app_name->name);
         FREE(attr->app_name);
         break;
 
@@ -115,6 +119,7 @@ gk_clean_attribute_tree(ds_tree_t *tree, enum gk_cache_request_type attr_type)
 static void
 free_flow_entry_members(struct ip_flow_cache *flow_entry)
 {
+    gkc_ttl_unschedule(&flow_entry->ttl);
     FREE(flow_entry->src_ip_addr);
     FREE(flow_entry->dst_ip_addr);
     FREE(flow_entry->gk_policy);
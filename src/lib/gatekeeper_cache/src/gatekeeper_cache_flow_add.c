@@ -27,6 +27,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "memutil.h"
 
 #include "gatekeeper_cache.h"
+#include "gatekeeper_cache_internals.h"
 #include "memutil.h"
 
 /**
@@ -147,10 +148,18 @@ gkc_add_flow_tree(struct per_device_cache *pdevice,
     if (req->direction == GKC_FLOW_DIRECTION_INBOUND)
     {
         ds_tree_insert(&pdevice->inbound_tree, flow_entry, flow_entry);
+        gkc_ttl_schedule(&flow_entry->ttl,
+                         flow_entry->original_ts + flow_entry->cache_ttl,
+                         pdevice, &pdevice->inbound_tree,
+                         GK_CACHE_REQ_TYPE_INBOUND);
     }
     else if (req->direction == GKC_FLOW_DIRECTION_OUTBOUND)
     {
         ds_tree_insert(&pdevice->outbound_tree, flow_entry, flow_entry);
+        gkc_ttl_schedule(&flow_entry->ttl,
+                         flow_entry->original_ts + flow_entry->cache_ttl,
+                         pdevice, &pdevice->outbound_tree,
+                         GK_CACHE_REQ_TYPE_OUTBOUND);
     }
 
     return true;
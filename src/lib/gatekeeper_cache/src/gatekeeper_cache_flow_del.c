@@ -27,6 +27,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "memutil.h"
 
 #include "gatekeeper_cache.h"
+#include "gatekeeper_cache_internals.h"
 #include "memutil.h"
 
 /**
@@ -70,6 +71,7 @@ gkc_is_flow_present(struct ip_flow_cache *cur_flow_entry,
 void
 gkc_free_flow_members(struct ip_flow_cache *flow_entry)
 {
+    gkc_ttl_unschedule(&flow_entry->ttl);
     FREE(flow_entry->gk_policy);
     FREE(flow_entry->dst_ip_addr);
     FREE(flow_entry->src_ip_addr);
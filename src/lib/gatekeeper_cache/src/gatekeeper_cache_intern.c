@@ -0,0 +1,227 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "gatekeeper_cache.h"
+#include "gatekeeper_cache_internals.h"
+#include "log.h"
+#include "memutil.h"
+
+/*
+ * The attribute names (hostnames, URLs, application names) are interned:
+ * a popular name is stored once, whatever the number of devices it is
+ * cached for. Each cache entry holds a reference on its name.
+ */
+
+static struct gkc_intern_table *
+gkc_intern_get_table(void)
+{
+    struct gk_cache_mgr *mgr;
+
+    mgr = gk_cache_get_mgr();
+    return &mgr->names;
+}
+
+/* FNV-1a */
+static uint64_t
+gkc_intern_hash(const char *name, size_t len)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+    {
+        h ^= (uint8_t)name[i];
+        h *= 0x100000001b3ULL;
+    }
+
+    return h;
+}
+
+static struct gkc_intern_str *
+gkc_intern_lookup(struct gkc_intern_table *table, const char *name,
+                  size_t len, uint64_t hash)
+{
+    struct gkc_intern_str *s;
+
+    if (table->buckets == NULL) return NULL;
+
+    s = table->buckets[hash & (table->nbuckets - 1)];
+    for (; s != NULL; s = s->next)
+    {
+        if (s->hash != hash || s->len != len) continue;
+        if (memcmp(s->str, name, len) == 0) return s;
+    }
+
+    return NULL;
+}
+
+static void
+gkc_intern_resize(struct gkc_intern_table *table, size_t nbuckets)
+{
+    struct gkc_intern_str **buckets;
+    struct gkc_intern_str *next;
+    struct gkc_intern_str *s;
+    size_t i;
+
+    buckets = CALLOC(nbuckets, sizeof(*buckets));
+    if (buckets == NULL) return;
+
+    for (i = 0; i < table->nbuckets; i++)
+    {
+        for (s = table->buckets[i]; s != NULL; s = next)
+        {
+            next = s->next;
+            s->next = buckets[s->hash & (nbuckets - 1)];
+            buckets[s->hash & (nbuckets - 1)] = s;
+        }
+    }
+
+    FREE(table->buckets);
+    table->buckets = buckets;
+    table->nbuckets = nbuckets;
+}
+
+void
+gkc_intern_init(struct gkc_intern_table *table)
+{
+    MEMZERO(*table);
+}
+
+void
+gkc_intern_fini(struct gkc_intern_table *table)
+{
+    if (table->count != 0)
+    {
+        LOGD("%s: %zu names still referenced", __func__, table->count);
+    }
+
+    FREE(table->buckets);
+    MEMZERO(*table);
+}
+
+char *
+gkc_intern_get(const char *name)
+{
+    struct gkc_intern_table *table;
+    struct gkc_intern_str *s;
+    uint64_t hash;
+    size_t idx;
+    size_t len;
+
+    if (name == NULL) return NULL;
+
+    table = gkc_intern_get_table();
+    len = strlen(name);
+    hash = gkc_intern_hash(name, len);
+
+    s = gkc_intern_lookup(table, name, len, hash);
+    if (s != NULL)
+    {
+        s->refcnt++;
+        table->refs++;
+        return s->str;
+    }
+
+    if (table->buckets == NULL) gkc_intern_resize(table, GKC_INTERN_MIN_BUCKETS);
+    else if (table->count >= table->nbuckets) gkc_intern_resize(table, table->nbuckets * 2);
+    if (table->buckets == NULL) return NULL;
+
+    s = CALLOC(1, sizeof(*s) + len + 1);
+    if (s == NULL) return NULL;
+
+    memcpy(s->str, name, len + 1);
+    s->len = len;
+    s->hash = hash;
+    s->refcnt = 1;
+
+    idx = hash & (table->nbuckets - 1);
+    s->next = table->buckets[idx];
+    table->buckets[idx] = s;
+
+    table->count++;
+    table->refs++;
+    table->bytes += sizeof(*s) + len + 1;
+
+    return s->str;
+}
+
+void
+gkc_intern_put(char *name)
+{
+    struct gkc_intern_table *table;
+    struct gkc_intern_str **pprev;
+    struct gkc_intern_str *s;
+
+    if (name == NULL) return;
+
+    table = gkc_intern_get_table();
+    s = CONTAINER_OF(name, struct gkc_intern_str, str[0]);
+
+    table->refs--;
+    s->refcnt--;
+    if (s->refcnt != 0) return;
+
+    pprev = &table->buckets[s->hash & (table->nbuckets - 1)];
+    while (*pprev != s) pprev = &(*pprev)->next;
+    *pprev = s->next;
+
+    table->count--;
+    table->bytes -= sizeof(*s) + s->len + 1;
+    FREE(s);
+}
+
+char *
+gkc_intern_find(const char *name)
+{
+    struct gkc_intern_table *table;
+    struct gkc_intern_str *s;
+    size_t len;
+
+    if (name == NULL) return NULL;
+
+    table = gkc_intern_get_table();
+    len = strlen(name);
+
+    s = gkc_intern_lookup(table, name, len, gkc_intern_hash(name, len));
+    if (s == NULL) return NULL;
+
+    return s->str;
+}
+
+void
+gkc_intern_print_stats(void)
+{
+    struct gkc_intern_table *table;
+
+    table = gkc_intern_get_table();
+
+    LOGT("%s: interned names: %zu unique, %" PRIu64 " references, %zu bytes, %zu buckets",
+         __func__, table->count, table->refs, table->bytes, table->nbuckets);
+}
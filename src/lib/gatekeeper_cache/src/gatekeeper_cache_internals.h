@@ -30,4 +30,93 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 struct per_device_cache *
 gkc_lookup_device_tree(os_macaddr_t *device_mac);
 
+/**
+ * @brief initialize the TTL timing wheel
+ */
+void
+gkc_ttl_wheel_init(struct gkc_ttl_wheel *wheel);
+
+/**
+ * @brief schedule a cache entry for expiry
+ *
+ * @param ttl the entry's wheel linkage
+ * @param expiry_ts the time the entry expires at
+ * @param pdevice the device owning the entry
+ * @param tree the tree holding the entry
+ * @param attr_type the tree type (attribute type or flow direction)
+ */
+void
+gkc_ttl_schedule(struct gkc_ttl_node *ttl, time_t expiry_ts,
+                 struct per_device_cache *pdevice, ds_tree_t *tree,
+                 enum gk_cache_request_type attr_type);
+
+/**
+ * @brief remove a cache entry from the TTL wheel. Safe on entries
+ *        never scheduled.
+ */
+void
+gkc_ttl_unschedule(struct gkc_ttl_node *ttl);
+
+/**
+ * @brief expire the entries due at or before now, within the budget
+ *
+ * @return the number of expired entries
+ */
+size_t
+gkc_ttl_wheel_expire(time_t now);
+
+/**
+ * @brief log the TTL wheel counters
+ */
+void
+gkc_ttl_print_stats(void);
+
+/**
+ * @brief initialize the attribute names intern table
+ */
+void
+gkc_intern_init(struct gkc_intern_table *table);
+
+/**
+ * @brief release the intern table buckets. All names are expected to
+ *        have been released by then.
+ */
+void
+gkc_intern_fini(struct gkc_intern_table *table);
+
+/**
+ * @brief get a reference on the interned copy of a name, creating it
+ *        if needed
+ *
+ * @param name the name to intern
+ * @return the interned name, NULL on failure. Must be released with
+ *         gkc_intern_put().
+ */
+char *
+gkc_intern_get(const char *name);
+
+/**
+ * @brief release a reference returned by gkc_intern_get()
+ */
+void
+gkc_intern_put(char *name);
+
+/**
+ * @brief find the interned copy of a name without taking a reference
+ *
+ * Cache entries carrying the same name share the same interned pointer,
+ * so the returned value can be compared to the entries' names by pointer.
+ *
+ * @param name the name to look for
+ * @return the interned name, NULL if no cache entry uses that name
+ */
+char *
+gkc_intern_find(const char *name);
+
+/**
+ * @brief log the intern table counters
+ */
+void
+gkc_intern_print_stats(void);
+
 #endif /* #define GK_CACHE_H_INTERNAL_INCLUDED */
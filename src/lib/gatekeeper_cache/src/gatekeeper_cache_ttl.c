@@ -0,0 +1,350 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <inttypes.h>
+#include <time.h>
+
+#include "gatekeeper_cache.h"
+#include "gatekeeper_cache_internals.h"
+#include "log.h"
+#include "memutil.h"
+#include "util.h"
+
+/*
+ * The wheel expires entries by their expiry second. An entry due within
+ * GKC_TTL_WHEEL_L0_SLOTS seconds sits in the level 0 slot of its expiry
+ * second. An entry due further out sits in the level 1 slot of its
+ * GKC_TTL_WHEEL_L0_SLOTS seconds block or in the overflow list, and is
+ * cascaded down when the level 0 cursor reaches its block.
+ */
+#define GKC_TTL_WHEEL_SPAN (GKC_TTL_WHEEL_L0_SLOTS * GKC_TTL_WHEEL_L1_SLOTS)
+
+static struct gkc_ttl_wheel *
+gkc_ttl_get_wheel(void)
+{
+    struct gk_cache_mgr *mgr;
+
+    mgr = gk_cache_get_mgr();
+    return &mgr->ttl_wheel;
+}
+
+/**
+ * @brief initialize the TTL timing wheel
+ */
+void
+gkc_ttl_wheel_init(struct gkc_ttl_wheel *wheel)
+{
+    size_t i;
+
+    for (i = 0; i < GKC_TTL_WHEEL_L0_SLOTS; i++)
+    {
+        ds_dlist_init(&wheel->l0[i], struct gkc_ttl_node, node);
+    }
+
+    for (i = 0; i < GKC_TTL_WHEEL_L1_SLOTS; i++)
+    {
+        ds_dlist_init(&wheel->l1[i], struct gkc_ttl_node, node);
+    }
+
+    ds_dlist_init(&wheel->overflow, struct gkc_ttl_node, node);
+
+    wheel->wheel_ts = time(NULL) - 1;
+    if (wheel->budget == 0) wheel->budget = GKC_TTL_CLEANUP_BUDGET;
+    wheel->scheduled = 0;
+}
+
+/**
+ * @brief set the max number of entries expired by one gkc_ttl_cleanup() call
+ *
+ * @param budget the max number of expiries, 0 restores the default
+ */
+void
+gkc_ttl_set_budget(size_t budget)
+{
+    struct gkc_ttl_wheel *wheel;
+
+    wheel = gkc_ttl_get_wheel();
+    wheel->budget = (budget != 0) ? budget : GKC_TTL_CLEANUP_BUDGET;
+}
+
+/**
+ * @brief insert a node in the slot matching its expiry
+ *
+ * Entries already past due are parked in the next slot to be swept.
+ */
+static void
+gkc_ttl_insert(struct gkc_ttl_wheel *wheel, struct gkc_ttl_node *ttl)
+{
+    time_t base;
+    time_t due;
+
+    base = wheel->wheel_ts + 1;
+    due = MAX(ttl->expiry_ts, base);
+
+    if ((due - base) < GKC_TTL_WHEEL_L0_SLOTS)
+    {
+        ttl->slot = &wheel->l0[due % GKC_TTL_WHEEL_L0_SLOTS];
+    }
+    else if ((due - base) < GKC_TTL_WHEEL_SPAN)
+    {
+        ttl->slot = &wheel->l1[(due / GKC_TTL_WHEEL_L0_SLOTS) % GKC_TTL_WHEEL_L1_SLOTS];
+    }
+    else
+    {
+        ttl->slot = &wheel->overflow;
+    }
+
+    ds_dlist_insert_tail(ttl->slot, ttl);
+}
+
+void
+gkc_ttl_schedule(struct gkc_ttl_node *ttl, time_t expiry_ts,
+                 struct per_device_cache *pdevice, ds_tree_t *tree,
+                 enum gk_cache_request_type attr_type)
+{
+    struct gkc_ttl_wheel *wheel;
+
+    wheel = gkc_ttl_get_wheel();
+
+    gkc_ttl_unschedule(ttl);
+
+    ttl->expiry_ts = expiry_ts;
+    ttl->pdevice = pdevice;
+    ttl->tree = tree;
+    ttl->attr_type = attr_type;
+
+    gkc_ttl_insert(wheel, ttl);
+    wheel->scheduled++;
+}
+
+void
+gkc_ttl_unschedule(struct gkc_ttl_node *ttl)
+{
+    struct gkc_ttl_wheel *wheel;
+
+    if (ttl->slot == NULL) return;
+
+    wheel = gkc_ttl_get_wheel();
+
+    ds_dlist_remove(ttl->slot, ttl);
+    ttl->slot = NULL;
+    wheel->scheduled--;
+}
+
+/**
+ * @brief re-insert all the nodes of a slot according to their expiry
+ */
+static void
+gkc_ttl_cascade(struct gkc_ttl_wheel *wheel, ds_dlist_t *slot)
+{
+    struct gkc_ttl_node *ttl;
+    ds_dlist_t pending;
+
+    if (ds_dlist_is_empty(slot)) return;
+
+    /* Detach the slot first, nodes may land back in it */
+    ds_dlist_init(&pending, struct gkc_ttl_node, node);
+    while ((ttl = ds_dlist_remove_head(slot)) != NULL)
+    {
+        ds_dlist_insert_tail(&pending, ttl);
+    }
+
+    while ((ttl = ds_dlist_remove_head(&pending)) != NULL)
+    {
+        gkc_ttl_insert(wheel, ttl);
+        wheel->cascaded++;
+    }
+}
+
+/**
+ * @brief remove an expired entry from its tree and free it
+ */
+static void
+gkc_ttl_expire_entry(struct gkc_ttl_node *ttl)
+{
+    enum gk_cache_request_type attr_type;
+    struct per_device_cache *pdevice;
+    struct ip_flow_cache *flow_entry;
+    struct attr_cache *attr_entry;
+    struct gk_cache_mgr *mgr;
+    ds_tree_t *tree;
+
+    mgr = gk_cache_get_mgr();
+
+    gkc_ttl_unschedule(ttl);
+    attr_type = ttl->attr_type;
+    pdevice = ttl->pdevice;
+    tree = ttl->tree;
+
+    if ((attr_type == GK_CACHE_REQ_TYPE_INBOUND) ||
+        (attr_type == GK_CACHE_REQ_TYPE_OUTBOUND))
+    {
+        flow_entry = CONTAINER_OF(ttl, struct ip_flow_cache, ttl);
+
+        LOGT("%s(): deleting flow for device " PRI_os_macaddr_lower_t
+             " with expired TTL",
+             __func__,
+             FMT_os_macaddr_pt(pdevice->device_mac));
+
+        gkc_free_flow_members(flow_entry);
+        ds_tree_remove(tree, flow_entry);
+        FREE(flow_entry);
+    }
+    else
+    {
+        attr_entry = CONTAINER_OF(ttl, struct attr_cache, ttl);
+
+        LOGT("%s(): removing attribute type %d for device " PRI_os_macaddr_lower_t
+             " due to expired TTL",
+             __func__, attr_type,
+             FMT_os_macaddr_pt(pdevice->device_mac));
+
+        gkc_free_attr_entry(attr_entry, attr_type);
+        ds_tree_remove(tree, attr_entry);
+        FREE(attr_entry);
+    }
+
+    mgr->total_entry_count--;
+}
+
+/**
+ * @brief re-insert every scheduled node against a new cursor.
+ *
+ * Used when more than a full wheel span elapsed since the last sweep,
+ * where walking the elapsed seconds one by one would be wasteful.
+ */
+static void
+gkc_ttl_rebase(struct gkc_ttl_wheel *wheel, time_t now)
+{
+    struct gkc_ttl_node *ttl;
+    ds_dlist_t pending;
+    size_t i;
+
+    ds_dlist_init(&pending, struct gkc_ttl_node, node);
+
+    for (i = 0; i < GKC_TTL_WHEEL_L0_SLOTS; i++)
+    {
+        while ((ttl = ds_dlist_remove_head(&wheel->l0[i])) != NULL)
+        {
+            ds_dlist_insert_tail(&pending, ttl);
+        }
+    }
+
+    for (i = 0; i < GKC_TTL_WHEEL_L1_SLOTS; i++)
+    {
+        while ((ttl = ds_dlist_remove_head(&wheel->l1[i])) != NULL)
+        {
+            ds_dlist_insert_tail(&pending, ttl);
+        }
+    }
+
+    while ((ttl = ds_dlist_remove_head(&wheel->overflow)) != NULL)
+    {
+        ds_dlist_insert_tail(&pending, ttl);
+    }
+
+    wheel->wheel_ts = now - 1;
+    while ((ttl = ds_dlist_remove_head(&pending)) != NULL)
+    {
+        gkc_ttl_insert(wheel, ttl);
+    }
+}
+
+size_t
+gkc_ttl_wheel_expire(time_t now)
+{
+    struct gkc_ttl_wheel *wheel;
+    struct gkc_ttl_node *ttl;
+    size_t expired;
+    ds_dlist_t *slot;
+    time_t ts;
+
+    wheel = gkc_ttl_get_wheel();
+    expired = 0;
+
+    if ((now - wheel->wheel_ts) > GKC_TTL_WHEEL_SPAN) gkc_ttl_rebase(wheel, now);
+
+    while (wheel->wheel_ts < now)
+    {
+        ts = wheel->wheel_ts + 1;
+
+        /* Entering a new block: bring its entries down to level 0 */
+        if ((ts % GKC_TTL_WHEEL_L0_SLOTS) == 0)
+        {
+            if ((ts % GKC_TTL_WHEEL_SPAN) == 0) gkc_ttl_cascade(wheel, &wheel->overflow);
+            gkc_ttl_cascade(wheel, &wheel->l1[(ts / GKC_TTL_WHEEL_L0_SLOTS) % GKC_TTL_WHEEL_L1_SLOTS]);
+        }
+
+        slot = &wheel->l0[ts % GKC_TTL_WHEEL_L0_SLOTS];
+        while ((ttl = ds_dlist_head(slot)) != NULL)
+        {
+            if (expired >= wheel->budget)
+            {
+                wheel->budget_exhausted++;
+                goto out;
+            }
+
+            /* Not due yet, a later revolution */
+            if (ttl->expiry_ts > now)
+            {
+                ds_dlist_remove(slot, ttl);
+                gkc_ttl_insert(wheel, ttl);
+                continue;
+            }
+
+            gkc_ttl_expire_entry(ttl);
+            expired++;
+        }
+
+        /* Entries may still be scheduled in the current second */
+        if (ts == now) break;
+
+        wheel->wheel_ts = ts;
+    }
+
+out:
+    wheel->expired += expired;
+    wheel->last_expired = expired;
+
+    return expired;
+}
+
+/**
+ * @brief log the TTL wheel counters
+ */
+void
+gkc_ttl_print_stats(void)
+{
+    struct gkc_ttl_wheel *wheel;
+
+    wheel = gkc_ttl_get_wheel();
+
+    LOGT("%s: ttl wheel: scheduled %" PRIu64 ", expired %" PRIu64
+         " (last cleanup %" PRIu64 "), cascaded %" PRIu64
+         ", budget %zu exhausted %" PRIu64 " times",
+         __func__, wheel->scheduled, wheel->expired, wheel->last_expired,
+         wheel->cascaded, wheel->budget, wheel->budget_exhausted);
+}
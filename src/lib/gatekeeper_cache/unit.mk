@@ -41,6 +41,8 @@ UNIT_SRC += src/gatekeeper_cache_flow_lookup.c
 UNIT_SRC += src/gatekeeper_cache_flow_del.c
 UNIT_SRC += src/gatekeeper_cache_flush.c
 UNIT_SRC += src/gatekeeper_cache_cmp.c
+UNIT_SRC += src/gatekeeper_cache_ttl.c
+UNIT_SRC += src/gatekeeper_cache_intern.c
 
 UNIT_CFLAGS := -I$(UNIT_PATH)/inc
 UNIT_CFLAGS += -I$(TOP_DIR)/src/lib/common/inc
@@ -1947,6 +1947,177 @@ test_flow_entry_network_id(void)
     LOGI("ending test: %s", __func__);
 }
 
+void
+test_ttl_wheel_budget(void)
+{
+    struct gk_attr_cache_interface entry;
+    struct gkc_ip_flow_interface *flow_entry;
+    char name[64];
+    bool ret;
+    int i;
+
+    LOGI("starting test: %s ...", __func__);
+
+    MEMZERO(entry);
+    entry.action = FSM_ALLOW;
+    entry.device_mac = str2os_mac("AA:AA:AA:AA:AA:02");
+    entry.attribute_type = GK_CACHE_REQ_TYPE_FQDN;
+    entry.attr_name = name;
+
+    /* 5 short lived entries */
+    entry.cache_ttl = 1;
+    for (i = 0; i < 5; i++)
+    {
+        snprintf(name, sizeof(name), "wheel%d.example.com", i);
+        entry.cache_key = 0;
+        ret = gkc_add_attribute_entry(&entry);
+        TEST_ASSERT_TRUE(ret);
+    }
+
+    /* 1 entry far in the future, beyond the wheel span */
+    entry.cache_ttl = 10 * GKC_TTL_WHEEL_L0_SLOTS * GKC_TTL_WHEEL_L1_SLOTS;
+    snprintf(name, sizeof(name), "wheel.example.com");
+    entry.cache_key = 0;
+    ret = gkc_add_attribute_entry(&entry);
+    TEST_ASSERT_TRUE(ret);
+
+    /* 1 flow expiring with the short lived attributes */
+    flow_entry = flow_entry1;
+    flow_entry->cache_ttl = 1;
+    ret = gkc_add_flow_entry(flow_entry);
+    TEST_ASSERT_TRUE(ret);
+
+    TEST_ASSERT_EQUAL_INT(7, gk_get_cache_count());
+
+    /* Nothing is due yet */
+    gkc_ttl_cleanup();
+    TEST_ASSERT_EQUAL_INT(7, gk_get_cache_count());
+
+    sleep(2);
+
+    /* Expiries are spread over several cleanups by the budget */
+    gkc_ttl_set_budget(2);
+    gkc_ttl_cleanup();
+    TEST_ASSERT_EQUAL_INT(5, gk_get_cache_count());
+    gkc_ttl_cleanup();
+    TEST_ASSERT_EQUAL_INT(3, gk_get_cache_count());
+    gkc_ttl_cleanup();
+    TEST_ASSERT_EQUAL_INT(1, gk_get_cache_count());
+    gkc_ttl_cleanup();
+    TEST_ASSERT_EQUAL_INT(1, gk_get_cache_count());
+
+    ret = gkc_lookup_flow(flow_entry, false);
+    TEST_ASSERT_FALSE(ret);
+    ret = gkc_lookup_attribute_entry(&entry, false);
+    TEST_ASSERT_TRUE(ret);
+
+    /* A budget of 0 restores the default, not an unlimited budget */
+    gkc_ttl_set_budget(0);
+    entry.cache_ttl = 1;
+    for (i = 0; i < 3; i++)
+    {
+        snprintf(name, sizeof(name), "default%d.example.com", i);
+        entry.cache_key = 0;
+        ret = gkc_add_attribute_entry(&entry);
+        TEST_ASSERT_TRUE(ret);
+    }
+    TEST_ASSERT_EQUAL_INT(4, gk_get_cache_count());
+
+    sleep(2);
+
+    gkc_ttl_cleanup();
+    TEST_ASSERT_EQUAL_INT(1, gk_get_cache_count());
+
+    snprintf(name, sizeof(name), "wheel.example.com");
+    entry.cache_key = 0;
+    ret = gkc_del_attribute(&entry);
+    TEST_ASSERT_TRUE(ret);
+    TEST_ASSERT_EQUAL_INT(0, gk_get_cache_count());
+
+    FREE(entry.device_mac);
+
+    LOGI("ending test: %s", __func__);
+}
+
+void
+test_intern_shared_names(void)
+{
+    struct gk_attr_cache_interface entry;
+    struct attr_cache *from_cache[3];
+    struct gk_cache_mgr *mgr;
+    os_macaddr_t *macs[3];
+    size_t names_count;
+    uint64_t names_refs;
+    char mac_str[32];
+    bool ret;
+    int i;
+
+    LOGI("starting test: %s ...", __func__);
+
+    mgr = gk_cache_get_mgr();
+    names_count = mgr->names.count;
+    names_refs = mgr->names.refs;
+
+    MEMZERO(entry);
+    entry.action = FSM_ALLOW;
+    entry.attribute_type = GK_CACHE_REQ_TYPE_FQDN;
+    entry.cache_ttl = 1000;
+
+    /* The same name cached for 3 devices is stored once */
+    for (i = 0; i < 3; i++)
+    {
+        snprintf(mac_str, sizeof(mac_str), "AA:AA:AA:AA:AB:%02d", i);
+        macs[i] = str2os_mac(mac_str);
+        entry.device_mac = macs[i];
+        entry.attr_name = "cdn.intern.example.com";
+        entry.cache_key = 0;
+        ret = gkc_add_attribute_entry(&entry);
+        TEST_ASSERT_TRUE(ret);
+
+        from_cache[i] = gkc_fetch_attribute_entry(&entry);
+        TEST_ASSERT_NOT_NULL(from_cache[i]);
+    }
+
+    TEST_ASSERT_EQUAL_PTR(from_cache[0]->attr.host_name->name, from_cache[1]->attr.host_name->name);
+    TEST_ASSERT_EQUAL_PTR(from_cache[0]->attr.host_name->name, from_cache[2]->attr.host_name->name);
+    TEST_ASSERT_EQUAL_STRING("cdn.intern.example.com", from_cache[0]->attr.host_name->name);
+    TEST_ASSERT_EQUAL_UINT(names_count + 1, mgr->names.count);
+    TEST_ASSERT_EQUAL_UINT64(names_refs + 3, mgr->names.refs);
+
+    /* A name not cached for any device is a miss */
+    entry.device_mac = macs[0];
+    entry.attr_name = "other.intern.example.com";
+    entry.cache_key = 0;
+    ret = gkc_lookup_attribute_entry(&entry, false);
+    TEST_ASSERT_FALSE(ret);
+
+    /* The name survives as long as one entry references it */
+    entry.attr_name = "cdn.intern.example.com";
+    for (i = 0; i < 2; i++)
+    {
+        entry.device_mac = macs[i];
+        entry.cache_key = 0;
+        ret = gkc_del_attribute(&entry);
+        TEST_ASSERT_TRUE(ret);
+    }
+    TEST_ASSERT_EQUAL_UINT(names_count + 1, mgr->names.count);
+    TEST_ASSERT_EQUAL_UINT64(names_refs + 1, mgr->names.refs);
+
+    entry.device_mac = macs[2];
+    entry.cache_key = 0;
+    ret = gkc_lookup_attribute_entry(&entry, false);
+    TEST_ASSERT_TRUE(ret);
+
+    ret = gkc_del_attribute(&entry);
+    TEST_ASSERT_TRUE(ret);
+    TEST_ASSERT_EQUAL_UINT(names_count, mgr->names.count);
+    TEST_ASSERT_EQUAL_UINT64(names_refs, mgr->names.refs);
+
+    for (i = 0; i < 3; i++) FREE(macs[i]);
+
+    LOGI("ending test: %s", __func__);
+}
+
 void
 run_gk_cache(void)
 {
@@ -1957,6 +2128,8 @@ run_gk_cache(void)
 
     RUN_TEST(test_add_gk_cache);
     RUN_TEST(test_check_ttl);
+    RUN_TEST(test_ttl_wheel_budget);
+    RUN_TEST(test_intern_shared_names);
     RUN_TEST(test_lookup);
     RUN_TEST(test_hit_counter);
     RUN_TEST(test_delete_attr);
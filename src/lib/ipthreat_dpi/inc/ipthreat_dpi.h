@@ -138,6 +138,20 @@ void
 ipthreat_dpi_plugin_handler(struct fsm_session *session,
                             struct net_header_parser *net_parser);
 
+
+/**
+ * @brief session batched packet processing entry point
+ *
+ * @param session the fsm session
+ * @param pkts consecutive packets of a flow
+ * @param n the number of packets
+ * @return the number of packets handled
+ */
+size_t
+ipthreat_dpi_plugin_batch_handler(struct fsm_session *session,
+                                  struct net_header_parser **pkts,
+                                  size_t n);
+
 /**
  * @brief process the parsed message
  *
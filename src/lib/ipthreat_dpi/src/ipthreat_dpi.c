@@ -218,6 +218,7 @@ ipthreat_dpi_plugin_init(struct fsm_session *session)
     struct dns_cache_settings cache_init;
     struct fsm_policy_client *client;
     struct ipthreat_dpi_cache *mgr;
+    char *max_entries;
     char *provider;
     char *outbound;
     char *inbound;
@@ -255,7 +256,9 @@ ipthreat_dpi_plugin_init(struct fsm_session *session)
     /* Set the plugin ops */
     dpi_plugin_ops = &session->p_ops->dpi_plugin_ops;
     FSM_FN_MAP(ipthreat_dpi_plugin_handler);
+    FSM_FN_MAP(ipthreat_dpi_plugin_batch_handler);
     dpi_plugin_ops->handler = ipthreat_dpi_plugin_handler;
+    dpi_plugin_ops->batch_handler = ipthreat_dpi_plugin_batch_handler;
 
     /* Wrap up the session initialization */
     ipthreat_dpi_session->session = session;
@@ -290,6 +293,12 @@ ipthreat_dpi_plugin_init(struct fsm_session *session)
         ipthreat_dpi_session->service_provider = dns_cache_get_service_provider(provider);
     }
 
+    max_entries = session->ops.get_config(session, "dns_cache_max_entries");
+    if (max_entries != NULL)
+    {
+        dns_cache_set_max_entries((int)strtoul(max_entries, NULL, 10));
+    }
+
     /* Initialize the DNS cache */
     cache_init.dns_cache_source = MODULE_IPTHREAT_DPI;
     cache_init.service_provider = ipthreat_dpi_session->service_provider;
@@ -387,6 +396,42 @@ ipthreat_dpi_plugin_handler(struct fsm_session *session,
 }
 
 
+/**
+ * @brief session batched packet processing entry point
+ *
+ * The policy verdict only depends on the flow: it is evaluated once for
+ * the burst. When no verdict could be reached, the other packets of the
+ * burst would not change the outcome and are considered handled.
+ * @param session the fsm session
+ * @param pkts consecutive packets of a flow
+ * @param n the number of packets
+ * @return the number of packets handled
+ */
+size_t
+ipthreat_dpi_plugin_batch_handler(struct fsm_session *session,
+                                  struct net_header_parser **pkts,
+                                  size_t n)
+{
+    struct net_md_stats_accumulator *acc;
+    struct fsm_dpi_flow_info *info;
+
+    if (n == 0) return 0;
+
+    ipthreat_dpi_plugin_handler(session, pkts[0]);
+
+    acc = pkts[0]->acc;
+    if (acc == NULL) return n;
+    if (acc->dpi_plugins == NULL) return n;
+
+    info = ds_tree_find(acc->dpi_plugins, session);
+    if (info == NULL) return n;
+
+    if (info->decision != FSM_DPI_INSPECT) return 1;
+
+    return n;
+}
+
+
 /**
  * @brief return the policy table to be used
  *
@@ -1362,6 +1362,100 @@ void test_ipthreat_null_provider_ops(void)
     LOGI("\n******************** %s: completed ****************\n", __func__);
 }
 
+/**
+ * @brief validate the batched packet handler
+ *
+ * The policy is evaluated once for a burst. The burst stops at the packet
+ * setting the verdict.
+ */
+void test_ipthreat_batch_handler(void)
+{
+    struct net_header_parser *pkts[3];
+    struct ipthreat_dpi_session *ds_session;
+    struct net_header_parser net_parsers[3];
+    struct schema_FSM_Policy *spolicy;
+    struct ipthreat_dpi_cache *mgr;
+    struct fsm_dpi_flow_info info;
+    struct fsm_session *session;
+    struct fsm_policy *fpolicy;
+    ds_tree_t dpi_plugins;
+    struct udphdr udphdr;
+    ds_tree_t *sessions;
+    struct iphdr iphdr;
+    size_t handled;
+    size_t i;
+    int ret;
+
+    LOGI("\n******************** %s: starting ****************\n", __func__);
+
+    mgr = ipthreat_dpi_get_mgr();
+    sessions = &mgr->ipt_sessions;
+
+    /* add ipthreat session */
+    session = &g_sessions[0];
+    ret = ipthreat_dpi_plugin_init(session);
+    TEST_ASSERT_TRUE(ret == 0);
+    ds_session = ds_tree_find(sessions, session);
+    TEST_ASSERT_NOT_NULL(ds_session);
+    TEST_ASSERT_TRUE(session->p_ops->dpi_plugin_ops.batch_handler ==
+                     ipthreat_dpi_plugin_batch_handler);
+
+    /* Bind the plugin to the flow */
+    ds_tree_init(&dpi_plugins, ds_void_cmp, struct fsm_dpi_flow_info, dpi_node);
+    memset(&info, 0, sizeof(info));
+    info.session = session;
+    info.decision = FSM_DPI_INSPECT;
+    ds_tree_insert(&dpi_plugins, &info, session);
+    g_v4_inbound_acc.dpi_plugins = &dpi_plugins;
+
+    /* populate a burst of the inbound flow */
+    memset(net_parsers, 0, sizeof(net_parsers));
+    memcpy(&iphdr.saddr, g_v4_inbound_key.src_ip, 4);
+    memcpy(&iphdr.daddr, g_v4_inbound_key.dst_ip, 4);
+    udphdr.source = g_v4_inbound_key.sport;
+    udphdr.dest = g_v4_inbound_key.dport;
+    for (i = 0; i < 3; i++)
+    {
+        net_parsers[i].eth_header = inbound_eth_header;
+        net_parsers[i].ip_version = 4;
+        net_parsers[i].ip_protocol = IPPROTO_UDP;
+        net_parsers[i].eth_pld.ip.iphdr = &iphdr;
+        net_parsers[i].ip_pld.udphdr = &udphdr;
+        net_parsers[i].parsed = 42;
+        net_parsers[i].packet_len = 42;
+        net_parsers[i].acc = &g_v4_inbound_acc;
+        pkts[i] = &net_parsers[i];
+    }
+
+    /* No policy: no verdict, the whole burst is handled */
+    handled = ipthreat_dpi_plugin_batch_handler(session, pkts, 3);
+    TEST_ASSERT_EQUAL_UINT(3, handled);
+    TEST_ASSERT_EQUAL_INT(FSM_DPI_INSPECT, info.decision);
+
+    /* add a blocking fsm policy */
+    spolicy = &spolicies[0];
+    fsm_add_policy(spolicy);
+    fpolicy = fsm_policy_lookup(spolicy);
+    TEST_ASSERT_NOT_NULL(fpolicy);
+
+    /* The verdict is set on the first packet */
+    handled = ipthreat_dpi_plugin_batch_handler(session, pkts, 3);
+    TEST_ASSERT_EQUAL_UINT(1, handled);
+    TEST_ASSERT_EQUAL_INT(FSM_DPI_DROP, info.decision);
+
+    g_v4_inbound_acc.dpi_plugins = NULL;
+
+    /* delete fsm policy */
+    fsm_delete_policy(spolicy);
+
+    /* free ipthreat session */
+    ipthreat_dpi_plugin_exit(session);
+    ds_session = ds_tree_find(sessions, session);
+    TEST_ASSERT_NULL(ds_session);
+
+    LOGI("\n******************** %s: completed ****************\n", __func__);
+}
+
 int main(int argc, char *argv[])
 {
     ut_init(test_name, global_test_init, global_test_exit);
@@ -1380,6 +1474,7 @@ int main(int argc, char *argv[])
     RUN_TEST(test_ipthreat_lan2lan_traffic);
     RUN_TEST(test_ipthreat_gk_dns_cache);
     RUN_TEST(test_ipthreat_null_provider_ops);
+    RUN_TEST(test_ipthreat_batch_handler);
 
     return ut_fini();
 }
@@ -168,8 +168,50 @@ typedef enum log_sink_e
         LOG_MODULE_TABLE_TARGET(ENTRY)
 #endif
 
+/**
+ * Severities above LOG_SEVERITY_BUILD_MAX are compiled out of the LOG*()
+ * macros. Each LOG*() call site caches whether its severity is enabled
+ * and only re-evaluates it after a severity change.
+ */
 #define LOG(level, ...) \
-    mlog(LOG_SEVERITY_##level, MODULE_ID, __VA_ARGS__)
+({ \
+    if (LOG_SEVERITY_##level <= LOG_SEVERITY_BUILD_MAX) \
+    { \
+        static log_site_t log_site__; \
+        if (log_site_enabled(&log_site__, LOG_SEVERITY_##level, MODULE_ID)) \
+            mlog(LOG_SEVERITY_##level, MODULE_ID, __VA_ARGS__); \
+    } \
+})
+
+/**
+ * Call site with a token bucket of @rate_ messages per second and a
+ * depth of @burst_ messages (@rate_ when 0), logging 1 out of @sample_
+ * calls when @sample_ is greater than 1. Messages dropped by the token
+ * bucket are accounted for in the next message logged from the site.
+ */
+#define LOG_LIMIT(level, rate_, burst_, sample_, ...) \
+({ \
+    if (LOG_SEVERITY_##level <= LOG_SEVERITY_BUILD_MAX) \
+    { \
+        static log_limit_t log_limit__ = \
+        { \
+            .file = __FILE__, \
+            .line = __LINE__, \
+            .rate = (rate_), \
+            .burst = (burst_), \
+            .sample = (sample_), \
+        }; \
+        if (log_site_enabled(&log_limit__.site, LOG_SEVERITY_##level, MODULE_ID) && \
+            log_limit_admit(&log_limit__, LOG_SEVERITY_##level, MODULE_ID)) \
+            mlog(LOG_SEVERITY_##level, MODULE_ID, __VA_ARGS__); \
+    } \
+})
+
+#define LOG_RATELIMIT(level, rate, burst, ...) \
+    LOG_LIMIT(level, rate, burst, 0, __VA_ARGS__)
+
+#define LOG_SAMPLE(level, n, ...) \
+    LOG_LIMIT(level, 0, 0, n, __VA_ARGS__)
 
 #define LOG_ONCE(level, ...) \
 ({ \
@@ -197,7 +239,8 @@ typedef enum log_sink_e
 #define TRACEF(FMT, ...)      LOGT("%s:%d " FMT, __FUNCTION__, __LINE__, ## __VA_ARGS__)
 #define TRACE(...)            TRACEF(""__VA_ARGS__)
 
-#define LOG_SEVERITY_ENABLED(LEVEL) (LEVEL <= log_module_severity_get(MODULE_ID))
+#define LOG_SEVERITY_ENABLED(LEVEL) \
+    ((LEVEL) <= LOG_SEVERITY_BUILD_MAX && (LEVEL) <= log_module_severity_get(MODULE_ID))
 
 #define WARN_ON(cond) \
 ({ \
@@ -243,6 +286,63 @@ typedef struct
     log_severity_t  severity;
 } log_module_entry_t;
 
+/** Most verbose severity compiled in, see CONFIG_LOG_SEVERITY_BUILD_MAX */
+#ifdef CONFIG_LOG_SEVERITY_BUILD_MAX
+#define LOG_SEVERITY_BUILD_MAX  CONFIG_LOG_SEVERITY_BUILD_MAX
+#else
+#define LOG_SEVERITY_BUILD_MAX  LOG_SEVERITY_TRACE
+#endif
+
+/** Most verbose severity kept by the traceback logger, see CONFIG_LOG_TRACEBACK_SEVERITY */
+#ifdef CONFIG_LOG_TRACEBACK_SEVERITY
+#define LOG_TRACEBACK_SEVERITY  CONFIG_LOG_TRACEBACK_SEVERITY
+#else
+#define LOG_TRACEBACK_SEVERITY  LOG_SEVERITY_DEBUG
+#endif
+
+/**
+ * Call site descriptor, caches the outcome of the severity checks
+ */
+typedef struct
+{
+    uint32_t        generation;     /* log_generation the decision was taken at */
+    bool            enabled;        /* a logger accepts the site's severity */
+} log_site_t;
+
+/**
+ * Rate limited or sampled call site descriptor
+ */
+typedef struct
+{
+    log_site_t      site;
+    const char     *file;           /* call site location */
+    int             line;
+    uint32_t        rate;           /* messages per second, 0 for no limit */
+    uint32_t        burst;          /* token bucket depth */
+    uint32_t        sample;         /* log 1 out of sample calls */
+    uint32_t        tokens;
+    int64_t         refill_ms;      /* last token refill */
+    uint32_t        calls;
+    uint32_t        suppressed;     /* dropped by the token bucket */
+} log_limit_t;
+
+/** Bumped whenever a change may flip a call site decision */
+extern uint32_t log_generation;
+
+void log_site_update(log_site_t *site, log_severity_t sev, log_module_t module);
+bool log_limit_admit(log_limit_t *limit, log_severity_t sev, log_module_t module);
+
+static inline bool log_site_enabled(log_site_t *site, log_severity_t sev, log_module_t module)
+{
+    if (__atomic_load_n(&site->generation, __ATOMIC_ACQUIRE) !=
+        __atomic_load_n(&log_generation, __ATOMIC_RELAXED))
+    {
+        log_site_update(site, sev, module);
+    }
+
+    return site->enabled;
+}
+
 /**
  * We use these macros to get a default module id inside the LOG_* macros.
  * In case there's no MODULE_ID defined, MODULE_ID_MISC will be used as
@@ -266,6 +366,16 @@ static inline void __unused_MODULE_ID(void)
 #define LOG_OPEN_STDOUT_QUIET   (1 << 3)        /* Log to stdout is quiet, shows only STDOUT severity messages */
 #define LOG_OPEN_REMOTE         (1 << 4)        /* Log to mqtt */
 #define LOG_OPEN_JOURNAL        (1 << 5)        /* Log to journal */
+#define LOG_OPEN_ASYNC          (1 << 6)        /* Format and deliver messages from a writer thread */
+
+/**
+ * Number of messages the asynchronous mode can hold before dropping
+ */
+#ifdef CONFIG_LOG_ASYNC_DEPTH
+#define LOG_ASYNC_DEPTH         CONFIG_LOG_ASYNC_DEPTH
+#else
+#define LOG_ASYNC_DEPTH         256
+#endif
 
 /*
  * ===========================================================================
@@ -303,6 +413,7 @@ struct logger_msg
     char               *lm_timestamp;               /* Timestamp string */
     char               *lm_tag;                     /* Message tag */
     char               *lm_text;                    /* Message text */
+    long                lm_tid;                     /* Thread id of the caller */
 };
 
 /*
@@ -342,6 +453,16 @@ bool                  log_register_dynamic_trigger(struct ev_loop *loop,
                                                    void (*callback)(FILE *fp));
 bool                  log_severity_dynamic_set();
 
+/*
+ * Asynchronous mode: mlog() captures the message arguments into a
+ * preallocated record and a writer thread formats and delivers it.
+ * Messages are dropped, and counted, when all records are in flight.
+ */
+bool                  log_async_start(size_t depth);
+void                  log_async_stop(void);
+bool                  log_async_running(void);
+uint64_t              log_async_drops(void);
+
 /*
  * ===========================================================================
  *  Loggers (backends)
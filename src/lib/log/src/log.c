@@ -35,8 +35,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <fcntl.h>
 #include <errno.h>
 #include <jansson.h>
+#include <sys/syscall.h>
 
 #include "log.h"
+#include "log_internal.h"
 #include "os_time.h"
 #include "util.h"
 #include "assert.h"
@@ -82,6 +84,14 @@ static bool log_enabled              = false;
 static bool traceback_enabled        = false;
 bool log_remote_enabled = false;
 
+/* Call sites cached with an older generation re-evaluate their severity */
+uint32_t log_generation = 1;
+
+static void log_generation_bump(void)
+{
+    __atomic_add_fetch(&log_generation, 1, __ATOMIC_RELEASE);
+}
+
 
 typedef struct
 {
@@ -124,6 +134,7 @@ static void log_init(char *name)
 
     /* enable it */
     log_enabled  = true;
+    log_generation_bump();
 
     log_name = name;
 
@@ -187,8 +198,21 @@ bool log_open(char *name, int flags)
 #endif
 
     traceback_enabled = logger_traceback_new(&logger_traceback);
+    log_generation_bump();
     log_register_logger(&logger_traceback);
 
+#ifdef CONFIG_LOG_ASYNC
+    flags |= LOG_OPEN_ASYNC;
+#endif
+
+    if (flags & LOG_OPEN_ASYNC)
+    {
+        if (!log_async_start(LOG_ASYNC_DEPTH))
+        {
+            LOG_MODULE_MESSAGE(ERR, LOG_MODULE_ID_COMMON, "asynchronous logging failed to start");
+        }
+    }
+
     return true;
 }
 
@@ -261,6 +285,7 @@ static void _log_sink_severity_set(log_sink_t sink, log_severity_t s)
         /* set severity for all modules         */
         module_table[mod].severity = s;
     }
+    log_generation_bump();
     if (sink == LOG_SINK_REMOTE && s > LOG_SEVERITY_DISABLED)
     {
         log_remote_enabled = true;
@@ -306,6 +331,7 @@ static void _log_sink_module_severity_set(log_sink_t sink, log_module_t mod, log
     }
 
     module_table[mod].severity = sev;
+    log_generation_bump();
 
     if (sink == LOG_SINK_REMOTE && sev > LOG_SEVERITY_DISABLED)
     {
@@ -427,7 +453,9 @@ bool log_severity_parse(char *sevstr)
 void log_close()
 {
     LOG_MODULE_MESSAGE(NOTICE, LOG_MODULE_ID_COMMON, "log functionality closed");
+    log_async_stop();
     log_enabled = false;
+    log_generation_bump();
 }
 
 static bool log_any_sink_match(log_severity_t sev, log_module_t module)
@@ -441,12 +469,83 @@ static bool log_any_sink_match(log_severity_t sev, log_module_t module)
     if (sev <= log_module_remote[module].severity) {
         match = true;
     }
-    if (traceback_enabled) {
+    // traceback, bounded so that the most verbose sites stay disabled
+    if (traceback_enabled && sev <= LOG_TRACEBACK_SEVERITY) {
         match = true;
     }
     return match;
 }
 
+void log_site_update(log_site_t *site, log_severity_t sev, log_module_t module)
+{
+    uint32_t generation;
+    bool enabled;
+
+    generation = __atomic_load_n(&log_generation, __ATOMIC_ACQUIRE);
+
+    if (module > LOG_MODULE_ID_LAST) module = LOG_MODULE_ID_MISC;
+
+    enabled = log_enabled &&
+              (sev != LOG_SEVERITY_DISABLED) &&
+              log_any_sink_match(sev, module);
+
+    // a change racing with the update bumps the generation again,
+    // the site is then re-evaluated on its next call
+    site->enabled = enabled;
+    __atomic_store_n(&site->generation, generation, __ATOMIC_RELEASE);
+}
+
+/*
+ * Sampling and token bucket state is updated without locking: concurrent
+ * callers of the same site may let a message more or less through.
+ */
+bool log_limit_admit(log_limit_t *limit, log_severity_t sev, log_module_t module)
+{
+    uint32_t suppressed;
+    uint32_t burst;
+    int64_t refill;
+    int64_t now;
+
+    if (limit->sample > 1)
+    {
+        if ((__atomic_fetch_add(&limit->calls, 1, __ATOMIC_RELAXED) % limit->sample) != 0) return false;
+    }
+
+    if (limit->rate != 0)
+    {
+        burst = (limit->burst != 0) ? limit->burst : limit->rate;
+        now = clock_mono_ms();
+
+        if (limit->refill_ms == 0)
+        {
+            limit->tokens = burst;
+            limit->refill_ms = now;
+        }
+
+        refill = (now - limit->refill_ms) * limit->rate / 1000;
+        if (refill > 0)
+        {
+            limit->tokens = (limit->tokens + refill > burst) ? burst : limit->tokens + refill;
+            limit->refill_ms = now;
+        }
+
+        if (limit->tokens == 0)
+        {
+            __atomic_add_fetch(&limit->suppressed, 1, __ATOMIC_RELAXED);
+            return false;
+        }
+        limit->tokens--;
+    }
+
+    suppressed = __atomic_exchange_n(&limit->suppressed, 0, __ATOMIC_RELAXED);
+    if (suppressed != 0)
+    {
+        mlog(sev, module, "%s:%d: %u messages suppressed", limit->file, limit->line, suppressed);
+    }
+
+    return true;
+}
+
 #ifdef BUILD_LOG_MEMINFO
 #if __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 6)
 #pragma message("LOG MEMINFO ENABLED")
@@ -503,51 +602,23 @@ void log_meminfo(char *str, int size, int pos, const char *str_prefix, const cha
 }
 #endif
 
-void mlog(log_severity_t sev,
-          log_module_t module,
-          const char  *fmt, ...)
+void log_deliver(log_severity_t sev, log_module_t module, time_t t, long tid, char *text)
 {
-    char            buff[LOGGER_BUFF_LEN];
     char            timestr[80];
     struct tm             *lt;
-    time_t                 t;
-    va_list                args;
     char           *strip;
     log_severity_entry_t *se;
     char           *tag;
 
-    // Save errno, so that log does not overwrite it
-    int save_errno = errno;
-
-    if (false == log_enabled) {
-        return;
-    }
-
-    if (sev == LOG_SEVERITY_DISABLED) {
-        return;
-    }
-
-    if (module > LOG_MODULE_ID_LAST) module = LOG_MODULE_ID_MISC;
-
-    if (!log_any_sink_match(sev, module)) {
-        return;
-    }
-
     se = &log_severity_table[sev];
     tag = log_module_table[module].module_name;
-    t = time_real();
     lt = localtime(&t);
 
     strftime(timestr, sizeof(timestr), "%d %b %H:%M:%S %Z", lt);
 
-    // format
-    va_start(args, fmt);
-    vsnprintf(buff, sizeof(buff), fmt, args);
-    va_end(args);
-
     // chop \r\n
-    strip = &buff[strlen(buff) - 1];
-    while ((strip > buff) && ((*strip == LF) || (*strip == CR)))
+    strip = &text[strlen(text) - 1];
+    while ((strip > text) && ((*strip == LF) || (*strip == CR)))
         *strip = NUL;
 
     // pretty print
@@ -575,7 +646,8 @@ void mlog(log_severity_t sev,
     msg.lm_module_name = log_module_table[module].module_name;
     msg.lm_tag = se_tag;
     msg.lm_timestamp = timestr;
-    msg.lm_text = buff;
+    msg.lm_text = text;
+    msg.lm_tid = tid;
 
     /* Feed messages to the registered loggers */
     logger_t *plog;
@@ -588,6 +660,48 @@ void mlog(log_severity_t sev,
         }
         plog->logger_fn(plog, &msg);
     }
+}
+
+void mlog(log_severity_t sev,
+          log_module_t module,
+          const char  *fmt, ...)
+{
+    char            buff[LOGGER_BUFF_LEN];
+    va_list                args;
+    bool                   queued;
+
+    // Save errno, so that log does not overwrite it
+    int save_errno = errno;
+
+    if (false == log_enabled) {
+        return;
+    }
+
+    if (sev == LOG_SEVERITY_DISABLED) {
+        return;
+    }
+
+    if (module > LOG_MODULE_ID_LAST) module = LOG_MODULE_ID_MISC;
+
+    if (!log_any_sink_match(sev, module)) {
+        return;
+    }
+
+    // hand over to the writer thread, formatting is deferred
+    if (log_async_running()) {
+        va_start(args, fmt);
+        queued = log_async_capture(sev, module, save_errno, fmt, args);
+        va_end(args);
+        errno = save_errno;
+        if (queued) return;
+    }
+
+    // format
+    va_start(args, fmt);
+    vsnprintf(buff, sizeof(buff), fmt, args);
+    va_end(args);
+
+    log_deliver(sev, module, time_real(), syscall(SYS_gettid), buff);
 
     // restore saved errno value
     errno = save_errno;
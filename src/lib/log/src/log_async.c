@@ -0,0 +1,746 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Asynchronous logging
+ *
+ * In asynchronous mode mlog() does not format anything: it copies the
+ * format string and its arguments into a preallocated record, stamps it
+ * with the monotonic clock and queues it. A writer thread renders the
+ * text and the wall clock timestamp and feeds the loggers.
+ *
+ * Arguments are captured by value. Strings are copied right away since
+ * they commonly live on the caller's stack. Conversions the capture does
+ * not handle (positional arguments, wide characters, %n) fall back to
+ * formatting on the caller's thread, the delivery is still deferred.
+ *
+ * Free records and queued records are kept in two lock-free rings. When
+ * no free record is left the message is dropped and counted; the writer
+ * reports the number of dropped messages once it catches up.
+ *
+ * log_async_stop() waits for the callers still queueing, and the writer
+ * delivers everything they queued before it exits.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "log_internal.h"
+#include "memutil.h"
+#include "mpmc_ring.h"
+#include "os_time.h"
+
+#define LOG_ASYNC_REC_SIZE  1024        /* format copy and captured arguments */
+#define LOG_ASYNC_TEXT_LEN  (1024 * 8)  /* rendered message */
+#define LOG_ASYNC_SPEC_MAX  32          /* longest supported conversion spec */
+#define LOG_ASYNC_BATCH     16
+
+enum log_async_arg
+{
+    LOG_ASYNC_ARG_NONE,
+    LOG_ASYNC_ARG_INT,
+    LOG_ASYNC_ARG_LONG,
+    LOG_ASYNC_ARG_LLONG,
+    LOG_ASYNC_ARG_SIZE,
+    LOG_ASYNC_ARG_INTMAX,
+    LOG_ASYNC_ARG_PTRDIFF,
+    LOG_ASYNC_ARG_DOUBLE,
+    LOG_ASYNC_ARG_LDOUBLE,
+    LOG_ASYNC_ARG_PTR,
+    LOG_ASYNC_ARG_STR,
+};
+
+struct log_async_spec
+{
+    size_t              len;            /* spec length, leading '%' included */
+    bool                star_width;     /* width passed as an argument */
+    bool                star_prec;      /* precision passed as an argument */
+    int                 prec;           /* literal precision, -1 if none */
+    char                conv;           /* conversion character */
+    enum log_async_arg  arg;            /* type of the converted argument */
+};
+
+struct log_async_rec
+{
+    log_severity_t      sev;
+    log_module_t        module;
+    int64_t             mono_ms;        /* capture time, monotonic clock */
+    long                tid;            /* thread of the caller */
+    bool                preformatted;   /* buf holds the final text */
+    size_t              fmt_len;        /* buf: format, NUL, arguments */
+    char                buf[LOG_ASYNC_REC_SIZE];
+};
+
+static struct
+{
+    bool                running;
+    bool                stop;           /* no more callers, drain and exit */
+    uint32_t            producers;      /* callers of log_async_capture() */
+    struct log_async_rec *pool;
+    struct mpmc_ring   *free;
+    struct mpmc_ring   *ready;
+    sem_t               wake;
+    pthread_t           thread;
+    uint32_t            drops;          /* drops not reported yet */
+    uint64_t            drops_total;
+} log_async;
+
+/* Thread id of the caller, cached: gettid() is a system call */
+static __thread long log_async_tid;
+
+
+/**
+ * Parse the conversion spec starting at p, which points at '%'.
+ * Returns false for conversions the capture does not support.
+ */
+static bool log_async_parse(const char *p, struct log_async_spec *spec)
+{
+    const char *start = p;
+    char lmod = 0;
+
+    memset(spec, 0, sizeof(*spec));
+    spec->prec = -1;
+    p++;
+
+    if (*p == '%')
+    {
+        spec->conv = '%';
+        spec->len = 2;
+        return true;
+    }
+
+    while (*p != '\0' && strchr("-+ #0'", *p) != NULL) p++;
+
+    if (*p == '*')
+    {
+        spec->star_width = true;
+        p++;
+    }
+    else
+    {
+        while (isdigit((unsigned char)*p)) p++;
+    }
+
+    /* positional arguments, %1$s */
+    if (*p == '$') return false;
+
+    if (*p == '.')
+    {
+        p++;
+        if (*p == '*')
+        {
+            spec->star_prec = true;
+            p++;
+        }
+        else
+        {
+            spec->prec = 0;
+            while (isdigit((unsigned char)*p)) spec->prec = spec->prec * 10 + (*p++ - '0');
+        }
+    }
+
+    switch (*p)
+    {
+        case 'h':
+            lmod = 'h';
+            p++;
+            if (*p == 'h') p++;
+            break;
+
+        case 'l':
+            lmod = 'l';
+            p++;
+            if (*p == 'l')
+            {
+                lmod = 'q';
+                p++;
+            }
+            break;
+
+        case 'q':
+        case 'L':
+        case 'z':
+        case 'j':
+        case 't':
+            lmod = *p++;
+            break;
+
+        default:
+            break;
+    }
+
+    spec->conv = *p;
+    switch (spec->conv)
+    {
+        case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+            if (lmod == 0 || lmod == 'h') spec->arg = LOG_ASYNC_ARG_INT;
+            else if (lmod == 'l') spec->arg = LOG_ASYNC_ARG_LONG;
+            else if (lmod == 'q') spec->arg = LOG_ASYNC_ARG_LLONG;
+            else if (lmod == 'z') spec->arg = LOG_ASYNC_ARG_SIZE;
+            else if (lmod == 'j') spec->arg = LOG_ASYNC_ARG_INTMAX;
+            else if (lmod == 't') spec->arg = LOG_ASYNC_ARG_PTRDIFF;
+            else return false;
+            break;
+
+        case 'c':
+            if (lmod != 0) return false;
+            spec->arg = LOG_ASYNC_ARG_INT;
+            break;
+
+        case 's':
+        case 'm':
+            /* %m is rendered as a string, captured from errno */
+            if (lmod != 0) return false;
+            spec->arg = LOG_ASYNC_ARG_STR;
+            break;
+
+        case 'p':
+            if (lmod != 0) return false;
+            spec->arg = LOG_ASYNC_ARG_PTR;
+            break;
+
+        case 'f': case 'F': case 'e': case 'E':
+        case 'g': case 'G': case 'a': case 'A':
+            if (lmod == 'L') spec->arg = LOG_ASYNC_ARG_LDOUBLE;
+            else if (lmod == 0 || lmod == 'l') spec->arg = LOG_ASYNC_ARG_DOUBLE;
+            else return false;
+            break;
+
+        default:
+            return false;
+    }
+
+    spec->len = p + 1 - start;
+    if (spec->len > LOG_ASYNC_SPEC_MAX) return false;
+
+    return true;
+}
+
+
+static bool log_async_put(struct log_async_rec *rec, size_t *pos, const void *val, size_t len)
+{
+    if (*pos + len > sizeof(rec->buf)) return false;
+
+    memcpy(rec->buf + *pos, val, len);
+    *pos += len;
+
+    return true;
+}
+
+
+static bool log_async_get(struct log_async_rec *rec, size_t *pos, void *val, size_t len)
+{
+    if (*pos + len > sizeof(rec->buf)) return false;
+
+    memcpy(val, rec->buf + *pos, len);
+    *pos += len;
+
+    return true;
+}
+
+
+#define LOG_ASYNC_PUT_ARG(type) \
+    do { \
+        type v__ = va_arg(ap, type); \
+        if (!log_async_put(rec, &pos, &v__, sizeof(v__))) return false; \
+    } while (0)
+
+/**
+ * Copy the format and its arguments into rec.
+ * Returns false if the format is not supported or does not fit.
+ */
+static bool log_async_encode(struct log_async_rec *rec, int save_errno,
+                             const char *fmt, va_list ap)
+{
+    struct log_async_spec spec;
+    const char *str;
+    const char *p;
+    size_t pos;
+    size_t n;
+    int prec;
+    int v;
+
+    rec->fmt_len = strlen(fmt);
+    pos = rec->fmt_len + 1;
+    if (pos > sizeof(rec->buf)) return false;
+    memcpy(rec->buf, fmt, pos);
+
+    for (p = strchr(fmt, '%'); p != NULL; p = strchr(p + spec.len, '%'))
+    {
+        if (!log_async_parse(p, &spec)) return false;
+
+        if (spec.star_width)
+        {
+            v = va_arg(ap, int);
+            if (!log_async_put(rec, &pos, &v, sizeof(v))) return false;
+        }
+
+        prec = spec.prec;
+        if (spec.star_prec)
+        {
+            prec = va_arg(ap, int);
+            if (!log_async_put(rec, &pos, &prec, sizeof(prec))) return false;
+        }
+
+        switch (spec.arg)
+        {
+            case LOG_ASYNC_ARG_NONE:
+                break;
+
+            case LOG_ASYNC_ARG_INT:
+                LOG_ASYNC_PUT_ARG(int);
+                break;
+
+            case LOG_ASYNC_ARG_LONG:
+                LOG_ASYNC_PUT_ARG(long);
+                break;
+
+            case LOG_ASYNC_ARG_LLONG:
+                LOG_ASYNC_PUT_ARG(long long);
+                break;
+
+            case LOG_ASYNC_ARG_SIZE:
+                LOG_ASYNC_PUT_ARG(size_t);
+                break;
+
+            case LOG_ASYNC_ARG_INTMAX:
+                LOG_ASYNC_PUT_ARG(intmax_t);
+                break;
+
+            case LOG_ASYNC_ARG_PTRDIFF:
+                LOG_ASYNC_PUT_ARG(ptrdiff_t);
+                break;
+
+            case LOG_ASYNC_ARG_DOUBLE:
+                LOG_ASYNC_PUT_ARG(double);
+                break;
+
+            case LOG_ASYNC_ARG_LDOUBLE:
+                LOG_ASYNC_PUT_ARG(long double);
+                break;
+
+            case LOG_ASYNC_ARG_PTR:
+                LOG_ASYNC_PUT_ARG(void *);
+                break;
+
+            case LOG_ASYNC_ARG_STR:
+                str = (spec.conv == 'm') ? strerror(save_errno) : va_arg(ap, const char *);
+                if (str == NULL) str = "(null)";
+
+                /* The precision bounds strings that are not NUL terminated */
+                n = (prec >= 0) ? strnlen(str, prec) : strlen(str);
+
+                /* What does not fit is formatted by the caller */
+                if (pos + n + 1 > sizeof(rec->buf)) return false;
+                memcpy(rec->buf + pos, str, n);
+                rec->buf[pos + n] = '\0';
+                pos += n + 1;
+                break;
+        }
+    }
+
+    return true;
+}
+
+
+/* Advance the output position by the return value of snprintf() */
+static size_t log_async_advance(size_t o, int n, size_t size)
+{
+    if (n < 0) return o;
+    if (o + n >= size) return size - 1;
+    return o + n;
+}
+
+
+#define LOG_ASYNC_FMT_ARG(type) \
+    do { \
+        type v__; \
+        if (!log_async_get(rec, &pos, &v__, sizeof(v__))) goto out; \
+        o = log_async_advance(o, snprintf(out + o, size - o, cfmt, v__), size); \
+    } while (0)
+
+/**
+ * Render rec into out
+ */
+static void log_async_format(struct log_async_rec *rec, char *out, size_t size)
+{
+    char cfmt[LOG_ASYNC_SPEC_MAX * 2];
+    struct log_async_spec spec;
+    const char *lit;
+    const char *p;
+    size_t pos;
+    size_t o;
+    size_t i;
+    size_t c;
+    int width;
+    int prec;
+
+    pos = rec->fmt_len + 1;
+    lit = rec->buf;
+    o = 0;
+
+    for (p = strchr(lit, '%'); p != NULL; p = strchr(lit, '%'))
+    {
+        o = log_async_advance(o, snprintf(out + o, size - o, "%.*s", (int)(p - lit), lit), size);
+
+        /* The format was validated at capture time */
+        log_async_parse(p, &spec);
+        lit = p + spec.len;
+
+        if (spec.conv == '%')
+        {
+            o = log_async_advance(o, snprintf(out + o, size - o, "%%"), size);
+            continue;
+        }
+
+        width = 0;
+        prec = -1;
+        if (spec.star_width && !log_async_get(rec, &pos, &width, sizeof(width))) goto out;
+        if (spec.star_prec && !log_async_get(rec, &pos, &prec, sizeof(prec))) goto out;
+
+        /* Rebuild the spec with the width and precision values in place of '*' */
+        c = 0;
+        for (i = 0; i < spec.len; i++)
+        {
+            if (p[i] == '*' && spec.star_width && (i == 0 || p[i - 1] != '.'))
+            {
+                c += snprintf(cfmt + c, sizeof(cfmt) - c, "%d", width);
+            }
+            else if (p[i] == '.' && spec.star_prec && p[i + 1] == '*')
+            {
+                /* A negative precision is taken as if it were omitted */
+                if (prec >= 0) c += snprintf(cfmt + c, sizeof(cfmt) - c, ".%d", prec);
+                i++;
+            }
+            else if (p[i] == 'm' && i == spec.len - 1)
+            {
+                cfmt[c++] = 's';
+            }
+            else
+            {
+                cfmt[c++] = p[i];
+            }
+        }
+        cfmt[c] = '\0';
+
+        switch (spec.arg)
+        {
+            case LOG_ASYNC_ARG_NONE:
+                break;
+
+            case LOG_ASYNC_ARG_INT:
+                LOG_ASYNC_FMT_ARG(int);
+                break;
+
+            case LOG_ASYNC_ARG_LONG:
+                LOG_ASYNC_FMT_ARG(long);
+                break;
+
+            case LOG_ASYNC_ARG_LLONG:
+                LOG_ASYNC_FMT_ARG(long long);
+                break;
+
+            case LOG_ASYNC_ARG_SIZE:
+                LOG_ASYNC_FMT_ARG(size_t);
+                break;
+
+            case LOG_ASYNC_ARG_INTMAX:
+                LOG_ASYNC_FMT_ARG(intmax_t);
+                break;
+
+            case LOG_ASYNC_ARG_PTRDIFF:
+                LOG_ASYNC_FMT_ARG(ptrdiff_t);
+                break;
+
+            case LOG_ASYNC_ARG_DOUBLE:
+                LOG_ASYNC_FMT_ARG(double);
+                break;
+
+            case LOG_ASYNC_ARG_LDOUBLE:
+                LOG_ASYNC_FMT_ARG(long double);
+                break;
+
+            case LOG_ASYNC_ARG_PTR:
+                LOG_ASYNC_FMT_ARG(void *);
+                break;
+
+            case LOG_ASYNC_ARG_STR:
+                if (pos >= sizeof(rec->buf)) goto out;
+                o = log_async_advance(o, snprintf(out + o, size - o, cfmt, rec->buf + pos), size);
+                pos += strlen(rec->buf + pos) + 1;
+                break;
+        }
+    }
+
+    o = log_async_advance(o, snprintf(out + o, size - o, "%s", lit), size);
+
+out:
+    out[o] = '\0';
+}
+
+
+bool log_async_capture(log_severity_t sev, log_module_t module, int save_errno,
+                       const char *fmt, va_list args)
+{
+    struct log_async_rec *rec;
+    va_list ap;
+    bool ok;
+
+    /*
+     * Register as a producer before checking the running flag, so that
+     * log_async_stop() either waits for this call or is seen here.
+     */
+    __atomic_add_fetch(&log_async.producers, 1, __ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&log_async.running, __ATOMIC_SEQ_CST))
+    {
+        __atomic_sub_fetch(&log_async.producers, 1, __ATOMIC_SEQ_CST);
+        return false;
+    }
+
+    rec = mpmc_ring_pop(log_async.free);
+    if (rec == NULL)
+    {
+        __atomic_add_fetch(&log_async.drops, 1, __ATOMIC_RELAXED);
+        __atomic_sub_fetch(&log_async.producers, 1, __ATOMIC_SEQ_CST);
+        return true;
+    }
+
+    if (log_async_tid == 0) log_async_tid = syscall(SYS_gettid);
+
+    rec->sev = sev;
+    rec->module = module;
+    rec->mono_ms = clock_mono_ms();
+    rec->tid = log_async_tid;
+
+    va_copy(ap, args);
+    ok = log_async_encode(rec, save_errno, fmt, ap);
+    va_end(ap);
+
+    rec->preformatted = !ok;
+    if (rec->preformatted)
+    {
+        errno = save_errno;
+        va_copy(ap, args);
+        vsnprintf(rec->buf, sizeof(rec->buf), fmt, ap);
+        va_end(ap);
+    }
+
+    /* The ready ring holds the whole pool, this cannot fail */
+    mpmc_ring_push(log_async.ready, rec);
+    sem_post(&log_async.wake);
+    __atomic_sub_fetch(&log_async.producers, 1, __ATOMIC_SEQ_CST);
+
+    return true;
+}
+
+
+static void log_async_drain(void)
+{
+    static char text[LOG_ASYNC_TEXT_LEN];
+    void *batch[LOG_ASYNC_BATCH];
+    struct log_async_rec *rec;
+    int64_t offset = 0;
+    uint32_t drops;
+    char *msg;
+    size_t n;
+    size_t i;
+
+    do
+    {
+        n = mpmc_ring_pop_batch(log_async.ready, batch, LOG_ASYNC_BATCH);
+
+        /* Map capture times from the monotonic clock to the wall clock */
+        if (n != 0) offset = clock_real_ms() - clock_mono_ms();
+
+        for (i = 0; i < n; i++)
+        {
+            rec = batch[i];
+            msg = rec->buf;
+            if (!rec->preformatted)
+            {
+                log_async_format(rec, text, sizeof(text));
+                msg = text;
+            }
+
+            log_deliver(rec->sev, rec->module, (rec->mono_ms + offset) / 1000, rec->tid, msg);
+            mpmc_ring_push(log_async.free, rec);
+        }
+    } while (n != 0);
+
+    drops = __atomic_exchange_n(&log_async.drops, 0, __ATOMIC_RELAXED);
+    if (drops == 0) return;
+
+    log_async.drops_total += drops;
+    snprintf(text, sizeof(text), "log: %u messages dropped, %llu since start",
+             drops, (unsigned long long)log_async.drops_total);
+    log_deliver(LOG_SEVERITY_WARNING, LOG_MODULE_ID_COMMON, time_real(), syscall(SYS_gettid), text);
+}
+
+
+static void *log_async_thread(void *arg)
+{
+    bool stop;
+
+    (void)arg;
+
+    for (;;)
+    {
+        if (sem_wait(&log_async.wake) != 0 && errno == EINTR) continue;
+
+        /*
+         * Sample the stop request before draining: everything queued
+         * before log_async_stop() is delivered before the thread exits.
+         */
+        stop = __atomic_load_n(&log_async.stop, __ATOMIC_ACQUIRE);
+        log_async_drain();
+        if (stop) break;
+    }
+
+    return NULL;
+}
+
+
+/* The writer thread does not survive fork(), the child logs synchronously */
+static void log_async_atfork_child(void)
+{
+    __atomic_store_n(&log_async.running, false, __ATOMIC_RELEASE);
+    log_async.producers = 0;
+    log_async_tid = 0;
+}
+
+
+/* Release the resources of a run, also left behind in a forked child */
+static void log_async_release(void)
+{
+    if (log_async.pool == NULL) return;
+
+    sem_destroy(&log_async.wake);
+    mpmc_ring_delete(log_async.free);
+    mpmc_ring_delete(log_async.ready);
+    FREE(log_async.pool);
+    log_async.pool = NULL;
+    log_async.free = NULL;
+    log_async.ready = NULL;
+}
+
+
+bool log_async_running(void)
+{
+    return __atomic_load_n(&log_async.running, __ATOMIC_ACQUIRE);
+}
+
+
+bool log_async_start(size_t depth)
+{
+    static bool atfork_registered = false;
+    size_t i;
+    int rc;
+
+    if (log_async_running()) return true;
+    if (depth == 0) return false;
+
+    log_async_release();
+
+    log_async.free = mpmc_ring_new(depth);
+    log_async.ready = mpmc_ring_new(depth);
+    if (log_async.free == NULL || log_async.ready == NULL) goto err_rings;
+
+    log_async.pool = CALLOC(depth, sizeof(*log_async.pool));
+    for (i = 0; i < depth; i++) mpmc_ring_push(log_async.free, &log_async.pool[i]);
+
+    if (sem_init(&log_async.wake, 0, 0) != 0) goto err_pool;
+
+    if (!atfork_registered)
+    {
+        pthread_atfork(NULL, NULL, log_async_atfork_child);
+        atexit(log_async_stop);
+        atfork_registered = true;
+    }
+
+    log_async.drops = 0;
+    log_async.drops_total = 0;
+    log_async.stop = false;
+    __atomic_store_n(&log_async.running, true, __ATOMIC_RELEASE);
+
+    rc = pthread_create(&log_async.thread, NULL, log_async_thread, NULL);
+    if (rc != 0)
+    {
+        __atomic_store_n(&log_async.running, false, __ATOMIC_RELEASE);
+        goto err_sem;
+    }
+
+    return true;
+
+err_sem:
+    sem_destroy(&log_async.wake);
+err_pool:
+    FREE(log_async.pool);
+    log_async.pool = NULL;
+err_rings:
+    mpmc_ring_delete(log_async.free);
+    mpmc_ring_delete(log_async.ready);
+    log_async.free = NULL;
+    log_async.ready = NULL;
+    return false;
+}
+
+
+void log_async_stop(void)
+{
+    if (!log_async_running()) return;
+
+    __atomic_store_n(&log_async.running, false, __ATOMIC_SEQ_CST);
+
+    /*
+     * Wait for the callers that saw the writer running to be done with
+     * the rings. Later callers deliver synchronously. The writer then
+     * delivers what they queued, nothing is left behind.
+     */
+    while (__atomic_load_n(&log_async.producers, __ATOMIC_SEQ_CST) != 0) sched_yield();
+
+    __atomic_store_n(&log_async.stop, true, __ATOMIC_RELEASE);
+    sem_post(&log_async.wake);
+    pthread_join(log_async.thread, NULL);
+
+    log_async_release();
+}
+
+
+uint64_t log_async_drops(void)
+{
+    return log_async.drops_total + __atomic_load_n(&log_async.drops, __ATOMIC_RELAXED);
+}
@@ -47,7 +47,7 @@ void logger_remote_log(logger_t *self, logger_msg_t *msg)
     inside_log = true;
 
     snprintf(msg_str, sizeof(msg_str), "[%5ld] %s %s: %s: %s\n",
-            syscall(SYS_gettid),
+            msg->lm_tid,
             msg->lm_timestamp,
             log_get_name(),
             msg->lm_tag,
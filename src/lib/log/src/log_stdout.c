@@ -74,7 +74,7 @@ void logger_stdout_log(logger_t *self, logger_msg_t *msg)
     /* By default, everything except LOG_INFO is logged to stderr */
     fprintf(stderr, "%s[%5ld] %s %s: %s: %s%s\n",
             color_log,
-            syscall(SYS_gettid),
+            msg->lm_tid,
             msg->lm_timestamp,
             log_get_name(),
             msg->lm_tag,
@@ -65,8 +65,11 @@ logger_traceback_match(log_severity_t sev, log_module_t module)
      * messages in a ring buffer to provide context for
      * errors with the need to increase log verbosity. The
      * goal is to make debugging easier.
+     *
+     * Every call site up to this severity is kept enabled,
+     * the bound keeps the per-packet TRACE sites cheap.
      */
-    return true;
+    return sev <= LOG_TRACEBACK_SEVERITY;
 }
 
 bool
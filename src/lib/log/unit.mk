@@ -36,6 +36,7 @@ UNIT_SRC  := src/log.c
 UNIT_SRC  += src/log_syslog.c
 UNIT_SRC  += src/log_stdout.c
 UNIT_SRC  += src/log_traceback.c
+UNIT_SRC  += src/log_async.c
 UNIT_SRC  += $(if $(CONFIG_LOG_JOURNAL),src/log_journal.c,)
 UNIT_SRC  += $(if $(CONFIG_LOG_REMOTE),src/log_remote.c,)
 
@@ -43,6 +44,7 @@ UNIT_CFLAGS := -I$(UNIT_PATH)/inc
 UNIT_CFLAGS += -Isrc/lib/osa/inc
 
 UNIT_LDFLAGS += -lev
+UNIT_LDFLAGS += -lpthread
 UNIT_LDFLAGS += $(if $(CONFIG_LOG_JOURNAL),-lsystemd,)
 
 UNIT_EXPORT_CFLAGS := $(UNIT_CFLAGS)
@@ -52,6 +54,7 @@ UNIT_DEPS := src/lib/common
 UNIT_DEPS += src/lib/const
 UNIT_DEPS += src/lib/ds
 UNIT_DEPS += src/lib/kconfig
+UNIT_DEPS += src/lib/mpmc_ring
 
 ifdef CONFIG_MANAGER_QM
 UNIT_DEPS += src/qm/qm_conn
@@ -0,0 +1,582 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <wchar.h>
+
+#include "log.h"
+#include "log_internal.h"
+#include "os.h"
+#include "unit_test_utils.h"
+#include "unity.h"
+
+const char *test_name = "log_tests";
+
+#define TEST_LOG_MAX_MSGS   64
+#define TEST_LOG_TEXT_LEN   2048
+
+/* Messages delivered to the test logger */
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    bool            block;      /* hold the delivering thread */
+    size_t          entered;    /* calls of the logger, blocked ones included */
+    size_t          count;      /* messages stored */
+    log_severity_t  sev[TEST_LOG_MAX_MSGS];
+    log_module_t    module[TEST_LOG_MAX_MSGS];
+    long            tid[TEST_LOG_MAX_MSGS];
+    char            text[TEST_LOG_MAX_MSGS][TEST_LOG_TEXT_LEN];
+} g_capture =
+{
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static logger_t g_logger;
+static int g_limited_line;
+
+extern void run_test_log_build_max(void);
+
+
+static void
+test_logger_fn(logger_t *self, logger_msg_t *msg)
+{
+    size_t i;
+
+    (void)self;
+
+    pthread_mutex_lock(&g_capture.lock);
+    g_capture.entered++;
+    pthread_cond_broadcast(&g_capture.cond);
+    while (g_capture.block) pthread_cond_wait(&g_capture.cond, &g_capture.lock);
+
+    i = g_capture.count;
+    if (i < TEST_LOG_MAX_MSGS)
+    {
+        g_capture.sev[i] = msg->lm_severity;
+        g_capture.module[i] = msg->lm_module;
+        g_capture.tid[i] = msg->lm_tid;
+        snprintf(g_capture.text[i], sizeof(g_capture.text[i]), "%s", msg->lm_text);
+        g_capture.count++;
+    }
+    pthread_cond_broadcast(&g_capture.cond);
+    pthread_mutex_unlock(&g_capture.lock);
+}
+
+
+static bool
+test_logger_match(log_severity_t sev, log_module_t module)
+{
+    (void)sev;
+    (void)module;
+
+    return true;
+}
+
+
+/**
+ * @brief waits for the test logger to be called @count times
+ *
+ * @param field the counter to wait on
+ * @param count the expected value
+ * @return true if the counter reached the value within 2 seconds
+ */
+static bool
+test_log_wait(size_t *field, size_t count)
+{
+    struct timespec ts;
+    bool reached;
+    int rc;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += 2;
+
+    rc = 0;
+    pthread_mutex_lock(&g_capture.lock);
+    while (*field < count && rc == 0)
+    {
+        rc = pthread_cond_timedwait(&g_capture.cond, &g_capture.lock, &ts);
+    }
+    reached = (*field >= count);
+    pthread_mutex_unlock(&g_capture.lock);
+
+    return reached;
+}
+
+
+static void
+test_log_block(bool block)
+{
+    pthread_mutex_lock(&g_capture.lock);
+    g_capture.block = block;
+    pthread_cond_broadcast(&g_capture.cond);
+    pthread_mutex_unlock(&g_capture.lock);
+}
+
+
+static void
+test_log_emit_info(void)
+{
+    LOGI("info site");
+}
+
+
+static void
+test_log_emit_trace(void)
+{
+    LOGT("trace site");
+}
+
+
+static void
+test_log_emit_limited(int i)
+{
+    g_limited_line = __LINE__ + 1;
+    LOG_RATELIMIT(INFO, 2, 3, "limited %d", i);
+}
+
+
+static void
+test_log_emit_sampled(int i)
+{
+    LOG_SAMPLE(INFO, 4, "sampled %d", i);
+}
+
+
+static void
+test_log_setUp(void)
+{
+    pthread_mutex_lock(&g_capture.lock);
+    g_capture.block = false;
+    g_capture.entered = 0;
+    g_capture.count = 0;
+    pthread_mutex_unlock(&g_capture.lock);
+
+    /* The build may have started the writer with the default depth */
+    log_async_stop();
+
+    MEMZERO(g_logger);
+    g_logger.logger_fn = test_logger_fn;
+    g_logger.match_fn = test_logger_match;
+    log_register_logger(&g_logger);
+}
+
+
+static void
+test_log_tearDown(void)
+{
+    test_log_block(false);
+    log_async_stop();
+    log_unregister_logger(&g_logger);
+    log_severity_set(LOG_SEVERITY_TRACE);
+}
+
+
+/**
+ * @brief queues a message to the writer and checks it renders as vsnprintf()
+ */
+static void
+test_async_expect(int line, const char *fmt, ...)
+{
+    char expected[TEST_LOG_TEXT_LEN];
+    int save_errno;
+    size_t count;
+    va_list ap;
+    bool rc;
+
+    save_errno = errno;
+    va_start(ap, fmt);
+    vsnprintf(expected, sizeof(expected), fmt, ap);
+    va_end(ap);
+
+    pthread_mutex_lock(&g_capture.lock);
+    count = g_capture.count;
+    pthread_mutex_unlock(&g_capture.lock);
+
+    va_start(ap, fmt);
+    rc = log_async_capture(LOG_SEVERITY_INFO, LOG_MODULE_ID_MISC, save_errno, fmt, ap);
+    va_end(ap);
+    UNITY_TEST_ASSERT(rc, line, "message not queued");
+
+    rc = test_log_wait(&g_capture.count, count + 1);
+    UNITY_TEST_ASSERT(rc, line, "message not delivered");
+    UNITY_TEST_ASSERT_EQUAL_STRING(expected, g_capture.text[count], line, fmt);
+}
+
+#define TEST_ASYNC_EXPECT(...) test_async_expect(__LINE__, __VA_ARGS__)
+
+
+void
+test_log_async_conversions(void)
+{
+    int x;
+
+    TEST_ASSERT_TRUE(log_async_start(16));
+
+    /* Integer conversions and flags */
+    TEST_ASYNC_EXPECT("%d %i %u %o %x %X %c", -42, 42, 42U, 42U, 0xbeefU, 0xbeefU, 'z');
+    TEST_ASYNC_EXPECT("[%-6d] [%+d] [% d] [%#x] [%#o] [%06d] [%'d]", 42, 42, 42, 42U, 42U, -42, 1234567);
+    TEST_ASYNC_EXPECT("[%8.3d] [%-8.3x] [%.0d]", 7, 7U, 0);
+
+    /* Length modifiers */
+    TEST_ASYNC_EXPECT("%hhd %hhu %hd %hu", 300, 300, 70000, 70000);
+    TEST_ASYNC_EXPECT("%ld %lu %lx", -1234567890L, 1234567890UL, 0xdeadbeefUL);
+    TEST_ASYNC_EXPECT("%lld %llu %llx %qd", -1234567890123LL, 1234567890123ULL,
+                      0xdeadbeefcafeULL, 42LL);
+    TEST_ASYNC_EXPECT("%zu %zd %zx", (size_t)123456, (ssize_t)-123456, (size_t)0xabc);
+    TEST_ASYNC_EXPECT("%jd %ju", (intmax_t)-9876543210LL, (uintmax_t)9876543210ULL);
+    TEST_ASYNC_EXPECT("%td %tx", (ptrdiff_t)-5, (ptrdiff_t)255);
+
+    /* Floating point */
+    TEST_ASYNC_EXPECT("%f %F %.3e %E %g %G", 3.14159, 2.5, 12345.678, 0.00012, 1e-10, 1e20);
+    TEST_ASYNC_EXPECT("%a %A %lf %10.4f %-10.2f|", 1.0, 0.5, 2.0, 3.14159, 2.71828);
+    TEST_ASYNC_EXPECT("%Lf %.2Le %Lg", (long double)1.5, (long double)12345.678, (long double)0.25);
+
+    /* Pointers and strings */
+    TEST_ASYNC_EXPECT("%p %p", (void *)&x, (void *)NULL);
+    TEST_ASYNC_EXPECT("[%s] [%.3s] [%10s] [%-10s] [%s]", "hello", "truncated", "right", "left", "");
+
+    /* '*' width and precision */
+    TEST_ASYNC_EXPECT("[%*d] [%-*d] [%.*d]", 6, 42, 6, 42, 4, 42);
+    TEST_ASYNC_EXPECT("[%*.*f] [%.*f] [%*s]", 10, 3, 3.14159, -1, 2.5, -6, "neg");
+    TEST_ASYNC_EXPECT("[%*.*s]", 8, 2, "abcdef");
+
+    /* Literals */
+    TEST_ASYNC_EXPECT("100%% done, %d%%", 50);
+    TEST_ASYNC_EXPECT("no conversion at all");
+}
+
+
+void
+test_log_async_strings(void)
+{
+    char unterminated[4] = { 'a', 'b', 'c', 'd' };
+    char local[32];
+
+    TEST_ASSERT_TRUE(log_async_start(16));
+
+    /* %m renders the errno of the caller */
+    errno = EINVAL;
+    TEST_ASYNC_EXPECT("failed: %m");
+    errno = ENOENT;
+    TEST_ASYNC_EXPECT("[%20m] %d", 7);
+
+    /* The precision bounds strings that are not NUL terminated */
+    TEST_ASYNC_EXPECT("[%.*s]", (int)sizeof(unterminated), unterminated);
+    TEST_ASYNC_EXPECT("[%.2s]", unterminated);
+
+    /* Strings are copied at capture time */
+    snprintf(local, sizeof(local), "stack string");
+    TEST_ASYNC_EXPECT("%s", local);
+    TEST_ASYNC_EXPECT("%s", (char *)NULL);
+}
+
+
+void
+test_log_async_fallback(void)
+{
+    char fmt[1004];
+    char expected[TEST_LOG_TEXT_LEN];
+
+    TEST_ASSERT_TRUE(log_async_start(16));
+
+    /* Conversions the capture does not handle are formatted by the caller */
+    TEST_ASYNC_EXPECT("%2$s %1$d", 42, "positional");
+    TEST_ASYNC_EXPECT("%ls %lc", L"wide", (wint_t)L'w');
+
+    /* So are formats that leave no room in the record for the arguments */
+    memset(fmt, 'f', sizeof(fmt));
+    memcpy(fmt + sizeof(fmt) - 3, "%s", 3);
+    TEST_ASYNC_EXPECT(fmt, "does not fit after it");
+
+    /* The public api defers the same way */
+    snprintf(expected, sizeof(expected), "mlog %d %s", 1, "async");
+    LOGI("mlog %d %s", 1, "async");
+    TEST_ASSERT_TRUE(test_log_wait(&g_capture.count, 4));
+    TEST_ASSERT_EQUAL_STRING(expected, g_capture.text[3]);
+}
+
+
+void
+test_log_async_drops(void)
+{
+    char expected[128];
+    uint64_t drops;
+    size_t i;
+
+    /* Two records: one held by the writer, one queued */
+    TEST_ASSERT_TRUE(log_async_start(2));
+    TEST_ASSERT_EQUAL_UINT64(0, log_async_drops());
+
+    test_log_block(true);
+    LOGI("first");
+    TEST_ASSERT_TRUE(test_log_wait(&g_capture.entered, 1));
+
+    LOGI("second");
+    for (i = 0; i < 3; i++) LOGI("dropped %zu", i);
+
+    /*
+     * Checked before the report: the warning makes the traceback logger
+     * replay its context, which overflows a pool this small again.
+     */
+    drops = log_async_drops();
+    TEST_ASSERT_EQUAL_UINT64(3, drops);
+
+    /* The writer reports the drops once it catches up */
+    test_log_block(false);
+    TEST_ASSERT_TRUE(test_log_wait(&g_capture.count, 3));
+    TEST_ASSERT_EQUAL_STRING("first", g_capture.text[0]);
+    TEST_ASSERT_EQUAL_STRING("second", g_capture.text[1]);
+
+    snprintf(expected, sizeof(expected), "log: 3 messages dropped, 3 since start");
+    TEST_ASSERT_EQUAL_STRING(expected, g_capture.text[2]);
+    TEST_ASSERT_EQUAL_INT(LOG_SEVERITY_WARNING, g_capture.sev[2]);
+    TEST_ASSERT_EQUAL_INT(LOG_MODULE_ID_COMMON, g_capture.module[2]);
+}
+
+
+void
+test_log_async_stop(void)
+{
+    size_t i;
+
+    TEST_ASSERT_TRUE(log_async_start(32));
+    TEST_ASSERT_TRUE(log_async_running());
+
+    /* Messages queued before the stop are delivered when it returns */
+    for (i = 0; i < 20; i++) LOGI("queued %zu", i);
+    log_async_stop();
+    TEST_ASSERT_FALSE(log_async_running());
+    TEST_ASSERT_EQUAL_UINT(20, g_capture.count);
+    TEST_ASSERT_EQUAL_STRING("queued 0", g_capture.text[0]);
+    TEST_ASSERT_EQUAL_STRING("queued 19", g_capture.text[19]);
+
+    /* Then mlog() delivers on the caller's thread */
+    LOGI("synchronous");
+    TEST_ASSERT_EQUAL_UINT(21, g_capture.count);
+    TEST_ASSERT_EQUAL_STRING("synchronous", g_capture.text[20]);
+
+    /* The writer can be restarted */
+    TEST_ASSERT_TRUE(log_async_start(32));
+    LOGI("restarted");
+    TEST_ASSERT_TRUE(test_log_wait(&g_capture.count, 22));
+    TEST_ASSERT_EQUAL_STRING("restarted", g_capture.text[21]);
+}
+
+
+static void *
+test_log_tid_thread(void *arg)
+{
+    long *tid = arg;
+
+    *tid = syscall(SYS_gettid);
+    LOGI("from thread");
+
+    return NULL;
+}
+
+
+void
+test_log_async_tid(void)
+{
+    pthread_t thread;
+    long tid;
+
+    /* The writer reports the thread that logged, not its own */
+    TEST_ASSERT_TRUE(log_async_start(16));
+    LOGI("from main");
+    TEST_ASSERT_EQUAL_INT(0, pthread_create(&thread, NULL, test_log_tid_thread, &tid));
+    pthread_join(thread, NULL);
+    TEST_ASSERT_TRUE(test_log_wait(&g_capture.count, 2));
+
+    TEST_ASSERT_EQUAL_STRING("from main", g_capture.text[0]);
+    TEST_ASSERT_EQUAL_INT64(syscall(SYS_gettid), g_capture.tid[0]);
+    TEST_ASSERT_EQUAL_STRING("from thread", g_capture.text[1]);
+    TEST_ASSERT_EQUAL_INT64(tid, g_capture.tid[1]);
+
+    /* So does the synchronous path */
+    log_async_stop();
+    LOGI("synchronous");
+    TEST_ASSERT_EQUAL_UINT(3, g_capture.count);
+    TEST_ASSERT_EQUAL_INT64(syscall(SYS_gettid), g_capture.tid[2]);
+}
+
+
+#define TEST_LOG_PRODUCER_MSGS 2000
+
+static void *
+test_log_producer_thread(void *arg)
+{
+    size_t i;
+
+    (void)arg;
+
+    for (i = 0; i < TEST_LOG_PRODUCER_MSGS; i++) LOGI("producer %zu", i);
+
+    return NULL;
+}
+
+
+void
+test_log_async_stop_producers(void)
+{
+    pthread_t thread;
+
+    /*
+     * Stop while another thread keeps logging: each message is either
+     * queued and delivered by the writer before the stop returns,
+     * delivered synchronously, or dropped and counted. None is left in
+     * the rings.
+     */
+    TEST_ASSERT_TRUE(log_async_start(TEST_LOG_PRODUCER_MSGS));
+    TEST_ASSERT_EQUAL_INT(0, pthread_create(&thread, NULL, test_log_producer_thread, NULL));
+    TEST_ASSERT_TRUE(test_log_wait(&g_capture.entered, 1));
+    log_async_stop();
+    pthread_join(thread, NULL);
+
+    TEST_ASSERT_EQUAL_UINT64(0, log_async_drops());
+    TEST_ASSERT_EQUAL_UINT(TEST_LOG_PRODUCER_MSGS, g_capture.entered);
+}
+
+
+void
+test_log_site_generation(void)
+{
+    uint32_t generation;
+    size_t traced;
+    size_t count;
+
+    /* TRACE sites are enabled by the log level only */
+    traced = (LOG_SEVERITY_TRACE <= LOG_TRACEBACK_SEVERITY) ? 1 : 0;
+
+    /* log_severity_set() logs the change, count from here */
+    log_severity_set(LOG_SEVERITY_INFO);
+    generation = log_generation;
+    count = g_capture.count;
+
+    test_log_emit_info();
+    TEST_ASSERT_EQUAL_UINT(count + 1, g_capture.count);
+    TEST_ASSERT_EQUAL_STRING("info site", g_capture.text[count]);
+    test_log_emit_trace();
+    TEST_ASSERT_EQUAL_UINT(count + 1 + traced, g_capture.count);
+
+    /* Using a site does not invalidate the others */
+    TEST_ASSERT_EQUAL_UINT32(generation, log_generation);
+
+    /* A severity change is picked up by sites that cached a decision */
+    log_severity_set(LOG_SEVERITY_TRACE);
+    TEST_ASSERT_NOT_EQUAL(generation, log_generation);
+    count = g_capture.count;
+    test_log_emit_trace();
+    TEST_ASSERT_EQUAL_UINT(count + 1, g_capture.count);
+    TEST_ASSERT_EQUAL_STRING("trace site", g_capture.text[count]);
+
+    /* So is a per module change */
+    generation = log_generation;
+    log_module_severity_set(LOG_MODULE_ID_MISC, LOG_SEVERITY_WARNING);
+    TEST_ASSERT_NOT_EQUAL(generation, log_generation);
+    count = g_capture.count;
+    test_log_emit_trace();
+    TEST_ASSERT_EQUAL_UINT(count + traced, g_capture.count);
+}
+
+
+void
+test_log_ratelimit(void)
+{
+    char expected[TEST_LOG_TEXT_LEN];
+    int i;
+
+    /* The burst goes through, the rest is suppressed */
+    for (i = 0; i < 10; i++) test_log_emit_limited(i);
+    TEST_ASSERT_EQUAL_UINT(3, g_capture.count);
+    TEST_ASSERT_EQUAL_STRING("limited 0", g_capture.text[0]);
+    TEST_ASSERT_EQUAL_STRING("limited 2", g_capture.text[2]);
+
+    /* 2 messages per second: a token is back after 600 ms */
+    usleep(600 * 1000);
+    test_log_emit_limited(i++);
+    TEST_ASSERT_EQUAL_UINT(5, g_capture.count);
+
+    /* The suppressed messages are accounted for first */
+    snprintf(expected, sizeof(expected), "%s:%d: 7 messages suppressed", __FILE__, g_limited_line);
+    TEST_ASSERT_EQUAL_STRING(expected, g_capture.text[3]);
+    TEST_ASSERT_EQUAL_INT(LOG_SEVERITY_INFO, g_capture.sev[3]);
+    TEST_ASSERT_EQUAL_STRING("limited 10", g_capture.text[4]);
+
+    /* The bucket is empty again */
+    test_log_emit_limited(i++);
+    TEST_ASSERT_EQUAL_UINT(5, g_capture.count);
+}
+
+
+void
+test_log_sample(void)
+{
+    int i;
+
+    for (i = 0; i < 12; i++) test_log_emit_sampled(i);
+
+    TEST_ASSERT_EQUAL_UINT(3, g_capture.count);
+    TEST_ASSERT_EQUAL_STRING("sampled 0", g_capture.text[0]);
+    TEST_ASSERT_EQUAL_STRING("sampled 4", g_capture.text[1]);
+    TEST_ASSERT_EQUAL_STRING("sampled 8", g_capture.text[2]);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    ut_init(test_name, NULL, NULL);
+    ut_setUp_tearDown(test_name, test_log_setUp, test_log_tearDown);
+
+    RUN_TEST(test_log_async_conversions);
+    RUN_TEST(test_log_async_strings);
+    RUN_TEST(test_log_async_fallback);
+    RUN_TEST(test_log_async_drops);
+    RUN_TEST(test_log_async_stop);
+    RUN_TEST(test_log_async_tid);
+    RUN_TEST(test_log_async_stop_producers);
+    RUN_TEST(test_log_site_generation);
+    RUN_TEST(test_log_ratelimit);
+    RUN_TEST(test_log_sample);
+    run_test_log_build_max();
+
+    return ut_fini();
+}
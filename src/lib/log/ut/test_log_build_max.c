@@ -0,0 +1,84 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Built with the most verbose severity compiled in lowered to INFO,
+ * the LOG*() call sites of this file above it must be compiled out.
+ */
+#undef CONFIG_LOG_SEVERITY_BUILD_MAX
+#define CONFIG_LOG_SEVERITY_BUILD_MAX 7
+
+#include <stdbool.h>
+
+#include "log.h"
+#include "unity.h"
+
+static int g_evaluated;
+
+
+static int
+test_log_arg(void)
+{
+    return ++g_evaluated;
+}
+
+
+void
+test_log_build_max(void)
+{
+    int i;
+
+    TEST_ASSERT_EQUAL_INT(LOG_SEVERITY_INFO, LOG_SEVERITY_BUILD_MAX);
+
+    log_severity_set(LOG_SEVERITY_TRACE);
+    g_evaluated = 0;
+
+    /* Sites up to the limit are called */
+    LOGI("build max %d", test_log_arg());
+    TEST_ASSERT_EQUAL_INT(1, g_evaluated);
+
+    /* Sites above it are not, whatever the log level */
+    LOGD("build max %d", test_log_arg());
+    LOGT("build max %d", test_log_arg());
+    for (i = 0; i < 4; i++)
+    {
+        LOG_RATELIMIT(DEBUG, 10, 0, "build max %d", test_log_arg());
+        LOG_SAMPLE(TRACE, 2, "build max %d", test_log_arg());
+    }
+    TEST_ASSERT_EQUAL_INT(1, g_evaluated);
+
+    /* Code guarded by LOG_SEVERITY_ENABLED() is compiled out as well */
+    TEST_ASSERT_TRUE(LOG_SEVERITY_ENABLED(LOG_SEVERITY_INFO));
+    TEST_ASSERT_FALSE(LOG_SEVERITY_ENABLED(LOG_SEVERITY_DEBUG));
+    TEST_ASSERT_FALSE(LOG_SEVERITY_ENABLED(LOG_SEVERITY_TRACE));
+}
+
+
+void
+run_test_log_build_max(void)
+{
+    RUN_TEST(test_log_build_max);
+}
@@ -0,0 +1,134 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MPMC_RING_H_INCLUDED
+#define MPMC_RING_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @file mpmc_ring.h
+ *
+ * @brief Bounded lock-free multi-producer/multi-consumer ring.
+ *
+ * Each slot carries a sequence number telling which lap of the ring it
+ * belongs to. Producers and consumers claim positions with a single
+ * compare-and-swap on the enqueue (resp. dequeue) position and publish
+ * the slot by advancing its sequence number. Neither side ever waits on
+ * the other: a full ring fails the push, an empty ring fails the pop.
+ *
+ * The ring stores opaque non NULL pointers. Ownership of the pointed
+ * object moves from the producer to the consumer popping it.
+ */
+
+struct mpmc_ring;
+
+/**
+ * @brief allocates a ring
+ *
+ * @param capacity the minimum number of entries the ring can hold.
+ *        It is rounded up to the next power of two.
+ * @return the ring, NULL on error
+ */
+struct mpmc_ring *
+mpmc_ring_new(size_t capacity);
+
+/**
+ * @brief frees a ring
+ *
+ * Entries still queued are not freed. The caller must make sure no
+ * producer or consumer is still accessing the ring.
+ *
+ * @param ring the ring to free
+ */
+void
+mpmc_ring_delete(struct mpmc_ring *ring);
+
+/**
+ * @brief returns the number of entries the ring can hold
+ *
+ * @param ring the ring
+ */
+size_t
+mpmc_ring_capacity(struct mpmc_ring *ring);
+
+/**
+ * @brief returns the number of queued entries
+ *
+ * The value is a snapshot and may already be stale when returned
+ * if other threads access the ring.
+ *
+ * @param ring the ring
+ */
+size_t
+mpmc_ring_count(struct mpmc_ring *ring);
+
+/**
+ * @brief queues an entry
+ *
+ * @param ring the ring
+ * @param data the entry to queue, must not be NULL
+ * @return true if the entry was queued, false if the ring is full
+ */
+bool
+mpmc_ring_push(struct mpmc_ring *ring, void *data);
+
+/**
+ * @brief dequeues an entry
+ *
+ * @param ring the ring
+ * @return the oldest queued entry, NULL if the ring is empty
+ */
+void *
+mpmc_ring_pop(struct mpmc_ring *ring);
+
+/**
+ * @brief queues up to n entries with a single position update
+ *
+ * The queued entries are contiguous in the ring: entries from other
+ * producers are not interleaved with them.
+ *
+ * @param ring the ring
+ * @param data the entries to queue, none of them NULL
+ * @param n the number of entries to queue
+ * @return the number of entries queued, data[0] to data[ret - 1]
+ */
+size_t
+mpmc_ring_push_batch(struct mpmc_ring *ring, void **data, size_t n);
+
+/**
+ * @brief dequeues up to n entries with a single position update
+ *
+ * @param ring the ring
+ * @param data the array receiving the dequeued entries
+ * @param n the size of the data array
+ * @return the number of entries dequeued
+ */
+size_t
+mpmc_ring_pop_batch(struct mpmc_ring *ring, void **data, size_t n);
+
+#endif /* MPMC_RING_H_INCLUDED */
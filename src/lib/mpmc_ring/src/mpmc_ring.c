@@ -0,0 +1,265 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "mpmc_ring.h"
+#include "memutil.h"
+
+/*
+ * Producers and consumers hammer distinct positions: keep them on
+ * distinct cache lines so a push does not invalidate the line a pop
+ * is spinning on.
+ */
+#define MPMC_RING_CACHE_LINE 64
+
+struct mpmc_ring_slot
+{
+    size_t seq;
+    void *data;
+};
+
+struct mpmc_ring
+{
+    struct mpmc_ring_slot *slots;
+    size_t mask;
+    char pad0[MPMC_RING_CACHE_LINE - sizeof(void *) - sizeof(size_t)];
+    size_t enqueue_pos;
+    char pad1[MPMC_RING_CACHE_LINE - sizeof(size_t)];
+    size_t dequeue_pos;
+    char pad2[MPMC_RING_CACHE_LINE - sizeof(size_t)];
+};
+
+
+static inline size_t
+mpmc_ring_load(size_t *p, int order)
+{
+    return __atomic_load_n(p, order);
+}
+
+
+static inline bool
+mpmc_ring_claim(size_t *pos, size_t *expected, size_t desired)
+{
+    return __atomic_compare_exchange_n(pos, expected, desired, true,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+
+/*
+ * Signed distance between a slot sequence and a position. Positions
+ * wrap around size_t, the difference stays meaningful as long as the
+ * ring is much smaller than the position range.
+ */
+static inline intptr_t
+mpmc_ring_dist(size_t seq, size_t pos)
+{
+    return (intptr_t)(seq - pos);
+}
+
+
+struct mpmc_ring *
+mpmc_ring_new(size_t capacity)
+{
+    struct mpmc_ring *ring;
+    size_t size;
+    size_t i;
+
+    if (capacity == 0) return NULL;
+    if (capacity > (SIZE_MAX >> 2)) return NULL;
+
+    size = 2;
+    while (size < capacity) size <<= 1;
+
+    ring = CALLOC(1, sizeof(*ring));
+    ring->slots = CALLOC(size, sizeof(*ring->slots));
+    ring->mask = size - 1;
+
+    /* Slot i is free for the producer holding position i */
+    for (i = 0; i < size; i++) ring->slots[i].seq = i;
+
+    __atomic_store_n(&ring->enqueue_pos, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring->dequeue_pos, 0, __ATOMIC_RELAXED);
+
+    return ring;
+}
+
+
+void
+mpmc_ring_delete(struct mpmc_ring *ring)
+{
+    if (ring == NULL) return;
+
+    FREE(ring->slots);
+    FREE(ring);
+}
+
+
+size_t
+mpmc_ring_capacity(struct mpmc_ring *ring)
+{
+    return ring->mask + 1;
+}
+
+
+size_t
+mpmc_ring_count(struct mpmc_ring *ring)
+{
+    size_t enq;
+    size_t deq;
+
+    deq = mpmc_ring_load(&ring->dequeue_pos, __ATOMIC_ACQUIRE);
+    enq = mpmc_ring_load(&ring->enqueue_pos, __ATOMIC_ACQUIRE);
+
+    if (mpmc_ring_dist(enq, deq) <= 0) return 0;
+
+    return enq - deq;
+}
+
+
+/**
+ * @brief claims up to n contiguous positions
+ *
+ * A slot is available to the side claiming position p when its
+ * sequence equals p + lag: lag is 0 for producers (the slot was
+ * released by the consumer of the previous lap), 1 for consumers
+ * (the slot was published by the producer of position p).
+ *
+ * @param ring the ring
+ * @param posp the position to advance
+ * @param lag the expected sequence offset
+ * @param n the maximum number of positions to claim
+ * @param first set to the first claimed position
+ * @return the number of claimed positions
+ */
+static size_t
+mpmc_ring_claim_range(struct mpmc_ring *ring, size_t *posp, size_t lag,
+                      size_t n, size_t *first)
+{
+    struct mpmc_ring_slot *slot;
+    intptr_t dist = 0;
+    size_t count;
+    size_t seq;
+    size_t pos;
+
+    pos = mpmc_ring_load(posp, __ATOMIC_RELAXED);
+    for (;;)
+    {
+        for (count = 0; count < n; count++)
+        {
+            slot = &ring->slots[(pos + count) & ring->mask];
+            seq = mpmc_ring_load(&slot->seq, __ATOMIC_ACQUIRE);
+            dist = mpmc_ring_dist(seq, pos + count + lag);
+            if (dist != 0) break;
+        }
+
+        if (count == 0)
+        {
+            /* Ring full (resp. empty) at the current position */
+            if (dist < 0) return 0;
+
+            /* Another thread claimed pos meanwhile, catch up */
+            pos = mpmc_ring_load(posp, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        /* On failure pos is refreshed with the current position */
+        if (mpmc_ring_claim(posp, &pos, pos + count)) break;
+    }
+
+    *first = pos;
+    return count;
+}
+
+
+size_t
+mpmc_ring_push_batch(struct mpmc_ring *ring, void **data, size_t n)
+{
+    struct mpmc_ring_slot *slot;
+    size_t count;
+    size_t pos;
+    size_t i;
+
+    if (ring == NULL || data == NULL || n == 0) return 0;
+
+    count = mpmc_ring_claim_range(ring, &ring->enqueue_pos, 0, n, &pos);
+    for (i = 0; i < count; i++)
+    {
+        slot = &ring->slots[(pos + i) & ring->mask];
+        slot->data = data[i];
+        __atomic_store_n(&slot->seq, pos + i + 1, __ATOMIC_RELEASE);
+    }
+
+    return count;
+}
+
+
+size_t
+mpmc_ring_pop_batch(struct mpmc_ring *ring, void **data, size_t n)
+{
+    struct mpmc_ring_slot *slot;
+    size_t count;
+    size_t pos;
+    size_t i;
+
+    if (ring == NULL || data == NULL || n == 0) return 0;
+
+    count = mpmc_ring_claim_range(ring, &ring->dequeue_pos, 1, n, &pos);
+    for (i = 0; i < count; i++)
+    {
+        slot = &ring->slots[(pos + i) & ring->mask];
+        data[i] = slot->data;
+        slot->data = NULL;
+
+        /* Hand the slot over to the producer of the next lap */
+        __atomic_store_n(&slot->seq, pos + i + ring->mask + 1,
+                         __ATOMIC_RELEASE);
+    }
+
+    return count;
+}
+
+
+bool
+mpmc_ring_push(struct mpmc_ring *ring, void *data)
+{
+    if (data == NULL) return false;
+
+    return (mpmc_ring_push_batch(ring, &data, 1) == 1);
+}
+
+
+void *
+mpmc_ring_pop(struct mpmc_ring *ring)
+{
+    void *data;
+
+    if (mpmc_ring_pop_batch(ring, &data, 1) == 0) return NULL;
+
+    return data;
+}
@@ -0,0 +1,281 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "log.h"
+#include "memutil.h"
+#include "mpmc_ring.h"
+#include "unit_test_utils.h"
+#include "unity.h"
+
+const char *test_name = "mpmc_ring_tests";
+
+#define TEST_THREADS 4
+#define TEST_ITEMS_PER_PRODUCER 20000
+#define TEST_BATCH 8
+
+struct test_mpmc_ctx
+{
+    struct mpmc_ring *ring;
+    size_t id;
+    uint64_t sum;
+    size_t count;
+};
+
+static size_t g_consumed;
+
+
+void
+test_mpmc_ring_capacity(void)
+{
+    struct mpmc_ring *ring;
+
+    TEST_ASSERT_NULL(mpmc_ring_new(0));
+
+    ring = mpmc_ring_new(5);
+    TEST_ASSERT_NOT_NULL(ring);
+    TEST_ASSERT_EQUAL_UINT(8, mpmc_ring_capacity(ring));
+    TEST_ASSERT_EQUAL_UINT(0, mpmc_ring_count(ring));
+    mpmc_ring_delete(ring);
+
+    ring = mpmc_ring_new(1);
+    TEST_ASSERT_EQUAL_UINT(2, mpmc_ring_capacity(ring));
+    mpmc_ring_delete(ring);
+}
+
+
+void
+test_mpmc_ring_push_pop(void)
+{
+    struct mpmc_ring *ring;
+    uintptr_t i;
+    bool ret;
+
+    ring = mpmc_ring_new(4);
+    TEST_ASSERT_NULL(mpmc_ring_pop(ring));
+    TEST_ASSERT_FALSE(mpmc_ring_push(ring, NULL));
+
+    /* Fill the ring, go around it a few times */
+    for (i = 1; i <= 4; i++)
+    {
+        ret = mpmc_ring_push(ring, (void *)i);
+        TEST_ASSERT_TRUE(ret);
+    }
+    TEST_ASSERT_FALSE(mpmc_ring_push(ring, (void *)5));
+    TEST_ASSERT_EQUAL_UINT(4, mpmc_ring_count(ring));
+
+    for (i = 1; i <= 20; i++)
+    {
+        TEST_ASSERT_EQUAL_PTR((void *)i, mpmc_ring_pop(ring));
+        ret = mpmc_ring_push(ring, (void *)(i + 4));
+        TEST_ASSERT_TRUE(ret);
+    }
+    for (i = 21; i <= 24; i++) TEST_ASSERT_EQUAL_PTR((void *)i, mpmc_ring_pop(ring));
+
+    TEST_ASSERT_NULL(mpmc_ring_pop(ring));
+    TEST_ASSERT_EQUAL_UINT(0, mpmc_ring_count(ring));
+
+    mpmc_ring_delete(ring);
+}
+
+
+void
+test_mpmc_ring_batch(void)
+{
+    struct mpmc_ring *ring;
+    void *out[8];
+    void *in[8];
+    uintptr_t i;
+    size_t n;
+
+    for (i = 0; i < 8; i++) in[i] = (void *)(i + 1);
+
+    ring = mpmc_ring_new(8);
+
+    /* Partial batch push when the ring runs out of room */
+    n = mpmc_ring_push_batch(ring, in, 5);
+    TEST_ASSERT_EQUAL_UINT(5, n);
+    n = mpmc_ring_push_batch(ring, in + 5, 3);
+    TEST_ASSERT_EQUAL_UINT(3, n);
+    n = mpmc_ring_push_batch(ring, in, 2);
+    TEST_ASSERT_EQUAL_UINT(0, n);
+
+    /* Partial batch pop when the ring runs dry */
+    n = mpmc_ring_pop_batch(ring, out, 6);
+    TEST_ASSERT_EQUAL_UINT(6, n);
+    TEST_ASSERT_EQUAL_PTR_ARRAY(in, out, 6);
+
+    n = mpmc_ring_push_batch(ring, in, 4);
+    TEST_ASSERT_EQUAL_UINT(4, n);
+
+    n = mpmc_ring_pop_batch(ring, out, 8);
+    TEST_ASSERT_EQUAL_UINT(6, n);
+    TEST_ASSERT_EQUAL_PTR(in[6], out[0]);
+    TEST_ASSERT_EQUAL_PTR(in[7], out[1]);
+    TEST_ASSERT_EQUAL_PTR_ARRAY(in, &out[2], 4);
+
+    n = mpmc_ring_pop_batch(ring, out, 8);
+    TEST_ASSERT_EQUAL_UINT(0, n);
+
+    mpmc_ring_delete(ring);
+}
+
+
+static void *
+test_mpmc_producer(void *arg)
+{
+    struct test_mpmc_ctx *ctx;
+    void *batch[TEST_BATCH];
+    uintptr_t next;
+    uintptr_t last;
+    size_t queued;
+    size_t n;
+    size_t i;
+
+    ctx = arg;
+    next = ctx->id * TEST_ITEMS_PER_PRODUCER + 1;
+    last = next + TEST_ITEMS_PER_PRODUCER;
+
+    while (next < last)
+    {
+        /* Alternate single and batched pushes */
+        if (next & 1)
+        {
+            if (mpmc_ring_push(ctx->ring, (void *)next)) next++;
+            else sched_yield();
+            continue;
+        }
+
+        n = 0;
+        for (i = 0; i < TEST_BATCH && next + i < last; i++)
+        {
+            batch[i] = (void *)(next + i);
+            n++;
+        }
+        queued = mpmc_ring_push_batch(ctx->ring, batch, n);
+        if (queued == 0) sched_yield();
+        next += queued;
+    }
+
+    return NULL;
+}
+
+
+static void *
+test_mpmc_consumer(void *arg)
+{
+    struct test_mpmc_ctx *ctx;
+    void *batch[TEST_BATCH];
+    size_t total;
+    size_t n;
+    size_t i;
+
+    ctx = arg;
+    total = TEST_THREADS * TEST_ITEMS_PER_PRODUCER;
+
+    while (__atomic_load_n(&g_consumed, __ATOMIC_RELAXED) < total)
+    {
+        n = mpmc_ring_pop_batch(ctx->ring, batch, TEST_BATCH);
+        if (n == 0) sched_yield();
+        for (i = 0; i < n; i++) ctx->sum += (uintptr_t)batch[i];
+        ctx->count += n;
+        __atomic_add_fetch(&g_consumed, n, __ATOMIC_RELAXED);
+    }
+
+    return NULL;
+}
+
+
+void
+test_mpmc_ring_threads(void)
+{
+    struct test_mpmc_ctx consumers[TEST_THREADS];
+    struct test_mpmc_ctx producers[TEST_THREADS];
+    pthread_t cthreads[TEST_THREADS];
+    pthread_t pthreads[TEST_THREADS];
+    struct mpmc_ring *ring;
+    uint64_t expected;
+    uint64_t items;
+    uint64_t sum;
+    size_t count;
+    size_t i;
+    int rc;
+
+    ring = mpmc_ring_new(64);
+    g_consumed = 0;
+
+    for (i = 0; i < TEST_THREADS; i++)
+    {
+        consumers[i] = (struct test_mpmc_ctx){ .ring = ring, .id = i };
+        producers[i] = (struct test_mpmc_ctx){ .ring = ring, .id = i };
+        rc = pthread_create(&cthreads[i], NULL, test_mpmc_consumer, &consumers[i]);
+        TEST_ASSERT_EQUAL_INT(0, rc);
+        rc = pthread_create(&pthreads[i], NULL, test_mpmc_producer, &producers[i]);
+        TEST_ASSERT_EQUAL_INT(0, rc);
+    }
+
+    for (i = 0; i < TEST_THREADS; i++) pthread_join(pthreads[i], NULL);
+    for (i = 0; i < TEST_THREADS; i++) pthread_join(cthreads[i], NULL);
+
+    /* Every item was consumed exactly once */
+    sum = 0;
+    count = 0;
+    for (i = 0; i < TEST_THREADS; i++)
+    {
+        sum += consumers[i].sum;
+        count += consumers[i].count;
+    }
+
+    items = (uint64_t)TEST_THREADS * TEST_ITEMS_PER_PRODUCER;
+    expected = items * (items + 1) / 2;
+    TEST_ASSERT_EQUAL_UINT(items, count);
+    TEST_ASSERT_EQUAL_UINT64(expected, sum);
+    TEST_ASSERT_NULL(mpmc_ring_pop(ring));
+
+    mpmc_ring_delete(ring);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    ut_init(test_name, NULL, NULL);
+
+    RUN_TEST(test_mpmc_ring_capacity);
+    RUN_TEST(test_mpmc_ring_push_pop);
+    RUN_TEST(test_mpmc_ring_batch);
+    RUN_TEST(test_mpmc_ring_threads);
+
+    return ut_fini();
+}
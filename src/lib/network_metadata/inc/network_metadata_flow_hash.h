@@ -0,0 +1,147 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef NETWORK_METADATA_FLOW_HASH_H_INCLUDED
+#define NETWORK_METADATA_FLOW_HASH_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct net_md_flow_key;
+struct net_md_stats_accumulator;
+
+/* Each bucket fills exactly one 64 bytes cache line on 64 bits targets */
+#define NET_MD_FLOW_HASH_SLOTS 5
+#define NET_MD_FLOW_HASH_ALIGN 64
+#define NET_MD_FLOW_HASH_MIN_BUCKETS 64
+
+/**
+ * @brief a flow hash bucket
+ *
+ * The slot hashes are kept ahead of the accumulator pointers so a probe
+ * only dereferences an accumulator key when the full 32 bits hash matches.
+ * overflow counts the entries hashed to this bucket or a previous one
+ * which were stored further down the probe sequence. A lookup stops at the
+ * first bucket with a null overflow count, so no tombstones are needed.
+ */
+struct net_md_flow_bucket
+{
+    uint32_t hashes[NET_MD_FLOW_HASH_SLOTS];
+    uint32_t overflow;
+    struct net_md_stats_accumulator *accs[NET_MD_FLOW_HASH_SLOTS];
+} __attribute__((aligned(NET_MD_FLOW_HASH_ALIGN)));
+
+
+/**
+ * @brief open addressing flow accumulators index
+ *
+ * Indexes the 5 tuple accumulators of an aggregator, both the ones attached
+ * to an ethernet pair and the ones tracked without ethernet information.
+ * The aggregator trees remain the owners of the accumulators and are still
+ * used for ordered walks when reporting.
+ */
+struct net_md_flow_hash
+{
+    struct net_md_flow_bucket *buckets;
+    size_t num_buckets;           /* power of 2 */
+    size_t count;                 /* # of indexed accumulators */
+    size_t lookups;               /* # of lookups */
+    size_t hits;                  /* # of successful lookups */
+};
+
+
+/**
+ * @brief checks if a flow key lookup can go through the flow hash
+ *
+ * @param key the flow key
+ * @return true if the key describes a 5 tuple flow
+ */
+bool
+net_md_flow_hash_eligible(struct net_md_flow_key *key);
+
+
+/**
+ * @brief computes the flow hash of a key
+ *
+ * The hashed fields match the ones compared when looking up the
+ * accumulator in the aggregator trees.
+ *
+ * @param key the flow key
+ * @return the 32 bits hash of the key
+ */
+uint32_t
+net_md_flow_hash_key(struct net_md_flow_key *key);
+
+
+/**
+ * @brief releases the flow hash buckets
+ *
+ * @param fh the flow hash
+ */
+void
+net_md_flow_hash_fini(struct net_md_flow_hash *fh);
+
+
+/**
+ * @brief looks up an accumulator in the flow hash
+ *
+ * @param fh the flow hash
+ * @param key the flow key
+ * @param hash the precomputed hash of the key
+ * @return the accumulator if found, NULL otherwise
+ */
+struct net_md_stats_accumulator *
+net_md_flow_hash_find(struct net_md_flow_hash *fh,
+                      struct net_md_flow_key *key,
+                      uint32_t hash);
+
+
+/**
+ * @brief indexes an accumulator
+ *
+ * The accumulator's flow_hash field must be set by the caller.
+ *
+ * @param fh the flow hash
+ * @param acc the accumulator to index
+ * @return true if the accumulator was indexed, false otherwise
+ */
+bool
+net_md_flow_hash_insert(struct net_md_flow_hash *fh,
+                        struct net_md_stats_accumulator *acc);
+
+
+/**
+ * @brief removes an accumulator from the flow hash
+ *
+ * @param fh the flow hash
+ * @param acc the accumulator to remove
+ */
+void
+net_md_flow_hash_remove(struct net_md_flow_hash *fh,
+                        struct net_md_stats_accumulator *acc);
+
+#endif /* NETWORK_METADATA_FLOW_HASH_H_INCLUDED */
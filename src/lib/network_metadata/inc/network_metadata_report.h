@@ -38,6 +38,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "os_types.h"
 
 #include "network_metadata.h"
+#include "network_metadata_flow_hash.h"
+#include "network_metadata_slab.h"
 #include "network_metadata_utils.h"
 
 /**
@@ -113,6 +115,9 @@ struct net_md_stats_accumulator
     struct net_md_stats_accumulator *rev_acc;
     uint32_t flags;
     bool dpi_always;
+    uint32_t flow_hash;                    /* precomputed flow key hash */
+    bool flow_hashed;                      /* indexed in the aggr flow hash */
+    bool from_slab;                        /* acc and key from the aggr slabs */
 };
 
 
@@ -177,6 +182,12 @@ struct net_md_aggregator
 {
     ds_tree_t eth_pairs;          /* tracked flows projected at the eth level */
     ds_tree_t five_tuple_flows;   /* 5 tuple only flows */
+    struct net_md_flow_hash flow_hash; /* 5 tuple flows lookup index */
+    struct net_md_slab_pool mem_pool; /* memory accounting of the slabs */
+    struct net_md_slab acc_slab;  /* flow accumulators */
+    struct net_md_slab key_slab;  /* flow accumulators' keys */
+    struct net_md_slab ctx_slab;  /* flow contexts of the aggregator user */
+    size_t evicted_flows;         /* # of idle flows evicted on memory cap */
     bool report_all_samples;      /* Do not aggregate ethernet samples */
     struct flow_report *report;   /* report to serialize */
     size_t max_windows;           /* maximum number of windows */
@@ -214,6 +225,8 @@ struct net_md_aggregator_set
     size_t num_windows;     /* the max # of windows the report will contain */
     int acc_ttl;            /* how long an incative accumulator is kept around */
     int report_type;        /* absolute or relative */
+    size_t mem_cap;         /* max bytes of flow memory, 0 for no limit */
+    size_t flow_ctx_size;   /* size of the user's per flow contexts */
 
     /* a collector filter routine */
     bool (*collect_filter)(struct net_md_aggregator *aggr,
@@ -0,0 +1,140 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef NETWORK_METADATA_SLAB_H_INCLUDED
+#define NETWORK_METADATA_SLAB_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ds_dlist.h"
+
+#define NET_MD_SLAB_CHUNK_SIZE (16 * 1024)
+#define NET_MD_SLAB_MIN_OBJS 8
+
+/**
+ * @brief memory pool shared by the slabs of an aggregator
+ *
+ * Accounts for the chunks allocated by its slabs. When mem_cap is set, a
+ * slab needing a new chunk fails its allocation instead of growing the pool
+ * past the cap, letting the owner evict objects and retry.
+ */
+struct net_md_slab_pool
+{
+    size_t mem_used;     /* bytes of chunks currently allocated */
+    size_t mem_hwm;      /* high water mark of mem_used */
+    size_t mem_cap;      /* max bytes of chunks, 0 for no limit */
+    size_t cap_hits;     /* # of allocations denied by the cap */
+};
+
+
+/**
+ * @brief fixed size objects allocator
+ *
+ * Objects are carved from chunks of NET_MD_SLAB_CHUNK_SIZE bytes.
+ * Chunks with free slots are kept on the partial list, and a chunk is
+ * released once empty unless it is the last partial one.
+ */
+struct net_md_slab
+{
+    const char *name;
+    struct net_md_slab_pool *pool;
+    size_t obj_size;          /* requested object size */
+    size_t slot_size;         /* object size with header and padding */
+    size_t chunk_objs;        /* # of objects per chunk */
+    ds_dlist_t partial;       /* chunks with free slots */
+    ds_dlist_t full;          /* chunks without free slots */
+    size_t num_chunks;        /* # of allocated chunks */
+    size_t in_use;            /* # of allocated objects */
+    size_t in_use_hwm;        /* high water mark of in_use */
+    size_t alloc_failures;    /* # of failed allocations */
+};
+
+
+/**
+ * @brief initializes a slab
+ *
+ * No memory is allocated until the first object allocation.
+ *
+ * @param slab the slab to initialize
+ * @param name the slab name, used for logging
+ * @param obj_size the size of the objects
+ * @param pool the memory pool to account the slab chunks to
+ */
+void
+net_md_slab_init(struct net_md_slab *slab, const char *name,
+                 size_t obj_size, struct net_md_slab_pool *pool);
+
+
+/**
+ * @brief releases the chunks of a slab
+ *
+ * @param slab the slab to release
+ */
+void
+net_md_slab_fini(struct net_md_slab *slab);
+
+
+/**
+ * @brief allocates a zeroed object
+ *
+ * @param slab the slab to allocate from
+ * @return a pointer to the object, NULL if the allocation failed or
+ *         the slab was not initialized
+ */
+void *
+net_md_slab_alloc(struct net_md_slab *slab);
+
+
+/**
+ * @brief checks if the next allocation needs a new chunk
+ *
+ * @param slab the slab to check
+ * @return true if all the slab chunks are full
+ */
+bool
+net_md_slab_is_full(struct net_md_slab *slab);
+
+
+/**
+ * @brief returns an object to its slab
+ *
+ * @param obj the object to free, allocated by net_md_slab_alloc()
+ */
+void
+net_md_slab_free(void *obj);
+
+
+/**
+ * @brief logs the usage of a slab
+ *
+ * @param slab the slab to log
+ */
+void
+net_md_slab_log_stats(struct net_md_slab *slab);
+
+#endif /* NETWORK_METADATA_SLAB_H_INCLUDED */
@@ -41,6 +41,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MD_MAX_STRLEN (256)
 #define UPLINK_INTERFACE (10)
 
+/* Memory cap driven eviction of idle flows */
+#define NET_MD_EVICT_BATCH 32
+#define NET_MD_EVICT_MIN_IDLE 2
+#define NET_MD_MEM_CAP_HEADROOM 8
+
 enum acc_state
 {
     ACC_STATE_INIT = 0,           /* Not accessed yet */
@@ -118,6 +123,11 @@ bool net_md_set_ip(uint8_t ipv, uint8_t *ip, uint8_t **ip_tgt);
 struct node_info * net_md_set_node_info(struct node_info *info);
 struct flow_key * net_md_set_flow_key(struct net_md_flow_key *key);
 void net_md_free_acc(struct net_md_stats_accumulator *acc);
+void net_md_destroy_acc(struct net_md_stats_accumulator *acc);
+size_t net_md_evict_idle_flows(struct net_md_aggregator *aggr);
+void *net_md_alloc_flow_ctx(struct net_md_aggregator *aggr);
+void net_md_free_flow_ctx(void *ctx);
+void net_md_log_mem_stats(struct net_md_aggregator *aggr);
 void net_md_free_flow_tree(ds_tree_t *tree);
 struct net_md_stats_accumulator * net_md_set_acc(struct net_md_aggregator *aggr,
                                                  struct net_md_flow_key *key);
@@ -0,0 +1,394 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "memutil.h"
+#include "network_metadata_flow_hash.h"
+#include "network_metadata_report.h"
+#include "network_metadata_utils.h"
+
+#define NET_MD_FLOW_HASH_SEED 0x9747b28c
+
+static inline uint32_t
+net_md_flow_hash_rotl(uint32_t x, int r)
+{
+    return (x << r) | (x >> (32 - r));
+}
+
+
+/**
+ * @brief murmur3 32 bits block mixing
+ */
+static inline uint32_t
+net_md_flow_hash_mix(uint32_t h, uint32_t k)
+{
+    k *= 0xcc9e2d51;
+    k = net_md_flow_hash_rotl(k, 15);
+    k *= 0x1b873593;
+
+    h ^= k;
+    h = net_md_flow_hash_rotl(h, 13);
+    h = h * 5 + 0xe6546b64;
+
+    return h;
+}
+
+
+/**
+ * @brief murmur3 32 bits finalizer
+ */
+static inline uint32_t
+net_md_flow_hash_final(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+
+    return h;
+}
+
+
+static uint32_t
+net_md_flow_hash_bytes(uint32_t h, const uint8_t *data, size_t len)
+{
+    uint32_t k;
+
+    while (len >= sizeof(k))
+    {
+        memcpy(&k, data, sizeof(k));
+        h = net_md_flow_hash_mix(h, k);
+        data += sizeof(k);
+        len -= sizeof(k);
+    }
+
+    if (len == 0) return h;
+
+    k = 0;
+    memcpy(&k, data, len);
+
+    return net_md_flow_hash_mix(h, k);
+}
+
+
+bool
+net_md_flow_hash_eligible(struct net_md_flow_key *key)
+{
+    if (key == NULL) return false;
+    if (is_eth_only(key)) return false;
+    if (key->flags & NET_MD_ACC_ETH) return false;
+
+    return true;
+}
+
+
+uint32_t
+net_md_flow_hash_key(struct net_md_flow_key *key)
+{
+    uint32_t presence;
+    uint32_t h;
+    size_t ipl;
+
+    h = NET_MD_FLOW_HASH_SEED;
+
+    /*
+     * The ethernet fields are only part of the lookup when the key carries
+     * some. 5 tuple only flows are compared regardless of their vlan id.
+     */
+    presence = 0;
+    if (has_eth_info(key))
+    {
+        presence |= (key->smac != NULL) ? 1 : 0;
+        presence |= (key->dmac != NULL) ? 2 : 0;
+        if (key->smac != NULL)
+        {
+            h = net_md_flow_hash_bytes(h, key->smac->addr,
+                                       sizeof(key->smac->addr));
+        }
+        if (key->dmac != NULL)
+        {
+            h = net_md_flow_hash_bytes(h, key->dmac->addr,
+                                       sizeof(key->dmac->addr));
+        }
+        h = net_md_flow_hash_mix(h, (uint16_t)key->vlan_id);
+    }
+
+    h = net_md_flow_hash_mix(h, key->ip_version | (key->ipprotocol << 8) |
+                             (presence << 16));
+
+    ipl = (key->ip_version == 4 ? 4 : 16);
+    h = net_md_flow_hash_bytes(h, key->src_ip, ipl);
+    h = net_md_flow_hash_bytes(h, key->dst_ip, ipl);
+
+    h = net_md_flow_hash_mix(h, key->sport | ((uint32_t)key->dport << 16));
+    h = net_md_flow_hash_mix(h, key->icmp_idt);
+
+    return net_md_flow_hash_final(h);
+}
+
+
+/**
+ * @brief checks that an indexed accumulator matches a lookup key
+ *
+ * Mirrors the aggregator trees comparisons: ethernet pair then 5 tuple
+ * for keys carrying ethernet information, 5 tuple only otherwise.
+ */
+static bool
+net_md_flow_hash_match(struct net_md_flow_key *key,
+                       struct net_md_flow_key *acc_key)
+{
+    int cmp;
+
+    if (has_eth_info(key))
+    {
+        cmp = net_md_eth_cmp(key, acc_key);
+        if (cmp != 0) return false;
+    }
+    else if (has_eth_info(acc_key))
+    {
+        return false;
+    }
+
+    cmp = net_md_5tuple_cmp(key, acc_key);
+
+    return (cmp == 0);
+}
+
+
+static struct net_md_flow_bucket *
+net_md_flow_hash_alloc_buckets(size_t num_buckets)
+{
+    struct net_md_flow_bucket *buckets;
+    size_t size;
+    int rc;
+
+    size = num_buckets * sizeof(*buckets);
+    rc = posix_memalign((void **)&buckets, NET_MD_FLOW_HASH_ALIGN, size);
+    if (rc != 0) return NULL;
+
+    memset(buckets, 0, size);
+
+    return buckets;
+}
+
+
+/**
+ * @brief stores an accumulator in the first free slot of its probe sequence
+ *
+ * The caller guarantees a free slot is available.
+ */
+static void
+net_md_flow_hash_place(struct net_md_flow_bucket *buckets, size_t mask,
+                       struct net_md_stats_accumulator *acc)
+{
+    struct net_md_flow_bucket *bucket;
+    size_t idx;
+    size_t i;
+
+    idx = acc->flow_hash & mask;
+    for (;;)
+    {
+        bucket = &buckets[idx];
+        for (i = 0; i < NET_MD_FLOW_HASH_SLOTS; i++)
+        {
+            if (bucket->accs[i] != NULL) continue;
+
+            bucket->hashes[i] = acc->flow_hash;
+            bucket->accs[i] = acc;
+            return;
+        }
+        bucket->overflow++;
+        idx = (idx + 1) & mask;
+    }
+}
+
+
+static bool
+net_md_flow_hash_resize(struct net_md_flow_hash *fh, size_t num_buckets)
+{
+    struct net_md_flow_bucket *buckets;
+    struct net_md_flow_bucket *bucket;
+    size_t mask;
+    size_t idx;
+    size_t i;
+
+    buckets = net_md_flow_hash_alloc_buckets(num_buckets);
+    if (buckets == NULL)
+    {
+        LOGE("%s: failed to allocate %zu flow hash buckets", __func__,
+             num_buckets);
+        return false;
+    }
+
+    mask = num_buckets - 1;
+    for (idx = 0; idx < fh->num_buckets; idx++)
+    {
+        bucket = &fh->buckets[idx];
+        for (i = 0; i < NET_MD_FLOW_HASH_SLOTS; i++)
+        {
+            if (bucket->accs[i] == NULL) continue;
+
+            net_md_flow_hash_place(buckets, mask, bucket->accs[i]);
+        }
+    }
+
+    FREE(fh->buckets);
+    fh->buckets = buckets;
+    fh->num_buckets = num_buckets;
+
+    return true;
+}
+
+
+void
+net_md_flow_hash_fini(struct net_md_flow_hash *fh)
+{
+    if (fh == NULL) return;
+
+    FREE(fh->buckets);
+    fh->buckets = NULL;
+    fh->num_buckets = 0;
+    fh->count = 0;
+}
+
+
+struct net_md_stats_accumulator *
+net_md_flow_hash_find(struct net_md_flow_hash *fh,
+                      struct net_md_flow_key *key,
+                      uint32_t hash)
+{
+    struct net_md_stats_accumulator *acc;
+    struct net_md_flow_bucket *bucket;
+    size_t probes;
+    size_t mask;
+    size_t idx;
+    size_t i;
+
+    if (fh == NULL) return NULL;
+    if (fh->buckets == NULL) return NULL;
+
+    fh->lookups++;
+    mask = fh->num_buckets - 1;
+    idx = hash & mask;
+    for (probes = 0; probes < fh->num_buckets; probes++)
+    {
+        bucket = &fh->buckets[idx];
+        for (i = 0; i < NET_MD_FLOW_HASH_SLOTS; i++)
+        {
+            if (bucket->hashes[i] != hash) continue;
+
+            acc = bucket->accs[i];
+            if (acc == NULL) continue;
+            if (!net_md_flow_hash_match(key, acc->key)) continue;
+
+            fh->hits++;
+            return acc;
+        }
+
+        if (bucket->overflow == 0) return NULL;
+        idx = (idx + 1) & mask;
+    }
+
+    return NULL;
+}
+
+
+bool
+net_md_flow_hash_insert(struct net_md_flow_hash *fh,
+                        struct net_md_stats_accumulator *acc)
+{
+    size_t num_buckets;
+    size_t capacity;
+    bool rc;
+
+    if (fh == NULL) return false;
+    if (acc == NULL) return false;
+
+    /* Keep the load factor under 75% */
+    capacity = fh->num_buckets * NET_MD_FLOW_HASH_SLOTS;
+    if ((fh->count + 1) * 4 > capacity * 3)
+    {
+        num_buckets = fh->num_buckets * 2;
+        if (num_buckets == 0) num_buckets = NET_MD_FLOW_HASH_MIN_BUCKETS;
+
+        rc = net_md_flow_hash_resize(fh, num_buckets);
+        if (!rc) return false;
+    }
+
+    net_md_flow_hash_place(fh->buckets, fh->num_buckets - 1, acc);
+    fh->count++;
+
+    return true;
+}
+
+
+void
+net_md_flow_hash_remove(struct net_md_flow_hash *fh,
+                        struct net_md_stats_accumulator *acc)
+{
+    struct net_md_flow_bucket *bucket;
+    size_t probes;
+    size_t home;
+    size_t mask;
+    size_t idx;
+    size_t i;
+
+    if (fh == NULL) return;
+    if (fh->buckets == NULL) return;
+
+    mask = fh->num_buckets - 1;
+    home = acc->flow_hash & mask;
+    idx = home;
+    for (probes = 0; probes < fh->num_buckets; probes++)
+    {
+        bucket = &fh->buckets[idx];
+        for (i = 0; i < NET_MD_FLOW_HASH_SLOTS; i++)
+        {
+            if (bucket->accs[i] != acc) continue;
+
+            bucket->accs[i] = NULL;
+            bucket->hashes[i] = 0;
+            fh->count--;
+
+            /* Undo the overflow accounting of the buckets walked at insertion */
+            while (home != idx)
+            {
+                fh->buckets[home].overflow--;
+                home = (home + 1) & mask;
+            }
+            return;
+        }
+
+        if (bucket->overflow == 0) return;
+        idx = (idx + 1) & mask;
+    }
+}
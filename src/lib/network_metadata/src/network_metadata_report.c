@@ -64,6 +64,10 @@ void net_md_free_aggregator(struct net_md_aggregator *aggr)
     }
 
     net_md_free_flow_tree(&aggr->five_tuple_flows);
+    net_md_flow_hash_fini(&aggr->flow_hash);
+    net_md_slab_fini(&aggr->acc_slab);
+    net_md_slab_fini(&aggr->key_slab);
+    net_md_slab_fini(&aggr->ctx_slab);
 }
 
 /**
@@ -116,6 +120,16 @@ net_md_allocate_aggregator(struct net_md_aggregator_set *aggr_set)
                  struct net_md_eth_pair, eth_pair_node);
     ds_tree_init(&aggr->five_tuple_flows, net_md_5tuple_cmp,
                  struct net_md_flow, flow_node);
+    aggr->mem_pool.mem_cap = aggr_set->mem_cap;
+    net_md_slab_init(&aggr->acc_slab, "accumulators",
+                     sizeof(struct net_md_stats_accumulator), &aggr->mem_pool);
+    net_md_slab_init(&aggr->key_slab, "flow keys",
+                     sizeof(struct net_md_flow_key), &aggr->mem_pool);
+    if (aggr_set->flow_ctx_size != 0)
+    {
+        net_md_slab_init(&aggr->ctx_slab, "flow contexts",
+                         aggr_set->flow_ctx_size, &aggr->mem_pool);
+    }
     aggr->collect_filter = aggr_set->collect_filter;
     aggr->report_filter = aggr_set->report_filter;
     aggr->send_report = aggr_set->send_report;
@@ -316,7 +330,6 @@ bool net_md_send_report(struct net_md_aggregator *aggr, char *mqtt_topic)
 {
     struct flow_report *report;
     struct packed_buffer *pb;
-    qm_response_t res;
     bool ret;
 
     if (aggr == NULL) return false;
@@ -339,8 +352,16 @@ bool net_md_send_report(struct net_md_aggregator *aggr, char *mqtt_topic)
     report = aggr->report;
     report->reported_at = time(NULL);
     pb = serialize_flow_report(aggr->report);
-    ret = qm_conn_send_direct(QM_REQ_COMPRESS_IF_CFG, mqtt_topic,
-                              pb->buf, pb->len, &res);
+
+    /*
+     * Queued to the QM sender thread when the manager started it,
+     * sent synchronously otherwise. Only the send is offloaded: the
+     * report points into the aggregator's windows, which are reset
+     * below, so the protobuf serialization stays on the caller's
+     * thread and its cost grows with the number of flows reported.
+     */
+    ret = qm_conn_send_async(QM_REQ_COMPRESS_IF_CFG, mqtt_topic,
+                             pb->buf, pb->len);
 
     /* Free the serialized container */
     free_packed_buffer(pb);
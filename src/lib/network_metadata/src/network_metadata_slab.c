@@ -0,0 +1,270 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "memutil.h"
+#include "network_metadata_slab.h"
+#include "util.h"
+
+#define NET_MD_SLAB_ALIGN(x) (((x) + 7) & ~((size_t)7))
+
+/**
+ * @brief a slab chunk
+ *
+ * The chunk header is followed by chunk_objs slots. Each slot starts with
+ * a pointer to its chunk so an object can be freed without its slab.
+ */
+struct net_md_slab_chunk
+{
+    struct net_md_slab *slab;
+    void *free_list;
+    size_t nused;
+    ds_dlist_node_t chunk_node;
+};
+
+#define NET_MD_SLAB_HDR_SIZE NET_MD_SLAB_ALIGN(sizeof(struct net_md_slab_chunk *))
+#define NET_MD_SLAB_CHUNK_HDR_SIZE NET_MD_SLAB_ALIGN(sizeof(struct net_md_slab_chunk))
+
+
+void
+net_md_slab_init(struct net_md_slab *slab, const char *name,
+                 size_t obj_size, struct net_md_slab_pool *pool)
+{
+    size_t avail;
+
+    memset(slab, 0, sizeof(*slab));
+    slab->name = name;
+    slab->pool = pool;
+    slab->obj_size = obj_size;
+
+    /* The free list link is stored in the object while it is free */
+    obj_size = MAX(obj_size, sizeof(void *));
+    slab->slot_size = NET_MD_SLAB_ALIGN(NET_MD_SLAB_HDR_SIZE + obj_size);
+
+    avail = NET_MD_SLAB_CHUNK_SIZE - NET_MD_SLAB_CHUNK_HDR_SIZE;
+    slab->chunk_objs = MAX(avail / slab->slot_size, NET_MD_SLAB_MIN_OBJS);
+
+    ds_dlist_init(&slab->partial, struct net_md_slab_chunk, chunk_node);
+    ds_dlist_init(&slab->full, struct net_md_slab_chunk, chunk_node);
+}
+
+
+static size_t
+net_md_slab_chunk_size(struct net_md_slab *slab)
+{
+    return NET_MD_SLAB_CHUNK_HDR_SIZE + slab->chunk_objs * slab->slot_size;
+}
+
+
+static struct net_md_slab_chunk *
+net_md_slab_add_chunk(struct net_md_slab *slab)
+{
+    struct net_md_slab_pool *pool;
+    struct net_md_slab_chunk *chunk;
+    size_t chunk_size;
+    uint8_t *slot;
+    size_t i;
+
+    pool = slab->pool;
+    chunk_size = net_md_slab_chunk_size(slab);
+    if ((pool != NULL) && (pool->mem_cap != 0) &&
+        (pool->mem_used + chunk_size > pool->mem_cap))
+    {
+        pool->cap_hits++;
+        return NULL;
+    }
+
+    chunk = MALLOC(chunk_size);
+    if (chunk == NULL) return NULL;
+
+    chunk->slab = slab;
+    chunk->nused = 0;
+    chunk->free_list = NULL;
+
+    /* Thread the slots in address order */
+    slot = (uint8_t *)chunk + NET_MD_SLAB_CHUNK_HDR_SIZE;
+    slot += (slab->chunk_objs - 1) * slab->slot_size;
+    for (i = 0; i < slab->chunk_objs; i++)
+    {
+        *(struct net_md_slab_chunk **)slot = chunk;
+        *(void **)(slot + NET_MD_SLAB_HDR_SIZE) = chunk->free_list;
+        chunk->free_list = slot + NET_MD_SLAB_HDR_SIZE;
+        slot -= slab->slot_size;
+    }
+
+    ds_dlist_insert_head(&slab->partial, chunk);
+    slab->num_chunks++;
+
+    if (pool != NULL)
+    {
+        pool->mem_used += chunk_size;
+        pool->mem_hwm = MAX(pool->mem_hwm, pool->mem_used);
+    }
+
+    return chunk;
+}
+
+
+static void
+net_md_slab_release_chunk(struct net_md_slab *slab,
+                          struct net_md_slab_chunk *chunk)
+{
+    if (slab->pool != NULL) slab->pool->mem_used -= net_md_slab_chunk_size(slab);
+    slab->num_chunks--;
+    FREE(chunk);
+}
+
+
+void *
+net_md_slab_alloc(struct net_md_slab *slab)
+{
+    struct net_md_slab_chunk *chunk;
+    void *obj;
+
+    if (slab == NULL) return NULL;
+    if (slab->slot_size == 0) return NULL;
+
+    chunk = ds_dlist_head(&slab->partial);
+    if (chunk == NULL) chunk = net_md_slab_add_chunk(slab);
+    if (chunk == NULL)
+    {
+        slab->alloc_failures++;
+        return NULL;
+    }
+
+    obj = chunk->free_list;
+    chunk->free_list = *(void **)obj;
+    chunk->nused++;
+    if (chunk->nused == slab->chunk_objs)
+    {
+        ds_dlist_remove(&slab->partial, chunk);
+        ds_dlist_insert_head(&slab->full, chunk);
+    }
+
+    slab->in_use++;
+    slab->in_use_hwm = MAX(slab->in_use_hwm, slab->in_use);
+
+    memset(obj, 0, slab->obj_size);
+
+    return obj;
+}
+
+
+bool
+net_md_slab_is_full(struct net_md_slab *slab)
+{
+    return ds_dlist_is_empty(&slab->partial);
+}
+
+
+void
+net_md_slab_free(void *obj)
+{
+    struct net_md_slab_chunk *chunk;
+    struct net_md_slab *slab;
+
+    if (obj == NULL) return;
+
+    chunk = *(struct net_md_slab_chunk **)((uint8_t *)obj - NET_MD_SLAB_HDR_SIZE);
+    slab = chunk->slab;
+
+    if (chunk->nused == slab->chunk_objs)
+    {
+        ds_dlist_remove(&slab->full, chunk);
+        ds_dlist_insert_head(&slab->partial, chunk);
+    }
+
+    *(void **)obj = chunk->free_list;
+    chunk->free_list = obj;
+    chunk->nused--;
+    slab->in_use--;
+
+    if (chunk->nused != 0) return;
+
+    /* Keep one empty chunk around to absorb flow churn */
+    if ((ds_dlist_head(&slab->partial) == chunk) &&
+        (ds_dlist_tail(&slab->partial) == chunk))
+    {
+        return;
+    }
+
+    ds_dlist_remove(&slab->partial, chunk);
+    net_md_slab_release_chunk(slab, chunk);
+}
+
+
+void
+net_md_slab_fini(struct net_md_slab *slab)
+{
+    struct net_md_slab_chunk *chunk;
+
+    if (slab == NULL) return;
+
+    if (slab->in_use != 0)
+    {
+        LOGW("%s: slab %s: releasing %zu objects still in use", __func__,
+             slab->name, slab->in_use);
+    }
+
+    while ((chunk = ds_dlist_remove_head(&slab->partial)) != NULL)
+    {
+        net_md_slab_release_chunk(slab, chunk);
+    }
+
+    while ((chunk = ds_dlist_remove_head(&slab->full)) != NULL)
+    {
+        net_md_slab_release_chunk(slab, chunk);
+    }
+
+    slab->in_use = 0;
+}
+
+
+void
+net_md_slab_log_stats(struct net_md_slab *slab)
+{
+    struct net_md_slab_pool *pool;
+
+    if (slab == NULL) return;
+    if (slab->slot_size == 0) return;
+
+    LOGI("%s: slab %s: %zu objects in use (high water mark %zu), "
+         "%zu chunks, %zu failed allocations", __func__, slab->name,
+         slab->in_use, slab->in_use_hwm, slab->num_chunks,
+         slab->alloc_failures);
+
+    pool = slab->pool;
+    if (pool == NULL) return;
+
+    LOGI("%s: slab %s: pool %zu bytes used (high water mark %zu, cap %zu), "
+         "%zu cap hits", __func__, slab->name, pool->mem_used, pool->mem_hwm,
+         pool->mem_cap, pool->cap_hits);
+}
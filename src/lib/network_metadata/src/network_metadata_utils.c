@@ -548,19 +548,23 @@ void free_net_md_flow_key(struct net_md_flow_key *lkey)
 }
 
 
-struct net_md_flow_key * set_net_md_flow_key(struct net_md_flow_key *lkey)
+/**
+ * @brief copies a lookup key into an allocated key
+ *
+ * @param key the key to fill
+ * @param lkey the key to copy
+ * @return true if the copy succeeded, false otherwise
+ */
+static bool
+net_md_fill_flow_key(struct net_md_flow_key *key, struct net_md_flow_key *lkey)
 {
-    struct net_md_flow_key *key;
     bool ret, err;
 
-    key = CALLOC(1, sizeof(*key));
-    if (key == NULL) return NULL;
-
     key->ufid = net_md_set_ufid(lkey->ufid);
 
     key->smac = net_md_set_os_macaddr(lkey->smac);
     err = ((key->smac == NULL) && (lkey->smac != NULL));
-    if (err) goto err_free_key;
+    if (err) goto err_free_ufid;
 
     key->isparent_of_smac = lkey->isparent_of_smac;
 
@@ -591,7 +595,7 @@ struct net_md_flow_key * set_net_md_flow_key(struct net_md_flow_key *lkey)
     key->tx_idx = lkey->tx_idx;
     key->flags = lkey->flags;
 
-    return key;
+    return true;
 
 err_free_src_ip:
     FREE(key->src_ip);
@@ -602,8 +606,27 @@ err_free_dmac:
 err_free_smac:
     FREE(key->smac);
 
-err_free_key:
+err_free_ufid:
     FREE(key->ufid);
+
+    return false;
+}
+
+
+struct net_md_flow_key * set_net_md_flow_key(struct net_md_flow_key *lkey)
+{
+    struct net_md_flow_key *key;
+    bool ret;
+
+    key = CALLOC(1, sizeof(*key));
+    if (key == NULL) return NULL;
+
+    ret = net_md_fill_flow_key(key, lkey);
+    if (!ret) goto err_free_key;
+
+    return key;
+
+err_free_key:
     FREE(key);
 
     return NULL;
@@ -706,10 +729,24 @@ void net_md_free_acc(struct net_md_stats_accumulator *acc)
     if (acc == NULL) return;
     CHECK_DOUBLE_FREE(acc);
 
+    if (acc->flow_hashed && acc->aggr != NULL)
+    {
+        net_md_flow_hash_remove(&acc->aggr->flow_hash, acc);
+    }
+    acc->flow_hashed = false;
+
     net_md_acc_destroy_cb(acc);
 
     free_net_md_flow_key(acc->key);
-    FREE(acc->key);
+    if (acc->from_slab)
+    {
+        net_md_slab_free(acc->key);
+        acc->key = NULL;
+    }
+    else
+    {
+        FREE(acc->key);
+    }
     free_flow_key(acc->fkey);
     FREE(acc->fkey);
     if (acc->free_plugins != NULL) acc->free_plugins(acc);
@@ -724,20 +761,256 @@ void net_md_free_acc(struct net_md_stats_accumulator *acc)
 }
 
 
+/**
+ * @brief checks if an accumulator can be evicted to make room for new flows
+ *
+ * Only accumulators not updated in the current window, not referenced,
+ * not pending a report and idle for NET_MD_EVICT_MIN_IDLE seconds qualify.
+ * Accumulators never updated are left to the ttl based retirement.
+ */
+static bool
+net_md_acc_is_evictable(struct net_md_stats_accumulator *acc, time_t now)
+{
+    if (acc->state == ACC_STATE_WINDOW_ACTIVE) return false;
+    if (acc->report) return false;
+    if (acc->refcnt != 0) return false;
+    if (acc->last_updated == 0) return false;
+
+    return (difftime(now, acc->last_updated) >= NET_MD_EVICT_MIN_IDLE);
+}
+
+
+struct net_md_evict_candidate
+{
+    ds_tree_t *tree;
+    struct net_md_flow *flow;
+    time_t last_updated;
+};
+
+
+static void
+net_md_evict_collect(ds_tree_t *tree, time_t now,
+                     struct net_md_evict_candidate *candidates,
+                     size_t *ncandidates)
+{
+    struct net_md_stats_accumulator *acc;
+    struct net_md_flow *flow;
+    size_t n;
+    size_t i;
+
+    n = *ncandidates;
+    ds_tree_foreach(tree, flow)
+    {
+        acc = flow->tuple_stats;
+        if (!net_md_acc_is_evictable(acc, now)) continue;
+
+        /* Keep the candidates sorted, oldest first */
+        if ((n == NET_MD_EVICT_BATCH) &&
+            (acc->last_updated >= candidates[n - 1].last_updated))
+        {
+            continue;
+        }
+        if (n < NET_MD_EVICT_BATCH) n++;
+
+        i = n - 1;
+        while ((i > 0) && (candidates[i - 1].last_updated > acc->last_updated))
+        {
+            candidates[i] = candidates[i - 1];
+            i--;
+        }
+        candidates[i].tree = tree;
+        candidates[i].flow = flow;
+        candidates[i].last_updated = acc->last_updated;
+    }
+    *ncandidates = n;
+}
+
+
+size_t
+net_md_evict_idle_flows(struct net_md_aggregator *aggr)
+{
+    struct net_md_evict_candidate candidates[NET_MD_EVICT_BATCH];
+    struct net_md_eth_pair *pair;
+    size_t ncandidates;
+    time_t now;
+    size_t i;
+
+    if (aggr == NULL) return 0;
+
+    /* The pending report windows reference the accumulators' flow keys */
+    if (aggr->total_report_flows != 0) return 0;
+
+    now = time(NULL);
+    ncandidates = 0;
+    ds_tree_foreach(&aggr->eth_pairs, pair)
+    {
+        net_md_evict_collect(&pair->ethertype_flows, now,
+                             candidates, &ncandidates);
+        net_md_evict_collect(&pair->five_tuple_flows, now,
+                             candidates, &ncandidates);
+    }
+    net_md_evict_collect(&aggr->five_tuple_flows, now,
+                         candidates, &ncandidates);
+
+    for (i = 0; i < ncandidates; i++)
+    {
+        ds_tree_remove(candidates[i].tree, candidates[i].flow);
+        net_md_free_flow(candidates[i].flow);
+        FREE(candidates[i].flow);
+        aggr->total_flows--;
+    }
+    aggr->evicted_flows += ncandidates;
+
+    if (ncandidates != 0)
+    {
+        LOGD("%s: evicted %zu idle flows, %zu flows left", __func__,
+             ncandidates, aggr->total_flows);
+    }
+
+    return ncandidates;
+}
+
+
+/**
+ * @brief makes room for a new accumulator when close to the memory cap
+ *
+ * Eviction only runs when the accumulator or key slabs need a new chunk,
+ * so its cost is amortized over the slots it frees. The cap headroom is
+ * left to the users' flow contexts.
+ */
+static void
+net_md_acc_reserve(struct net_md_aggregator *aggr)
+{
+    struct net_md_slab_pool *pool;
+    bool need_chunk;
+    size_t limit;
+
+    pool = &aggr->mem_pool;
+    if (pool->mem_cap == 0) return;
+
+    need_chunk = net_md_slab_is_full(&aggr->acc_slab);
+    need_chunk |= net_md_slab_is_full(&aggr->key_slab);
+    if (!need_chunk) return;
+
+    limit = pool->mem_cap - (pool->mem_cap / NET_MD_MEM_CAP_HEADROOM);
+    if (pool->mem_used + NET_MD_SLAB_CHUNK_SIZE <= limit) return;
+
+    net_md_evict_idle_flows(aggr);
+}
+
+
+static struct net_md_stats_accumulator *
+net_md_alloc_acc(struct net_md_aggregator *aggr)
+{
+    struct net_md_stats_accumulator *acc;
+
+    /* Aggregators not set up through net_md_allocate_aggregator() */
+    if (aggr->acc_slab.slot_size == 0) return CALLOC(1, sizeof(*acc));
+
+    net_md_acc_reserve(aggr);
+
+    acc = net_md_slab_alloc(&aggr->acc_slab);
+    if (acc == NULL) return NULL;
+
+    acc->from_slab = true;
+    acc->key = net_md_slab_alloc(&aggr->key_slab);
+    if (acc->key != NULL) return acc;
+
+    net_md_slab_free(acc);
+
+    return NULL;
+}
+
+
+/**
+ * @brief releases an accumulator and its storage
+ *
+ * @param acc the accumulator to release
+ */
+void
+net_md_destroy_acc(struct net_md_stats_accumulator *acc)
+{
+    bool from_slab;
+
+    if (acc == NULL) return;
+
+    from_slab = acc->from_slab;
+    net_md_free_acc(acc);
+    if (from_slab)
+    {
+        net_md_slab_free(acc);
+    }
+    else
+    {
+        FREE(acc);
+    }
+}
+
+
+/**
+ * @brief allocates a zeroed flow context from the aggregator's context slab
+ *
+ * @param aggr the aggregator
+ * @return the context, NULL if the allocation failed or the aggregator
+ *         was not set up with a flow context size
+ */
+void *
+net_md_alloc_flow_ctx(struct net_md_aggregator *aggr)
+{
+    if (aggr == NULL) return NULL;
+
+    return net_md_slab_alloc(&aggr->ctx_slab);
+}
+
+
+/**
+ * @brief releases a flow context allocated by net_md_alloc_flow_ctx()
+ *
+ * @param ctx the context to release
+ */
+void
+net_md_free_flow_ctx(void *ctx)
+{
+    net_md_slab_free(ctx);
+}
+
+
+/**
+ * @brief logs the aggregator's flow memory usage
+ *
+ * @param aggr the aggregator
+ */
+void
+net_md_log_mem_stats(struct net_md_aggregator *aggr)
+{
+    if (aggr == NULL) return;
+
+    net_md_slab_log_stats(&aggr->acc_slab);
+    net_md_slab_log_stats(&aggr->key_slab);
+    net_md_slab_log_stats(&aggr->ctx_slab);
+    LOGI("%s: %zu flows, %zu evicted on memory cap", __func__,
+         aggr->total_flows, aggr->evicted_flows);
+}
+
+
 struct net_md_stats_accumulator *
 net_md_set_acc(struct net_md_aggregator *aggr,
                struct net_md_flow_key *key)
 {
     struct net_md_stats_accumulator *acc;
+    bool ret;
 
     if (key == NULL || aggr == NULL) return NULL;
 
-    acc = CALLOC(1, sizeof(*acc));
+    acc = net_md_alloc_acc(aggr);
     if (acc == NULL) return NULL;
 
-    acc->key = set_net_md_flow_key(key);
+    if (!acc->from_slab) acc->key = CALLOC(1, sizeof(*acc->key));
     if (acc->key == NULL) goto err_free_acc;
 
+    ret = net_md_fill_flow_key(acc->key, key);
+    if (!ret) goto err_free_key;
+
     acc->fkey = net_md_set_flow_key(key);
     if (acc->fkey == NULL) goto err_free_md_flow_key;
     acc->fkey->acc = acc;
@@ -751,6 +1024,14 @@ net_md_set_acc(struct net_md_aggregator *aggr,
 
 err_free_md_flow_key:
     free_net_md_flow_key(acc->key);
+
+err_free_key:
+    if (acc->from_slab)
+    {
+        net_md_slab_free(acc->key);
+        net_md_slab_free(acc);
+        return NULL;
+    }
     FREE(acc->key);
 
 err_free_acc:
@@ -765,8 +1046,8 @@ void net_md_free_flow(struct net_md_flow *flow)
     if (flow == NULL) return;
     CHECK_DOUBLE_FREE(flow);
 
-    net_md_free_acc(flow->tuple_stats);
-    FREE(flow->tuple_stats);
+    net_md_destroy_acc(flow->tuple_stats);
+    flow->tuple_stats = NULL;
 }
 
 
@@ -794,8 +1075,8 @@ void net_md_free_eth_pair(struct net_md_eth_pair *pair)
     if (pair == NULL) return;
     CHECK_DOUBLE_FREE(pair);
 
-    net_md_free_acc(pair->mac_stats);
-    FREE(pair->mac_stats);
+    net_md_destroy_acc(pair->mac_stats);
+    pair->mac_stats = NULL;
     net_md_free_flow_tree(&pair->ethertype_flows);
     net_md_free_flow_tree(&pair->five_tuple_flows);
 }
@@ -982,13 +1263,39 @@ net_md_lookup_acc(struct net_md_aggregator *aggr,
                   struct net_md_flow_key *key)
 {
     struct net_md_stats_accumulator *acc;
+    uint32_t hash;
+    bool hashed;
 
     if (aggr == NULL) return NULL;
 
-    if (has_eth_info(key)) return net_md_lookup_eth_acc(aggr, key);
+    /* 5 tuple flows are first looked up through the flow hash */
+    hash = 0;
+    hashed = net_md_flow_hash_eligible(key);
+    if (hashed)
+    {
+        hash = net_md_flow_hash_key(key);
+        acc = net_md_flow_hash_find(&aggr->flow_hash, key, hash);
+        if (acc != NULL) return acc;
+    }
 
-    acc = net_md_tree_lookup_acc(aggr, &aggr->five_tuple_flows, key);
-    if (acc != NULL) acc->aggr = aggr;
+    if (has_eth_info(key))
+    {
+        acc = net_md_lookup_eth_acc(aggr, key);
+    }
+    else
+    {
+        acc = net_md_tree_lookup_acc(aggr, &aggr->five_tuple_flows, key);
+    }
+    if (acc == NULL) return NULL;
+
+    acc->aggr = aggr;
+
+    /* Index the accumulator. A failure only costs future tree lookups */
+    if (hashed && !acc->flow_hashed)
+    {
+        acc->flow_hash = hash;
+        acc->flow_hashed = net_md_flow_hash_insert(&aggr->flow_hash, acc);
+    }
 
     return acc;
 }
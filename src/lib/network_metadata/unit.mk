@@ -35,6 +35,8 @@ UNIT_TYPE := LIB
 UNIT_SRC := src/network_metadata.c
 UNIT_SRC += src/network_metadata_report.c
 UNIT_SRC += src/network_metadata_utils.c
+UNIT_SRC += src/network_metadata_flow_hash.c
+UNIT_SRC += src/network_metadata_slab.c
 
 UNIT_CFLAGS := -I$(UNIT_PATH)/inc
 UNIT_LDFLAGS := -lprotobuf-c
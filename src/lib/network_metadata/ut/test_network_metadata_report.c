@@ -3372,6 +3372,189 @@ test_net_md_ufid(void)
 }
 
 
+/**
+ * @brief validates the flow hash index of the aggregator
+ *
+ * Creates enough 5 tuple flows to force the hash to grow, with and without
+ * ethernet information, and validates lookups return the tree accumulators.
+ */
+void
+test_flow_hash_lookup(void)
+{
+    struct net_md_stats_accumulator *eth_acc;
+    struct net_md_aggregator_set *aggr_set;
+    struct net_md_stats_accumulator *acc;
+    struct net_md_aggregator *aggr;
+    struct net_md_flow_key key;
+    struct net_md_flow *flow;
+    os_macaddr_t smac = { .addr = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55 } };
+    os_macaddr_t dmac = { .addr = { 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff } };
+    uint8_t src_ip[4] = { 192, 168, 40, 1 };
+    uint8_t dst_ip[4] = { 1, 2, 3, 4 };
+    size_t nflows;
+    size_t hits;
+    size_t i;
+
+    TEST_ASSERT_TRUE(g_nd_test.initialized);
+
+    aggr_set = &g_nd_test.aggr_set;
+    aggr_set->report_type = NET_MD_REPORT_RELATIVE;
+    aggr = net_md_allocate_aggregator(aggr_set);
+    TEST_ASSERT_NOT_NULL(aggr);
+
+    memset(&key, 0, sizeof(key));
+    key.ip_version = 4;
+    key.src_ip = src_ip;
+    key.dst_ip = dst_ip;
+    key.ipprotocol = IPPROTO_TCP;
+    key.dport = htons(443);
+
+    /* Create 5 tuple only flows */
+    nflows = 2 * NET_MD_FLOW_HASH_MIN_BUCKETS * NET_MD_FLOW_HASH_SLOTS;
+    for (i = 0; i < nflows; i++)
+    {
+        key.sport = htons(1024 + i);
+        acc = net_md_lookup_acc(aggr, &key);
+        TEST_ASSERT_NOT_NULL(acc);
+        TEST_ASSERT_TRUE(acc->flow_hashed);
+    }
+    TEST_ASSERT_EQUAL_UINT(nflows, aggr->flow_hash.count);
+    TEST_ASSERT_TRUE(aggr->flow_hash.num_buckets > NET_MD_FLOW_HASH_MIN_BUCKETS);
+
+    /* Lookups now resolve through the hash to the tree accumulators */
+    hits = aggr->flow_hash.hits;
+    for (i = 0; i < nflows; i++)
+    {
+        key.sport = htons(1024 + i);
+        acc = net_md_lookup_acc(aggr, &key);
+        TEST_ASSERT_NOT_NULL(acc);
+        flow = ds_tree_find(&aggr->five_tuple_flows, &key);
+        TEST_ASSERT_NOT_NULL(flow);
+        TEST_ASSERT_EQUAL_PTR(flow->tuple_stats, acc);
+    }
+    TEST_ASSERT_EQUAL_UINT(hits + nflows, aggr->flow_hash.hits);
+
+    /* The same 5 tuple with ethernet information is a different flow */
+    key.sport = htons(1024);
+    acc = net_md_lookup_acc(aggr, &key);
+    key.smac = &smac;
+    key.dmac = &dmac;
+    eth_acc = net_md_lookup_acc(aggr, &key);
+    TEST_ASSERT_NOT_NULL(eth_acc);
+    TEST_ASSERT_TRUE(acc != eth_acc);
+    TEST_ASSERT_EQUAL_PTR(eth_acc, net_md_lookup_acc(aggr, &key));
+    TEST_ASSERT_EQUAL_UINT(nflows + 1, aggr->flow_hash.count);
+
+    /* Ethernet accumulators are not indexed */
+    key.flags = NET_MD_ACC_ETH;
+    acc = net_md_lookup_acc(aggr, &key);
+    TEST_ASSERT_NOT_NULL(acc);
+    TEST_ASSERT_FALSE(acc->flow_hashed);
+    key.flags = 0;
+
+    /* Freed accumulators are removed from the index */
+    net_md_free_flow_tree(&aggr->five_tuple_flows);
+    TEST_ASSERT_EQUAL_UINT(1, aggr->flow_hash.count);
+    key.smac = NULL;
+    key.dmac = NULL;
+    key.flags = NET_MD_ACC_LOOKUP_ONLY;
+    acc = net_md_lookup_acc(aggr, &key);
+    TEST_ASSERT_NULL(acc);
+
+    net_md_free_aggregator(aggr);
+    FREE(aggr);
+}
+
+
+/**
+ * @brief validates the idle flows eviction on memory cap
+ *
+ * Fills the aggregator up to its memory cap, ages the flows and validates
+ * new flows are created by evicting the oldest idle ones.
+ */
+void
+test_flow_mem_cap_eviction(void)
+{
+    struct net_md_aggregator_set *aggr_set;
+    struct net_md_stats_accumulator *acc;
+    struct net_md_aggregator *aggr;
+    struct net_md_flow_key key;
+    struct net_md_flow *flow;
+    uint8_t src_ip[4] = { 192, 168, 40, 1 };
+    uint8_t dst_ip[4] = { 1, 2, 3, 4 };
+    size_t max_flows;
+    size_t nflows;
+    time_t now;
+    size_t i;
+
+    TEST_ASSERT_TRUE(g_nd_test.initialized);
+
+    aggr_set = &g_nd_test.aggr_set;
+    aggr_set->report_type = NET_MD_REPORT_RELATIVE;
+    aggr_set->acc_ttl = INT32_MAX;
+    aggr_set->mem_cap = 8 * NET_MD_SLAB_CHUNK_SIZE;
+    aggr = net_md_allocate_aggregator(aggr_set);
+    aggr_set->mem_cap = 0;
+    TEST_ASSERT_NOT_NULL(aggr);
+
+    memset(&key, 0, sizeof(key));
+    key.ip_version = 4;
+    key.src_ip = src_ip;
+    key.dst_ip = dst_ip;
+    key.ipprotocol = IPPROTO_UDP;
+    key.dport = htons(53);
+
+    /* Fill the aggregator until the cap denies new flows */
+    max_flows = 8 * NET_MD_SLAB_CHUNK_SIZE / sizeof(*acc);
+    for (nflows = 0; nflows < max_flows; nflows++)
+    {
+        key.sport = htons(1024 + nflows);
+        acc = net_md_lookup_acc(aggr, &key);
+        if (acc == NULL) break;
+    }
+    TEST_ASSERT_TRUE(nflows < max_flows);
+    TEST_ASSERT_TRUE(aggr->mem_pool.mem_used <= aggr->mem_pool.mem_cap);
+    TEST_ASSERT_EQUAL_UINT(nflows, aggr->acc_slab.in_use);
+    TEST_ASSERT_EQUAL_UINT(nflows, aggr->acc_slab.in_use_hwm);
+    TEST_ASSERT_EQUAL_UINT(0, aggr->evicted_flows);
+
+    /* Age the flows, the first half being the oldest */
+    now = time(NULL);
+    i = 0;
+    ds_tree_foreach(&aggr->five_tuple_flows, flow)
+    {
+        acc = flow->tuple_stats;
+        acc->state = ACC_STATE_WINDOW_RESET;
+        acc->last_updated = now - 10;
+        if (ntohs(acc->key->sport) < 1024 + nflows / 2) acc->last_updated -= 10;
+        i++;
+    }
+    TEST_ASSERT_EQUAL_UINT(nflows, i);
+
+    /* New flows now evict the oldest idle ones */
+    for (i = 0; i < nflows / 4; i++)
+    {
+        key.sport = htons(1024 + nflows + i);
+        acc = net_md_lookup_acc(aggr, &key);
+        TEST_ASSERT_NOT_NULL(acc);
+    }
+    TEST_ASSERT_TRUE(aggr->evicted_flows > 0);
+    TEST_ASSERT_TRUE(aggr->evicted_flows <= nflows / 2);
+    TEST_ASSERT_TRUE(aggr->mem_pool.mem_used <= aggr->mem_pool.mem_cap);
+    TEST_ASSERT_EQUAL_UINT(aggr->total_flows, aggr->acc_slab.in_use);
+
+    /* The most recent of the aged flows were kept */
+    key.sport = htons(1024 + nflows - 1);
+    key.flags = NET_MD_ACC_LOOKUP_ONLY;
+    acc = net_md_lookup_acc(aggr, &key);
+    TEST_ASSERT_NOT_NULL(acc);
+
+    net_md_free_aggregator(aggr);
+    TEST_ASSERT_EQUAL_UINT(0, aggr->mem_pool.mem_used);
+    FREE(aggr);
+}
+
+
 void
 test_network_metadata_reports(void)
 {
@@ -3407,6 +3590,8 @@ test_network_metadata_reports(void)
     RUN_TEST(test_direction_originator_data_serialize_deserialize);
     RUN_TEST(test_acc_flow_info_report);
     RUN_TEST(test_net_md_ufid);
+    RUN_TEST(test_flow_hash_lookup);
+    RUN_TEST(test_flow_mem_cap_eviction);
 
     UnitySetTestFile(old_filename);
     FREE(filename);
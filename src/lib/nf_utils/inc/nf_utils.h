@@ -141,6 +141,9 @@ typedef struct ctflow_info
     ds_dlist_node_t ct_node;
 } ctflow_info_t;
 
+/* Receives each flow of a streamed dump, returns false to stop */
+typedef bool (*nf_ct_flow_sink_fn)(ct_flow_t *flow, void *ctx);
+
 enum
 {
     CT_MARK_INSPECT = 1,
@@ -166,6 +169,10 @@ struct nf_ct_context
 
     /* for reading conntrack events */
     void (*conntrack_update_cb)(void *data);
+    struct mnl_socket *mnl_ev;
+    struct ev_io wmnl_ev;
+    uint32_t event_overruns;
+    unsigned int flow_events_users;
 
     uint16_t zone_id;
 };
@@ -287,6 +294,13 @@ int nf_ct_set_flow_mark(struct net_header_parser *net_pkt,
 
 bool nf_ct_get_flow_entries(int af_family, ds_dlist_t *g_nf_ct_list, uint16_t zone_id);
 
+bool nf_ct_stream_flow_entries(int af_family, uint16_t zone_id,
+                               nf_ct_flow_sink_fn sink, void *ctx);
+
+uint32_t nf_ct_get_event_overruns(void);
+
+int nf_ct_set_flow_events(bool enable);
+
 void nf_ct_print_entries(ds_dlist_t *g_nf_ct_list);
 
 bool nf_ct_filter_ip(int af, void *ip);
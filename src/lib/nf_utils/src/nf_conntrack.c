@@ -24,6 +24,7 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#define _GNU_SOURCE /* Needed for recvmmsg() */
 #include <errno.h>
 #include <ev.h>
 #include <libmnl/libmnl.h>
@@ -32,6 +33,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <netinet/in.h>
 #include <netinet/ip_icmp.h>
 #include <netdb.h>
+#include <sys/socket.h>
 
 #include "sockaddr_storage.h"
 #include "log.h"
@@ -55,6 +57,24 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #define ZONE_2      (USHRT_MAX -1)
 
+/* Dump replies read per recvmmsg() call and size of each reply buffer */
+#define NF_CT_STREAM_BATCH      (4)
+#define NF_CT_STREAM_BUF_SIZE   (32 * 1024)
+
+/**
+ * State of a streamed conntrack dump
+ */
+struct nf_ct_stream
+{
+    nf_ct_flow_sink_fn sink;
+    void *ctx;
+    size_t records;
+    bool stopped;
+};
+
+/* Reply buffers of streamed dumps, reused across dumps */
+static char nf_ct_stream_bufs[NF_CT_STREAM_BATCH][NF_CT_STREAM_BUF_SIZE];
+
 static struct nf_ct_context
 nfct_context =
 {
@@ -650,6 +670,7 @@ read_mnl_socket_cbk(struct ev_loop *loop, struct ev_io *watcher, int revents)
 {
     char rcv_buf[MNL_SOCKET_BUFFER_SIZE];
     struct nf_ct_context *nf_ct;
+    struct mnl_socket *nl;
     ds_dlist_t nf_ct_list;
     int portid;
     int ret;
@@ -657,6 +678,8 @@ read_mnl_socket_cbk(struct ev_loop *loop, struct ev_io *watcher, int revents)
     nf_ct = nf_ct_get_context();
     if (!nf_ct->initialized) return;
 
+    nl = (watcher == &nf_ct->wmnl_ev) ? nf_ct->mnl_ev : nf_ct->mnl;
+
     /* initialize list to store conntrack update events */
     ds_dlist_init(&nf_ct_list, ctflow_info_t, ct_node);
     if (EV_ERROR & revents)
@@ -665,14 +688,22 @@ read_mnl_socket_cbk(struct ev_loop *loop, struct ev_io *watcher, int revents)
         return;
     }
 
-    ret = mnl_socket_recvfrom(nf_ct->mnl, rcv_buf, sizeof(rcv_buf));
+    ret = mnl_socket_recvfrom(nl, rcv_buf, sizeof(rcv_buf));
     if (ret == -1)
     {
+        /* The kernel dropped events: listeners must resynchronize */
+        if (errno == ENOBUFS && nl == nf_ct->mnl_ev)
+        {
+            nf_ct->event_overruns++;
+            LOGN("%s: conntrack event overrun (%u)", __func__,
+                 nf_ct->event_overruns);
+            return;
+        }
         LOGE("%s: mnl_socket_recvfrom failed: %s", __func__, strerror(errno));
         return;
     }
 
-    portid = mnl_socket_get_portid(nf_ct->mnl);
+    portid = mnl_socket_get_portid(nl);
 
     ret = mnl_cb_run2(rcv_buf, ret, 0, portid, nf_process_ct_cb, &nf_ct_list, cb_ctl_array,
                       MNL_ARRAY_SIZE(cb_ctl_array));
@@ -1309,31 +1340,33 @@ nf_ct_filter_ip(int af, void *ip)
     return false;
 }
 
-int
-nf_process_ct_cb(const struct nlmsghdr *nlh, void *data)
+/**
+ * @brief decodes a conntrack netlink record into its two directions
+ *
+ * @param nlh the netlink record
+ * @param forward_flow zeroed storage for the original direction
+ * @param reverse_flow zeroed storage for the reply direction
+ * @return 0 when decoded, 1 when the record is skipped (filtered out by
+ *         zone or undecodable attribute), -1 when the record is malformed
+ */
+static int
+nf_ct_decode(const struct nlmsghdr *nlh, ct_flow_t *forward_flow,
+             ct_flow_t *reverse_flow)
 {
-    ctflow_info_t *forward_entry;
-    ctflow_info_t *reverse_entry;
     struct nf_ct_context *nf_ct;
     struct nlattr *tb[CTA_MAX+1];
-    ct_flow_t *forward_flow;
-    ct_flow_t *reverse_flow;
-    ds_dlist_t *nf_ct_list;
     struct nfgenmsg *nfg;
     uint16_t ct_zone;
     int rc;
     int af;
 
     nf_ct = nf_ct_get_context();
-    if (!nf_ct->initialized) return MNL_CB_ERROR;
-
-    nf_ct_list = (ds_dlist_t *)data;
 
     memset(tb, 0, (CTA_MAX+1) * sizeof(tb[0]));
     nfg = mnl_nlmsg_get_payload(nlh);
 
     rc = mnl_attr_parse(nlh, sizeof(*nfg), data_attr_cb, tb);
-    if (rc < 0) return MNL_CB_ERROR;
+    if (rc < 0) return -1;
 
     ct_zone = 0; /* Zone = 0 flows will not have CTA_ZONE */
     if (tb[CTA_ZONE] != NULL)
@@ -1342,37 +1375,30 @@ nf_process_ct_cb(const struct nlmsghdr *nlh, void *data)
     }
 
     if (nf_ct->zone_id != USHRT_MAX && (nf_ct->zone_id != ZONE_2) &&
-        nf_ct->zone_id != ct_zone) return MNL_CB_OK;
-
-
-    forward_entry = CALLOC(1, sizeof(struct ctflow_info));
-    forward_flow =  &forward_entry->flow;
-
-    reverse_entry = CALLOC(1, sizeof(struct ctflow_info));
-    reverse_flow =  &reverse_entry->flow;
+        nf_ct->zone_id != ct_zone) return 1;
 
     if (tb[CTA_TUPLE_ORIG])
     {
         rc = get_tuple(tb[CTA_TUPLE_ORIG], forward_flow);
-        if (rc < 0) goto error;
+        if (rc < 0) return 1;
     }
 
     if (tb[CTA_TUPLE_REPLY])
     {
         rc = get_tuple(tb[CTA_TUPLE_REPLY], reverse_flow);
-        if (rc < 0) goto error;
+        if (rc < 0) return 1;
     }
 
     if (tb[CTA_COUNTERS_ORIG])
     {
         rc =  get_counter(tb[CTA_COUNTERS_ORIG], forward_flow);
-        if (rc < 0) goto error;
+        if (rc < 0) return 1;
     }
 
     if (tb[CTA_COUNTERS_REPLY])
     {
         rc =  get_counter(tb[CTA_COUNTERS_REPLY], reverse_flow);
-        if (rc < 0) goto error;
+        if (rc < 0) return 1;
     }
 
     af = forward_flow->layer3_info.src_ip.ss_family;
@@ -1387,7 +1413,7 @@ nf_process_ct_cb(const struct nlmsghdr *nlh, void *data)
     if (tb[CTA_PROTOINFO] && forward_flow->layer3_info.proto_type != 17)
     {
         rc = get_protoinfo(tb[CTA_PROTOINFO], forward_flow);
-        if (rc < 0) goto error;
+        if (rc < 0) return 1;
     }
 
     if (tb[CTA_MARK] != NULL)
@@ -1396,18 +1422,47 @@ nf_process_ct_cb(const struct nlmsghdr *nlh, void *data)
         reverse_flow->ct_mark = forward_flow->ct_mark;
     }
 
+    /* A destroy event carries the final counters of the connection */
+    if (NFNL_MSG_TYPE(nlh->nlmsg_type) == IPCTNL_MSG_CT_DELETE)
+    {
+        forward_flow->end = true;
+        reverse_flow->end = true;
+    }
 
+    forward_flow->ct_zone = ct_zone;
+    reverse_flow->ct_zone = ct_zone;
+
+    return 0;
+}
+
+int
+nf_process_ct_cb(const struct nlmsghdr *nlh, void *data)
+{
+    ctflow_info_t *forward_entry;
+    ctflow_info_t *reverse_entry;
+    struct nf_ct_context *nf_ct;
+    ds_dlist_t *nf_ct_list;
+    int rc;
+
+    nf_ct = nf_ct_get_context();
+    if (!nf_ct->initialized) return MNL_CB_ERROR;
+
+    nf_ct_list = (ds_dlist_t *)data;
+
+    forward_entry = CALLOC(1, sizeof(struct ctflow_info));
+    reverse_entry = CALLOC(1, sizeof(struct ctflow_info));
+
+    /* Records filtered out by zone are dropped as well */
+    rc = nf_ct_decode(nlh, &forward_entry->flow, &reverse_entry->flow);
+    if (rc != 0) goto error;
 
     if ((nf_ct->zone_id == USHRT_MAX) ||
         (nf_ct->zone_id == ZONE_2))
     {
-        flow_merge_multi_zonestats(forward_entry, ct_zone);
-        flow_merge_multi_zonestats(reverse_entry, ct_zone);
+        flow_merge_multi_zonestats(forward_entry, forward_entry->flow.ct_zone);
+        flow_merge_multi_zonestats(reverse_entry, reverse_entry->flow.ct_zone);
     }
 
-    forward_flow->ct_zone = ct_zone;
-    reverse_flow->ct_zone = ct_zone;
-
     ds_dlist_insert_tail(nf_ct_list, forward_entry);
     ds_dlist_insert_tail(nf_ct_list, reverse_entry);
 
@@ -1417,9 +1472,112 @@ error:
     FREE(forward_entry);
     FREE(reverse_entry);
 
+    return (rc < 0) ? MNL_CB_ERROR : MNL_CB_OK;
+}
+
+/**
+ * @brief hands the decoded directions of a record to the stream sink
+ *
+ * The flows live on the stack for the duration of the sink call only.
+ * Once the sink asked to stop, the remaining records of the dump are
+ * still consumed so that the socket is left clean.
+ */
+static int
+nf_stream_ct_cb(const struct nlmsghdr *nlh, void *data)
+{
+    struct nf_ct_stream *stream;
+    ct_flow_t forward_flow;
+    ct_flow_t reverse_flow;
+    int rc;
+
+    stream = (struct nf_ct_stream *)data;
+    if (stream->stopped) return MNL_CB_OK;
+
+    memset(&forward_flow, 0, sizeof(forward_flow));
+    memset(&reverse_flow, 0, sizeof(reverse_flow));
+
+    rc = nf_ct_decode(nlh, &forward_flow, &reverse_flow);
+    if (rc < 0) return MNL_CB_ERROR;
+    if (rc > 0) return MNL_CB_OK;
+
+    stream->records++;
+    if (!stream->sink(&forward_flow, stream->ctx) ||
+        !stream->sink(&reverse_flow, stream->ctx))
+    {
+        stream->stopped = true;
+    }
+
     return MNL_CB_OK;
 }
 
+/**
+ * @brief reads the replies of a dump in batches and streams them
+ *
+ * Up to NF_CT_STREAM_BATCH replies are pulled per system call, each one
+ * parsed in place from its reply buffer.
+ *
+ * @param seq the sequence number of the dump request
+ * @param stream the stream state
+ * @return 0 when the dump completed, -1 otherwise
+ */
+static int
+nf_ct_recv_stream(uint32_t seq, struct nf_ct_stream *stream)
+{
+    struct mmsghdr msgs[NF_CT_STREAM_BATCH];
+    struct iovec iovs[NF_CT_STREAM_BATCH];
+    struct nf_ct_context *nf_ct;
+    unsigned int portid;
+    int ret;
+    int fd;
+    int n;
+    int i;
+
+    nf_ct = nf_ct_get_context();
+    portid = mnl_socket_get_portid(nf_ct->mnl);
+    fd = mnl_socket_get_fd(nf_ct->mnl);
+
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < NF_CT_STREAM_BATCH; i++)
+    {
+        iovs[i].iov_base = nf_ct_stream_bufs[i];
+        iovs[i].iov_len = sizeof(nf_ct_stream_bufs[i]);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    ret = MNL_CB_OK;
+    while (ret > MNL_CB_STOP)
+    {
+        /* Block for the first reply, then take whatever is queued */
+        n = recvmmsg(fd, msgs, NF_CT_STREAM_BATCH, MSG_WAITFORONE, NULL);
+        if (n <= 0)
+        {
+            if (n < 0 && errno == EINTR) continue;
+            LOGE("%s: recvmmsg failed: %s", __func__, strerror(errno));
+            return -1;
+        }
+
+        for (i = 0; i < n && ret > MNL_CB_STOP; i++)
+        {
+            if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+            {
+                LOGE("%s: truncated dump reply", __func__);
+                return -1;
+            }
+
+            ret = mnl_cb_run(nf_ct_stream_bufs[i], msgs[i].msg_len, seq, portid,
+                             nf_stream_ct_cb, stream);
+            if (ret == -1)
+            {
+                LOGE("%s: mnl_cb_run failed: %s", __func__, strerror(errno));
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
 int
 nf_ct_set_mark(nf_flow_t *flow)
 {
@@ -1652,9 +1810,77 @@ nf_ct_get_flow_entries(int af_family, ds_dlist_t *nf_ct_list, uint16_t zone_id)
     return true;
 }
 
+/**
+ * @brief dumps the conntrack table, streaming each flow to a sink
+ *
+ * Unlike nf_ct_get_flow_entries(), no flow is allocated: each direction of
+ * a record is decoded on the stack and handed to the sink, so memory use
+ * does not depend on the table size. The flow pointer is only valid during
+ * the sink call. The sink returns false to ignore the rest of the dump.
+ * Merging flows across zones needs the whole table and falls back to a
+ * dump into a temporary list.
+ *
+ * @param af_family the address family to dump
+ * @param zone_id the conntrack zone to report
+ * @param sink the per flow callback
+ * @param ctx the opaque sink context
+ * @return true if the dump completed, false otherwise
+ */
+bool
+nf_ct_stream_flow_entries(int af_family, uint16_t zone_id,
+                          nf_ct_flow_sink_fn sink, void *ctx)
+{
+    char buf[MNL_SOCKET_BUFFER_SIZE];
+    struct nf_ct_context *nf_ct;
+    struct nf_ct_stream stream;
+    ctflow_info_t *flow_info;
+    ds_dlist_t nf_ct_list;
+    struct nlmsghdr *nlh;
+    bool rc;
+    int ret;
+
+    nf_ct = nf_ct_get_context();
+    if (!nf_ct->initialized) return false;
+    if (sink == NULL) return false;
+
+    if (zone_id == USHRT_MAX || zone_id == ZONE_2)
+    {
+        ds_dlist_init(&nf_ct_list, ctflow_info_t, ct_node);
+        rc = nf_ct_get_flow_entries(af_family, &nf_ct_list, zone_id);
+        ds_dlist_foreach(&nf_ct_list, flow_info)
+        {
+            if (!rc) break;
+            if (!sink(&flow_info->flow, ctx)) break;
+        }
+        nf_free_ct_flow_list(&nf_ct_list);
+        return rc;
+    }
+
+    nlh = nf_ct_build_msg_hdr(buf, (NFNL_SUBSYS_CTNETLINK << 8) | IPCTNL_MSG_CT_GET,
+                                     NLM_F_REQUEST | NLM_F_DUMP, af_family);
+
+    ret = mnl_socket_sendto(nf_ct->mnl, nlh, nlh->nlmsg_len);
+    if (ret == -1)
+    {
+        LOGE("%s: mnl_socket_sendto", __func__);
+        return false;
+    }
+
+    memset(&stream, 0, sizeof(stream));
+    stream.sink = sink;
+    stream.ctx = ctx;
+
+    nf_ct->zone_id = zone_id;
+    ret = nf_ct_recv_stream(nlh->nlmsg_seq, &stream);
+    LOGT("%s: streamed %zu records", __func__, stream.records);
+
+    return (ret == 0);
+}
+
 int
 nf_ct_init(struct ev_loop *loop, void (*callback)(void *data))
 {
+    struct mnl_socket *nl_ev = NULL;
     struct mnl_socket *nl = NULL;
     struct nf_ct_context *nf_ct;
     unsigned int group;
@@ -1669,31 +1895,133 @@ nf_ct_init(struct ev_loop *loop, void (*callback)(void *data))
         return -1;
     }
 
-    /* register for update event only if the callback is provided */
-    group = (callback == NULL) ? 0 : NF_NETLINK_CONNTRACK_UPDATE;
-    if (mnl_socket_bind(nl, group, MNL_SOCKET_AUTOPID) < 0)
+    if (mnl_socket_bind(nl, 0, MNL_SOCKET_AUTOPID) < 0)
     {
         LOGE("%s: mnl_socket_bind", __func__);
         goto err;
     }
 
+    /*
+     * Conntrack events get their own socket so that they never interleave
+     * with the replies of a table dump. Only needed if a callback is set.
+     * Only update events are reported by default, new and destroy events
+     * are added by nf_ct_set_flow_events().
+     */
+    if (callback != NULL)
+    {
+        nl_ev = mnl_socket_open(NETLINK_NETFILTER);
+        if (nl_ev == NULL)
+        {
+            LOGE("%s: mnl_socket_open", __func__);
+            goto err;
+        }
+
+        group = NF_NETLINK_CONNTRACK_UPDATE;
+        if (mnl_socket_bind(nl_ev, group, MNL_SOCKET_AUTOPID) < 0)
+        {
+            LOGE("%s: mnl_socket_bind events", __func__);
+            goto err;
+        }
+    }
+
     nf_ct->mnl = nl;
+    nf_ct->mnl_ev = nl_ev;
     nf_ct->loop = loop;
     nf_ct->conntrack_update_cb = callback;
+    nf_ct->event_overruns = 0;
+    nf_ct->flow_events_users = 0;
     nf_ct->fd = mnl_socket_get_fd(nl);
     os_ev_trace_map(read_mnl_socket_cbk, "read_mnl_socket_cbk");
     ev_io_init(&nf_ct->wmnl, read_mnl_socket_cbk, nf_ct->fd, EV_READ);
     nf_ct_set_sockbuf_size(nf_ct->fd);
     ev_io_start(loop, &nf_ct->wmnl);
+
+    if (nl_ev != NULL)
+    {
+        ev_io_init(&nf_ct->wmnl_ev, read_mnl_socket_cbk,
+                   mnl_socket_get_fd(nl_ev), EV_READ);
+        nf_ct_set_sockbuf_size(mnl_socket_get_fd(nl_ev));
+        ev_io_start(loop, &nf_ct->wmnl_ev);
+    }
+
     nf_ct->initialized = true;
     LOGD("%s: nf_ct initialized", __func__);
     return 0;
 
 err:
+    if (nl_ev != NULL) mnl_socket_close(nl_ev);
     mnl_socket_close(nl);
     return -1;
 }
 
+uint32_t
+nf_ct_get_event_overruns(void)
+{
+    struct nf_ct_context *nf_ct;
+
+    nf_ct = nf_ct_get_context();
+    return nf_ct->event_overruns;
+}
+
+/**
+ * @brief joins or leaves a conntrack event group on the event socket
+ */
+static int
+nf_ct_set_event_group(struct mnl_socket *nl, int group, bool join)
+{
+    int opt;
+    int rc;
+
+    opt = join ? NETLINK_ADD_MEMBERSHIP : NETLINK_DROP_MEMBERSHIP;
+    rc = mnl_socket_setsockopt(nl, opt, &group, sizeof(group));
+    if (rc < 0)
+    {
+        LOGE("%s: group %d: %s", __func__, group, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief adds or removes new and destroy events to the reported events
+ *
+ * Requests are counted: the events are reported as long as one user
+ * enabled them.
+ *
+ * @param enable true to request the events, false to release a request
+ * @return 0 on success, -1 if there is no event socket or on error
+ */
+int
+nf_ct_set_flow_events(bool enable)
+{
+    struct nf_ct_context *nf_ct;
+    int rc;
+
+    nf_ct = nf_ct_get_context();
+    if (nf_ct->mnl_ev == NULL) return -1;
+
+    if (enable && nf_ct->flow_events_users++ > 0) return 0;
+    if (!enable)
+    {
+        if (nf_ct->flow_events_users == 0) return -1;
+        if (--nf_ct->flow_events_users > 0) return 0;
+    }
+
+    rc = nf_ct_set_event_group(nf_ct->mnl_ev, NFNLGRP_CONNTRACK_NEW, enable);
+    rc |= nf_ct_set_event_group(nf_ct->mnl_ev, NFNLGRP_CONNTRACK_DESTROY, enable);
+    if (rc != 0 && enable)
+    {
+        nf_ct_set_event_group(nf_ct->mnl_ev, NFNLGRP_CONNTRACK_NEW, false);
+        nf_ct->flow_events_users--;
+        return -1;
+    }
+
+    LOGD("%s: new and destroy events %s", __func__,
+         enable ? "enabled" : "disabled");
+    return (rc != 0) ? -1 : 0;
+}
+
 int
 nf_ct_exit(void)
 {
@@ -1713,6 +2041,16 @@ nf_ct_exit(void)
         nf_ct->mnl = NULL;
     }
 
+    if (nf_ct->mnl_ev != NULL)
+    {
+        if (ev_is_active(&nf_ct->wmnl_ev))
+        {
+            ev_io_stop(nf_ct->loop, &nf_ct->wmnl_ev);
+        }
+        mnl_socket_close(nf_ct->mnl_ev);
+        nf_ct->mnl_ev = NULL;
+    }
+
     nf_ct->initialized = false;
     return 0;
 }
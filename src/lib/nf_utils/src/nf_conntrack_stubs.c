@@ -75,6 +75,27 @@ nf_ct_get_flow_entries(int af_family, ds_dlist_t *g_nf_ct_list, uint16_t zone_id
     return 0;
 }
 
+bool
+nf_ct_stream_flow_entries(int af_family, uint16_t zone_id,
+                          nf_ct_flow_sink_fn sink, void *ctx)
+{
+    return 0;
+}
+
+
+uint32_t
+nf_ct_get_event_overruns(void)
+{
+    return 0;
+}
+
+
+int
+nf_ct_set_flow_events(bool enable)
+{
+    return 0;
+}
+
 
 void
 nf_ct_print_entries(ds_dlist_t *g_nf_ct_list) {}
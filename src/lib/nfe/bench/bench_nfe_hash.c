@@ -0,0 +1,236 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Packet hashing benchmark
+ *
+ * Reports packets/sec of nfe_packet_hash() with the jhash and the CRC32C
+ * tuple hash. Packets are read from the pcap files given on the command
+ * line, or generated when none are given:
+ *
+ *     bench_nfe_hash [-n rounds] [file.pcap ...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nfe.h"
+#include "nfe_flow.h"
+
+#define PCAP_MAGIC          0xa1b2c3d4
+#define PCAP_MAGIC_NSEC     0xa1b23c4d
+#define PCAP_LINKTYPE_ETH   1
+#define BENCH_SYNTH_PACKETS 65536
+#define BENCH_SNAPLEN       128
+
+struct bench_pkt {
+    uint8_t *data;
+    size_t len;
+};
+
+struct bench_corpus {
+    struct bench_pkt *pkts;
+    size_t count;
+    size_t alloc;
+};
+
+static int
+corpus_add(struct bench_corpus *c, const uint8_t *data, size_t len)
+{
+    struct bench_pkt *pkts;
+
+    if (c->count == c->alloc) {
+        c->alloc = c->alloc ? c->alloc * 2 : 1024;
+        pkts = realloc(c->pkts, c->alloc * sizeof(*pkts));
+        if (pkts == NULL) return -1;
+        c->pkts = pkts;
+    }
+
+    c->pkts[c->count].data = malloc(len);
+    if (c->pkts[c->count].data == NULL) return -1;
+    memcpy(c->pkts[c->count].data, data, len);
+    c->pkts[c->count].len = len;
+    c->count++;
+    return 0;
+}
+
+/* Only native byte order ethernet captures are supported */
+static int
+corpus_load_pcap(struct bench_corpus *c, const char *path)
+{
+    uint32_t ghdr[6], rhdr[4];
+    uint8_t buf[65536];
+    FILE *f;
+    int rc = -1;
+
+    f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    if (fread(ghdr, sizeof(ghdr), 1, f) != 1) goto out;
+    if (ghdr[0] != PCAP_MAGIC && ghdr[0] != PCAP_MAGIC_NSEC) goto out;
+    if (ghdr[5] != PCAP_LINKTYPE_ETH) goto out;
+
+    while (fread(rhdr, sizeof(rhdr), 1, f) == 1) {
+        if (rhdr[2] > sizeof(buf)) goto out;
+        if (fread(buf, rhdr[2], 1, f) != 1) goto out;
+        if (corpus_add(c, buf, rhdr[2]) != 0) goto out;
+    }
+    rc = 0;
+
+out:
+    if (rc != 0) fprintf(stderr, "%s: not a supported pcap file\n", path);
+    fclose(f);
+    return rc;
+}
+
+/* IPv4 TCP/UDP frames spread over a few thousand flows, both directions */
+static int
+corpus_synthesize(struct bench_corpus *c)
+{
+    uint8_t frame[14 + 20 + 20];
+    uint32_t flow, src, dst;
+    size_t i, len;
+    uint8_t *ip, *l4;
+
+    srand(1);
+    for (i = 0; i < BENCH_SYNTH_PACKETS; i++) {
+        memset(frame, 0, sizeof(frame));
+        flow = rand() % 4096;
+        src = htonl(0xc0a80000 | (flow & 0xff));
+        dst = htonl(0x08080000 | flow);
+
+        frame[12] = 0x08;
+        ip = frame + 14;
+        l4 = ip + 20;
+        ip[0] = 0x45;
+        ip[8] = 64;
+        ip[9] = (flow & 1) ? 17 : 6;
+        len = 20 + ((ip[9] == 6) ? 20 : 8);
+        ip[2] = len >> 8;
+        ip[3] = len & 0xff;
+
+        if (i & 1) {
+            memcpy(ip + 12, &dst, 4);
+            memcpy(ip + 16, &src, 4);
+            l4[0] = 0x01; l4[1] = 0xbb;
+            l4[2] = 0x80; l4[3] = flow & 0xff;
+        } else {
+            memcpy(ip + 12, &src, 4);
+            memcpy(ip + 16, &dst, 4);
+            l4[0] = 0x80; l4[1] = flow & 0xff;
+            l4[2] = 0x01; l4[3] = 0xbb;
+        }
+        if (ip[9] == 6) {
+            l4[12] = 0x50;
+            l4[13] = 0x10;
+        } else {
+            l4[5] = 8;
+        }
+
+        if (corpus_add(c, frame, 14 + len) != 0) return -1;
+    }
+    return 0;
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+bench_run(struct bench_corpus *c, const char *name, bool accel, int rounds)
+{
+    struct nfe_packet packet;
+    uint32_t sum = 0;
+    size_t i, hashed = 0;
+    double start, elapsed;
+    int r;
+
+    nfe_tuple_hash_init(accel);
+
+    start = now();
+    for (r = 0; r < rounds; r++) {
+        for (i = 0; i < c->count; i++) {
+            if (nfe_packet_hash(&packet, 0, c->pkts[i].data, c->pkts[i].len, 0) == 0) {
+                sum += packet.hash;
+                hashed++;
+            }
+        }
+    }
+    elapsed = now() - start;
+
+    printf("%-8s %12.0f packets/sec (%zu hashed, checksum %08x)\n",
+           name, (c->count * rounds) / elapsed, hashed, sum);
+}
+
+int
+main(int argc, char **argv)
+{
+    struct bench_corpus corpus;
+    int rounds = 100;
+    size_t i;
+    int opt;
+
+    memset(&corpus, 0, sizeof(corpus));
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+            case 'n':
+                rounds = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n rounds] [file.pcap ...]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (rounds <= 0) rounds = 1;
+
+    for (i = optind; i < (size_t)argc; i++) {
+        if (corpus_load_pcap(&corpus, argv[i]) != 0) return 1;
+    }
+    if (corpus.count == 0 && corpus_synthesize(&corpus) != 0) return 1;
+
+    printf("%zu packets x %d rounds\n", corpus.count, rounds);
+    bench_run(&corpus, "jhash", false, rounds);
+    if (nfe_tuple_hash_crc32c_supported()) {
+        bench_run(&corpus, "crc32c", true, rounds);
+    } else {
+        printf("crc32c   not supported on this cpu\n");
+    }
+
+    for (i = 0; i < corpus.count; i++) free(corpus.pkts[i].data);
+    free(corpus.pkts);
+    return 0;
+}
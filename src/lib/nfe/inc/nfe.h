@@ -37,6 +37,8 @@ extern "C" {
  *
  * Create a conntrack for use by a thread, where @param size is the number of
  * hash buckets to use, increased to the next power of 2 when necessary. 
+ * The table grows and shrinks with the number of tracked connections, so
+ * @param size is only the initial size.
  *
  * This operation will allocate memory through nfe_ext_alloc().
  * 
@@ -59,6 +61,50 @@ int nfe_conntrack_create(nfe_conntrack_t *conntrack, uint32_t size);
  */
 int nfe_conntrack_destroy(nfe_conntrack_t conntrack);
 
+/* nfe_conntrack_expire()
+ *
+ * Remove every connection that has been idle for longer than the timeout
+ * of its protocol state, where @param timestamp is the current time in
+ * milliseconds. Lookups already expire connections of the protocol being
+ * looked up; this lets an integration reclaim idle connections when no
+ * traffic arrives.
+ *
+ * The cost is proportional to the number of connections expired.
+ *
+ * This operation may deallocate memory through nfe_ext_conn_free().
+ *
+ * Returns the number of connections expired or a negative error code.
+ */
+int nfe_conntrack_expire(nfe_conntrack_t conntrack, uint64_t timestamp);
+
+/* nfe_conntrack_set_expire_cb()
+ *
+ * Register @param cb to be called with @param ctx for every connection
+ * removed from the conntrack because it timed out, before the conntrack
+ * drops its reference. A NULL @param cb disables the notification.
+ *
+ * The connection is no longer reachable through lookups when @param cb
+ * is called, so an integration can release its per-connection state right
+ * away. The nfe_conn_t stays valid until the last nfe_conn_release().
+ *
+ * Returns 0 on success or -EINVAL if @param conntrack is NULL.
+ */
+int nfe_conntrack_set_expire_cb(nfe_conntrack_t conntrack, nfe_conn_expire_fn cb, void *ctx);
+
+/* nfe_conntrack_stats()
+ *
+ * Fill @param stats with the current size and occupancy of the conntrack
+ * hash table, including a histogram of bucket chain lengths.
+ *
+ * This walks every bucket, so it is meant for periodic diagnostics rather
+ * than the packet path.
+ *
+ * This operation will not allocate memory.
+ *
+ * Returns 0 on success or -EINVAL if either argument is NULL.
+ */
+int nfe_conntrack_stats(nfe_conntrack_t conntrack, struct nfe_conntrack_stats *stats);
+
 /* nfe_packet_hash()
  *
  * Compute the hash for @param packet and fills the ntuple header. The
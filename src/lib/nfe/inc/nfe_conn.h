@@ -32,6 +32,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "nfe_tcp.h"
 #include "nfe_udp.h"
 
+struct nfe_conntrack;
+struct nfe_packet;
+
 enum {
     NEXT_BYPASS_ICMP = 1,
     NEXT_LOOKUP_ICMP = 2,
@@ -43,8 +46,10 @@ enum {
 struct nfe_conn {
 
     struct nfe_tuple tuple;
+    uint32_t hash;
     struct nfe_list_head list;
     struct nfe_list_head lru;
+    struct nfe_conntrack *ct;
 
     union {
         struct nfe_tcp tcp;
@@ -56,8 +61,6 @@ struct nfe_conn {
     uint64_t timestamp;
 };
 
-struct nfe_conntrack;
-struct nfe_packet;
 
 struct nfe_conn *nfe_conn_lookup_next(struct nfe_conntrack *ct, struct nfe_packet *packet);
 
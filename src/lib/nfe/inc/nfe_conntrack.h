@@ -41,10 +41,19 @@ enum {
     LRU_PROTO_TCP_SYN = 1,
     LRU_PROTO_TCP_EST = 2,
     LRU_PROTO_UDP     = 3,
+    LRU_PROTO_TCP_FIN = 4,
 
     LRU_PROTO_MAX
 };
 
+/* Expiry queue
+ *
+ * Every connection in a queue shares the same idle timeout and is moved to
+ * the tail whenever it is touched, so the queue stays ordered by deadline:
+ * insertion is O(1) and expiring walks only the connections that are due.
+ * A connection changes queue when its timeout class changes, e.g. when a
+ * tcp connection starts closing.
+ */
 struct nfe_hash_lru {
     uint64_t expiry;
     struct nfe_list_head list;
@@ -54,19 +63,52 @@ struct nfe_hash_bucket {
     struct nfe_list_head list;
 };
 
+/* Hash table sizing
+ *
+ * The bucket array grows to twice its size once the table holds more
+ * connections than buckets, and shrinks back (never below
+ * NFE_CONNTRACK_MIN_SIZE) when connections expire and leave it less than
+ * 1/8 full. A resize does not move every entry at once: the previous array
+ * is kept in @old and NFE_CONNTRACK_REHASH_STEP of its buckets are migrated
+ * on each lookup, so the cost is spread over the packets that follow. If
+ * the table fills up again before a shrink has drained, the shrink is
+ * reversed and the entries already moved are migrated back to the larger
+ * array.
+ */
+#define NFE_CONNTRACK_MIN_SIZE     64
+#define NFE_CONNTRACK_REHASH_STEP  16
+#define NFE_CONNTRACK_SHRINK_DIV   8
+
 struct nfe_conntrack {
-    int size;
+    uint32_t size;
+    uint32_t min_size;
+    uint32_t count;
+    uint32_t resizes;
+    struct nfe_hash_bucket *bucket;
+
+    /* previous bucket array while a resize is in progress */
+    struct nfe_hash_bucket *old;
+    uint32_t old_size;
+    uint32_t rehash;
+
     struct nfe_hash_lru lru[LRU_PROTO_MAX];
-    struct nfe_hash_bucket bucket[0];
+
+    nfe_conn_expire_fn expire_cb;
+    void *expire_ctx;
 };
 
+int nfe_conntrack_table_init(struct nfe_conntrack *conntrack, uint32_t size);
+void nfe_conntrack_table_fini(struct nfe_conntrack *conntrack);
+void nfe_conntrack_table_stats(struct nfe_conntrack *conntrack,
+    struct nfe_conntrack_stats *stats);
+
 struct nfe_conn *nfe_conntrack_lookup_hash(struct nfe_conntrack *conntrack, 
     const struct nfe_tuple *tuple, uint32_t hash);
 
 struct nfe_conn *nfe_conntrack_lookup(struct nfe_conntrack *conntrack,
     struct nfe_packet *packet, int alloc_policy);
 
-void nfe_conntrack_lru_expire(struct nfe_conntrack *conntrack, int lru, uint64_t timestamp);
+unsigned nfe_conntrack_lru_expire(struct nfe_conntrack *conntrack, int lru, uint64_t timestamp);
 void nfe_conntrack_lru_update(struct nfe_conntrack *conntrack, int lru, struct nfe_list_head *item);
 
 #endif
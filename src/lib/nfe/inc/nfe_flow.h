@@ -49,4 +49,22 @@ nfe_tuple_equal(const struct nfe_tuple *lhs, const struct nfe_tuple *rhs)
 struct nfe_tuple *nfe_tuple_copy(struct nfe_tuple *dst, const struct nfe_tuple *src, bool invert);
 uint32_t nfe_tuple_hash(const struct nfe_tuple *dst);
 
+/* Tuple hash implementations. nfe_tuple_hash() uses the CRC32C one when
+ * nfe_hash_accel is set and the cpu supports it, and jhash otherwise.
+ * Both are symmetric, but they produce different values, so the choice
+ * made by nfe_tuple_hash_init() is fixed for the lifetime of a conntrack.
+ * The CRC32C one only exists where NFE_HAVE_CRC32C is defined.
+ */
+#if (defined(__x86_64__) && !defined(KERNEL)) || \
+    (defined(__aarch64__) && defined(__ARM_FEATURE_CRC32))
+#define NFE_HAVE_CRC32C
+#endif
+
+uint32_t nfe_tuple_hash_jhash(const struct nfe_tuple *tuple);
+#ifdef NFE_HAVE_CRC32C
+uint32_t nfe_tuple_hash_crc32c(const struct nfe_tuple *tuple);
+#endif
+bool nfe_tuple_hash_crc32c_supported(void);
+void nfe_tuple_hash_init(bool accel);
+
 #endif
@@ -75,4 +75,9 @@ struct nfe_packet;
 int nfe_proto_tcp(struct nfe_packet *);
 struct nfe_conn *nfe_tcp_lookup(struct nfe_conntrack *conntrack, struct nfe_packet *packet);
 
+/* Returns the expiry queue for @param tcp given its state, @param lru
+ * when the connection is not closing.
+ */
+int nfe_tcp_lru(const struct nfe_tcp *tcp, int lru);
+
 #endif
@@ -40,6 +40,28 @@ typedef struct nfe_conntrack *nfe_conntrack_t;
 /* connection handle */
 typedef struct nfe_conn *nfe_conn_t;
 
+/* nfe_conntrack_stats
+ *
+ * @size is the number of hash buckets currently in use
+ * @count is the number of connections in the table
+ * @resizes is the number of completed table resizes
+ * @rehash is the number of buckets still to be migrated by a resize in
+ *   progress, 0 when the table is not being resized
+ * @max_chain is the length of the longest bucket chain
+ * @chain[n] is the number of buckets holding n connections; the last slot
+ *   counts every bucket with NFE_CONNTRACK_CHAIN_HIST - 1 or more
+ */
+#define NFE_CONNTRACK_CHAIN_HIST 8
+
+struct nfe_conntrack_stats {
+    uint32_t size;
+    uint32_t count;
+    uint32_t resizes;
+    uint32_t rehash;
+    uint32_t max_chain;
+    uint32_t chain[NFE_CONNTRACK_CHAIN_HIST];
+};
+
 /* 16 bytes */
 struct nfe_ipaddr {
     union {
@@ -64,12 +86,17 @@ struct nfe_tuple {
     uint16_t vlan;
 };
 
+/* Called for every connection that is removed from a conntrack after being
+ * idle for longer than its timeout. See nfe_conntrack_set_expire_cb().
+ */
+typedef void (*nfe_conn_expire_fn)(nfe_conn_t conn, const struct nfe_tuple *tuple, void *ctx);
+
 /* nfe_packet
  *
  * @tuple (populated and available after nfe_packet_hash())
  * @direction (0-from client, 1-from server)
  * @type host/broadcast/multicast
- * @hash is a symmetric jhash of the tuple
+ * @hash is a symmetric hash of the tuple
  * @user is an opaque pointer for user by an integration
  * @head points to the start of the packet
  * @tail points to the end of the packet
@@ -58,20 +58,20 @@ clp2(uint32_t n)
 EXPORT int
 nfe_conntrack_create(nfe_conntrack_t *h, uint32_t size)
 {
-    size_t sz;
-    uint32_t i;
     struct nfe_conntrack *ct;
 
     size = clp2(size);
-    sz = sizeof(*ct) + (sizeof(*ct->bucket) * size);
 
     if (!h || !size)
         return -EINVAL;
 
-    if (!(ct = nfe_ext_alloc(sz)))
+    if (!(ct = nfe_ext_alloc(sizeof(*ct))))
         return -ENOMEM;
 
-    ct->size = size;
+    if (nfe_conntrack_table_init(ct, size)) {
+        nfe_ext_free(ct);
+        return -ENOMEM;
+    }
 
     ct->lru[LRU_PROTO_ICMP].expiry = nfe_conntrack_icmp_timeout * 1000;
     nfe_list_init(&ct->lru[LRU_PROTO_ICMP].list);
@@ -85,9 +85,11 @@ nfe_conntrack_create(nfe_conntrack_t *h, uint32_t size)
     ct->lru[LRU_PROTO_UDP].expiry = nfe_conntrack_udp_timeout * 1000;
     nfe_list_init(&ct->lru[LRU_PROTO_UDP].list);
 
-    for (i = 0; i < size; i++) {
-        nfe_list_init(&ct->bucket[i].list);
-    }
+    ct->lru[LRU_PROTO_TCP_FIN].expiry = nfe_conntrack_tcp_timeout_fin * 1000;
+    nfe_list_init(&ct->lru[LRU_PROTO_TCP_FIN].list);
+
+    ct->expire_cb = NULL;
+    ct->expire_ctx = NULL;
 
     *h = ct;
     return 0;
@@ -102,10 +104,14 @@ nfe_conntrack_destroy(struct nfe_conntrack *ct)
     if (!ct)
         return -EINVAL;
 
+    /* Detach every conn from the table first so that conns the caller
+     * still holds do not point back into freed memory.
+     */
+    nfe_conntrack_table_fini(ct);
+
     for (i = 0; i < LRU_PROTO_MAX; i++) {
         nfe_list_for_each_entry_safe(conn, tmp, &ct->lru[i].list, lru) {
             nfe_list_remove(&conn->lru);
-            nfe_list_remove(&conn->list);
             nfe_conn_release(conn);
         }
     }
@@ -113,6 +119,41 @@ nfe_conntrack_destroy(struct nfe_conntrack *ct)
     return 0;
 }
 
+EXPORT int
+nfe_conntrack_expire(struct nfe_conntrack *ct, uint64_t timestamp)
+{
+    unsigned i;
+    int n = 0;
+
+    if (!ct)
+        return -EINVAL;
+
+    for (i = 0; i < LRU_PROTO_MAX; i++)
+        n += nfe_conntrack_lru_expire(ct, i, timestamp);
+    return n;
+}
+
+EXPORT int
+nfe_conntrack_set_expire_cb(struct nfe_conntrack *ct, nfe_conn_expire_fn cb, void *ctx)
+{
+    if (!ct)
+        return -EINVAL;
+
+    ct->expire_cb = cb;
+    ct->expire_ctx = ctx;
+    return 0;
+}
+
+EXPORT int
+nfe_conntrack_stats(struct nfe_conntrack *ct, struct nfe_conntrack_stats *stats)
+{
+    if (!ct || !stats)
+        return -EINVAL;
+
+    nfe_conntrack_table_stats(ct, stats);
+    return 0;
+}
+
 EXPORT int
 nfe_packet_hash(struct nfe_packet *p, uint16_t ethertype, const uint8_t *data, size_t len, uint64_t timestamp)
 {
@@ -189,6 +230,7 @@ nfe_conn_lookup_by_tuple(nfe_conntrack_t conntrack,
             break;
         case IPPROTO_TCP:
             nfe_conntrack_lru_expire(conntrack, LRU_PROTO_TCP_SYN, timestamp);
+            nfe_conntrack_lru_expire(conntrack, LRU_PROTO_TCP_FIN, timestamp);
             lru = LRU_PROTO_TCP_EST;
             break;
         case IPPROTO_UDP:
@@ -202,6 +244,8 @@ nfe_conn_lookup_by_tuple(nfe_conntrack_t conntrack,
 
     conn = nfe_conntrack_lookup_hash(conntrack, tuple, nfe_tuple_hash(tuple));
     if (conn) {
+        if (tuple->proto == IPPROTO_TCP)
+            lru = nfe_tcp_lru(&conn->cb.tcp, lru);
         nfe_conntrack_lru_update(conntrack, lru, &conn->lru);
         if (dir) {
             *dir = __builtin_memcmp(&conn->tuple.addr[0], &tuple->addr[0],
@@ -220,6 +264,8 @@ nfe_conn_release(nfe_conn_t conn)
     nfe_assert(conn->lockref >= 1);
 
     if (--(conn->lockref) == 0) {
+        if (conn->ct)
+            conn->ct->count--;
         nfe_list_remove(&conn->list);
         nfe_list_remove(&conn->lru);
         nfe_ext_conn_free(conn, &conn->tuple);
@@ -32,8 +32,11 @@ EXPORT int nfe_conntrack_tcp_midflow = 0;
 EXPORT int nfe_conntrack_tcp_timeout_syn = 60;
 /* Timeout idle established tcp connections */
 EXPORT int nfe_conntrack_tcp_timeout_est = 3600;
+/* Timeout idle tcp connections after a fin was seen */
+EXPORT int nfe_conntrack_tcp_timeout_fin = 120;
 /* Timeout idle udp connections */
 EXPORT int nfe_conntrack_udp_timeout = 180;
 /* Timeout idle icmp connections */
 EXPORT int nfe_conntrack_icmp_timeout = 30;
-
+/* Hash tuples with the cpu crc32c instruction when available */
+EXPORT int nfe_hash_accel = 1;
@@ -24,16 +24,232 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include "nfe.h"
 #include "nfe_list.h"
 #include "nfe_conn.h"
 #include "nfe_flow.h"
 #include "nfe_conntrack.h"
 #include "nfe_priv.h"
 
+static struct nfe_hash_bucket *
+ct_buckets_alloc(uint32_t size)
+{
+    uint32_t i;
+    struct nfe_hash_bucket *b;
+
+    if (!(b = nfe_ext_alloc(sizeof(*b) * size)))
+        return NULL;
+
+    for (i = 0; i < size; i++)
+        nfe_list_init(&b[i].list);
+
+    return b;
+}
+
+/* Migrate the next few buckets of a resize in progress to the new array,
+ * and release the old array once it is empty.
+ */
+static void
+ct_rehash_step(struct nfe_conntrack *ct)
+{
+    unsigned n;
+    struct nfe_conn *conn, *tmp;
+
+    for (n = 0; ct->old && n < NFE_CONNTRACK_REHASH_STEP; n++) {
+        nfe_list_for_each_entry_safe(conn, tmp, &ct->old[ct->rehash].list, list) {
+            nfe_list_remove(&conn->list);
+            nfe_list_insert(&ct->bucket[conn->hash & (ct->size-1)].list, &conn->list);
+        }
+        if (++ct->rehash == ct->old_size) {
+            nfe_ext_free(ct->old);
+            ct->old = NULL;
+            ct->old_size = 0;
+            ct->rehash = 0;
+            ct->resizes++;
+        }
+    }
+}
+
+/* Start moving the table to @param size buckets. On allocation failure
+ * the current array is kept and simply runs at a higher load.
+ */
+static void
+ct_resize(struct nfe_conntrack *ct, uint32_t size)
+{
+    struct nfe_hash_bucket *b;
+
+    if (ct->old || size == ct->size)
+        return;
+
+    if (!(b = ct_buckets_alloc(size)))
+        return;
+
+    ct->old = ct->bucket;
+    ct->old_size = ct->size;
+    ct->rehash = 0;
+    ct->bucket = b;
+    ct->size = size;
+}
+
+/* Turn a shrink in progress back into a grow: the previous, larger array
+ * becomes the current one again and the buckets already migrated to the
+ * smaller array are drained back into it. Every conn stays reachable since
+ * lookups search both arrays.
+ */
+static void
+ct_resize_revert(struct nfe_conntrack *ct)
+{
+    struct nfe_hash_bucket *b = ct->bucket;
+    uint32_t size = ct->size;
+
+    ct->bucket = ct->old;
+    ct->size = ct->old_size;
+    ct->old = b;
+    ct->old_size = size;
+    ct->rehash = 0;
+}
+
+/* Called when a conn was added. A shrink still draining does not hold back
+ * growth: it is reversed instead.
+ */
+static inline void
+ct_grow_check(struct nfe_conntrack *ct)
+{
+    if (ct->count <= ct->size)
+        return;
+
+    if (ct->old) {
+        if (ct->old_size > ct->size)
+            ct_resize_revert(ct);
+    } else if (ct->size < (1U << 31)) {
+        ct_resize(ct, ct->size << 1);
+    }
+}
+
+/* Called when conns were expired. Shrinking is left to expiry so that a
+ * table growing back after a reversed shrink is not shrunk again right away.
+ */
+static inline void
+ct_shrink_check(struct nfe_conntrack *ct)
+{
+    uint32_t size;
+
+    if (ct->old)
+        return;
+
+    if (ct->size > ct->min_size &&
+            ct->count < ct->size / NFE_CONNTRACK_SHRINK_DIV) {
+        /* leave room for the table to grow back before the next resize */
+        for (size = ct->min_size; size < ct->count * 2; size <<= 1);
+        ct_resize(ct, size);
+    }
+}
+
+int
+nfe_conntrack_table_init(struct nfe_conntrack *ct, uint32_t size)
+{
+    if (!(ct->bucket = ct_buckets_alloc(size)))
+        return -1;
+
+    ct->size = size;
+    ct->min_size = size < NFE_CONNTRACK_MIN_SIZE ? size : NFE_CONNTRACK_MIN_SIZE;
+    ct->count = 0;
+    ct->resizes = 0;
+    ct->old = NULL;
+    ct->old_size = 0;
+    ct->rehash = 0;
+    return 0;
+}
+
+static void
+ct_buckets_detach(struct nfe_hash_bucket *b, uint32_t size)
+{
+    uint32_t i;
+    struct nfe_conn *conn, *tmp;
+
+    for (i = 0; i < size; i++) {
+        nfe_list_for_each_entry_safe(conn, tmp, &b[i].list, list) {
+            nfe_list_remove(&conn->list);
+            conn->ct = NULL;
+        }
+    }
+}
+
+/* Unlink every connection from the bucket arrays and free them. Connections
+ * still referenced by the caller stay valid and are freed by their final
+ * nfe_conn_release().
+ */
+void
+nfe_conntrack_table_fini(struct nfe_conntrack *ct)
+{
+    if (ct->old) {
+        ct_buckets_detach(ct->old, ct->old_size);
+        nfe_ext_free(ct->old);
+        ct->old = NULL;
+    }
+    ct_buckets_detach(ct->bucket, ct->size);
+    nfe_ext_free(ct->bucket);
+    ct->bucket = NULL;
+    ct->count = 0;
+}
+
+static void
+ct_buckets_stats(struct nfe_hash_bucket *b, uint32_t from, uint32_t size,
+    struct nfe_conntrack_stats *stats)
+{
+    uint32_t i, len;
+    struct nfe_list_head *pos;
+
+    for (i = from; i < size; i++) {
+        len = 0;
+        nfe_list_for_each(pos, &b[i].list)
+            len++;
+        if (len > stats->max_chain)
+            stats->max_chain = len;
+        if (len >= NFE_CONNTRACK_CHAIN_HIST)
+            len = NFE_CONNTRACK_CHAIN_HIST - 1;
+        stats->chain[len]++;
+    }
+}
+
+void
+nfe_conntrack_table_stats(struct nfe_conntrack *ct, struct nfe_conntrack_stats *stats)
+{
+    __builtin_memset(stats, 0, sizeof(*stats));
+    stats->size = ct->size;
+    stats->count = ct->count;
+    stats->resizes = ct->resizes;
+
+    ct_buckets_stats(ct->bucket, 0, ct->size, stats);
+    if (ct->old) {
+        stats->rehash = ct->old_size - ct->rehash;
+        ct_buckets_stats(ct->old, ct->rehash, ct->old_size, stats);
+    }
+}
+
+static inline struct nfe_conn *
+ct_chain_lookup(struct nfe_hash_bucket *b, const struct nfe_tuple *tuple, uint32_t hash)
+{
+    struct nfe_conn *conn;
+
+    nfe_list_for_each_entry(conn, &b->list, list) {
+        if (conn->hash == hash && nfe_tuple_equal(&conn->tuple, tuple)) {
+            conn->lockref++;
+            return conn;
+        }
+    }
+
+    return NULL;
+}
+
 /* Private lookup
  *
  * Returns the nfe_conn for the given tuple. Out @param b is always
- * set to point to the hashed bucket.
+ * set to point to the hashed bucket in the current array, which is
+ * where new connections are inserted.
+ *
+ * While a resize is in progress, buckets of the previous array that
+ * have not been migrated yet are searched as well.
  *
  * The returned nfe_conn will have the lockref incremented by 1 with
  * each successful lookup.
@@ -41,18 +257,21 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 static inline struct nfe_conn *
 ct_lookup_hash(struct nfe_conntrack *ct, const struct nfe_tuple *tuple, uint32_t hash, struct nfe_hash_bucket **b)
 {
+    uint32_t i;
     struct nfe_conn *conn;
 
+    ct_rehash_step(ct);
+
     *b = &ct->bucket[hash & (ct->size-1)];
+    conn = ct_chain_lookup(*b, tuple, hash);
 
-    nfe_list_for_each_entry(conn, &(*b)->list, list) {
-        if (nfe_tuple_equal(&conn->tuple, tuple)) {
-            conn->lockref++;
-            return conn;
-        }
+    if (!conn && ct->old) {
+        i = hash & (ct->old_size-1);
+        if (i >= ct->rehash)
+            conn = ct_chain_lookup(&ct->old[i], tuple, hash);
     }
 
-    return NULL;
+    return conn;
 }
 
 struct nfe_conn *
@@ -71,26 +290,53 @@ nfe_conntrack_lookup(struct nfe_conntrack *ct, struct nfe_packet *packet, int al
         if (alloc_policy != NFE_ALLOC_POLICY_NONE) {
             conn = nfe_conn_alloc(packet, alloc_policy == NFE_ALLOC_POLICY_INVERT);
             if (conn) {
+                conn->hash = packet->hash;
+                conn->ct = ct;
                 nfe_list_insert(&b->list, &conn->list);
                 conn->lockref++;
+                ct->count++;
+                ct_grow_check(ct);
             }
         }
     }
     return conn;
 }
 
-void
+/* Make @param conn unreachable from the table. The reference the table
+ * held is dropped by the caller.
+ */
+static void
+ct_unlink(struct nfe_conntrack *ct, struct nfe_conn *conn)
+{
+    nfe_list_remove(&conn->list);
+    nfe_list_remove(&conn->lru);
+    if (conn->ct == ct) {
+        conn->ct = NULL;
+        ct->count--;
+    }
+}
+
+unsigned
 nfe_conntrack_lru_expire(struct nfe_conntrack *ct, int lru, uint64_t timestamp)
 {
+    unsigned n = 0;
     struct nfe_conn *conn, *tmp;
+
     nfe_list_for_each_entry_safe(conn, tmp, &ct->lru[lru].list, lru) {
         nfe_assert(conn->lockref);
         if (timestamp < conn->timestamp ||
                 (timestamp - conn->timestamp) < ct->lru[lru].expiry) {
             break;
         }
+        ct_unlink(ct, conn);
+        if (ct->expire_cb)
+            ct->expire_cb(conn, &conn->tuple, ct->expire_ctx);
         nfe_conn_release(conn);
+        n++;
     }
+    if (n)
+        ct_shrink_check(ct);
+    return n;
 }
 
 void
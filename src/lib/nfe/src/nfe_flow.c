@@ -26,8 +26,18 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "nfe_flow.h"
 #include "nfe_priv.h"
+#include "nfe_config.h"
 #include "jhash.h"
 
+#if defined(NFE_HAVE_CRC32C) && defined(__x86_64__)
+#include <cpuid.h>
+#define CRC32C_TARGET __attribute__((target("sse4.2")))
+#define crc32c_u64(crc, v) ((uint32_t)__builtin_ia32_crc32di((crc), (v)))
+#elif defined(NFE_HAVE_CRC32C)
+#define CRC32C_TARGET
+#define crc32c_u64(crc, v) __builtin_aarch64_crc32cx((crc), (v))
+#endif
+
 struct nfe_tuple *
 nfe_tuple_copy(struct nfe_tuple *dst, const struct nfe_tuple *src, bool invert)
 {
@@ -53,7 +63,7 @@ nfe_tuple_copy(struct nfe_tuple *dst, const struct nfe_tuple *src, bool invert)
 }
 
 uint32_t
-nfe_tuple_hash(const struct nfe_tuple *tuple)
+nfe_tuple_hash_jhash(const struct nfe_tuple *tuple)
 {
     struct nfe_tuple rev;
 
@@ -70,3 +80,75 @@ nfe_tuple_hash(const struct nfe_tuple *tuple)
         (sizeof(tuple->addr) + sizeof(tuple->port))/4,
         ((uint32_t)tuple->domain << 24) | ((uint32_t)tuple->proto << 16) | tuple->vlan);
 }
+
+#ifdef NFE_HAVE_CRC32C
+/* Each endpoint (address, port) is folded separately and the two results
+ * are combined with commutative operators, so the hash is symmetric
+ * without having to order the endpoints first.
+ */
+CRC32C_TARGET uint32_t
+nfe_tuple_hash_crc32c(const struct nfe_tuple *tuple)
+{
+    uint32_t seed, h0, h1;
+
+    seed = ((uint32_t)tuple->domain << 24) | ((uint32_t)tuple->proto << 16) | tuple->vlan;
+
+    h0 = crc32c_u64(seed, tuple->addr[0].addr64[0]);
+    h0 = crc32c_u64(h0, tuple->addr[0].addr64[1]);
+    h0 = crc32c_u64(h0, tuple->port[0]);
+
+    h1 = crc32c_u64(seed, tuple->addr[1].addr64[0]);
+    h1 = crc32c_u64(h1, tuple->addr[1].addr64[1]);
+    h1 = crc32c_u64(h1, tuple->port[1]);
+
+    return crc32c_u64(seed, ((uint64_t)(h0 + h1) << 32) | (h0 ^ h1));
+}
+#endif
+
+bool
+nfe_tuple_hash_crc32c_supported(void)
+{
+#if defined(NFE_HAVE_CRC32C) && defined(__x86_64__)
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return false;
+    return (ecx & bit_SSE4_2) != 0;
+#elif defined(NFE_HAVE_CRC32C)
+    return true;
+#else
+    return false;
+#endif
+}
+
+static uint32_t tuple_hash_select(const struct nfe_tuple *tuple);
+
+static uint32_t (*tuple_hash)(const struct nfe_tuple *) = tuple_hash_select;
+
+void
+nfe_tuple_hash_init(bool accel)
+{
+#ifdef NFE_HAVE_CRC32C
+    if (accel && nfe_tuple_hash_crc32c_supported()) {
+        tuple_hash = nfe_tuple_hash_crc32c;
+        return;
+    }
+#endif
+    tuple_hash = nfe_tuple_hash_jhash;
+}
+
+/* The implementation is picked on first use, and must not change while
+ * any conntrack holds connections hashed with the previous one.
+ */
+static uint32_t
+tuple_hash_select(const struct nfe_tuple *tuple)
+{
+    nfe_tuple_hash_init(nfe_hash_accel);
+    return tuple_hash(tuple);
+}
+
+uint32_t
+nfe_tuple_hash(const struct nfe_tuple *tuple)
+{
+    return tuple_hash(tuple);
+}
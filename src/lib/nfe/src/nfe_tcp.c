@@ -200,6 +200,20 @@ nfe_tcpfsm[TCP_NUM_STATE][3] =
     { &tcp_rcv_err, &tcp_rcv_err, &tcp_rcv_err }, /* CLOSED */
 };
 
+/* A closed connection is released by the fsm as soon as it closes, so only
+ * the closing states have to be mapped to the fin queue.
+ */
+int
+nfe_tcp_lru(const struct nfe_tcp *tcp, int lru)
+{
+    switch (tcp->state) {
+        case TCP_HALF_DISCONNECTED:
+        case TCP_LAST_ACK:
+            return LRU_PROTO_TCP_FIN;
+    }
+    return lru;
+}
+
 static int64_t
 nfe_tcpfsm_input(struct nfe_conntrack *conntrack, struct nfe_packet *packet, struct nfe_conn **conn)
 {
@@ -219,6 +233,7 @@ nfe_tcpfsm_input(struct nfe_conntrack *conntrack, struct nfe_packet *packet, str
             policy = NFE_ALLOC_POLICY_CREATE;
     } else {
         nfe_conntrack_lru_expire(conntrack, LRU_PROTO_TCP_EST, packet->timestamp);
+        nfe_conntrack_lru_expire(conntrack, LRU_PROTO_TCP_FIN, packet->timestamp);
         policy = nfe_conntrack_tcp_midflow ? NFE_ALLOC_POLICY_CREATE : NFE_ALLOC_POLICY_NONE;
     }
 
@@ -244,12 +259,12 @@ nfe_tcpfsm_input(struct nfe_conntrack *conntrack, struct nfe_packet *packet, str
     /* Update this connections lru */
     if (th->flags & TH_SYN) {
         if (th->flags & TH_ACK) {
-            nfe_conntrack_lru_update(conntrack, LRU_PROTO_TCP_EST, &(*conn)->lru);
+            nfe_conntrack_lru_update(conntrack, nfe_tcp_lru(tcp, LRU_PROTO_TCP_EST), &(*conn)->lru);
         } else {
-            nfe_conntrack_lru_update(conntrack, LRU_PROTO_TCP_SYN, &(*conn)->lru);
+            nfe_conntrack_lru_update(conntrack, nfe_tcp_lru(tcp, LRU_PROTO_TCP_SYN), &(*conn)->lru);
         }
     } else {
-        nfe_conntrack_lru_update(conntrack, LRU_PROTO_TCP_EST, &(*conn)->lru);
+        nfe_conntrack_lru_update(conntrack, nfe_tcp_lru(tcp, LRU_PROTO_TCP_EST), &(*conn)->lru);
     }
 
     if (tcp->half[dir].packets++ == 0) {
@@ -343,6 +358,10 @@ nfe_tcpfsm_input(struct nfe_conntrack *conntrack, struct nfe_packet *packet, str
             return 0;
     }
 
+    /* a closing connection ages out on the shorter fin timeout */
+    if (tcp->state == TCP_HALF_DISCONNECTED || tcp->state == TCP_LAST_ACK)
+        nfe_conntrack_lru_update(conntrack, LRU_PROTO_TCP_FIN, &(*conn)->lru);
+
     if (tcp_seq_is_after(seq, tcp->half[dir].last_seq_sent)) {
         if (seq < tcp->half[dir].last_seq_sent)
             tcp->half[dir].curr_seq_wrap++;
@@ -0,0 +1,312 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nfe.h"
+#include "nfe_config.h"
+#include "unit_test_utils.h"
+#include "unity.h"
+
+const char *test_name = "nfe_conntrack_tests";
+
+#define TEST_FRAME_LEN 64
+
+/* Frames start 2 bytes into a word aligned buffer, as received, so that
+ * the ip header is aligned.
+ */
+struct test_frame
+{
+    uint16_t pad;
+    uint8_t data[TEST_FRAME_LEN];
+} __attribute__((aligned(4)));
+
+#define TEST_TCP_SPORT 40000
+#define TEST_TCP_DPORT 80
+
+#define TEST_TH_FIN 0x01
+#define TEST_TH_SYN 0x02
+#define TEST_TH_ACK 0x10
+
+/* Build an ethernet/ipv4 frame from 10.0.0.1 to 10.0.0.2, or the other way
+ * around for a @reply, with room for @l4_len bytes of @proto header.
+ * Returns the offset of the l4 header.
+ */
+static size_t
+test_ipv4_frame(uint8_t *f, uint8_t proto, size_t l4_len, bool reply)
+{
+    memset(f, 0, TEST_FRAME_LEN);
+
+    /* ethernet, unicast destination */
+    f[0] = 0x02; f[5] = reply ? 0x01 : 0x02;
+    f[6] = 0x02; f[11] = reply ? 0x02 : 0x01;
+    f[12] = 0x08; f[13] = 0x00;
+
+    /* ipv4 */
+    f[14] = 0x45;
+    f[17] = 20 + l4_len;
+    f[22] = 64;
+    f[23] = proto;
+    f[26] = 10; f[29] = reply ? 2 : 1;
+    f[30] = 10; f[33] = reply ? 1 : 2;
+
+    return 14 + 20;
+}
+
+/* Build a frame from 10.0.0.1:@sport to 10.0.0.2:@dport with an 8 bytes
+ * udp header.
+ */
+static size_t
+test_udp_frame(uint8_t *f, uint16_t sport, uint16_t dport)
+{
+    size_t off;
+
+    off = test_ipv4_frame(f, 17, 8, false);
+    f[off + 0] = sport >> 8; f[off + 1] = sport & 0xff;
+    f[off + 2] = dport >> 8; f[off + 3] = dport & 0xff;
+    f[off + 5] = 8;
+
+    return off + 8;
+}
+
+/* Build a tcp segment with no payload between TEST_TCP_SPORT on the client
+ * and TEST_TCP_DPORT on the server, sent by the server for a @reply.
+ */
+static size_t
+test_tcp_frame(uint8_t *f, bool reply, uint8_t flags, uint32_t seq, uint32_t ack)
+{
+    uint16_t sport = reply ? TEST_TCP_DPORT : TEST_TCP_SPORT;
+    uint16_t dport = reply ? TEST_TCP_SPORT : TEST_TCP_DPORT;
+    size_t off;
+
+    off = test_ipv4_frame(f, 6, 20, reply);
+    f[off + 0] = sport >> 8; f[off + 1] = sport & 0xff;
+    f[off + 2] = dport >> 8; f[off + 3] = dport & 0xff;
+    f[off + 4] = seq >> 24; f[off + 5] = seq >> 16;
+    f[off + 6] = seq >> 8; f[off + 7] = seq;
+    f[off + 8] = ack >> 24; f[off + 9] = ack >> 16;
+    f[off + 10] = ack >> 8; f[off + 11] = ack;
+    f[off + 12] = 5 << 4;
+    f[off + 13] = flags;
+    f[off + 14] = 0xff; f[off + 15] = 0xff;
+
+    return off + 20;
+}
+
+static nfe_conn_t
+test_udp_lookup(nfe_conntrack_t ct, uint16_t sport, uint64_t timestamp)
+{
+    struct test_frame frame;
+    struct nfe_packet packet;
+    size_t len;
+    int rc;
+
+    len = test_udp_frame(frame.data, sport, 53);
+    rc = nfe_packet_hash(&packet, 0, frame.data, len, timestamp);
+    TEST_ASSERT_EQUAL_INT(0, rc);
+
+    return nfe_conn_lookup(ct, &packet);
+}
+
+static nfe_conn_t
+test_tcp_lookup(nfe_conntrack_t ct, bool reply, uint8_t flags,
+                uint32_t seq, uint32_t ack, uint64_t timestamp)
+{
+    struct test_frame frame;
+    struct nfe_packet packet;
+    size_t len;
+    int rc;
+
+    len = test_tcp_frame(frame.data, reply, flags, seq, ack);
+    rc = nfe_packet_hash(&packet, 0, frame.data, len, timestamp);
+    TEST_ASSERT_EQUAL_INT(0, rc);
+
+    return nfe_conn_lookup(ct, &packet);
+}
+
+static size_t g_expired;
+static nfe_conn_t g_expired_conn;
+
+static void
+test_expire_cb(nfe_conn_t conn, const struct nfe_tuple *tuple, void *ctx)
+{
+    (void)tuple;
+    (void)ctx;
+
+    g_expired++;
+    g_expired_conn = conn;
+}
+
+/* Look up @n udp conns, from source port @base on, and keep the handles in
+ * @conns when not NULL.
+ */
+static void
+test_udp_lookup_range(nfe_conntrack_t ct, uint16_t base, size_t n,
+                      uint64_t timestamp, nfe_conn_t *conns)
+{
+    nfe_conn_t conn;
+    size_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        conn = test_udp_lookup(ct, base + i, timestamp);
+        TEST_ASSERT_NOT_NULL(conn);
+        if (conns != NULL)
+        {
+            /* a conn already seen must be found, not created again */
+            if (conns[i] != NULL) TEST_ASSERT_EQUAL_PTR(conns[i], conn);
+            conns[i] = conn;
+        }
+        nfe_conn_release(conn);
+    }
+}
+
+
+/**
+ * @brief a table growing back while a large shrink drains must not wait
+ *        for the drain to complete
+ */
+void
+test_nfe_conntrack_grow_while_shrinking(void)
+{
+    struct nfe_conntrack_stats stats;
+    nfe_conn_t conns[128];
+    nfe_conntrack_t ct;
+    uint64_t now;
+    size_t big;
+    int rc;
+
+    rc = nfe_conntrack_create(&ct, 64);
+    TEST_ASSERT_EQUAL_INT(0, rc);
+
+    /* grow to a large table, and let the last resize drain */
+    test_udp_lookup_range(ct, 10000, 8192, 0, NULL);
+    test_udp_lookup_range(ct, 10000, 2048, 0, NULL);
+    nfe_conntrack_stats(ct, &stats);
+    TEST_ASSERT_EQUAL_UINT(8192, stats.count);
+    TEST_ASSERT_EQUAL_UINT(0, stats.rehash);
+    TEST_ASSERT_TRUE(stats.size >= 4096);
+    big = stats.size;
+
+    /* every conn times out, the table starts shrinking to the minimum */
+    now = (uint64_t)nfe_conntrack_udp_timeout * 1000 + 1;
+    rc = nfe_conntrack_expire(ct, now);
+    TEST_ASSERT_EQUAL_INT(8192, rc);
+    nfe_conntrack_stats(ct, &stats);
+    TEST_ASSERT_EQUAL_UINT(0, stats.count);
+    TEST_ASSERT_EQUAL_UINT(64, stats.size);
+    TEST_ASSERT_NOT_EQUAL(0, stats.rehash);
+
+    /* new conns outnumber the small array well before the drain is done */
+    memset(conns, 0, sizeof(conns));
+    test_udp_lookup_range(ct, 30000, 128, now, conns);
+    nfe_conntrack_stats(ct, &stats);
+    TEST_ASSERT_EQUAL_UINT(128, stats.count);
+    TEST_ASSERT_EQUAL_UINT(big, stats.size);
+
+    /* the conns created on either side of the reversal are all found */
+    test_udp_lookup_range(ct, 30000, 128, now, conns);
+    nfe_conntrack_stats(ct, &stats);
+    TEST_ASSERT_EQUAL_UINT(128, stats.count);
+    TEST_ASSERT_EQUAL_UINT(0, stats.rehash);
+
+    nfe_conntrack_destroy(ct);
+}
+
+
+/**
+ * @brief a connection that saw a fin ages out on the fin timeout rather
+ *        than the established one
+ */
+void
+test_nfe_conntrack_tcp_fin_expiry(void)
+{
+    nfe_conntrack_t ct;
+    nfe_conn_t conn;
+    uint64_t fin;
+    uint64_t ts;
+    int rc;
+
+    rc = nfe_conntrack_create(&ct, 64);
+    TEST_ASSERT_EQUAL_INT(0, rc);
+    nfe_conntrack_set_expire_cb(ct, test_expire_cb, NULL);
+    g_expired = 0;
+    g_expired_conn = NULL;
+
+    /* handshake */
+    ts = 1000;
+    conn = test_tcp_lookup(ct, false, TEST_TH_SYN, 100, 0, ts);
+    TEST_ASSERT_NOT_NULL(conn);
+    nfe_conn_release(conn);
+    conn = test_tcp_lookup(ct, true, TEST_TH_SYN | TEST_TH_ACK, 500, 101, ts);
+    TEST_ASSERT_NOT_NULL(conn);
+    nfe_conn_release(conn);
+    conn = test_tcp_lookup(ct, false, TEST_TH_ACK, 101, 501, ts);
+    TEST_ASSERT_NOT_NULL(conn);
+    nfe_conn_release(conn);
+
+    /* the client closes its half: the conn is now half disconnected */
+    ts += 1000;
+    conn = test_tcp_lookup(ct, false, TEST_TH_FIN | TEST_TH_ACK, 101, 501, ts);
+    TEST_ASSERT_NOT_NULL(conn);
+    nfe_conn_release(conn);
+
+    /* still tracked right before the fin timeout */
+    fin = (uint64_t)nfe_conntrack_tcp_timeout_fin * 1000;
+    TEST_ASSERT_TRUE(nfe_conntrack_tcp_timeout_fin < nfe_conntrack_tcp_timeout_est);
+    rc = nfe_conntrack_expire(ct, ts + fin - 1);
+    TEST_ASSERT_EQUAL_INT(0, rc);
+    TEST_ASSERT_EQUAL_UINT(0, g_expired);
+
+    /* and evicted once it elapsed, well before the established timeout */
+    rc = nfe_conntrack_expire(ct, ts + fin);
+    TEST_ASSERT_EQUAL_INT(1, rc);
+    TEST_ASSERT_EQUAL_UINT(1, g_expired);
+    TEST_ASSERT_EQUAL_PTR(conn, g_expired_conn);
+
+    /* a new segment of the flow does not find it anymore */
+    conn = test_tcp_lookup(ct, true, TEST_TH_ACK, 501, 102, ts + fin);
+    TEST_ASSERT_NULL(conn);
+
+    nfe_conntrack_destroy(ct);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    ut_init(test_name, NULL, NULL);
+
+    RUN_TEST(test_nfe_conntrack_grow_while_shrinking);
+    RUN_TEST(test_nfe_conntrack_tcp_fin_expiry);
+
+    return ut_fini();
+}
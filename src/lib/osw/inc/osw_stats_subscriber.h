@@ -32,6 +32,16 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 struct osw_stats_subscriber;
 
+/* Per stats id bookkeeping of the subscriber's bucket
+ * aggregation. Useful for spotting allocation churn.
+ */
+struct osw_stats_subscriber_counters {
+    unsigned long merges;
+    unsigned long underflows;
+    unsigned long allocs;
+    unsigned long frees;
+};
+
 typedef void osw_stats_subscriber_report_fn_t(enum osw_stats_id id,
                                               const struct osw_tlv *data,
                                               const struct osw_tlv *last,
@@ -43,6 +53,10 @@ osw_stats_subscriber_alloc(void);
 void
 osw_stats_subscriber_free(struct osw_stats_subscriber *sub);
 
+const struct osw_stats_subscriber_counters *
+osw_stats_subscriber_get_counters(const struct osw_stats_subscriber *sub,
+                                  enum osw_stats_id id);
+
 void
 osw_stats_subscriber_set_report_fn(struct osw_stats_subscriber *sub,
                                    osw_stats_subscriber_report_fn_t *fn,
@@ -38,7 +38,15 @@ osw_timer_fn(struct osw_timer *timer);
 struct osw_timer {
     osw_timer_fn *cb;
     uint64_t at_nsec;
+    uint64_t seq;
 
+    /* active timers, pairing heap ordered by at_nsec */
+    bool queued;
+    struct osw_timer *heap_child;
+    struct osw_timer *heap_next;
+    struct osw_timer *heap_prev;
+
+    /* expired timers, pending dispatch */
     struct ds_dlist *list;
     struct ds_dlist_node node;
 };
@@ -71,4 +71,21 @@ osw_tlv_merge(struct osw_tlv *dest_tlv,
               const struct osw_tlv_merge_policy *mpolicy,
               const size_t tb_size);
 
+/**
+ * Checks, without modifying anything, whether merging given
+ * sample against prev_tlv would report
+ * OSW_TLV_MERGE_ERR_UNDERFLOW.
+ *
+ * This allows callers to pick how to handle the underflow
+ * (eg. drop prev_tlv) before calling osw_tlv_merge() instead
+ * of having to snapshot dest_tlv to undo a partial merge.
+ */
+bool
+osw_tlv_merge_underflows(const struct osw_tlv *prev_tlv,
+                         const void *data,
+                         size_t len,
+                         const struct osw_tlv_policy *tpolicy,
+                         const struct osw_tlv_merge_policy *mpolicy,
+                         const size_t tb_size);
+
 #endif /* OSW_TLV_MERGE_H_INCLUDED */
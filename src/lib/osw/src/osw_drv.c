@@ -358,6 +358,7 @@ osw_drv_sta_free(struct osw_drv_sta *sta)
     g_osw_drv_work_done = true;
     osw_drv_buf_free(&sta->cur_ies);
     osw_drv_buf_free(&sta->new_ies);
+    osw_state_sta_index_update(sta);
     ds_tree_remove(&sta->vif->sta_tree, sta);
     FREE(sta);
 }
@@ -560,6 +561,8 @@ osw_drv_sta_process_state(struct osw_drv_sta *sta)
         sta->pub.connected_at -= sta->cur_state.connected_duration_seconds;
     }
 
+    osw_state_sta_index_update(sta);
+
     const int in_network_sec = now - sta->pub.connected_at;
 
     if (removed == true) OSW_STATE_NOTIFY(sta_disconnected_fn, &sta->pub);
@@ -770,6 +773,7 @@ osw_drv_vif_free(struct osw_drv_vif *vif)
     g_osw_drv_work_done = true;
     osw_timer_disarm(&vif->recent_channel_timeout);
     ev_timer_stop(EV_DEFAULT_ &vif->chan_sync);
+    osw_state_vif_index_update(vif);
     ds_tree_remove(&vif->phy->vif_tree, vif);
     FREE(vif->vif_name);
     FREE(vif);
@@ -2388,6 +2392,8 @@ osw_drv_vif_process_state(struct osw_drv_vif *vif)
     vif->pub.phy = &vif->phy->pub;
     vif->pub.drv_state = &vif->cur_state;
 
+    osw_state_vif_index_update(vif);
+
     if (added == true) osw_drv_vif_dump(vif);
     if (added == true) OSW_STATE_NOTIFY(vif_added_fn, &vif->pub);
     if (changed == true) OSW_STATE_NOTIFY(vif_changed_fn, &vif->pub);
@@ -122,6 +122,12 @@ struct osw_drv_vif {
     bool sta_list_valid;
     bool radar_detected;
     ev_timer chan_sync; /* used for CSA state invalidation */
+
+    /* osw_state global indexes, see osw_state_vif_index_update() */
+    struct ds_tree_node index_name_node;
+    struct ds_dlist_node index_mac_node;
+    struct osw_state_index_entry *index_mac;
+    bool index_name;
 };
 
 struct osw_drv_sta {
@@ -135,6 +141,10 @@ struct osw_drv_sta {
     struct osw_drv_buf cur_ies;
     struct osw_drv_buf new_ies;
     struct osw_timer ies_timeout;
+
+    /* osw_state global index, see osw_state_sta_index_update() */
+    struct ds_dlist_node index_node;
+    struct osw_state_index_entry *index_mac;
 };
 
 struct osw_drv_frame_tx_desc {
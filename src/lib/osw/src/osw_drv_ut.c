@@ -467,6 +467,16 @@ OSW_UT(osw_drv_ut_1)
     assert(osw_state_phy_lookup("phy2") != NULL);
     assert(osw_state_phy_lookup("phy3") != NULL);
 
+    {
+        const struct osw_hwaddr zero = {0};
+
+        printf("checking global lookups\n");
+        assert(osw_state_vif_lookup_by_vif_name("vif1") == osw_state_vif_lookup("phy1", "vif1"));
+        assert(osw_state_vif_lookup_by_vif_name("vif4") == osw_state_vif_lookup("phy3", "vif4"));
+        assert(osw_state_vif_lookup_by_vif_name("vif10") == NULL);
+        assert(osw_state_vif_lookup_by_mac_addr(&zero) == osw_state_vif_lookup("phy1", "vif1"));
+    }
+
     {
         printf("checking conf from state\n");
 
@@ -540,6 +550,7 @@ OSW_UT(osw_drv_ut_1)
     osw_drv_ut_work(&obs1);
     assert(osw_state_phy_lookup("phy2") == NULL);
     assert(osw_state_vif_lookup("phy2", "vif3") == NULL);
+    assert(osw_state_vif_lookup_by_vif_name("vif3") == NULL);
 
     printf("add phy4\n");
     drv1_priv[1].phy_name = "phy4";
@@ -547,6 +558,7 @@ OSW_UT(osw_drv_ut_1)
     osw_drv_ut_work(&obs1);
     assert(osw_state_phy_lookup("phy4") != NULL);
     assert(osw_state_vif_lookup("phy4", "vif3") != NULL);
+    assert(osw_state_vif_lookup_by_vif_name("vif3") == osw_state_vif_lookup("phy4", "vif3"));
 
     printf("blip phy5\n");
     drv1_priv[1].phy_name = "";
@@ -614,6 +626,9 @@ OSW_UT(osw_drv_ut_1)
     osw_drv_ut_work(&obs1);
     assert(osw_state_phy_lookup("phy1") == NULL);
     assert(osw_state_phy_lookup("phy3") == NULL);
+    assert(osw_state_vif_lookup_by_vif_name("vif1") == NULL);
+    assert(osw_state_vif_lookup_by_mac_addr(&(struct osw_hwaddr){0}) == NULL);
+    assert(osw_state_sta_lookup_newest(&drv1_priv[0].stas[0].mac_addr) == NULL);
 
     printf("unregister2\n");
     osw_drv_unregister_ops(&drv2); /* intentional triple unregister */
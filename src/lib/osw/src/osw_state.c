@@ -33,8 +33,43 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "osw_state_i.h"
 #include "osw_drv_i.h"
 
+struct osw_state_index_entry {
+    struct osw_hwaddr mac_addr;
+    struct ds_tree_node node;
+    struct ds_dlist list;
+};
+
+struct osw_state_index {
+    struct ds_tree entries;
+    const struct ds_dlist list_init;
+};
+
+typedef bool
+osw_state_index_before_fn_t(void *a, void *b);
+
 struct ds_dlist g_osw_state_observer_list = DS_DLIST_INIT(struct osw_state_observer, node);
 
+/* Global lookup indexes. These are maintained by osw_drv
+ * as vifs and stas transition in and out of existence so
+ * that lookups that do not know the phy (or vif) don't
+ * need to walk the whole drv/phy/vif/sta hierarchy.
+ *
+ * Multiple vifs can share a MAC address (eg. AP_VLAN
+ * interfaces inherit the parent AP address) and a single
+ * STA can be connected on multiple vifs at once (eg.
+ * roaming, MLO). Hence MAC address keyed indexes hold a
+ * list of objects per address.
+ */
+static struct ds_tree g_osw_state_vif_name_index = DS_TREE_INIT(ds_str_cmp, struct osw_drv_vif, index_name_node);
+static struct osw_state_index g_osw_state_vif_mac_index = {
+    .entries = DS_TREE_INIT((ds_key_cmp_t *)osw_hwaddr_cmp, struct osw_state_index_entry, node),
+    .list_init = DS_DLIST_INIT(struct osw_drv_vif, index_mac_node),
+};
+static struct osw_state_index g_osw_state_sta_mac_index = {
+    .entries = DS_TREE_INIT((ds_key_cmp_t *)osw_hwaddr_cmp, struct osw_state_index_entry, node),
+    .list_init = DS_DLIST_INIT(struct osw_drv_sta, index_node),
+};
+
 #define osw_log_state_observer_register(o) \
     LOGD("osw: state: registering observer: name=%s", o->name)
 #define osw_log_state_observer_unregister(o) \
@@ -125,6 +160,125 @@ osw_state_observer_notify_settled(struct osw_state_observer *observer)
         observer->busy_fn(observer);
 }
 
+static struct osw_state_index_entry *
+osw_state_index_entry_get(struct osw_state_index *index,
+                          const struct osw_hwaddr *mac_addr)
+{
+    struct osw_state_index_entry *entry = ds_tree_find(&index->entries, mac_addr);
+    if (entry != NULL) return entry;
+
+    entry = CALLOC(1, sizeof(*entry));
+    entry->mac_addr = *mac_addr;
+    entry->list = index->list_init;
+    ds_tree_insert(&index->entries, entry, &entry->mac_addr);
+    return entry;
+}
+
+static void
+osw_state_index_entry_put(struct osw_state_index *index,
+                          struct osw_state_index_entry *entry)
+{
+    if (ds_dlist_is_empty(&entry->list) == false) return;
+
+    ds_tree_remove(&index->entries, entry);
+    FREE(entry);
+}
+
+static void
+osw_state_index_entry_insert(struct osw_state_index_entry *entry,
+                             void *data,
+                             osw_state_index_before_fn_t *before_fn)
+{
+    void *i;
+
+    ds_dlist_foreach(&entry->list, i) {
+        if (before_fn(data, i) == true) {
+            ds_dlist_insert_before(&entry->list, i, data);
+            return;
+        }
+    }
+
+    ds_dlist_insert_tail(&entry->list, data);
+}
+
+static bool
+osw_state_vif_index_before(void *a, void *b)
+{
+    const struct osw_drv_vif *x = a;
+    const struct osw_drv_vif *y = b;
+    /* Mimics the order in which hierarchy walks used to
+     * find vifs, at least within a single phy.
+     */
+    return strcmp(x->vif_name, y->vif_name) < 0;
+}
+
+static bool
+osw_state_sta_index_before(void *a, void *b)
+{
+    const struct osw_drv_sta *x = a;
+    const struct osw_drv_sta *y = b;
+    /* Newest first. Ties keep the insertion order. */
+    return x->pub.connected_at > y->pub.connected_at;
+}
+
+void
+osw_state_vif_index_update(struct osw_drv_vif *vif)
+{
+    struct osw_state_index *index = &g_osw_state_vif_mac_index;
+    struct osw_state_index_entry *entry = vif->index_mac;
+    const bool exists = (vif->cur_state.exists == true);
+
+    if (vif->index_name == true && exists == false) {
+        ds_tree_remove(&g_osw_state_vif_name_index, vif);
+        vif->index_name = false;
+    }
+
+    if (vif->index_name == false && exists == true) {
+        ds_tree_insert(&g_osw_state_vif_name_index, vif, vif->vif_name);
+        vif->index_name = true;
+    }
+
+    if (entry != NULL) {
+        const bool moved = (osw_hwaddr_cmp(&entry->mac_addr, &vif->cur_state.mac_addr) != 0);
+        if (exists == true && moved == false) return;
+
+        ds_dlist_remove(&entry->list, vif);
+        osw_state_index_entry_put(index, entry);
+        vif->index_mac = NULL;
+    }
+
+    if (exists == true) {
+        entry = osw_state_index_entry_get(index, &vif->cur_state.mac_addr);
+        osw_state_index_entry_insert(entry, vif, osw_state_vif_index_before);
+        vif->index_mac = entry;
+    }
+}
+
+void
+osw_state_sta_index_update(struct osw_drv_sta *sta)
+{
+    struct osw_state_index *index = &g_osw_state_sta_mac_index;
+    struct osw_state_index_entry *entry = sta->index_mac;
+
+    /* connected_at can be re-computed on any update, so
+     * always re-insert to keep the list ordered. The lists
+     * are expected to be very short.
+     */
+    if (entry != NULL) {
+        ds_dlist_remove(&entry->list, sta);
+        sta->index_mac = NULL;
+    }
+
+    if (sta->cur_state.connected == true) {
+        if (entry == NULL) entry = osw_state_index_entry_get(index, &sta->mac_addr);
+        osw_state_index_entry_insert(entry, sta, osw_state_sta_index_before);
+        sta->index_mac = entry;
+    }
+    else if (entry != NULL) {
+        osw_state_index_entry_put(index, entry);
+    }
+}
+
 void
 osw_state_register_observer(struct osw_state_observer *observer)
 {
@@ -177,18 +331,14 @@ osw_state_vif_lookup(const char *phy_name,
 const struct osw_state_vif_info *
 osw_state_vif_lookup_by_mac_addr(const struct osw_hwaddr *mac_addr)
 {
-    struct osw_drv *drv;
-    struct osw_drv_phy *phy;
+    struct osw_state_index_entry *entry = ds_tree_find(&g_osw_state_vif_mac_index.entries, mac_addr);
     struct osw_drv_vif *vif;
 
-    /* TODO This may be optimized by introducing global (mac addr, vif) tree. */
-    ds_tree_foreach(&g_osw_drv_tree, drv)
-        ds_tree_foreach(&drv->phy_tree, phy)
-            if (phy->cur_state.exists == true)
-                ds_tree_foreach(&phy->vif_tree, vif)
-                    if (vif->cur_state.exists == true)
-                        if (osw_hwaddr_cmp(&vif->cur_state.mac_addr, mac_addr) == 0)
-                            return &vif->pub;
+    if (entry == NULL) return NULL;
+
+    ds_dlist_foreach(&entry->list, vif)
+        if (vif->phy->cur_state.exists == true)
+            return &vif->pub;
 
     return NULL;
 }
@@ -196,18 +346,12 @@ osw_state_vif_lookup_by_mac_addr(const struct osw_hwaddr *mac_addr)
 const struct osw_state_vif_info *
 osw_state_vif_lookup_by_vif_name(const char *vif_name)
 {
-    struct osw_drv *drv;
-    struct osw_drv_phy *phy;
-    struct osw_drv_vif *vif;
+    struct osw_drv_vif *vif = ds_tree_find(&g_osw_state_vif_name_index, vif_name);
 
-    ds_tree_foreach(&g_osw_drv_tree, drv)
-        ds_tree_foreach(&drv->phy_tree, phy)
-            if (phy->cur_state.exists == true)
-                if ((vif = ds_tree_find(&phy->vif_tree, vif_name)) != NULL)
-                    if (vif->cur_state.exists == true)
-                        return &vif->pub;
+    if (vif == NULL) return NULL;
+    if (vif->phy->cur_state.exists == false) return NULL;
 
-    return NULL;
+    return &vif->pub;
 }
 
 const struct osw_state_sta_info *
@@ -235,23 +379,17 @@ osw_state_sta_lookup(const char *phy_name,
 const struct osw_state_sta_info *
 osw_state_sta_lookup_newest(const struct osw_hwaddr *mac_addr)
 {
-    struct osw_drv *drv;
-    struct osw_drv_phy *phy;
-    struct osw_drv_vif *vif;
+    struct osw_state_index_entry *entry = ds_tree_find(&g_osw_state_sta_mac_index.entries, mac_addr);
     struct osw_drv_sta *sta;
-    struct osw_drv_sta *newest = NULL;
 
-    ds_tree_foreach(&g_osw_drv_tree, drv)
-        ds_tree_foreach(&drv->phy_tree, phy)
-            if (phy->cur_state.exists == true)
-                ds_tree_foreach(&phy->vif_tree, vif)
-                    if (vif->cur_state.exists == true)
-                        if ((sta = ds_tree_find(&vif->sta_tree, mac_addr)) != NULL)
-                            if (sta->cur_state.connected == true)
-                                if (newest == NULL || sta->pub.connected_at > newest->pub.connected_at)
-                                    newest = sta;
+    if (entry == NULL) return NULL;
 
-    return newest != NULL ? &newest->pub : NULL;
+    ds_dlist_foreach(&entry->list, sta)
+        if (sta->vif->cur_state.exists == true)
+            if (sta->vif->phy->cur_state.exists == true)
+                return &sta->pub;
+
+    return NULL;
 }
 
 void
@@ -48,4 +48,20 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 extern struct ds_dlist g_osw_state_observer_list;
 
+struct osw_drv_vif;
+struct osw_drv_sta;
+struct osw_state_index_entry;
+
+/* Keep the global lookup indexes in sync with vif/sta
+ * cur_state. Must be called after cur_state is updated and
+ * before observers are notified so that lookups done from
+ * within observer callbacks see consistent results. Safe
+ * to call on objects that are not indexed.
+ */
+void
+osw_state_vif_index_update(struct osw_drv_vif *vif);
+
+void
+osw_state_sta_index_update(struct osw_drv_sta *sta);
+
 #endif /* OSW_STATE_I_H_INCLUDED */
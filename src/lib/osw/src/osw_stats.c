@@ -56,6 +56,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  * periods then it should be freed up.
  */
 #define OSW_STATS_BUCKET_EXPIRE_AFTER_N_PERIODS 30
+#define OSW_STATS_BUCKET_INDEX_MIN_SLOTS 16
 #define OSW_STATS_POLL_MAX_GAP (1 / 256.0)
 
 #define LOG_PREFIX(fmt, ...) \
@@ -81,12 +82,25 @@ osw_stats_double_cmp(const void *a, const void *b)
 
 struct osw_stats_bucket {
     struct ds_tree_node node;
+    struct osw_stats_bucket *index_next;
+    uint32_t index_hash;
     struct osw_tlv key;
     struct osw_tlv data;
     struct osw_tlv last;
     unsigned int idle_periods;
 };
 
+/* Buckets are looked up on every sample that is put so
+ * they are indexed with a hash table keyed by the packed
+ * TLV key. The ds_tree is kept for ordered iteration when
+ * flushing.
+ */
+struct osw_stats_bucket_index {
+    struct osw_stats_bucket **slots;
+    size_t n_slots;
+    size_t n_buckets;
+};
+
 struct osw_stats_poller {
     struct ds_tree_node node;
     struct ds_dlist subscribers;
@@ -100,6 +114,8 @@ struct osw_stats_subscriber {
     struct osw_stats *stats;
     struct osw_stats_poller *poller;
     struct ds_tree buckets[OSW_STATS_MAX__];
+    struct osw_stats_bucket_index index[OSW_STATS_MAX__];
+    struct osw_stats_subscriber_counters counters[OSW_STATS_MAX__];
     double report_at;
     double report_seconds;
     double poll_seconds;
@@ -197,15 +213,149 @@ osw_stats_bucket_expire_work(struct osw_stats_bucket *b)
     }
 }
 
+static uint32_t
+osw_stats_bucket_key_hash(const struct osw_tlv *key)
+{
+    /* FNV-1a */
+    const uint8_t *p = key->data;
+    size_t n = key->used;
+    uint32_t h = 2166136261u;
+
+    while (n-- > 0) {
+        h ^= *p++;
+        h *= 16777619u;
+    }
+
+    return h;
+}
+
+static struct osw_stats_bucket *
+osw_stats_bucket_index_lookup(const struct osw_stats_bucket_index *index,
+                              const struct osw_tlv *key,
+                              const uint32_t hash)
+{
+    struct osw_stats_bucket *b;
+
+    if (index->n_slots == 0) return NULL;
+
+    for (b = index->slots[hash & (index->n_slots - 1)]; b != NULL; b = b->index_next) {
+        if (b->index_hash != hash) continue;
+        if (b->key.used != key->used) continue;
+        if (memcmp(b->key.data, key->data, key->used) != 0) continue;
+        return b;
+    }
+
+    return NULL;
+}
+
 static void
-osw_stats_bucket_free(struct ds_tree *buckets, struct osw_stats_bucket *b)
+osw_stats_bucket_index_link(struct osw_stats_bucket_index *index,
+                            struct osw_stats_bucket *b)
+{
+    struct osw_stats_bucket **slot = &index->slots[b->index_hash & (index->n_slots - 1)];
+    b->index_next = *slot;
+    *slot = b;
+}
+
+static void
+osw_stats_bucket_index_grow(struct osw_stats_bucket_index *index,
+                            struct osw_stats_subscriber_counters *counters)
+{
+    struct osw_stats_bucket **old_slots = index->slots;
+    const size_t old_n_slots = index->n_slots;
+    size_t i;
+
+    index->n_slots = old_n_slots > 0
+                   ? old_n_slots * 2
+                   : OSW_STATS_BUCKET_INDEX_MIN_SLOTS;
+    index->slots = CALLOC(index->n_slots, sizeof(*index->slots));
+    counters->allocs++;
+
+    for (i = 0; i < old_n_slots; i++) {
+        struct osw_stats_bucket *b = old_slots[i];
+        while (b != NULL) {
+            struct osw_stats_bucket *next = b->index_next;
+            osw_stats_bucket_index_link(index, b);
+            b = next;
+        }
+    }
+
+    FREE(old_slots);
+}
+
+static void
+osw_stats_bucket_index_insert(struct osw_stats_bucket_index *index,
+                              struct osw_stats_subscriber_counters *counters,
+                              struct osw_stats_bucket *b)
+{
+    if (index->n_buckets >= index->n_slots) {
+        osw_stats_bucket_index_grow(index, counters);
+    }
+
+    osw_stats_bucket_index_link(index, b);
+    index->n_buckets++;
+}
+
+static void
+osw_stats_bucket_index_remove(struct osw_stats_bucket_index *index,
+                              struct osw_stats_bucket *b)
+{
+    struct osw_stats_bucket **i;
+
+    if (index->n_slots == 0) return;
+
+    for (i = &index->slots[b->index_hash & (index->n_slots - 1)]; *i != NULL; i = &(*i)->index_next) {
+        if (*i != b) continue;
+        *i = b->index_next;
+        b->index_next = NULL;
+        index->n_buckets--;
+        return;
+    }
+}
+
+static void
+osw_stats_bucket_index_fini(struct osw_stats_bucket_index *index)
+{
+    FREE(index->slots);
+    index->slots = NULL;
+    index->n_slots = 0;
+    index->n_buckets = 0;
+}
+
+static void
+osw_stats_subscriber_free_bucket(struct osw_stats_subscriber *sub,
+                                 const enum osw_stats_id id,
+                                 struct osw_stats_bucket *b)
 {
     if (b == NULL) return;
-    if (buckets != NULL) ds_tree_remove(buckets, b);
+    ds_tree_remove(&sub->buckets[id], b);
+    osw_stats_bucket_index_remove(&sub->index[id], b);
     osw_tlv_fini(&b->key);
     osw_tlv_fini(&b->data);
     osw_tlv_fini(&b->last);
     FREE(b);
+    sub->counters[id].frees++;
+}
+
+static struct osw_stats_bucket *
+osw_stats_subscriber_get_bucket(struct osw_stats_subscriber *sub,
+                                const enum osw_stats_id id,
+                                const struct osw_tlv *key)
+{
+    struct osw_stats_bucket_index *index = &sub->index[id];
+    struct osw_stats_subscriber_counters *counters = &sub->counters[id];
+    const uint32_t hash = osw_stats_bucket_key_hash(key);
+    struct osw_stats_bucket *bucket = osw_stats_bucket_index_lookup(index, key, hash);
+
+    if (bucket != NULL) return bucket;
+
+    bucket = CALLOC(1, sizeof(*bucket));
+    bucket->index_hash = hash;
+    osw_tlv_copy(&bucket->key, key);
+    ds_tree_insert(&sub->buckets[id], bucket, &bucket->key);
+    osw_stats_bucket_index_insert(index, counters, bucket);
+    counters->allocs++;
+    return bucket;
 }
 
 static bool
@@ -232,20 +382,31 @@ osw_stats_subscriber_put(struct osw_stats_subscriber *sub,
     const int bit = 1 << id;
     if ((sub->stats_mask & bit) == 0) return OSW_TLV_MERGE_OK;
 
-    struct ds_tree *tree = &sub->buckets[id];
-    struct osw_stats_bucket *bucket = ds_tree_find(tree, key);
+    struct osw_stats_bucket *bucket = osw_stats_subscriber_get_bucket(sub, id, key);
+    struct osw_stats_subscriber_counters *counters = &sub->counters[id];
     const bool first = osw_stats_first_to_bool(true, defs->first);
-
-    if (bucket == NULL) {
-        bucket = CALLOC(1, sizeof(*bucket));
-        osw_tlv_copy(&bucket->key, key);
-        ds_tree_insert(tree, bucket, &bucket->key);
+    const bool underflow = osw_tlv_merge_underflows(&bucket->last,
+                                                    data, len,
+                                                    defs->tpolicy,
+                                                    defs->mpolicy,
+                                                    defs->size);
+
+    if (underflow == true) {
+        /* Some absolute TLVs need 2 samples to compute
+         * the delta. However some require only 1
+         * because they can be compared against "0". For
+         * example re-association and station counters
+         * can be compared against 0. To handle the
+         * latter clear out last samples before merging.
+         *
+         * This is checked up front so that bucket->data
+         * never needs to be snapshotted and restored
+         * after a partially applied merge.
+         */
+        osw_tlv_fini(&bucket->last);
+        counters->underflows++;
     }
 
-    struct osw_tlv backup;
-    MEMZERO(backup);
-    osw_tlv_copy(&backup, &bucket->data);
-
     const enum osw_tlv_merge_result r = osw_tlv_merge(&bucket->data,
                                                       &bucket->last,
                                                       data, len,
@@ -253,34 +414,12 @@ osw_stats_subscriber_put(struct osw_stats_subscriber *sub,
                                                       defs->tpolicy,
                                                       defs->mpolicy,
                                                       defs->size);
-    switch (r) {
-        case OSW_TLV_MERGE_OK:
-            break;
-        case OSW_TLV_MERGE_ERR:
-            break;
-        case OSW_TLV_MERGE_ERR_UNDERFLOW:
-            /* Some absolute TLVs need 2 samples to compute
-             * the delta. However some require only 1
-             * because they can be compared against "0". For
-             * example re-association and station counters
-             * can be compared against 0. To handle the
-             * latter clear out last samples and try again.
-             */
-            osw_tlv_fini(&bucket->data);
-            osw_tlv_fini(&bucket->last);
-            bucket->data = backup;
-            MEMZERO(backup);
-            osw_tlv_merge(&bucket->data,
-                          &bucket->last,
-                          data, len,
-                          first,
-                          defs->tpolicy,
-                          defs->mpolicy,
-                          defs->size);
-
-            break;
-    }
-    osw_tlv_fini(&backup);
+    counters->merges++;
+
+    if (underflow == true) {
+        return OSW_TLV_MERGE_ERR_UNDERFLOW;
+    }
+
     return r;
 }
 
@@ -313,7 +452,7 @@ osw_stats_subscriber_flush(struct osw_stats_subscriber *sub)
         ds_tree_foreach_safe(buckets, b, tmp) {
             osw_stats_bucket_expire_work(b);
             if (osw_stats_bucket_is_expired(b) == true) {
-                osw_stats_bucket_free(buckets, b);
+                osw_stats_subscriber_free_bucket(sub, id, b);
                 continue;
             }
 
@@ -346,8 +485,10 @@ osw_stats_subscriber_free_buckets(struct osw_stats_subscriber *sub)
         struct osw_stats_bucket *b;
 
         ds_tree_foreach_safe(buckets, b, tmp) {
-            osw_stats_bucket_free(buckets, b);
+            osw_stats_subscriber_free_bucket(sub, i, b);
         }
+
+        osw_stats_bucket_index_fini(&sub->index[i]);
     }
 }
 
@@ -394,6 +535,15 @@ osw_stats_subscriber_free(struct osw_stats_subscriber *sub)
     FREE(sub);
 }
 
+const struct osw_stats_subscriber_counters *
+osw_stats_subscriber_get_counters(const struct osw_stats_subscriber *sub,
+                                  const enum osw_stats_id id)
+{
+    if (sub == NULL) return NULL;
+    if ((size_t)id >= ARRAY_SIZE(sub->counters)) return NULL;
+    return &sub->counters[id];
+}
+
 void
 osw_stats_subscriber_set_report_fn(struct osw_stats_subscriber *sub,
                                    osw_stats_subscriber_report_fn_t *fn,
@@ -303,6 +303,65 @@ OSW_UT(osw_stats_bucket_expiry)
     osw_tlv_fini(&s0);
 }
 
+OSW_UT(osw_stats_bucket_index)
+{
+    const size_t n = 100;
+    struct osw_tlv s0;
+    MEMZERO(s0);
+    struct osw_tlv s1;
+    MEMZERO(s1);
+    size_t i;
+    for (i = 0; i < n; i++) {
+        osw_stats_ut_put_chan(&s0, "phy0", 2000 + i, OSW_STATS_CHAN_CNT_MSEC, 0, 0, 0, 0, 0);
+        osw_stats_ut_put_chan(&s1, "phy0", 2000 + i, OSW_STATS_CHAN_CNT_MSEC, 1000, 50, 100, 50, 500);
+    }
+    struct osw_stats stats;
+    MEMZERO(stats);
+    struct osw_stats_subscriber *sub = osw_stats_subscriber_alloc();
+    const struct osw_stats_subscriber_counters *c = osw_stats_subscriber_get_counters(sub, OSW_STATS_CHAN);
+    const struct osw_stats_bucket_index *index = &sub->index[OSW_STATS_CHAN];
+    assert(c != NULL);
+    assert(osw_stats_subscriber_get_counters(sub, OSW_STATS_MAX__) == NULL);
+    osw_stats_init(&stats);
+    osw_stats_subscriber_set_chan(sub, true);
+    osw_stats_subscriber_set_poll_seconds(sub, 1.0);
+    osw_stats_subscriber_set_report_seconds(sub, 1.0);
+    osw_stats_register_subscriber__(&stats, sub);
+
+    osw_stats_put_tlv(&stats, &s0);
+    assert(c->merges == n);
+    assert(c->underflows == 0);
+    assert(index->n_buckets == n);
+    assert(index->n_slots >= n);
+    /* buckets + index slot tables */
+    const unsigned long allocs = c->allocs;
+    assert(allocs > n);
+
+    {
+        struct osw_stats_bucket *b;
+        ds_tree_foreach(&sub->buckets[OSW_STATS_CHAN], b) {
+            assert(osw_stats_bucket_index_lookup(index, &b->key, osw_stats_bucket_key_hash(&b->key)) == b);
+        }
+    }
+
+    /* Merging into existing buckets must not allocate */
+    osw_stats_put_tlv(&stats, &s1);
+    assert(c->merges == 2 * n);
+    assert(c->underflows == 0);
+    assert(c->allocs == allocs);
+
+    /* Counters going backwards */
+    osw_stats_put_tlv(&stats, &s0);
+    assert(c->merges == 3 * n);
+    assert(c->underflows == n);
+    assert(c->allocs == allocs);
+
+    osw_stats_unregister_subscriber(sub);
+    osw_stats_subscriber_free(sub);
+    osw_tlv_fini(&s0);
+    osw_tlv_fini(&s1);
+}
+
 static void
 osw_stats_ut_put_bss(struct osw_tlv *t,
                      const char *phy_name,
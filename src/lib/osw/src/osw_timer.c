@@ -32,7 +32,132 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <osw_timer.h>
 #include <osw_module.h>
 
-static struct ds_dlist g_active_list = DS_DLIST_INIT(struct osw_timer, node);
+/*
+ * Active timers are kept in a pairing heap: arming is O(1), removing
+ * the earliest or an arbitrary timer is O(log n) amortized. Each node
+ * links to its first child and its siblings; heap_prev points to the
+ * parent for a first child and to the previous sibling otherwise.
+ */
+static struct osw_timer *g_heap;
+static uint64_t g_seq;
+
+/*
+ * Timers due at the same time fire in the reverse order they were
+ * armed in, as with the sorted list the heap replaced.
+ */
+static bool
+osw_timer_heap_before(const struct osw_timer *a,
+                      const struct osw_timer *b)
+{
+    if (a->at_nsec != b->at_nsec)
+        return a->at_nsec < b->at_nsec;
+
+    return a->seq > b->seq;
+}
+
+static struct osw_timer *
+osw_timer_heap_meld(struct osw_timer *a,
+                    struct osw_timer *b)
+{
+    struct osw_timer *tmp;
+
+    if (a == NULL) return b;
+    if (b == NULL) return a;
+
+    if (osw_timer_heap_before(b, a) == true) {
+        tmp = a;
+        a = b;
+        b = tmp;
+    }
+
+    /* b becomes the first child of a */
+    b->heap_prev = a;
+    b->heap_next = a->heap_child;
+    if (a->heap_child != NULL)
+        a->heap_child->heap_prev = b;
+    a->heap_child = b;
+
+    a->heap_next = NULL;
+    a->heap_prev = NULL;
+    return a;
+}
+
+/* Two pass pairing of a sibling list into a single tree */
+static struct osw_timer *
+osw_timer_heap_merge_pairs(struct osw_timer *first)
+{
+    struct osw_timer *pairs = NULL;
+    struct osw_timer *root = NULL;
+    struct osw_timer *next;
+    struct osw_timer *a;
+    struct osw_timer *b;
+
+    /* Meld siblings pairwise, left to right, stacking the results */
+    while (first != NULL) {
+        a = first;
+        b = a->heap_next;
+        next = (b != NULL) ? b->heap_next : NULL;
+
+        a->heap_next = a->heap_prev = NULL;
+        if (b != NULL)
+            b->heap_next = b->heap_prev = NULL;
+
+        a = osw_timer_heap_meld(a, b);
+        a->heap_next = pairs;
+        pairs = a;
+        first = next;
+    }
+
+    /* Meld the pairs, right to left */
+    while (pairs != NULL) {
+        next = pairs->heap_next;
+        pairs->heap_next = NULL;
+        root = osw_timer_heap_meld(root, pairs);
+        pairs = next;
+    }
+
+    return root;
+}
+
+static void
+osw_timer_heap_insert(struct osw_timer *timer)
+{
+    timer->heap_child = NULL;
+    timer->heap_next = NULL;
+    timer->heap_prev = NULL;
+    timer->queued = true;
+    g_heap = osw_timer_heap_meld(g_heap, timer);
+}
+
+static void
+osw_timer_heap_remove(struct osw_timer *timer)
+{
+    struct osw_timer *children;
+
+    WARN_ON(timer->queued == false);
+
+    children = osw_timer_heap_merge_pairs(timer->heap_child);
+
+    if (timer == g_heap) {
+        g_heap = children;
+    }
+    else {
+        if (timer->heap_prev->heap_child == timer)
+            timer->heap_prev->heap_child = timer->heap_next;
+        else
+            timer->heap_prev->heap_next = timer->heap_next;
+
+        if (timer->heap_next != NULL)
+            timer->heap_next->heap_prev = timer->heap_prev;
+
+        g_heap = osw_timer_heap_meld(g_heap, children);
+    }
+
+    timer->heap_child = NULL;
+    timer->heap_next = NULL;
+    timer->heap_prev = NULL;
+    timer->queued = false;
+}
 
 void
 osw_timer_core_dispatch(uint64_t now_nsec)
@@ -40,15 +165,13 @@ osw_timer_core_dispatch(uint64_t now_nsec)
     struct ds_dlist pending_list = DS_DLIST_INIT(struct osw_timer, node);
 
     /* Prepare */
-    while (ds_dlist_is_empty(&g_active_list) == false) {
-        struct osw_timer *timer = (struct osw_timer*) ds_dlist_head(&g_active_list);
+    while (g_heap != NULL) {
+        struct osw_timer *timer = g_heap;
 
         if (timer->at_nsec > now_nsec)
             break;
 
-        WARN_ON(timer->list != &g_active_list);
-        ds_dlist_remove(&g_active_list, timer);
-        timer->list = NULL;
+        osw_timer_heap_remove(timer);
 
         ds_dlist_insert_tail(&pending_list, timer);
         timer->list = &pending_list;
@@ -72,13 +195,10 @@ osw_timer_core_get_next_at(uint64_t *next_at_nsec)
 {
     ASSERT(next_at_nsec != NULL, "");
 
-    struct osw_timer *timer;
-
-    if (ds_dlist_is_empty(&g_active_list) == true)
+    if (g_heap == NULL)
         return false;
 
-    timer = (struct osw_timer*) ds_dlist_head(&g_active_list);
-    *next_at_nsec = timer->at_nsec;
+    *next_at_nsec = g_heap->at_nsec;
     return true;
 }
 
@@ -100,24 +220,17 @@ osw_timer_arm_at_nsec(struct osw_timer *timer,
     ASSERT(timer != NULL, "");
     ASSERT(timer->cb != NULL, "");
 
-    struct osw_timer *next_timer;
+    if (timer->queued)
+        osw_timer_heap_remove(timer);
 
-    timer->at_nsec = nsec;
     if (timer->list) {
         ds_dlist_remove(timer->list, timer);
         timer->list = NULL;
     }
 
-    ds_dlist_foreach(&g_active_list, next_timer)
-        if (next_timer->at_nsec >= timer->at_nsec)
-            break;
-
-    if (next_timer != NULL)
-        ds_dlist_insert_before(&g_active_list, next_timer, timer);
-    else
-        ds_dlist_insert_tail(&g_active_list, timer);
-
-    timer->list = &g_active_list;
+    timer->at_nsec = nsec;
+    timer->seq = ++g_seq;
+    osw_timer_heap_insert(timer);
 }
 
 void
@@ -125,6 +238,9 @@ osw_timer_disarm(struct osw_timer *timer)
 {
     ASSERT(timer != NULL, "");
 
+    if (timer->queued)
+        osw_timer_heap_remove(timer);
+
     if (timer->list == NULL)
         return;
 
@@ -136,7 +252,7 @@ bool
 osw_timer_is_armed(const struct osw_timer *timer)
 {
     ASSERT(timer != NULL, "");
-    return timer->list != NULL;
+    return timer->queued || timer->list != NULL;
 }
 
 uint64_t
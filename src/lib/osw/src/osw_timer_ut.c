@@ -24,10 +24,17 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <inttypes.h>
+#include <stdlib.h>
+#include <time.h>
 #include <const.h>
 #include <ev.h>
+#include <memutil.h>
 #include <osw_ut.h>
 
+#define OSW_TIMER_UT_BENCH_TIMERS 20000
+#define OSW_TIMER_UT_BENCH_REARMS 5
+
 struct osw_timer_ut_dummy {
     bool dispatched;
     struct osw_timer timer;
@@ -46,6 +53,37 @@ osw_timer_ut_nop_cb(struct osw_timer *timer)
     /* nop */
 }
 
+static struct osw_timer *
+osw_timer_ut_pop(void)
+{
+    struct osw_timer *timer = g_heap;
+
+    if (timer != NULL)
+        osw_timer_heap_remove(timer);
+
+    return timer;
+}
+
+static uint64_t g_osw_timer_ut_last_at;
+static unsigned int g_osw_timer_ut_fired;
+
+static void
+osw_timer_ut_order_cb(struct osw_timer *timer)
+{
+    assert(timer->at_nsec >= g_osw_timer_ut_last_at);
+    g_osw_timer_ut_last_at = timer->at_nsec;
+    g_osw_timer_ut_fired++;
+}
+
+static uint64_t
+osw_timer_ut_clock_nsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
 OSW_UT(osw_timer_ut_lifecycle)
 {
     struct osw_timer_ut_dummy dummy_a;
@@ -171,9 +209,110 @@ OSW_UT(osw_timer_ut_ordering)
     osw_timer_arm_at_nsec(&t0, 0);
     osw_timer_arm_at_nsec(&t20, 20);
 
-    assert(ds_dlist_remove_head(&g_active_list) == &t0);
-    assert(ds_dlist_remove_head(&g_active_list) == &t5);
-    assert(ds_dlist_remove_head(&g_active_list) == &t10);
-    assert(ds_dlist_remove_head(&g_active_list) == &t15);
-    assert(ds_dlist_remove_head(&g_active_list) == &t20);
+    assert(osw_timer_ut_pop() == &t0);
+    assert(osw_timer_ut_pop() == &t5);
+    assert(osw_timer_ut_pop() == &t10);
+    assert(osw_timer_ut_pop() == &t15);
+    assert(osw_timer_ut_pop() == &t20);
+    assert(osw_timer_ut_pop() == NULL);
+}
+
+OSW_UT(osw_timer_ut_ordering_ties)
+{
+    struct osw_timer a = { .cb = osw_timer_ut_nop_cb };
+    struct osw_timer b = { .cb = osw_timer_ut_nop_cb };
+    struct osw_timer c = { .cb = osw_timer_ut_nop_cb };
+
+    /* Timers due at the same time: the last armed goes first */
+    osw_timer_arm_at_nsec(&a, 10);
+    osw_timer_arm_at_nsec(&b, 10);
+    osw_timer_arm_at_nsec(&c, 10);
+    osw_timer_arm_at_nsec(&a, 10);
+
+    assert(osw_timer_ut_pop() == &a);
+    assert(osw_timer_ut_pop() == &c);
+    assert(osw_timer_ut_pop() == &b);
+    assert(osw_timer_ut_pop() == NULL);
+}
+
+OSW_UT(osw_timer_ut_rearm_disarm)
+{
+    struct osw_timer timers[64];
+    uint64_t next_at_nsec;
+    unsigned int seed = 1;
+    size_t i;
+    size_t n;
+
+    g_osw_timer_ut_last_at = 0;
+    g_osw_timer_ut_fired = 0;
+
+    for (i = 0; i < ARRAY_SIZE(timers); i++)
+        osw_timer_init(&timers[i], osw_timer_ut_order_cb);
+
+    /* Shuffle the heap around: arm, re-arm and disarm at random */
+    for (n = 0; n < 10000; n++) {
+        i = rand_r(&seed) % ARRAY_SIZE(timers);
+        if (rand_r(&seed) % 4 == 0)
+            osw_timer_disarm(&timers[i]);
+        else
+            osw_timer_arm_at_nsec(&timers[i], 1 + rand_r(&seed) % 1000);
+    }
+
+    n = 0;
+    for (i = 0; i < ARRAY_SIZE(timers); i++)
+        if (osw_timer_is_armed(&timers[i]) == true)
+            n++;
+
+    assert(osw_timer_core_get_next_at(&next_at_nsec) == true);
+    osw_timer_core_dispatch(1000);
+    assert(g_osw_timer_ut_fired == n);
+    assert(osw_timer_core_get_next_at(&next_at_nsec) == false);
+}
+
+/*
+ * Micro-benchmark: arm many timers, re-arm each of them a few times as
+ * during a roaming storm, then dispatch them all.
+ */
+OSW_UT(osw_timer_ut_bench)
+{
+    const size_t count = OSW_TIMER_UT_BENCH_TIMERS;
+    struct osw_timer *timers = CALLOC(count, sizeof(*timers));
+    unsigned int seed = 1;
+    uint64_t dispatch_nsec;
+    uint64_t rearm_nsec;
+    uint64_t arm_nsec;
+    uint64_t start;
+    size_t i;
+    size_t r;
+
+    g_osw_timer_ut_last_at = 0;
+    g_osw_timer_ut_fired = 0;
+
+    for (i = 0; i < count; i++)
+        osw_timer_init(&timers[i], osw_timer_ut_order_cb);
+
+    start = osw_timer_ut_clock_nsec();
+    for (i = 0; i < count; i++)
+        osw_timer_arm_at_nsec(&timers[i], 1 + rand_r(&seed) % 1000000);
+    arm_nsec = osw_timer_ut_clock_nsec() - start;
+
+    start = osw_timer_ut_clock_nsec();
+    for (r = 0; r < OSW_TIMER_UT_BENCH_REARMS; r++)
+        for (i = 0; i < count; i++)
+            osw_timer_arm_at_nsec(&timers[i], 1 + rand_r(&seed) % 1000000);
+    rearm_nsec = osw_timer_ut_clock_nsec() - start;
+
+    start = osw_timer_ut_clock_nsec();
+    osw_timer_core_dispatch(1000000);
+    dispatch_nsec = osw_timer_ut_clock_nsec() - start;
+
+    assert(g_osw_timer_ut_fired == count);
+
+    LOGI("osw: timer: ut: bench: timers: %zu arm: %"PRIu64" ns/op rearm: %"PRIu64" ns/op dispatch: %"PRIu64" ns/op",
+         count,
+         arm_nsec / count,
+         rearm_nsec / (count * OSW_TIMER_UT_BENCH_REARMS),
+         dispatch_nsec / count);
+
+    FREE(timers);
 }
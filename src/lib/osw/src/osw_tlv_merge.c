@@ -414,4 +414,111 @@ osw_tlv_merge(struct osw_tlv *dest_tlv,
     return OSW_TLV_MERGE_OK;
 }
 
+static bool
+osw_tlv_merge_underflows_buf(const void *prev,
+                             const size_t prev_len,
+                             const void *data,
+                             const size_t len,
+                             const struct osw_tlv_policy *tpolicy,
+                             const struct osw_tlv_merge_policy *mpolicy,
+                             const size_t tb_size);
+
+/* This must mirror the conditions under which
+ * osw_tlv_merge_op_accumulate_cb() and
+ * osw_tlv_merge_op_merge_cb() report underflow.
+ */
+static bool
+osw_tlv_merge_op_underflows(const struct osw_tlv_hdr *src,
+                            const struct osw_tlv_hdr *prev,
+                            const struct osw_tlv_policy *tpolicy,
+                            const struct osw_tlv_merge_policy *mpolicy)
+{
+    const uint32_t id = src->id;
+    const enum osw_tlv_type type = src->type;
+
+    switch (mpolicy[id].type) {
+        case OSW_TLV_OP_NONE:
+        case OSW_TLV_OP_OVERWRITE:
+            return false;
+        case OSW_TLV_OP_ACCUMULATE:
+            {
+                const bool need_diff = ((src->flags & OSW_TLV_F_DELTA) == 0);
+                osw_tlv_merge_ufl_fn_t *ufl_fn = osw_tlv_merge_ufl_fn_lookup(type);
+
+                if (need_diff == false) return false;
+                if (osw_tlv_merge_add_fn_lookup(type) == NULL) return false;
+                if (osw_tlv_merge_sub_fn_lookup(type) == NULL) return false;
+                if (ufl_fn == NULL) return false;
+
+                return ufl_fn(osw_tlv_get_data(src), osw_tlv_get_data(prev));
+            }
+        case OSW_TLV_OP_MERGE:
+            if (tpolicy == NULL) return false;
+            if (tpolicy[id].tb_size == 0) return false;
+            if (tpolicy[id].tb_size != mpolicy[id].tb_size) return false;
+            if (mpolicy[id].nested == NULL) return false;
+            if (type != OSW_TLV_NESTED) return false;
+
+            return osw_tlv_merge_underflows_buf(osw_tlv_get_data(prev),
+                                                prev->len,
+                                                osw_tlv_get_data(src),
+                                                src->len,
+                                                tpolicy[id].nested,
+                                                mpolicy[id].nested,
+                                                tpolicy[id].tb_size);
+    }
+    return false;
+}
+
+static bool
+osw_tlv_merge_underflows_buf(const void *prev,
+                             const size_t prev_len,
+                             const void *data,
+                             const size_t len,
+                             const struct osw_tlv_policy *tpolicy,
+                             const struct osw_tlv_merge_policy *mpolicy,
+                             const size_t tb_size)
+{
+    /* Nothing to compute deltas against */
+    if (prev_len == 0) return false;
+    if (mpolicy == NULL) return false;
+    if (tb_size == 0) return false;
+
+    const struct osw_tlv_hdr *ntb[tb_size];
+    const struct osw_tlv_hdr *ptb[tb_size];
+    size_t i;
+
+    memset(ntb, 0, tb_size * sizeof(*ntb));
+    memset(ptb, 0, tb_size * sizeof(*ptb));
+
+    osw_tlv_parse(prev, prev_len, tpolicy, ptb, tb_size);
+    osw_tlv_parse(data, len, tpolicy, ntb, tb_size);
+
+    for (i = 0; i < tb_size; i++) {
+        if (ntb[i] == NULL) continue;
+        if (ptb[i] == NULL) continue;
+        if (ptb[i]->type != ntb[i]->type) continue;
+        if (osw_tlv_merge_op_underflows(ntb[i], ptb[i], tpolicy, mpolicy) == true) return true;
+    }
+
+    return false;
+}
+
+bool
+osw_tlv_merge_underflows(const struct osw_tlv *prev_tlv,
+                         const void *data,
+                         const size_t len,
+                         const struct osw_tlv_policy *tpolicy,
+                         const struct osw_tlv_merge_policy *mpolicy,
+                         const size_t tb_size)
+{
+    return osw_tlv_merge_underflows_buf(prev_tlv->data,
+                                        prev_tlv->used,
+                                        data,
+                                        len,
+                                        tpolicy,
+                                        mpolicy,
+                                        tb_size);
+}
+
 #include "osw_tlv_merge_ut.c.h"
@@ -613,3 +613,83 @@ OSW_UT(osw_tlv_merge_repack_str)
     assert(dest.used != len2);
     assert(dest.used == len1);
 }
+
+OSW_UT(osw_tlv_merge_underflows)
+{
+    enum {
+        STATI,
+        STATN,
+        STATMAX,
+    };
+    enum {
+        NESTI,
+        NESTMAX,
+    };
+    const struct osw_tlv_policy pn[NESTMAX] = {
+        [NESTI] = { .type = OSW_TLV_U32 },
+    };
+    const struct osw_tlv_policy p[STATMAX] = {
+        [STATI] = { .type = OSW_TLV_U32 },
+        [STATN] = { .type = OSW_TLV_NESTED,
+                    .nested = pn,
+                    .tb_size = NESTMAX },
+    };
+    const struct osw_tlv_merge_policy p2n[NESTMAX] = {
+        [NESTI] = { .type = OSW_TLV_OP_ACCUMULATE },
+    };
+    const struct osw_tlv_merge_policy p2[STATMAX] = {
+        [STATI] = { .type = OSW_TLV_OP_ACCUMULATE },
+        [STATN] = { .type = OSW_TLV_OP_MERGE,
+                    .nested = p2n,
+                    .tb_size = NESTMAX },
+    };
+
+    struct osw_tlv dest = {0};
+    struct osw_tlv prev = {0};
+    struct osw_tlv src = {0};
+    size_t start;
+
+    /* Nothing to underflow against */
+    osw_tlv_put_u32(&src, STATI, 10);
+    start = osw_tlv_put_nested(&src, STATN);
+    osw_tlv_put_u32(&src, NESTI, 10);
+    osw_tlv_end_nested(&src, start);
+    assert(osw_tlv_merge_underflows(&prev, src.data, src.used, p, p2, STATMAX) == false);
+    assert(osw_tlv_merge(&dest, &prev, src.data, src.used, false, p, p2, STATMAX) == OSW_TLV_MERGE_OK);
+    osw_tlv_fini(&src);
+    assert(prev.used > 0);
+
+    /* Nested counter went backwards */
+    osw_tlv_put_u32(&src, STATI, 12);
+    start = osw_tlv_put_nested(&src, STATN);
+    osw_tlv_put_u32(&src, NESTI, 5);
+    osw_tlv_end_nested(&src, start);
+    {
+        const size_t prev_used = prev.used;
+        assert(osw_tlv_merge_underflows(&prev, src.data, src.used, p, p2, STATMAX) == true);
+        assert(prev.used == prev_used);
+    }
+    assert(osw_tlv_merge(&dest, &prev, src.data, src.used, false, p, p2, STATMAX) == OSW_TLV_MERGE_ERR_UNDERFLOW);
+    osw_tlv_fini(&src);
+
+    /* Top level counter went backwards */
+    osw_tlv_put_u32(&src, STATI, 1);
+    start = osw_tlv_put_nested(&src, STATN);
+    osw_tlv_put_u32(&src, NESTI, 6);
+    osw_tlv_end_nested(&src, start);
+    assert(osw_tlv_merge_underflows(&prev, src.data, src.used, p, p2, STATMAX) == true);
+    assert(osw_tlv_merge(&dest, &prev, src.data, src.used, false, p, p2, STATMAX) == OSW_TLV_MERGE_ERR_UNDERFLOW);
+    osw_tlv_fini(&src);
+
+    /* Both moved forward */
+    osw_tlv_put_u32(&src, STATI, 2);
+    start = osw_tlv_put_nested(&src, STATN);
+    osw_tlv_put_u32(&src, NESTI, 7);
+    osw_tlv_end_nested(&src, start);
+    assert(osw_tlv_merge_underflows(&prev, src.data, src.used, p, p2, STATMAX) == false);
+    assert(osw_tlv_merge(&dest, &prev, src.data, src.used, false, p, p2, STATMAX) == OSW_TLV_MERGE_OK);
+    osw_tlv_fini(&src);
+
+    osw_tlv_fini(&dest);
+    osw_tlv_fini(&prev);
+}
@@ -36,6 +36,11 @@ struct ovsdb_stream *ovsdb_stream_alloc(void);
 
 int ovsdb_stream_run(struct ovsdb_stream *st, int fd, bool (*fn)(json_t *));
 
+/* Same as ovsdb_stream_run(), except that fn receives the raw
+ * text of each complete message instead of a parsed document.
+ */
+int ovsdb_stream_run_raw(struct ovsdb_stream *st, int fd, bool (*fn)(const char *buf, size_t len));
+
 int ovsdb_stream_recv(struct ovsdb_stream *st, int fd);
 
 json_t *ovsdb_stream_next_json(struct ovsdb_stream *st);
@@ -74,6 +74,89 @@ static inline json_t *ovsdb_update_parse_get_old(ovsdb_update_parse_t *self)
     return self->up_jold;
 }
 
+/*
+ * ===========================================================================
+ *  OVSDB Update Streaming parser
+ * ===========================================================================
+ */
+
+/*
+ * Same as the update parser above, except that it walks the raw text of the
+ * update instead of a jansson document. Only the current row is decoded,
+ * which keeps the memory used by large updates (initial dumps) bounded by
+ * the size of a single row.
+ */
+#define OVSDB_UPDATE_STREAM_NAME_MAX    128
+
+/*
+ * Messages smaller than this are not worth streaming
+ */
+#define OVSDB_UPDATE_STREAM_MIN_SIZE    (32 * 1024)
+
+typedef struct ovsdb_update_stream ovsdb_update_stream_t;
+
+struct ovsdb_update_stream
+{
+    const char          *us_buf;            /* Raw table list */
+    size_t               us_len;            /* Length of the raw table list */
+    size_t               us_pos;            /* Parse position */
+    bool                 us_in_table;       /* Parsing the rows of a table */
+    bool                 us_error;          /* Parse error */
+    char                 us_table[OVSDB_UPDATE_STREAM_NAME_MAX];
+    char                 us_uuid[OVSDB_UPDATE_STREAM_NAME_MAX];
+    json_t              *us_jrow;           /* Current row document */
+    json_t              *us_jnew;           /* Current (new) row data */
+    json_t              *us_jold;           /* Old row data, if any */
+};
+
+extern bool ovsdb_update_stream_start(ovsdb_update_stream_t *self, const char *buf, size_t len);
+extern bool ovsdb_update_stream_next(ovsdb_update_stream_t *self);
+extern void ovsdb_update_stream_end(ovsdb_update_stream_t *self);
+
+static inline const char *ovsdb_update_stream_get_table(ovsdb_update_stream_t *self)
+{
+    return self->us_table;
+}
+
+static inline const char *ovsdb_update_stream_get_uuid(ovsdb_update_stream_t *self)
+{
+    return self->us_uuid;
+}
+
+static inline json_t *ovsdb_update_stream_get_new(ovsdb_update_stream_t *self)
+{
+    return self->us_jnew;
+}
+
+static inline json_t *ovsdb_update_stream_get_old(ovsdb_update_stream_t *self)
+{
+    return self->us_jold;
+}
+
+static inline bool ovsdb_update_stream_failed(ovsdb_update_stream_t *self)
+{
+    return self->us_error;
+}
+
+/*
+ * Raw JSON-RPC message which carries table updates: either an "update"
+ * notification or a method result
+ */
+typedef struct ovsdb_update_msg ovsdb_update_msg_t;
+
+struct ovsdb_update_msg
+{
+    bool                 um_update;         /* "update" notification, otherwise a result */
+    int                  um_id;             /* Monitor id or JSON-RPC id */
+    const char          *um_tables;         /* Raw table list */
+    size_t               um_tables_len;
+};
+
+/*
+ * Check if the raw message is an update notification or a result, and locate its table list
+ */
+extern bool ovsdb_update_stream_msg(ovsdb_update_msg_t *msg, const char *buf, size_t len);
+
 /*
  * ===========================================================================
  *  OVSDB Update Monitor
@@ -142,6 +225,14 @@ extern bool ovsdb_update_monitor(
 
 bool ovsdb_update_monitor_cancel(ovsdb_update_monitor_t *self, const char *table_name);
 
+/*
+ * Stream the rows of a raw update notification or monitor reply to the monitor owning
+ * the handler; these return false if the handler does not belong to an update monitor
+ */
+bool ovsdb_update_monitor_stream_update(ovsdb_update_process_t *callback, void *data, const char *buf, size_t len);
+
+bool ovsdb_update_monitor_stream_result(json_rpc_response_t *callback, void *data, const char *buf, size_t len);
+
 bool ovsdb_update_changed(ovsdb_update_monitor_t *self, char *field);
 
 char* ovsdb_update_type_to_str(ovsdb_update_type_t update_type);
@@ -46,6 +46,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "os_ev_trace.h"
 
 #include "ovsdb_stream.h"
+#include "ovsdb_update.h"
 
 /*****************************************************************************/
 
@@ -84,6 +85,8 @@ static struct ds_dlist g_ovsdb_ready = DS_DLIST_INIT(struct ovsdb_ready, node);
  *  PROTECTED declarations
  *****************************************************************************/
 
+static bool ovsdb_process_recv_raw(const char *buf, size_t len);
+static bool ovsdb_process_stream(const char *buf, size_t len);
 static bool ovsdb_process_recv(json_t *js);
 static bool ovsdb_process_event(json_t *js);
 static bool ovsdb_process_result(json_t *id, json_t *js);
@@ -106,7 +109,7 @@ static void cb_ovsdb_read(struct ev_loop *loop, struct ev_io *watcher, int reven
         return;
     }
 
-    int err = ovsdb_stream_run(st, watcher->fd, ovsdb_process_recv);
+    int err = ovsdb_stream_run_raw(st, watcher->fd, ovsdb_process_recv_raw);
     if (err)
     {
         /* During Opensync restart OVSDB may end up getting
@@ -131,6 +134,70 @@ static void cb_ovsdb_read(struct ev_loop *loop, struct ev_io *watcher, int reven
     }
 }
 
+/**
+ * Dispatch raw JSON-RPC message
+ */
+bool ovsdb_process_recv_raw(const char *buf, size_t len)
+{
+    json_error_t error;
+    json_t *jsrpc;
+    bool rc;
+
+    /* Large table updates are delivered row by row, straight from the raw text */
+    if (len >= OVSDB_UPDATE_STREAM_MIN_SIZE && ovsdb_process_stream(buf, len))
+    {
+        return true;
+    }
+
+    jsrpc = json_loadb(buf, len, 0, &error);
+    if (jsrpc == NULL)
+    {
+        LOG(ERR, "JSON-RPC: Error parsing message: %s (line %d)", error.text, error.line);
+        return false;
+    }
+
+    rc = ovsdb_process_recv(jsrpc);
+    json_decref(jsrpc);
+
+    return rc;
+}
+
+/**
+ * Stream an update notification or a monitor reply to its update monitor, without
+ * building the whole message document. Returns false if the message must go through
+ * the generic path instead.
+ */
+bool ovsdb_process_stream(const char *buf, size_t len)
+{
+    struct rpc_response_handler *rrh;
+    struct rpc_update_handler *urh;
+    ovsdb_update_msg_t msg;
+
+    if (!ovsdb_update_stream_msg(&msg, buf, len)) return false;
+
+    if (msg.um_update)
+    {
+        urh = ds_tree_find(&json_rpc_update_handler_list, &msg.um_id);
+        if (urh == NULL) return false;
+
+        return ovsdb_update_monitor_stream_update(urh->rrh_callback, urh->data, msg.um_tables, msg.um_tables_len);
+    }
+
+    rrh = ds_tree_find(&json_rpc_handler_list, &msg.um_id);
+    if (rrh == NULL) return false;
+
+    if (!ovsdb_update_monitor_stream_result(rrh->rrh_callback, rrh->data, msg.um_tables, msg.um_tables_len))
+    {
+        return false;
+    }
+
+    /* Remove callback from the tree */
+    ds_tree_remove(&json_rpc_handler_list, rrh);
+    FREE(rrh);
+
+    return true;
+}
+
 /**
  * Dispatch message JSON-RPC
  */
@@ -48,18 +48,32 @@ struct ovsdb_stream_chunk
     size_t remaining;
 };
 
+/* Incremental framing state: locates the end of the first JSON
+ * value buffered in the stream. Bytes are scanned only once, as
+ * they arrive, instead of re-parsing the partial message on each
+ * receive.
+ */
+struct ovsdb_stream_scan
+{
+    struct ovsdb_stream_chunk *chunk;
+    size_t offset;
+    size_t length;
+    int depth;
+    bool started;
+    bool in_string;
+    bool escape;
+};
+
 struct ovsdb_stream
 {
     struct ds_dlist chunks;
-    struct ovsdb_stream_chunk *iter;
-    size_t position;
+    struct ovsdb_stream_scan scan;
 };
 
 static void ovsdb_stream_init(struct ovsdb_stream *st)
 {
     ds_dlist_init(&st->chunks, struct ovsdb_stream_chunk, node);
-    st->iter = NULL;
-    st->position = 0;
+    MEMZERO(st->scan);
 }
 
 static void ovsdb_stream_chunk_free(struct ovsdb_stream_chunk *c)
@@ -104,32 +118,88 @@ int ovsdb_stream_recv(struct ovsdb_stream *st, int fd)
     return 0;
 }
 
-static void ovsdb_stream_iter_init(struct ovsdb_stream *st)
+static size_t ovsdb_stream_scan_chunk(struct ovsdb_stream_scan *sc, const struct ovsdb_stream_chunk *c)
 {
-    st->iter = ds_dlist_head(&st->chunks);
-    st->position = 0;
+    const char *pos = c->pos;
+    while (sc->offset < c->remaining)
+    {
+        const char ch = pos[sc->offset++];
+        sc->length++;
+
+        if (sc->in_string)
+        {
+            if (sc->escape) sc->escape = false;
+            else if (ch == '\\') sc->escape = true;
+            else if (ch == '"') sc->in_string = false;
+            continue;
+        }
+
+        switch (ch)
+        {
+            case '"':
+                sc->in_string = true;
+                break;
+            case '{':
+            case '[':
+                sc->depth++;
+                sc->started = true;
+                break;
+            case '}':
+            case ']':
+                sc->depth--;
+                break;
+        }
+
+        if (sc->started && sc->depth <= 0) return sc->length;
+    }
+    return 0;
 }
 
-static void ovsdb_stream_iter_next(struct ovsdb_stream *st, struct ovsdb_stream_chunk *c)
+/* Returns the length of the first complete JSON value
+ * buffered in the stream, leading whitespace included,
+ * or 0 if it is not complete yet.
+ */
+static size_t ovsdb_stream_scan_frame(struct ovsdb_stream *st)
 {
-    if (st->position < c->remaining) return;
-    st->iter = ds_dlist_next(&st->chunks, c);
-    st->position = 0;
+    struct ovsdb_stream_scan *sc = &st->scan;
+    struct ovsdb_stream_chunk *c = sc->chunk ?: ds_dlist_head(&st->chunks);
+
+    while (c != NULL)
+    {
+        sc->chunk = c;
+        const size_t len = ovsdb_stream_scan_chunk(sc, c);
+        if (len > 0)
+        {
+            MEMZERO(*sc);
+            return len;
+        }
+
+        c = ds_dlist_next(&st->chunks, c);
+        if (c != NULL) sc->offset = 0;
+    }
+    return 0;
 }
 
-static size_t ovsdb_stream_next_json_cb(void *buf, size_t len, void *priv)
+/* Returns the frame as a contiguous buffer. It points into
+ * the head chunk when the frame fits there, otherwise the
+ * frame is copied to *copy which must be freed by the caller.
+ */
+static const char *ovsdb_stream_frame_buf(struct ovsdb_stream *st, size_t len, char **copy)
 {
-    struct ovsdb_stream *st = priv;
-    struct ovsdb_stream_chunk *c = st->iter;
-    if (c == NULL) return 0;
+    struct ovsdb_stream_chunk *c = ds_dlist_head(&st->chunks);
+    *copy = NULL;
+    if (c->remaining >= len) return c->pos;
 
-    const size_t remaining = c->remaining - st->position;
-    len = MIN(len, remaining);
-    memcpy(buf, c->pos + st->position, len);
-    st->position += len;
-
-    ovsdb_stream_iter_next(st, c);
-    return len;
+    char *buf = MALLOC(len);
+    size_t off = 0;
+    for (; c != NULL && off < len; c = ds_dlist_next(&st->chunks, c))
+    {
+        const size_t n = MIN(len - off, c->remaining);
+        memcpy(buf + off, c->pos, n);
+        off += n;
+    }
+    *copy = buf;
+    return buf;
 }
 
 static void ovsdb_stream_chunk_gc(struct ovsdb_stream *st, struct ovsdb_stream_chunk *c)
@@ -179,21 +249,37 @@ static void ovsdb_stream_advance(struct ovsdb_stream *st, size_t bytes)
     }
 }
 
-json_t *ovsdb_stream_next_json(struct ovsdb_stream *st)
+static json_t *ovsdb_stream_frame_json(const char *buf, size_t len)
 {
-    const size_t flags = JSON_DISABLE_EOF_CHECK;
     json_error_t error;
     MEMZERO(error);
 
-    ovsdb_stream_iter_init(st);
-    json_t *json = json_load_callback(ovsdb_stream_next_json_cb, st, flags, &error);
-    if (json != NULL)
+    json_t *json = json_loadb(buf, len, 0, &error);
+    if (json == NULL)
     {
-        ovsdb_stream_advance(st, error.position);
+        LOG(ERR, "JSON RECV: Error parsing message: %s (line %d)", error.text, error.line);
     }
     return json;
 }
 
+json_t *ovsdb_stream_next_json(struct ovsdb_stream *st)
+{
+    for (;;)
+    {
+        const size_t len = ovsdb_stream_scan_frame(st);
+        if (len == 0) return NULL;
+
+        char *copy;
+        const char *buf = ovsdb_stream_frame_buf(st, len, &copy);
+        json_t *json = ovsdb_stream_frame_json(buf, len);
+        FREE(copy);
+        ovsdb_stream_advance(st, len);
+
+        /* Malformed messages are dropped */
+        if (json != NULL) return json;
+    }
+}
+
 static void ovsdb_stream_consume(struct ovsdb_stream *st, bool (*fn)(json_t *))
 {
     for (;;)
@@ -206,6 +292,22 @@ static void ovsdb_stream_consume(struct ovsdb_stream *st, bool (*fn)(json_t *))
     }
 }
 
+static void ovsdb_stream_consume_raw(struct ovsdb_stream *st, bool (*fn)(const char *, size_t))
+{
+    for (;;)
+    {
+        const size_t len = ovsdb_stream_scan_frame(st);
+        if (len == 0) break;
+
+        char *copy;
+        const char *buf = ovsdb_stream_frame_buf(st, len, &copy);
+        const bool handled = fn(buf, len);
+        WARN_ON(handled == false);
+        FREE(copy);
+        ovsdb_stream_advance(st, len);
+    }
+}
+
 int ovsdb_stream_run(struct ovsdb_stream *st, int fd, bool (*fn)(json_t *))
 {
     const int err = ovsdb_stream_recv(st, fd);
@@ -214,6 +316,14 @@ int ovsdb_stream_run(struct ovsdb_stream *st, int fd, bool (*fn)(json_t *))
     return 0;
 }
 
+int ovsdb_stream_run_raw(struct ovsdb_stream *st, int fd, bool (*fn)(const char *buf, size_t len))
+{
+    const int err = ovsdb_stream_recv(st, fd);
+    if (err) return err;
+    ovsdb_stream_consume_raw(st, fn);
+    return 0;
+}
+
 struct ovsdb_stream *ovsdb_stream_alloc(void)
 {
     struct ovsdb_stream *st = MALLOC(sizeof(*st));
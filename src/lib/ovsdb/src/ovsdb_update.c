@@ -333,101 +333,175 @@ void ovsdb_update_monitor_resp_cbk(int id, bool is_error, json_t *js, void *data
 }
 
 /*
- * Process an update request
+ * Deliver a single row update to the monitor callback
  */
-void ovsdb_update_monitor_process(ovsdb_update_monitor_t *self, json_t *js)
+static void ovsdb_update_monitor_row(
+        ovsdb_update_monitor_t *self,
+        const char *table,
+        const char *uuid,
+        json_t *jnew,
+        json_t *jold)
 {
-    ovsdb_update_parse_t parse;
-    MEMZERO(parse);
+    self->mon_type      = OVSDB_UPDATE_ERROR;
+    self->mon_table     = table;
+    self->mon_uuid      = uuid;
+    self->mon_json_new  = jnew;
+    self->mon_json_old  = jold;
+
+    /* Figure out the type of the event */
+    if (self->mon_json_old == NULL && self->mon_json_new != NULL)
+    {
+        self->mon_type = OVSDB_UPDATE_NEW;
+    }
+    else if (self->mon_json_old != NULL && self->mon_json_new != NULL)
+    {
+        self->mon_type = OVSDB_UPDATE_MODIFY;
+    }
+    else if (self->mon_json_old != NULL && self->mon_json_new == NULL)
+    {
+        self->mon_type = OVSDB_UPDATE_DEL;
+    }
 
-    /* Start parsing the message */
-    if (!ovsdb_update_parse_start(&parse, js))
+    /*
+     * Somebody thought it would be a good idea to skip on the _uuid fields,
+     * as we already have it as the key. Our parser was modified to handle this
+     * special case. However, in order to avoid copying the uuid to the structure
+     * each time, we insert it here. This way the parser will take care of it
+     * for us.
+     */
+    json_t *juuid = json_array();
+    if (juuid == NULL)
     {
-        LOG(ERR, "UPDATE: Error parsing OVSDB uppdate notification.");
-        ovsdb_update_monitor_error(self);
+        LOG(ERR, "UPDATE: Error creating array for UUID.");
         return;
     }
 
-    while (ovsdb_update_parse_next(&parse))
+    do
     {
-        self->mon_type      = OVSDB_UPDATE_ERROR;
-        self->mon_table     = ovsdb_update_parse_get_table(&parse);
-        self->mon_uuid      = ovsdb_update_parse_get_uuid(&parse);
-        self->mon_json_new  = ovsdb_update_parse_get_new(&parse);
-        self->mon_json_old  = ovsdb_update_parse_get_old(&parse);
-
-        /* Figure out the type of the event */
-        if (self->mon_json_old == NULL && self->mon_json_new != NULL)
-        {
-            self->mon_type = OVSDB_UPDATE_NEW;
-        }
-        else if (self->mon_json_old != NULL && self->mon_json_new != NULL)
-        {
-            self->mon_type = OVSDB_UPDATE_MODIFY;
-        }
-        else if (self->mon_json_old != NULL && self->mon_json_new == NULL)
+        /*
+         * The UUID is an array, where the first element is the "uuid" string and the second element
+         * is the actual uuid.
+         */
+        if (json_array_append_new(juuid, json_string("uuid")) != 0)
         {
-            self->mon_type = OVSDB_UPDATE_DEL;
+            LOG(ERR, "UPDATE: Error appending string \"uuid\"");
+            break;
         }
 
-        /*
-         * Somebody thought it would be a good idea to skip on the _uuid fields,
-         * as we already have it as the key. Our parser was modified to handle this
-         * special case. However, in order to avoid copying the uuid to the structure
-         * each time, we insert it here. This way the parser will take care of it
-         * for us.
-         */
-        json_t *juuid = json_array();
-        if (juuid == NULL)
+        if (json_array_append_new(juuid, json_string(self->mon_uuid)) != 0)
         {
-            LOG(ERR, "UPDATE: Error creating array for UUID.");
-            continue;
+            LOG(ERR, "UPDATE: Error appending UUID.");
+            break;
         }
 
-        do
+        if (self->mon_json_new != NULL)
         {
-            /*
-             * The UUID is an array, where the first element is the "uuid" string and the second element
-             * is the actual uuid.
-             */
-            if (json_array_append_new(juuid, json_string("uuid")) != 0)
+            if (json_object_set(self->mon_json_new, "_uuid", juuid) != 0)
             {
-                LOG(ERR, "UPDATE: Error appending string \"uuid\"");
+                LOG(ERR, "UPDATE: Error appending UUID to NEW.");
                 break;
             }
+        }
 
-            if (json_array_append_new(juuid, json_string(self->mon_uuid)) != 0)
+        if (self->mon_json_old != NULL)
+        {
+            if (json_object_set(self->mon_json_old, "_uuid", juuid) != 0)
             {
-                LOG(ERR, "UPDATE: Error appending UUID.");
+                LOG(ERR, "UPDATE: Error appending UUID to OLD.");
                 break;
             }
+        }
 
-            if (self->mon_json_new != NULL)
-            {
-                if (json_object_set(self->mon_json_new, "_uuid", juuid) != 0)
-                {
-                    LOG(ERR, "UPDATE: Error appending UUID to NEW.");
-                    break;
-                }
-            }
+        self->mon_cb(self);
+    }
+    while (false);
 
-            if (self->mon_json_old != NULL)
-            {
-                if (json_object_set(self->mon_json_old, "_uuid", juuid) != 0)
-                {
-                    LOG(ERR, "UPDATE: Error appending UUID to OLD.");
-                    break;
-                }
-            }
+    json_decref(juuid);
+}
 
-            self->mon_cb(self);
-        }
-        while (false);
+/*
+ * Process an update request
+ */
+void ovsdb_update_monitor_process(ovsdb_update_monitor_t *self, json_t *js)
+{
+    ovsdb_update_parse_t parse;
+    MEMZERO(parse);
+
+    /* Start parsing the message */
+    if (!ovsdb_update_parse_start(&parse, js))
+    {
+        LOG(ERR, "UPDATE: Error parsing OVSDB uppdate notification.");
+        ovsdb_update_monitor_error(self);
+        return;
+    }
 
-        json_decref(juuid);
+    while (ovsdb_update_parse_next(&parse))
+    {
+        ovsdb_update_monitor_row(
+                self,
+                ovsdb_update_parse_get_table(&parse),
+                ovsdb_update_parse_get_uuid(&parse),
+                ovsdb_update_parse_get_new(&parse),
+                ovsdb_update_parse_get_old(&parse));
     }
 }
 
+/*
+ * Process an update request from its raw text, one row at a time
+ */
+static void ovsdb_update_monitor_process_stream(ovsdb_update_monitor_t *self, const char *buf, size_t len)
+{
+    ovsdb_update_stream_t stream;
+
+    /* Start parsing the message */
+    if (!ovsdb_update_stream_start(&stream, buf, len))
+    {
+        LOG(ERR, "UPDATE: Error parsing OVSDB uppdate notification.");
+        ovsdb_update_monitor_error(self);
+        return;
+    }
+
+    while (ovsdb_update_stream_next(&stream))
+    {
+        ovsdb_update_monitor_row(
+                self,
+                ovsdb_update_stream_get_table(&stream),
+                ovsdb_update_stream_get_uuid(&stream),
+                ovsdb_update_stream_get_new(&stream),
+                ovsdb_update_stream_get_old(&stream));
+    }
+
+    if (ovsdb_update_stream_failed(&stream))
+    {
+        ovsdb_update_monitor_error(self);
+    }
+
+    ovsdb_update_stream_end(&stream);
+}
+
+/*
+ * Stream the rows of an update notification -- buf is the raw "tables" object of the
+ * notification params. Returns false if the handler is not an update monitor.
+ */
+bool ovsdb_update_monitor_stream_update(ovsdb_update_process_t *callback, void *data, const char *buf, size_t len)
+{
+    if (callback != ovsdb_update_monitor_call_cbk) return false;
+
+    ovsdb_update_monitor_process_stream(data, buf, len);
+    return true;
+}
+
+/*
+ * Stream the rows of a monitor reply (the "initial" dump) -- buf is the raw "result"
+ * object. Returns false if the handler is not an update monitor.
+ */
+bool ovsdb_update_monitor_stream_result(json_rpc_response_t *callback, void *data, const char *buf, size_t len)
+{
+    if (callback != ovsdb_update_monitor_resp_cbk) return false;
+
+    ovsdb_update_monitor_process_stream(data, buf, len);
+    return true;
+}
 
 void ovsdb_update_monitor_error(ovsdb_update_monitor_t *self)
 {
@@ -0,0 +1,415 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * ===========================================================================
+ *  Streaming parser for OVS update notifications and monitor replies
+ * ===========================================================================
+ */
+#define MODULE_ID LOG_MODULE_ID_OVSDB
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "util.h"
+#include "ovsdb.h"
+#include "ovsdb_update.h"
+
+/*
+ * Minimal scanner over raw JSON text. It locates values without decoding
+ * them; the text was already framed as a complete JSON value by the stream.
+ */
+typedef struct
+{
+    const char          *sc_buf;
+    size_t               sc_len;
+    size_t               sc_pos;
+}
+ovsdb_us_scan_t;
+
+static void ovsdb_us_ws(ovsdb_us_scan_t *sc)
+{
+    while (sc->sc_pos < sc->sc_len)
+    {
+        switch (sc->sc_buf[sc->sc_pos])
+        {
+            case ' ':
+            case '\t':
+            case '\r':
+            case '\n':
+                sc->sc_pos++;
+                break;
+
+            default:
+                return;
+        }
+    }
+}
+
+static bool ovsdb_us_expect(ovsdb_us_scan_t *sc, char c)
+{
+    ovsdb_us_ws(sc);
+    if (sc->sc_pos >= sc->sc_len || sc->sc_buf[sc->sc_pos] != c) return false;
+    sc->sc_pos++;
+    return true;
+}
+
+/*
+ * Skip the next value and return its raw text span
+ */
+static bool ovsdb_us_value(ovsdb_us_scan_t *sc, const char **val, size_t *len)
+{
+    bool in_str = false;
+    bool esc = false;
+    int depth = 0;
+    size_t start;
+    char c;
+
+    ovsdb_us_ws(sc);
+    if (sc->sc_pos >= sc->sc_len) return false;
+
+    start = sc->sc_pos;
+    for (; sc->sc_pos < sc->sc_len; sc->sc_pos++)
+    {
+        c = sc->sc_buf[sc->sc_pos];
+
+        if (in_str)
+        {
+            if (esc) esc = false;
+            else if (c == '\\') esc = true;
+            else if (c == '"') in_str = false;
+            if (in_str || depth > 0) continue;
+            /* End of a string value */
+            sc->sc_pos++;
+            break;
+        }
+
+        if (c == '"')
+        {
+            in_str = true;
+            continue;
+        }
+
+        if (c == '{' || c == '[')
+        {
+            depth++;
+            continue;
+        }
+
+        if (c == '}' || c == ']')
+        {
+            /* End of the enclosing container, for scalars */
+            if (depth == 0) break;
+            if (--depth > 0) continue;
+            sc->sc_pos++;
+            break;
+        }
+
+        /* End of a scalar value */
+        if (depth == 0 && (c == ',' || c == ' ' || c == '\t' || c == '\r' || c == '\n')) break;
+    }
+
+    if (in_str || depth != 0) return false;
+
+    *val = sc->sc_buf + start;
+    *len = sc->sc_pos - start;
+
+    return *len > 0;
+}
+
+/*
+ * Move to the next member of the current object and copy its key (escape sequences
+ * are not supported in keys). Returns false at the end of the object or on error.
+ */
+static bool ovsdb_us_member(ovsdb_us_scan_t *sc, char *key, size_t key_sz, bool *error)
+{
+    const char *kval;
+    size_t klen;
+
+    *error = false;
+
+    ovsdb_us_ws(sc);
+    if (sc->sc_pos >= sc->sc_len) goto error;
+
+    if (sc->sc_buf[sc->sc_pos] == '}')
+    {
+        sc->sc_pos++;
+        return false;
+    }
+
+    if (sc->sc_buf[sc->sc_pos] == ',') sc->sc_pos++;
+
+    ovsdb_us_ws(sc);
+    if (sc->sc_pos >= sc->sc_len || sc->sc_buf[sc->sc_pos] != '"') goto error;
+    if (!ovsdb_us_value(sc, &kval, &klen)) goto error;
+
+    /* Strip the quotes */
+    kval++;
+    klen -= 2;
+    if (klen >= key_sz || memchr(kval, '\\', klen) != NULL) goto error;
+
+    memcpy(key, kval, klen);
+    key[klen] = '\0';
+
+    if (!ovsdb_us_expect(sc, ':')) goto error;
+
+    return true;
+
+error:
+    *error = true;
+    return false;
+}
+
+static bool ovsdb_us_is_object(const char *val, size_t len)
+{
+    return len >= 2 && val[0] == '{';
+}
+
+static bool ovsdb_us_integer(const char *val, size_t len, int *out)
+{
+    char num[24];
+    char *end;
+    long n;
+
+    if (len == 0 || len >= sizeof(num)) return false;
+
+    memcpy(num, val, len);
+    num[len] = '\0';
+
+    n = strtol(num, &end, 10);
+    if (*end != '\0') return false;
+
+    *out = (int)n;
+    return true;
+}
+
+/*
+ * Parse the raw "params" of an update notification: [ monitor_id, { tables } ]
+ */
+static bool ovsdb_us_params(ovsdb_update_msg_t *msg, const char *buf, size_t len)
+{
+    ovsdb_us_scan_t sc = { .sc_buf = buf, .sc_len = len, .sc_pos = 0 };
+    const char *val;
+    size_t vlen;
+
+    if (!ovsdb_us_expect(&sc, '[')) return false;
+
+    if (!ovsdb_us_value(&sc, &val, &vlen)) return false;
+    if (!ovsdb_us_integer(val, vlen, &msg->um_id)) return false;
+
+    if (!ovsdb_us_expect(&sc, ',')) return false;
+
+    if (!ovsdb_us_value(&sc, &val, &vlen)) return false;
+    if (!ovsdb_us_is_object(val, vlen)) return false;
+
+    msg->um_tables = val;
+    msg->um_tables_len = vlen;
+
+    return ovsdb_us_expect(&sc, ']');
+}
+
+bool ovsdb_update_stream_msg(ovsdb_update_msg_t *msg, const char *buf, size_t len)
+{
+    ovsdb_us_scan_t sc = { .sc_buf = buf, .sc_len = len, .sc_pos = 0 };
+    char key[OVSDB_UPDATE_STREAM_NAME_MAX];
+    const char *params = NULL;
+    const char *result = NULL;
+    size_t params_len = 0;
+    size_t result_len = 0;
+    bool is_update = false;
+    bool has_id = false;
+    const char *val;
+    size_t vlen;
+    bool error;
+
+    MEMZERO(*msg);
+
+    if (!ovsdb_us_expect(&sc, '{')) return false;
+
+    while (ovsdb_us_member(&sc, key, sizeof(key), &error))
+    {
+        if (!ovsdb_us_value(&sc, &val, &vlen)) return false;
+
+        if (strcmp(key, "method") == 0)
+        {
+            is_update = (vlen == strlen("\"update\"") && memcmp(val, "\"update\"", vlen) == 0);
+            /* Other methods are not supported by the streaming parser */
+            if (!is_update) return false;
+        }
+        else if (strcmp(key, "params") == 0)
+        {
+            params = val;
+            params_len = vlen;
+        }
+        else if (strcmp(key, "id") == 0)
+        {
+            has_id = ovsdb_us_integer(val, vlen, &msg->um_id);
+        }
+        else if (strcmp(key, "result") == 0)
+        {
+            result = val;
+            result_len = vlen;
+        }
+        else if (strcmp(key, "error") == 0)
+        {
+            /* Errors are left to the generic path */
+            if (!(vlen == strlen("null") && memcmp(val, "null", vlen) == 0)) return false;
+        }
+    }
+    if (error) return false;
+
+    if (is_update)
+    {
+        if (params == NULL) return false;
+
+        msg->um_update = true;
+        return ovsdb_us_params(msg, params, params_len);
+    }
+
+    if (!has_id || result == NULL || !ovsdb_us_is_object(result, result_len)) return false;
+
+    msg->um_tables = result;
+    msg->um_tables_len = result_len;
+
+    return true;
+}
+
+/*
+ * ===========================================================================
+ *  OVSDB Update streaming parser
+ * ===========================================================================
+ */
+
+/*
+ * Start parsing the raw table list of an update:
+ *
+ * { "TABLE": { "UUID": { "old": { ... }, "new": { ... } }, ... }, "TABLE": { ... } }
+ *
+ * NOTE, the first row is retrieved by calling ovsdb_update_stream_next()!
+ */
+bool ovsdb_update_stream_start(ovsdb_update_stream_t *self, const char *buf, size_t len)
+{
+    ovsdb_us_scan_t sc = { .sc_buf = buf, .sc_len = len, .sc_pos = 0 };
+
+    MEMZERO(*self);
+
+    if (!ovsdb_us_expect(&sc, '{'))
+    {
+        LOG(ERR, "UPDATE: Update notification is not an object.");
+        return false;
+    }
+
+    self->us_buf = buf;
+    self->us_len = len;
+    self->us_pos = sc.sc_pos;
+
+    return true;
+}
+
+static void ovsdb_update_stream_row_free(ovsdb_update_stream_t *self)
+{
+    json_decref(self->us_jrow);
+    self->us_jrow = NULL;
+    self->us_jnew = NULL;
+    self->us_jold = NULL;
+}
+
+/**
+ * Decode the next row. The row data returned by the getters is valid
+ * until the next call.
+ */
+bool ovsdb_update_stream_next(ovsdb_update_stream_t *self)
+{
+    ovsdb_us_scan_t sc = { .sc_buf = self->us_buf, .sc_len = self->us_len, .sc_pos = self->us_pos };
+    json_error_t jerr;
+    const char *row;
+    size_t row_len;
+    bool error;
+
+    ovsdb_update_stream_row_free(self);
+
+    if (self->us_error) return false;
+
+    for (;;)
+    {
+        if (!self->us_in_table)
+        {
+            /* Move to the next table */
+            if (!ovsdb_us_member(&sc, self->us_table, sizeof(self->us_table), &error))
+            {
+                if (error) goto error;
+                /* End of the table list */
+                self->us_pos = sc.sc_pos;
+                return false;
+            }
+
+            if (!ovsdb_us_expect(&sc, '{'))
+            {
+                LOG(ERR, "UPDATE: Row is not an object.");
+                goto error;
+            }
+
+            self->us_in_table = true;
+        }
+
+        /* UUID is the key of the table */
+        if (ovsdb_us_member(&sc, self->us_uuid, sizeof(self->us_uuid), &error)) break;
+        if (error) goto error;
+
+        /* End of the rows, move to the next table */
+        self->us_in_table = false;
+    }
+
+    if (!ovsdb_us_value(&sc, &row, &row_len)) goto error;
+
+    /* Decode this row only */
+    self->us_jrow = json_loadb(row, row_len, 0, &jerr);
+    if (!json_is_object(self->us_jrow))
+    {
+        LOG(ERR, "UPDATE: Row data is not an object!");
+        goto error;
+    }
+
+    /* No need to error check, if "new" is NULL it means that the row was deleted */
+    self->us_jnew = json_object_get(self->us_jrow, "new");
+    self->us_jold = json_object_get(self->us_jrow, "old");
+
+    self->us_pos = sc.sc_pos;
+
+    return true;
+
+error:
+    LOG(ERR, "UPDATE: Error parsing update at offset %zu.", sc.sc_pos);
+    ovsdb_update_stream_row_free(self);
+    self->us_error = true;
+    return false;
+}
+
+void ovsdb_update_stream_end(ovsdb_update_stream_t *self)
+{
+    ovsdb_update_stream_row_free(self);
+}
@@ -24,6 +24,7 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include "ovsdb_update.h"
 #include "ovsdb_utils.h"
 #include "log.h"
 #include "target.h"
@@ -236,6 +237,104 @@ test_schema2itree(void)
     free_str_itree(converted);
 }
 
+/**
+ * @brief test the streaming update parser
+ *
+ * Validates that the rows of a raw update notification are yielded one at a
+ * time, with their table, uuid and row data.
+ */
+void
+test_update_stream(void)
+{
+    const char *update =
+        "{\"id\": null, \"method\": \"update\", \"params\": [ 3, {"
+        "  \"Table_A\": {"
+        "    \"uuid-a1\": { \"new\": { \"name\": \"a1 {}[]\\\" \" } },"
+        "    \"uuid-a2\": { \"old\": { \"name\": \"a2\" } }"
+        "  },"
+        "  \"Table_B\": {"
+        "    \"uuid-b1\": { \"old\": { \"n\": 1 }, \"new\": { \"n\": 2 } }"
+        "  }"
+        "} ] }";
+    ovsdb_update_stream_t stream;
+    ovsdb_update_msg_t msg;
+    bool rc;
+
+    rc = ovsdb_update_stream_msg(&msg, update, strlen(update));
+    TEST_ASSERT_TRUE(rc);
+    TEST_ASSERT_TRUE(msg.um_update);
+    TEST_ASSERT_EQUAL_INT(3, msg.um_id);
+
+    rc = ovsdb_update_stream_start(&stream, msg.um_tables, msg.um_tables_len);
+    TEST_ASSERT_TRUE(rc);
+
+    rc = ovsdb_update_stream_next(&stream);
+    TEST_ASSERT_TRUE(rc);
+    TEST_ASSERT_EQUAL_STRING("Table_A", ovsdb_update_stream_get_table(&stream));
+    TEST_ASSERT_EQUAL_STRING("uuid-a1", ovsdb_update_stream_get_uuid(&stream));
+    TEST_ASSERT_NOT_NULL(ovsdb_update_stream_get_new(&stream));
+    TEST_ASSERT_NULL(ovsdb_update_stream_get_old(&stream));
+    TEST_ASSERT_EQUAL_STRING("a1 {}[]\" ",
+                             json_string_value(json_object_get(ovsdb_update_stream_get_new(&stream), "name")));
+
+    rc = ovsdb_update_stream_next(&stream);
+    TEST_ASSERT_TRUE(rc);
+    TEST_ASSERT_EQUAL_STRING("Table_A", ovsdb_update_stream_get_table(&stream));
+    TEST_ASSERT_EQUAL_STRING("uuid-a2", ovsdb_update_stream_get_uuid(&stream));
+    TEST_ASSERT_NULL(ovsdb_update_stream_get_new(&stream));
+    TEST_ASSERT_NOT_NULL(ovsdb_update_stream_get_old(&stream));
+
+    rc = ovsdb_update_stream_next(&stream);
+    TEST_ASSERT_TRUE(rc);
+    TEST_ASSERT_EQUAL_STRING("Table_B", ovsdb_update_stream_get_table(&stream));
+    TEST_ASSERT_EQUAL_STRING("uuid-b1", ovsdb_update_stream_get_uuid(&stream));
+    TEST_ASSERT_NOT_NULL(ovsdb_update_stream_get_new(&stream));
+    TEST_ASSERT_NOT_NULL(ovsdb_update_stream_get_old(&stream));
+
+    rc = ovsdb_update_stream_next(&stream);
+    TEST_ASSERT_FALSE(rc);
+    TEST_ASSERT_FALSE(ovsdb_update_stream_failed(&stream));
+
+    ovsdb_update_stream_end(&stream);
+}
+
+/**
+ * @brief test the streaming parser message detection
+ *
+ * Results are streamed, other methods and errors are left to the
+ * generic JSON-RPC path. Malformed rows stop the parser.
+ */
+void
+test_update_stream_msg(void)
+{
+    const char *result = "{\"id\":12,\"error\":null,\"result\":{\"T\":{\"u\":{\"new\":{}}}}}";
+    const char *error = "{\"id\":12,\"error\":\"failed\",\"result\":null}";
+    const char *echo = "{\"id\":\"echo\",\"method\":\"echo\",\"params\":[]}";
+    const char *bad_row = "{\"T\":{\"u\":[1,2]}}";
+    ovsdb_update_stream_t stream;
+    ovsdb_update_msg_t msg;
+    bool rc;
+
+    rc = ovsdb_update_stream_msg(&msg, result, strlen(result));
+    TEST_ASSERT_TRUE(rc);
+    TEST_ASSERT_FALSE(msg.um_update);
+    TEST_ASSERT_EQUAL_INT(12, msg.um_id);
+    TEST_ASSERT_EQUAL_INT(strlen("{\"T\":{\"u\":{\"new\":{}}}}"), msg.um_tables_len);
+
+    rc = ovsdb_update_stream_msg(&msg, error, strlen(error));
+    TEST_ASSERT_FALSE(rc);
+
+    rc = ovsdb_update_stream_msg(&msg, echo, strlen(echo));
+    TEST_ASSERT_FALSE(rc);
+
+    rc = ovsdb_update_stream_start(&stream, bad_row, strlen(bad_row));
+    TEST_ASSERT_TRUE(rc);
+    rc = ovsdb_update_stream_next(&stream);
+    TEST_ASSERT_FALSE(rc);
+    TEST_ASSERT_TRUE(ovsdb_update_stream_failed(&stream));
+    ovsdb_update_stream_end(&stream);
+}
+
 int main(int argc, char *argv[])
 {
     (void)argc;
@@ -249,6 +348,8 @@ int main(int argc, char *argv[])
     RUN_TEST(test_schema2tree);
     RUN_TEST(test_schema2int_set);
     RUN_TEST(test_schema2itree);
+    RUN_TEST(test_update_stream);
+    RUN_TEST(test_update_stream_msg);
 
     return ut_fini();
 }
@@ -63,9 +63,9 @@ extern int rts_handle_memory_size;
 extern int rts_handle_dict_hash_expiry;
 extern int rts_handle_dict_hash_bucket;
 extern int nfe_conntrack_tcp_timeout_est;
-extern nfe_conn_t nfe_conn_lookup_by_tuple(nfe_conntrack_t conntrack,
-                                           const struct nfe_tuple *tuple,
-                                           uint64_t timestamp, int *dir);
+
+static void dpi_conn_expired(nfe_conn_t conn, const struct nfe_tuple *tuple,
+                             void *ctx);
 
 /* The maximum number of tags to be reported */
 #define NUM_TAGS 3
@@ -996,6 +996,7 @@ walleye_dpi_plugin_init(struct fsm_session *session)
         LOGE("%s: failed to allocate conntrack: %d\n", __func__, res);
         goto error;
     }
+    nfe_conntrack_set_expire_cb(dpi_session->ct, dpi_conn_expired, dpi_session);
 
     if ((res = rts_handle_create(&dpi_session->handle)) != 0)
     {
@@ -1464,6 +1465,26 @@ destroy_stream(struct dpi_session *dpi_session,
 }
 
 
+/**
+ * @brief nfe conntrack expiry callback
+ *
+ * Called when a connection times out before its stream was fully scanned.
+ * Tear the stream down right away rather than when the connection is freed.
+ */
+static void
+dpi_conn_expired(nfe_conn_t conn, const struct nfe_tuple *tuple, void *ctx)
+{
+    struct dpi_conn *dpi;
+
+    dpi = container_of(conn, struct dpi_conn, priv);
+    if (!dpi->initialized || dpi->stream == NULL) return;
+
+    dpi->dpi_sess->err_incomplete++;
+    dpi->scan_error |= SCAN_ERROR_INCOMPLETE;
+    destroy_stream(dpi->dpi_sess, NULL, dpi, tuple, 0);
+}
+
+
 /**
  * @brief session packet processing entry point
  *
@@ -1680,12 +1701,9 @@ dpi_plugin_periodic(struct fsm_session *session)
 {
     struct dpi_session *dpi_session;
     struct dpi_plugin_cache *mgr;
-    struct nfe_tuple tuple;
     struct timespec now;
-    nfe_conn_t conn;
     int threshold;
     uint64_t ts;
-    int dir = 0;
 
     mgr = dpi_get_mgr();
     clock_gettime(CLOCK_MONOTONIC, &now);
@@ -1699,20 +1717,8 @@ dpi_plugin_periodic(struct fsm_session *session)
 
     ts = ((uint64_t)now.tv_sec * 1000) + (now.tv_nsec / 1000000);
 
-    memset(&tuple, 0, sizeof(tuple));
-
     /* Expire idle nfe connections */
-    tuple.proto = IPPROTO_ICMP;
-    conn = nfe_conn_lookup_by_tuple(dpi_session->ct, &tuple, ts, &dir);
-    nfe_conn_release(conn);
-
-    tuple.proto = IPPROTO_TCP;
-    conn = nfe_conn_lookup_by_tuple(dpi_session->ct, &tuple, ts, &dir);
-    nfe_conn_release(conn);
-
-    tuple.proto = IPPROTO_UDP;
-    conn = nfe_conn_lookup_by_tuple(dpi_session->ct, &tuple, ts, &dir);
-    nfe_conn_release(conn);
+    nfe_conntrack_expire(dpi_session->ct, ts);
 
     LOGI("%s:%s: active connections: %u", __func__,
          session->name, dpi_session->connections);
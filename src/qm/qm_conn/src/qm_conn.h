@@ -27,6 +27,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef QM_CONN_H_INCLUDED
 #define QM_CONN_H_INCLUDED
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -206,6 +207,22 @@ bool qm_conn_send_direct(qm_compress_t compress, char *topic, void *data, int da
 bool qm_conn_send_direct_req_ack(qm_compress_t compress, char *topic, void *data, int data_size, qm_response_t *res);
 bool qm_conn_send_stats(void *data, int data_size, qm_response_t *res);
 
+// asynchronous api
+//
+// qm_conn_send_async() copies the message to a lock-free ring drained by
+// a sender thread and returns right away. It falls back to
+// qm_conn_send_direct() when the sender is not started. When the ring is
+// full or the sender is in its connect back off, the message is dropped,
+// counted, and false is returned. Messages queued before a connect error
+// stay queued and are sent once the back off expires.
+// qm_conn_async_stop() waits for concurrent qm_conn_send_async() calls,
+// then sends the queued messages before returning.
+
+bool qm_conn_async_start(size_t depth);
+void qm_conn_async_stop(void);
+bool qm_conn_async_running(void);
+bool qm_conn_send_async(qm_compress_t compress, char *topic, void *data, int data_size);
+
 // streaming api
 
 typedef struct
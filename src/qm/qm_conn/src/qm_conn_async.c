@@ -0,0 +1,333 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Asynchronous QM sender
+ *
+ * qm_conn_send_direct() connects to QM and waits for its response, which
+ * can take a while when QM is busy compressing or publishing. Callers on
+ * a packet processing path hand their report over to a lock-free ring
+ * instead; a single sender thread drains it in batches and does the
+ * blocking I/O.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "log.h"
+#include "memutil.h"
+#include "mpmc_ring.h"
+#include "qm_conn.h"
+
+#define QM_ASYNC_BATCH 16
+#define QM_ASYNC_BACKOFF 20 // seconds without connect attempt after a connect error
+
+typedef struct
+{
+    qm_compress_t compress;
+    int data_size;
+    char *topic;
+    uint8_t data[];
+} qm_async_msg_t;
+
+static struct
+{
+    struct mpmc_ring *ring;
+    pthread_t thread;
+    sem_t wake;
+    bool running;
+    bool stop;                  // no more producers, the thread drains and exits
+    uint32_t producers;         // callers of qm_conn_send_async() using the ring
+    time_t backoff;             // set by the thread, read by the producers
+    void *batch[QM_ASYNC_BATCH]; // popped, not yet sent
+    size_t batch_len;
+    size_t batch_pos;
+    uint32_t sent;
+    uint32_t errors;
+    uint32_t drops;             // reports refused by qm_conn_send_async()
+} qm_async;
+
+
+/*
+ * Returns false when the message could not be sent for lack of a QM
+ * connection and is to be retried once the back off expires. Once
+ * stopping, nothing is retried.
+ */
+static bool qm_conn_async_send_msg(qm_async_msg_t *msg, bool stop)
+{
+    qm_response_t res;
+    bool ret;
+
+    if (qm_async.backoff != 0)
+    {
+        LOGD("%s: stopping in back off, dropping %d bytes for topic %s",
+             __FUNCTION__, msg->data_size, msg->topic);
+        qm_async.errors++;
+        return true;
+    }
+
+    ret = qm_conn_send_direct(msg->compress, msg->topic, msg->data, msg->data_size, &res);
+    if (ret)
+    {
+        qm_async.sent++;
+        return true;
+    }
+
+    if (res.error == QM_ERROR_CONNECT)
+    {
+        __atomic_store_n(&qm_async.backoff, time(NULL), __ATOMIC_RELAXED);
+        if (!stop)
+        {
+            LOGD("%s: cannot connect, keeping reports queued for %d seconds",
+                 __FUNCTION__, QM_ASYNC_BACKOFF);
+            return false;
+        }
+    }
+
+    qm_async.errors++;
+    LOGE("%s: error sending mqtt with topic %s: response: %u, error: %u",
+         __FUNCTION__, msg->topic, res.response, res.error);
+
+    return true;
+}
+
+
+/*
+ * Sends the queued messages. Stops at the first connect error, leaving
+ * the message that failed and the following ones queued.
+ */
+static void qm_conn_async_drain(bool stop)
+{
+    qm_async_msg_t *msg;
+
+    for (;;)
+    {
+        if (qm_async.batch_pos == qm_async.batch_len)
+        {
+            qm_async.batch_pos = 0;
+            qm_async.batch_len = mpmc_ring_pop_batch(qm_async.ring, qm_async.batch,
+                                                     QM_ASYNC_BATCH);
+            if (qm_async.batch_len == 0) return;
+        }
+
+        msg = qm_async.batch[qm_async.batch_pos];
+        if (!qm_conn_async_send_msg(msg, stop)) return;
+
+        qm_async.batch_pos++;
+        FREE(msg);
+    }
+}
+
+
+/* Waits for a new message, or for the back off to expire */
+static void qm_conn_async_wait(void)
+{
+    struct timespec ts;
+
+    if (qm_async.backoff == 0)
+    {
+        sem_wait(&qm_async.wake);
+        return;
+    }
+
+    ts.tv_sec = qm_async.backoff + QM_ASYNC_BACKOFF;
+    ts.tv_nsec = 0;
+    sem_timedwait(&qm_async.wake, &ts);
+
+    if ((time(NULL) - qm_async.backoff) >= QM_ASYNC_BACKOFF)
+    {
+        __atomic_store_n(&qm_async.backoff, 0, __ATOMIC_RELAXED);
+    }
+}
+
+
+static void *qm_conn_async_thread(void *arg)
+{
+    bool stop;
+
+    (void)arg;
+
+    for (;;)
+    {
+        qm_conn_async_wait();
+
+        /*
+         * Sample the stop request before draining: everything queued
+         * before qm_conn_async_stop() is sent before the thread exits.
+         * During the back off, messages stay queued.
+         */
+        stop = __atomic_load_n(&qm_async.stop, __ATOMIC_ACQUIRE);
+        if (qm_async.backoff == 0 || stop) qm_conn_async_drain(stop);
+        if (stop) break;
+    }
+
+    return NULL;
+}
+
+
+bool qm_conn_async_start(size_t depth)
+{
+    int rc;
+
+#ifdef CONFIG_USE_OSBUS
+    // the osbus transport is driven by the caller's event loop
+    LOGI("%s: not supported with osbus, sending synchronously", __FUNCTION__);
+    return false;
+#endif
+
+    if (qm_conn_async_running()) return true;
+
+    qm_async.ring = mpmc_ring_new(depth);
+    if (qm_async.ring == NULL) return false;
+
+    if (sem_init(&qm_async.wake, 0, 0) != 0)
+    {
+        LOGE("%s: sem_init: %s", __FUNCTION__, strerror(errno));
+        goto err_ring;
+    }
+
+    qm_async.backoff = 0;
+    qm_async.drops = 0;
+    qm_async.batch_len = 0;
+    qm_async.batch_pos = 0;
+    qm_async.stop = false;
+    __atomic_store_n(&qm_async.running, true, __ATOMIC_SEQ_CST);
+
+    rc = pthread_create(&qm_async.thread, NULL, qm_conn_async_thread, NULL);
+    if (rc != 0)
+    {
+        LOGE("%s: pthread_create: %s", __FUNCTION__, strerror(rc));
+        __atomic_store_n(&qm_async.running, false, __ATOMIC_SEQ_CST);
+        goto err_sem;
+    }
+
+    LOGI("%s: asynchronous QM sender started, depth %zu", __FUNCTION__,
+         mpmc_ring_capacity(qm_async.ring));
+    return true;
+
+err_sem:
+    sem_destroy(&qm_async.wake);
+err_ring:
+    mpmc_ring_delete(qm_async.ring);
+    qm_async.ring = NULL;
+    return false;
+}
+
+
+void qm_conn_async_stop(void)
+{
+    if (!qm_conn_async_running()) return;
+
+    __atomic_store_n(&qm_async.running, false, __ATOMIC_SEQ_CST);
+
+    /*
+     * Wait for the callers that saw the sender running to be done with
+     * the ring. Later callers send synchronously. The sender thread
+     * then drains what they queued before the ring is freed.
+     */
+    while (__atomic_load_n(&qm_async.producers, __ATOMIC_SEQ_CST) != 0) sched_yield();
+
+    __atomic_store_n(&qm_async.stop, true, __ATOMIC_RELEASE);
+    sem_post(&qm_async.wake);
+    pthread_join(qm_async.thread, NULL);
+
+    LOGI("%s: sent: %u, errors: %u, dropped: %u", __FUNCTION__,
+         qm_async.sent, qm_async.errors, qm_async.drops);
+
+    sem_destroy(&qm_async.wake);
+    mpmc_ring_delete(qm_async.ring);
+    qm_async.ring = NULL;
+}
+
+
+bool qm_conn_async_running(void)
+{
+    return __atomic_load_n(&qm_async.running, __ATOMIC_SEQ_CST);
+}
+
+
+bool qm_conn_send_async(qm_compress_t compress, char *topic, void *data, int data_size)
+{
+    qm_async_msg_t *msg;
+    qm_response_t res;
+    size_t topic_len;
+    bool queued;
+
+    /*
+     * Register as a producer before checking the running flag, so that
+     * qm_conn_async_stop() either sees the producer or is seen here.
+     */
+    __atomic_add_fetch(&qm_async.producers, 1, __ATOMIC_SEQ_CST);
+    if (!qm_conn_async_running())
+    {
+        __atomic_sub_fetch(&qm_async.producers, 1, __ATOMIC_SEQ_CST);
+        goto send_direct;
+    }
+
+    if (topic == NULL || data_size < 0)
+    {
+        __atomic_sub_fetch(&qm_async.producers, 1, __ATOMIC_SEQ_CST);
+        return false;
+    }
+
+    // QM is unreachable, the queued reports are all the sender will retry
+    if (__atomic_load_n(&qm_async.backoff, __ATOMIC_RELAXED) != 0)
+    {
+        __atomic_sub_fetch(&qm_async.producers, 1, __ATOMIC_SEQ_CST);
+        goto drop;
+    }
+
+    // one allocation: header, payload, then the nul terminated topic
+    topic_len = strlen(topic) + 1;
+    msg = MALLOC(sizeof(*msg) + data_size + topic_len);
+    msg->compress = compress;
+    msg->data_size = data_size;
+    msg->topic = (char *)msg->data + data_size;
+    if (data_size > 0) memcpy(msg->data, data, data_size);
+    memcpy(msg->topic, topic, topic_len);
+
+    queued = mpmc_ring_push(qm_async.ring, msg);
+    if (queued) sem_post(&qm_async.wake);
+    __atomic_sub_fetch(&qm_async.producers, 1, __ATOMIC_SEQ_CST);
+    if (queued) return true;
+
+    // ring full: the sender is behind, never block the caller on QM
+    FREE(msg);
+
+drop:
+    __atomic_add_fetch(&qm_async.drops, 1, __ATOMIC_RELAXED);
+    LOGD("%s: sender busy or in back off, dropping %d bytes for topic %s",
+         __FUNCTION__, data_size, topic);
+    return false;
+
+send_direct:
+    return qm_conn_send_direct(compress, topic, data, data_size, &res);
+}
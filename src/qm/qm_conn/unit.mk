@@ -35,14 +35,17 @@ UNIT_NAME := qm_conn
 UNIT_TYPE := LIB
 
 UNIT_SRC += src/qm_conn.c
+UNIT_SRC += src/qm_conn_async.c
 UNIT_SRC += $(if $(CONFIG_USE_OSBUS), src/qm_conn_osbus.c)
 
 UNIT_CFLAGS := -I$(UNIT_PATH)/src
+UNIT_LDFLAGS := -lpthread
 
 UNIT_EXPORT_CFLAGS := $(UNIT_CFLAGS)
 UNIT_EXPORT_LDFLAGS := $(UNIT_LDFLAGS)
 
 UNIT_DEPS += src/lib/common
+UNIT_DEPS += src/lib/mpmc_ring
 UNIT_DEPS_CFLAGS += src/lib/log
 UNIT_DEPS += $(if $(CONFIG_USE_OSBUS), src/lib/osbus)
 
@@ -32,6 +32,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "schema.h"
 #include "ds_list.h"
 #include "ds_dlist.h"
+#include "ds_tree.h"
 #include "qm_conn.h"
 
 #define QM_MAX_QUEUE_DEPTH (200)
@@ -39,6 +40,25 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #define QM_LOG_QUEUE_SIZE (100*1024) // 100k
 
+// max size of a single publish coalescing same-topic stats reports
+#define QM_COALESCE_MAX_BYTES (256*1024)
+
+// per-topic queue counters
+
+typedef struct qm_topic_stats
+{
+    char *topic;            // "" for the default topic
+    int depth;              // items currently queued
+    int64_t bytes;          // bytes currently queued
+    int64_t queued;         // total items queued
+    int64_t published;      // total items published
+    int64_t dropped;        // total items dropped
+    int64_t latency_sum;    // total queue latency of published items [s]
+    int latency_max;        // max queue latency [s]
+    struct qm_item *batch;  // stats coalesced during a publish pass
+    ds_tree_node_t tnode;
+} qm_topic_stats_t;
+
 // queue item
 
 typedef struct qm_item
@@ -48,14 +68,19 @@ typedef struct qm_item
     size_t size;
     void *buf;
     time_t timestamp;
-    ds_dlist_node_t qnode;
+    int count;              // number of reports coalesced in buf
+    qm_topic_stats_t *tstats;
 } qm_item_t;
 
+// ring of queued items, the queue owns the items and their buffers
+
 typedef struct qm_queue
 {
-    ds_dlist_t queue;
+    qm_item_t *ring[QM_MAX_QUEUE_DEPTH];
+    int head;
     int length;
     int size;
+    ds_tree_t topics;       // qm_topic_stats_t
 } qm_queue_t;
 
 typedef struct qm_stats
@@ -98,6 +123,9 @@ bool qm_queue_drop_head();
 bool qm_queue_make_room(qm_item_t *qi, qm_response_t *res);
 bool qm_queue_put(qm_item_t **qitem, qm_response_t *res);
 bool qm_queue_get(qm_item_t **qitem);
+bool qm_queue_requeue(qm_item_t **qitem);
+void qm_queue_item_published(qm_item_t *qi, bool ok);
+void qm_queue_log_topic_stats(void);
 void qm_res_status(qm_response_t *res);
 void qm_enqueue_or_send(qm_item_t *qi, qm_response_t *res);
 
@@ -35,7 +35,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "target.h"
 #include "osp_unit.h"
 #include "log.h"
-#include "ds_dlist.h"
+#include "ds_tree.h"
 #include "opensync_stats.pb-c.h"
 #include "memutil.h"
 #include "util.h"
@@ -266,148 +266,114 @@ bool qm_mqtt_send_message(qm_item_t *qi, qm_response_t *res)
     return result;
 }
 
-void qm_append_report(qm_item_t *qi, qm_item_t *rep)
-{
-    Sts__Report *rqi = NULL;
-    Sts__Report *rpt = NULL;
-    int          num;
-
-    // have stats, unpack
-    rqi = sts__report__unpack(NULL, qi->size, qi->buf);
-    if (!rqi) {
-        // decode failed
-        goto out;
-    }
-
-    // first reprot
-    if (rep->size == 0) {
-        rpt = rqi;
-        rqi = NULL;
+// Sts__Report.power_mode: field 11, length delimited
+#define QM_REPORT_POWER_MODE_TAG ((11 << 3) | 2)
 
-        goto first;
-    }
+// append a string field to a packed message, protobuf merges
+// concatenated messages and the last occurrence of a scalar wins
+static void qm_append_pb_string(qm_item_t *qi, uint8_t tag, const char *str)
+{
+    size_t len = strlen(str);
+    size_t v = len;
+    uint8_t hdr[1 + 10];
+    int n = 0;
+
+    hdr[n++] = tag;
+    do {
+        hdr[n] = v & 0x7f;
+        v >>= 7;
+        if (v) hdr[n] |= 0x80;
+        n++;
+    } while (v);
+
+    qi->buf = REALLOC(qi->buf, qi->size + n + len);
+    memcpy((uint8_t*)qi->buf + qi->size, hdr, n);
+    memcpy((uint8_t*)qi->buf + qi->size + n, str, len);
+    qi->size += n + len;
+}
 
-    rpt = sts__report__unpack(NULL, rep->size, rep->buf);
-    if (!rpt) {
-        goto out;
-    }
+static void qm_mqtt_publish_batch(mosqev_t *mqtt, qm_topic_stats_t *ts)
+{
+    qm_item_t *qi = ts->batch;
+    bool ok;
 
-#define APPEND(_name, _type) do {\
-        num = rpt->n_##_name;  \
-        rpt->n_##_name += rqi->n_##_name; \
-        rpt->_name = \
-            REALLOC(rpt->_name, \
-                    rpt->n_##_name * sizeof(Sts__##_type*)); \
-        memcpy (&rpt->_name[num], \
-                rqi->_name, \
-                rqi->n_##_name * sizeof(Sts__##_type*)); \
-        memset(rqi->_name, \
-               0, \
-               rqi->n_##_name * sizeof(Sts__##_type*)); \
-    } while (0)
-
-    // append messages
-    if (rqi->survey) {
-        APPEND(survey, Survey);
-    }
-    if (rqi->neighbors) {
-        APPEND(neighbors, Neighbor);
-    }
-    if (rqi->capacity) {
-        APPEND(capacity, Capacity);
+    ts->batch = NULL;
+    if (qm_has_power_mode) {
+        LOGD("Report: setting power mode to %s", qm_power_mode);
+        qm_append_pb_string(qi, QM_REPORT_POWER_MODE_TAG, qm_power_mode);
     }
-    if (rqi->clients) {
-        APPEND(clients, ClientReport);
+    if (qi->count > 1) {
+        LOGI("merged %d stats reports %zd bytes", qi->count, qi->size);
     }
-    if (rqi->device) {
-        APPEND(device, Device);
+    ok = qm_mqtt_publish(mqtt, qi);
+    if (!ok) {
+        LOGE("Publish report failed.\n");
     }
-    if (rqi->rssi_report) {
-        APPEND(rssi_report, RssiReport);
-    }
-    if (rqi->bs_report) {
-        APPEND(bs_report, BSReport);
-    }
-    if (rqi->radius_report) {
-        APPEND(radius_report, RadiusReport);
-    }
-#undef APPEND
-
-first:
-    {
-        // set the power mode first
-        if (qm_has_power_mode) {
-            LOGD("Report: setting power mode to %s", qm_power_mode);
-            rpt->power_mode = STRDUP(qm_power_mode);
-        }
-
-        // pack new message
-        int size = sts__report__get_packed_size(rpt);
-        void *buf = MALLOC(size);
-        size = sts__report__pack(rpt, buf);
-        LOGI("merged reports stats %zd + %zd = %d", rep->size, qi->size, size);
-
-        // replace message
-        if(rep->buf) FREE(rep->buf);
-        rep->buf = buf;
-        rep->size = size;
-    }
-
-out:
-    // cleanup
-    if (rpt) sts__report__free_unpacked(rpt, NULL);
-    if (rqi) sts__report__free_unpacked(rqi, NULL);
+    qm_queue_item_published(qi, ok);
+    qm_queue_item_free(qi);
 }
 
-// merge STATS to a single report
-void qm_queue_merge_stats(qm_item_t *rep)
+// Coalesce a STATS item into the pending batch of its topic.
+// A concatenation of packed Sts__Report messages decodes as a single
+// report with all the repeated fields appended, so no unpack/repack
+// is needed. The batch reuses the buffer of its first item.
+static void qm_mqtt_coalesce_stats(mosqev_t *mqtt, qm_item_t *qi)
 {
-    qm_item_t *qi = NULL;
-    qm_item_t *next = NULL;
+    qm_topic_stats_t *ts = qi->tstats;
+    qm_item_t *batch = ts->batch;
 
-    for (qi = ds_dlist_head(&g_qm_queue.queue); qi != NULL; qi = next)
-    {
-        next = ds_dlist_next(&g_qm_queue.queue, qi);
-        //LOGT("t:%d s:%d\n", qi->req.data_type, (int)qi->size);
-        if (qi->req.data_type == QM_DATA_STATS)
-        {
-            qm_append_report(qi, rep);
-            qm_queue_remove(qi);
-        }
+    if (batch && batch->size + qi->size > QM_COALESCE_MAX_BYTES) {
+        qm_mqtt_publish_batch(mqtt, ts);
+        batch = NULL;
+    }
+    if (!batch) {
+        ts->batch = qi;
+        return;
     }
+    batch->buf = REALLOC(batch->buf, batch->size + qi->size);
+    memcpy((uint8_t*)batch->buf + batch->size, qi->buf, qi->size);
+    batch->size += qi->size;
+    batch->count += qi->count;
+    qm_queue_item_free(qi);
 }
 
 void qm_mqtt_publish_queue()
 {
     mosqev_t *mqtt = &qm_mqtt;
-    // publish messages to mqtt
-    LOGD("total %d elements queued for transmission.\n", qm_queue_length());
-
-    qm_item_t  rep;
+    qm_topic_stats_t *ts;
     qm_item_t *qi = NULL;
-    qm_item_t *next = NULL;
+    int n;
 
-    memset(&rep, 0, sizeof(rep));
-    qm_queue_merge_stats(&rep);
-    // publish merged reports
-    if (rep.size) {
-        if (!qm_mqtt_publish(mqtt, &rep)) {
-            LOGE("Publish report failed.\n");
-        }
-        // free
-        qm_queue_item_free_buf(&rep);
-    }
+    // publish messages to mqtt
+    n = qm_queue_length();
+    LOGD("total %d elements queued for transmission.\n", n);
 
-    // publish the rest of messages
-    for (qi = ds_dlist_head(&g_qm_queue.queue); qi != NULL; qi = next)
+    // one pass over the items queued so far, failed ones go back to the tail
+    while (n-- > 0 && qm_queue_get(&qi))
     {
-        next = ds_dlist_next(&g_qm_queue.queue, qi);
+        if (qi->req.data_type == QM_DATA_STATS) {
+            qm_mqtt_coalesce_stats(mqtt, qi);
+            continue;
+        }
         if (qm_mqtt_publish(mqtt, qi)) {
-            qm_queue_remove(qi);
-        } else {
-            LOGE("Publish message failed.\n");
+            qm_queue_item_published(qi, true);
+            qm_queue_item_free(qi);
+            continue;
+        }
+        LOGE("Publish message failed.\n");
+        if (!qm_queue_requeue(&qi)) {
+            qm_queue_item_published(qi, false);
+            qm_queue_item_free(qi);
         }
     }
+
+    // publish merged reports
+    ds_tree_foreach(&g_qm_queue.topics, ts)
+    {
+        if (ts->batch) qm_mqtt_publish_batch(mqtt, ts);
+    }
+
+    qm_queue_log_topic_stats();
 }
 
 void qm_mqtt_reconnect()
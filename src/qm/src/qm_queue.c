@@ -24,9 +24,11 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <inttypes.h>
+
 #include "opensync_stats.pb-c.h"
 #include "ds.h"
-#include "ds_dlist.h"
+#include "ds_tree.h"
 #include "os_time.h"
 #include "log.h"
 #include "qm.h"
@@ -64,7 +66,54 @@ void qm_queue_item_free(qm_item_t *qi)
 
 void qm_queue_init()
 {
-    ds_dlist_init(&g_qm_queue.queue, qm_item_t, qnode);
+    g_qm_queue.head = 0;
+    g_qm_queue.length = 0;
+    g_qm_queue.size = 0;
+    ds_tree_init(&g_qm_queue.topics, ds_str_cmp, qm_topic_stats_t, tnode);
+}
+
+static qm_topic_stats_t* qm_queue_topic_stats(const char *topic)
+{
+    qm_topic_stats_t *ts;
+    if (!topic) topic = "";
+    ts = ds_tree_find(&g_qm_queue.topics, (void*)topic);
+    if (ts) return ts;
+    ts = CALLOC(1, sizeof(*ts));
+    ts->topic = STRDUP(topic);
+    ds_tree_insert(&g_qm_queue.topics, ts, ts->topic);
+    return ts;
+}
+
+static qm_item_t** qm_queue_slot(int i)
+{
+    return &g_qm_queue.ring[(g_qm_queue.head + i) % QM_MAX_QUEUE_DEPTH];
+}
+
+static void qm_queue_push(qm_item_t *qi)
+{
+    *qm_queue_slot(g_qm_queue.length) = qi;
+    g_qm_queue.length++;
+    g_qm_queue.size += qi->size;
+    qi->tstats->depth++;
+    qi->tstats->bytes += qi->size;
+}
+
+// unlink the i-th item, closing the gap
+static qm_item_t* qm_queue_unlink(int i)
+{
+    qm_item_t *qi = *qm_queue_slot(i);
+    if (i == 0) {
+        g_qm_queue.head = (g_qm_queue.head + 1) % QM_MAX_QUEUE_DEPTH;
+    } else {
+        for (; i < g_qm_queue.length - 1; i++) {
+            *qm_queue_slot(i) = *qm_queue_slot(i + 1);
+        }
+    }
+    g_qm_queue.length--;
+    g_qm_queue.size -= qi->size;
+    qi->tstats->depth--;
+    qi->tstats->bytes -= qi->size;
+    return qi;
 }
 
 int qm_queue_length()
@@ -79,24 +128,33 @@ int qm_queue_size()
 
 bool qm_queue_head(qm_item_t **qitem)
 {
-    *qitem = ds_dlist_head(&g_qm_queue.queue);
-    if (!*qitem) return false;
+    if (!g_qm_queue.length) {
+        *qitem = NULL;
+        return false;
+    }
+    *qitem = *qm_queue_slot(0);
     return true;
 }
 
 bool qm_queue_tail(qm_item_t **qitem)
 {
-    *qitem = ds_dlist_tail(&g_qm_queue.queue);
-    if (!*qitem) return false;
+    if (!g_qm_queue.length) {
+        *qitem = NULL;
+        return false;
+    }
+    *qitem = *qm_queue_slot(g_qm_queue.length - 1);
     return true;
 }
 
 bool qm_queue_remove(qm_item_t *qitem)
 {
+    int i;
     if (!qitem) return false;
-    ds_dlist_remove(&g_qm_queue.queue, qitem);
-    g_qm_queue.length--;
-    g_qm_queue.size -= qitem->size;
+    for (i = 0; i < g_qm_queue.length; i++) {
+        if (*qm_queue_slot(i) == qitem) break;
+    }
+    if (i == g_qm_queue.length) return false;
+    qm_queue_unlink(i);
     qm_queue_item_free(qitem);
     return true;
 }
@@ -105,6 +163,7 @@ bool qm_queue_drop_head()
 {
     qm_item_t *qitem;
     if (!qm_queue_head(&qitem)) return false;
+    qitem->tstats->dropped += qitem->count;
     return qm_queue_remove(qitem);
 }
 
@@ -112,6 +171,7 @@ bool qm_queue_make_room(qm_item_t *qi, qm_response_t *res)
 {
     if (qi->size > QM_MAX_QUEUE_SIZE_BYTES) {
         // message too big to fit in queue
+        if (qi->tstats) qi->tstats->dropped++;
         return false;
     }
     while (g_qm_queue.length >= QM_MAX_QUEUE_DEPTH
@@ -128,12 +188,13 @@ bool qm_queue_append_item(qm_item_t **qitem, qm_response_t *res)
     qm_item_t *qi = *qitem;
     qi->size = qi->req.data_size;
     qi->timestamp = time_monotonic();
+    qi->count = 1;
+    qi->tstats = qm_queue_topic_stats(qi->topic);
     if (!qm_queue_make_room(qi, res)) {
         return false;
     }
-    ds_dlist_insert_tail(&g_qm_queue.queue, qi);
-    g_qm_queue.length++;
-    g_qm_queue.size += qi->size;
+    qm_queue_push(qi);
+    qi->tstats->queued++;
     // take ownership
     *qitem = NULL;
     return true;
@@ -234,9 +295,51 @@ bool qm_queue_put(qm_item_t **qitem, qm_response_t *res)
 
 bool qm_queue_get(qm_item_t **qitem)
 {
-    *qitem = ds_dlist_remove_head(&g_qm_queue.queue);
-    if (!*qitem) return false;
-    g_qm_queue.length--;
-    g_qm_queue.size -= (*qitem)->size;
+    if (!g_qm_queue.length) {
+        *qitem = NULL;
+        return false;
+    }
+    *qitem = qm_queue_unlink(0);
+    return true;
+}
+
+// put back an item taken with qm_queue_get(), at the tail
+bool qm_queue_requeue(qm_item_t **qitem)
+{
+    qm_item_t *qi = *qitem;
+    if (g_qm_queue.length >= QM_MAX_QUEUE_DEPTH) return false;
+    qm_queue_push(qi);
+    // take ownership
+    *qitem = NULL;
     return true;
 }
+
+// account the outcome of publishing an item taken off the queue
+void qm_queue_item_published(qm_item_t *qi, bool ok)
+{
+    qm_topic_stats_t *ts = qi->tstats;
+    int latency;
+    if (!ts) return;
+    if (!ok) {
+        ts->dropped += qi->count;
+        return;
+    }
+    // latency of the oldest report in the item
+    latency = time_monotonic() - qi->timestamp;
+    ts->published += qi->count;
+    ts->latency_sum += (int64_t)latency * qi->count;
+    if (latency > ts->latency_max) ts->latency_max = latency;
+}
+
+void qm_queue_log_topic_stats(void)
+{
+    qm_topic_stats_t *ts;
+    ds_tree_foreach(&g_qm_queue.topics, ts)
+    {
+        LOGI("queue topic '%s': depth %d bytes %"PRId64" queued %"PRId64
+             " published %"PRId64" dropped %"PRId64" latency avg %"PRId64" max %d",
+             *ts->topic ? ts->topic : "(default)", ts->depth, ts->bytes, ts->queued,
+             ts->published, ts->dropped,
+             ts->published ? ts->latency_sum / ts->published : 0, ts->latency_max);
+    }
+}
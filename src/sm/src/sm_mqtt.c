@@ -264,7 +264,7 @@ void sm_mqtt_timer_handler(struct ev_loop *loop, ev_timer *timer, int revents)
 
     while (dpp_get_queue_elements() > 0)
     {
-        if (!dpp_get_report(sm_mqtt_buf, sizeof(sm_mqtt_buf), &buf_len))
+        if (!dpp_get_report_arena(sm_mqtt_buf, sizeof(sm_mqtt_buf), &buf_len))
         {
             LOGE("DPP: Get report failed.\n");
             break;
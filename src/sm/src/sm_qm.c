@@ -93,7 +93,7 @@ void sm_mqtt_timer_handler(struct ev_loop *loop, ev_timer *timer, int revents)
 
         ret = dpp_get_report2(&buf, sizeof(sm_mqtt_buf), &buf_len);
 #else
-        ret = dpp_get_report(sm_mqtt_buf, sizeof(sm_mqtt_buf), &buf_len);
+        ret = dpp_get_report_arena(sm_mqtt_buf, sizeof(sm_mqtt_buf), &buf_len);
 #endif
         if (!ret)
         {